@@ -0,0 +1,56 @@
+/********************************************************
+ * Description : heap allocations counted by a replaced operator new
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include "bench_allocation.h"
+
+static std::atomic<uint64_t> s_allocation_count(0);
+
+void * operator new (std::size_t size)
+{
+    s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void * memory = malloc(0 == size ? 1 : size);
+    if (nullptr == memory)
+    {
+        throw std::bad_alloc();
+    }
+    return (memory);
+}
+
+void * operator new [] (std::size_t size)
+{
+    return (operator new (size));
+}
+
+void operator delete (void * memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete [] (void * memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete (void * memory, std::size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete [] (void * memory, std::size_t) noexcept
+{
+    free(memory);
+}
+
+uint64_t get_allocation_count()
+{
+    return (s_allocation_count.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,22 @@
+/********************************************************
+ * Description : heap allocations counted by a replaced operator new
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef BENCH_ALLOCATION_H
+#define BENCH_ALLOCATION_H
+
+
+#include <cstdint>
+
+/*
+ * operator new calls of the whole program so far, link bench_allocation.cpp into the benchmark to count them
+ */
+uint64_t get_allocation_count();
+
+
+#endif // BENCH_ALLOCATION_H
@@ -0,0 +1,362 @@
+/********************************************************
+ * Description : per-process tables of a pass, flat containers against std::map / std::set
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <set>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "resource_monitor_impl.h"
+#include "bench_allocation.h"
+
+/*
+ * usage: bench_flat_tables [process_count] [tick_count] [churn_per_mille]
+ *   process_count processes (50000 by default) in trees of 100, every tenth tree root nested in the tree before it;
+ *   each tick replays what a pass does to the tables of SystemSnapshot: the leaf map is rebuilt, churn_per_mille of the processes
+ *   (1 by default) exit and as many new ones start, every process is matched to its tree and helper, and the resources are summed by ancestor;
+ *   the std tables drop the leaf map each pass and erase / insert one process at a time as update_process_tree did before,
+ *   the flat tables keep their storage, drop the exited processes in one sweep and merge the new ones once per pass,
+ *   and must not allocate at all once they have grown
+ */
+
+#define BENCH_PROCESS_COUNT             50000
+#define BENCH_TICK_COUNT                100
+#define BENCH_WARMUP_TICK_COUNT         3
+#define BENCH_TREE_SIZE                 100
+#define BENCH_NESTED_TREE_STEP          10
+#define BENCH_CHURN_PER_MILLE           1
+
+struct StdProcessLeaf
+{
+    std::set<uint32_t>                      process_descendant_set;
+};
+
+struct StdProcessTree
+{
+    bool                                    process_tree;
+    std::set<uint32_t>                      process_descendant_set;
+
+    StdProcessTree(uint32_t ancestor, bool tree);
+};
+
+StdProcessTree::StdProcessTree(uint32_t ancestor, bool tree)
+    : process_tree(tree)
+    , process_descendant_set()
+{
+    process_descendant_set.insert(ancestor);
+}
+
+struct StdProcessTables
+{
+    typedef std::map<uint32_t, StdProcessLeaf>      leaf_map_t;
+    typedef std::map<uint32_t, StdProcessTree>      tree_map_t;
+    typedef std::map<uint32_t, ProcessHelper>       helper_map_t;
+    typedef std::map<uint32_t, ProcessSnapshot>     snapshot_map_t;
+    typedef StdProcessTree                          tree_t;
+
+    leaf_map_t                              process_leaf_map;
+    tree_map_t                              process_tree_map;
+    helper_map_t                            process_helper_map;
+    snapshot_map_t                          process_snapshot_map;
+
+    void reset_leaves()
+    {
+        process_leaf_map.clear();
+    }
+
+    void drop_processes(std::vector<uint32_t> & process_drop_list)
+    {
+        for (std::vector<uint32_t>::const_iterator iter = process_drop_list.begin(); process_drop_list.end() != iter; ++iter)
+        {
+            helper_map_t::iterator iter_helper = process_helper_map.find(*iter);
+            if (process_helper_map.end() == iter_helper)
+            {
+                continue;
+            }
+            tree_map_t::iterator iter_tree = process_tree_map.find(iter_helper->second.process_ancestor);
+            if (process_tree_map.end() != iter_tree)
+            {
+                iter_tree->second.process_descendant_set.erase(*iter);
+            }
+            process_helper_map.erase(iter_helper);
+        }
+    }
+
+    void start_processes(const std::vector<std::pair<uint32_t, uint32_t>> & process_start_list)
+    {
+        for (std::vector<std::pair<uint32_t, uint32_t>>::const_iterator iter = process_start_list.begin(); process_start_list.end() != iter; ++iter)
+        {
+            process_tree_map.find(iter->second)->second.process_descendant_set.insert(iter->first);
+            process_helper_map.insert(std::make_pair(iter->first, ProcessHelper(iter->second, process_handle_t())));
+        }
+    }
+};
+
+struct FlatProcessTables
+{
+    typedef FlatMap<uint32_t, ProcessLeaf>          leaf_map_t;
+    typedef FlatMap<uint32_t, ProcessTree>          tree_map_t;
+    typedef FlatMap<uint32_t, ProcessHelper>        helper_map_t;
+    typedef FlatMap<uint32_t, ProcessSnapshot>      snapshot_map_t;
+    typedef ProcessTree                             tree_t;
+
+    leaf_map_t                              process_leaf_map;
+    tree_map_t                              process_tree_map;
+    helper_map_t                            process_helper_map;
+    snapshot_map_t                          process_snapshot_map;
+
+    void reset_leaves()
+    {
+        for (leaf_map_t::iterator iter = process_leaf_map.begin(); process_leaf_map.end() != iter; ++iter)
+        {
+            iter->second.process_descendant_set.clear();
+        }
+    }
+
+    /* as drop_exited_processes does */
+    void drop_processes(std::vector<uint32_t> & process_drop_list)
+    {
+        std::sort(process_drop_list.begin(), process_drop_list.end());
+        for (tree_map_t::iterator iter_tree = process_tree_map.begin(); process_tree_map.end() != iter_tree; ++iter_tree)
+        {
+            iter_tree->second.process_descendant_set.erase_keys(process_drop_list.begin(), process_drop_list.end());
+        }
+        process_helper_map.erase_keys(process_drop_list.begin(), process_drop_list.end());
+    }
+
+    /* as update_process_tree does with the processes its walk finds without a helper */
+    void start_processes(const std::vector<std::pair<uint32_t, uint32_t>> & process_start_list)
+    {
+        for (std::vector<std::pair<uint32_t, uint32_t>>::const_iterator iter = process_start_list.begin(); process_start_list.end() != iter; ++iter)
+        {
+            process_tree_map.find(iter->second)->second.process_descendant_set.insert_pending(iter->first);
+            process_helper_map.insert_pending(std::make_pair(iter->first, ProcessHelper(iter->second, process_handle_t())));
+        }
+        process_helper_map.merge_pending();
+        for (tree_map_t::iterator iter_tree = process_tree_map.begin(); process_tree_map.end() != iter_tree; ++iter_tree)
+        {
+            iter_tree->second.process_descendant_set.merge_pending();
+        }
+    }
+};
+
+/*
+ * tree_members[i]: the processes of tree i besides its root, tree i has root pid tree_roots[i]
+ */
+struct ProcessLayout
+{
+    std::vector<uint32_t>                   tree_roots;
+    std::vector<std::vector<uint32_t>>      tree_members;
+    uint32_t                                next_process_id;
+    std::size_t                             churn_count;          /* processes replaced each tick */
+    std::vector<uint32_t>                   process_drop_list;    /* the processes exited in a tick */
+    std::vector<std::pair<uint32_t, uint32_t>> process_start_list; /* the processes started in a tick and their ancestors */
+};
+
+static void build_layout(uint32_t process_count, uint32_t churn_per_mille, ProcessLayout & process_layout)
+{
+    const uint32_t tree_count = std::max<uint32_t>(1, process_count / BENCH_TREE_SIZE);
+    process_layout.tree_roots.resize(tree_count);
+    process_layout.tree_members.resize(tree_count);
+    process_layout.next_process_id = 1000;
+    process_layout.churn_count = static_cast<std::size_t>(process_count) * churn_per_mille / 1000;
+    process_layout.process_drop_list.reserve(process_layout.churn_count);
+    process_layout.process_start_list.reserve(process_layout.churn_count);
+
+    for (uint32_t tree_index = 0; tree_index < tree_count; ++tree_index)
+    {
+        process_layout.tree_roots[tree_index] = process_layout.next_process_id++;
+        for (uint32_t member_index = 1; member_index < BENCH_TREE_SIZE; ++member_index)
+        {
+            process_layout.tree_members[tree_index].push_back(process_layout.next_process_id++);
+        }
+    }
+}
+
+template <typename tables_t>
+static void fill_tables(const ProcessLayout & process_layout, tables_t & process_tables)
+{
+    for (std::size_t tree_index = 0; tree_index < process_layout.tree_roots.size(); ++tree_index)
+    {
+        const uint32_t process_ancestor = process_layout.tree_roots[tree_index];
+        typename tables_t::tree_t process_tree(process_ancestor, true);
+        const std::vector<uint32_t> & tree_members = process_layout.tree_members[tree_index];
+        for (std::vector<uint32_t>::const_iterator iter = tree_members.begin(); tree_members.end() != iter; ++iter)
+        {
+            process_tree.process_descendant_set.insert(*iter);
+            process_tables.process_helper_map.insert(std::make_pair(*iter, ProcessHelper(process_ancestor, process_handle_t())));
+        }
+        process_tables.process_tree_map.insert(std::make_pair(process_ancestor, process_tree));
+        process_tables.process_helper_map.insert(std::make_pair(process_ancestor, ProcessHelper(process_ancestor, process_handle_t())));
+        process_tables.process_snapshot_map.insert(std::make_pair(process_ancestor, ProcessSnapshot()));
+    }
+}
+
+/*
+ * return: a sum over the ancestors found, the same for both tables
+ */
+template <typename tables_t>
+static uint64_t run_tick(ProcessLayout & process_layout, tables_t & process_tables, uint32_t tick_index)
+{
+    typedef typename tables_t::leaf_map_t leaf_map_t;
+    typedef typename tables_t::tree_map_t tree_map_t;
+    typedef typename tables_t::helper_map_t helper_map_t;
+    typedef typename tables_t::snapshot_map_t snapshot_map_t;
+
+    leaf_map_t & process_leaf_map = process_tables.process_leaf_map;
+    tree_map_t & process_tree_map = process_tables.process_tree_map;
+    helper_map_t & process_helper_map = process_tables.process_helper_map;
+    snapshot_map_t & process_snapshot_map = process_tables.process_snapshot_map;
+
+    uint64_t check_sum = 0;
+
+    /* the leaf map of the nested tree roots */
+    process_tables.reset_leaves();
+    for (std::size_t tree_index = BENCH_NESTED_TREE_STEP; tree_index < process_layout.tree_roots.size(); tree_index += BENCH_NESTED_TREE_STEP)
+    {
+        process_leaf_map[process_layout.tree_roots[tree_index - 1]].process_descendant_set.insert(process_layout.tree_roots[tree_index]);
+    }
+
+    /* processes exit, new ones start in their trees, spread over the trees in turn */
+    const std::size_t tree_count = process_layout.tree_roots.size();
+    process_layout.process_drop_list.clear();
+    process_layout.process_start_list.clear();
+    for (std::size_t churn_index = 0; churn_index < process_layout.churn_count; ++churn_index)
+    {
+        const std::size_t churn_sequence = static_cast<std::size_t>(tick_index) * process_layout.churn_count + churn_index;
+        const std::size_t tree_index = churn_sequence % tree_count;
+        const uint32_t process_ancestor = process_layout.tree_roots[tree_index];
+        std::vector<uint32_t> & tree_members = process_layout.tree_members[tree_index];
+        if (tree_members.empty())
+        {
+            continue;
+        }
+
+        uint32_t & process_id = tree_members[(churn_sequence / tree_count) % tree_members.size()];
+        process_layout.process_drop_list.push_back(process_id);
+
+        process_id = process_layout.next_process_id++;
+        process_layout.process_start_list.push_back(std::make_pair(process_id, process_ancestor));
+    }
+    process_tables.drop_processes(process_layout.process_drop_list);
+    process_tables.start_processes(process_layout.process_start_list);
+
+    /* every process is matched to its tree and its helper, as update_process_tree does after its walk */
+    for (std::size_t tree_index = 0; tree_index < process_layout.tree_roots.size(); ++tree_index)
+    {
+        const uint32_t process_ancestor = process_layout.tree_roots[tree_index];
+        const std::vector<uint32_t> & tree_members = process_layout.tree_members[tree_index];
+        for (std::vector<uint32_t>::const_iterator iter = tree_members.begin(); tree_members.end() != iter; ++iter)
+        {
+            typename tree_map_t::iterator iter_tree = process_tree_map.find(process_ancestor);
+            typename helper_map_t::iterator iter_helper = process_helper_map.find(*iter);
+            if (process_tree_map.end() != iter_tree && process_helper_map.end() != iter_helper && process_ancestor == iter_helper->second.process_ancestor)
+            {
+                check_sum += iter_tree->second.process_descendant_set.size();
+            }
+        }
+    }
+
+    /* resources are summed by ancestor */
+    for (typename snapshot_map_t::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        iter->second.process_resource.cpu_usage = 0;
+    }
+    for (typename helper_map_t::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+    {
+        typename snapshot_map_t::iterator iter_snapshot = process_snapshot_map.find(iter->second.process_ancestor);
+        if (process_snapshot_map.end() != iter_snapshot)
+        {
+            iter_snapshot->second.process_resource.cpu_usage += 1.0;
+            check_sum += iter->second.process_ancestor;
+        }
+    }
+
+    return (check_sum);
+}
+
+static uint64_t steady_nanoseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+/*
+ * return: the heap allocations per tick once warmed up
+ */
+template <typename tables_t>
+static double bench_tables(const char * tables_name, uint32_t process_count, uint32_t tick_count, uint32_t churn_per_mille, uint64_t & check_sum)
+{
+    ProcessLayout process_layout;
+    build_layout(process_count, churn_per_mille, process_layout);
+
+    tables_t process_tables;
+    fill_tables(process_layout, process_tables);
+
+    /* the pending list of a tree grows the first time a process starts in it, so warm up until the churn has been round every tree */
+    uint32_t warmup_tick_count = BENCH_WARMUP_TICK_COUNT;
+    if (0 != process_layout.churn_count)
+    {
+        warmup_tick_count += static_cast<uint32_t>(process_layout.tree_roots.size() / process_layout.churn_count);
+    }
+
+    uint32_t tick_index = 0;
+    for (; tick_index < warmup_tick_count; ++tick_index)
+    {
+        run_tick(process_layout, process_tables, tick_index);
+    }
+
+    check_sum = 0;
+    uint64_t allocation_count = get_allocation_count();
+    uint64_t begin_time = steady_nanoseconds();
+    for (uint32_t tick_end = tick_index + tick_count; tick_index < tick_end; ++tick_index)
+    {
+        check_sum += run_tick(process_layout, process_tables, tick_index);
+    }
+    uint64_t elapsed_ns = steady_nanoseconds() - begin_time;
+    double tick_allocation_count = static_cast<double>(get_allocation_count() - allocation_count) / tick_count;
+
+    printf("%-6s %10.1f us/tick  %10.1f allocations/tick  (check sum %llu)\n", tables_name, static_cast<double>(elapsed_ns) / tick_count / 1000.0, tick_allocation_count, static_cast<unsigned long long>(check_sum));
+
+    return (tick_allocation_count);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t process_count = (argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : BENCH_PROCESS_COUNT);
+    uint32_t tick_count = (argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : BENCH_TICK_COUNT);
+    uint32_t churn_per_mille = (argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : BENCH_CHURN_PER_MILLE);
+    if (0 == tick_count)
+    {
+        tick_count = 1;
+    }
+
+    printf("%u processes, %u ticks, %u per mille replaced each tick\n", process_count, tick_count, churn_per_mille);
+
+    uint64_t std_sum = 0;
+    bench_tables<StdProcessTables>("std", process_count, tick_count, churn_per_mille, std_sum);
+
+    uint64_t flat_sum = 0;
+    double flat_allocation_count = bench_tables<FlatProcessTables>("flat", process_count, tick_count, churn_per_mille, flat_sum);
+
+    if (std_sum != flat_sum)
+    {
+        printf("the tables disagree\n");
+        return (1);
+    }
+
+    if (0.0 != flat_allocation_count)
+    {
+        printf("the flat tables allocate in steady state\n");
+        return (1);
+    }
+
+    return (0);
+}
@@ -0,0 +1,178 @@
+/********************************************************
+ * Description : nvidia-smi dmon parsing, in place against split and stoi
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "../src/resource_monitor_impl.cpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench_allocation.h"
+
+/*
+ * usage: bench_nvsmi_parse [pass_count]
+ *   parses the recorded dmon rows below pass_count times, once the way get_nvidia_gpu_detail did with goofer_split_piece and std::stoi,
+ *   once with split_nvsmi_line and get_nvsmi_column_value; both start from a copy of the row, as fgets leaves it
+ */
+
+#define BENCH_PASS_COUNT                200000
+
+static const char * s_dmon_header = "# gpu    sm   mem   enc   dec   jpg   ofa\n";
+
+static const char * s_dmon_rows[] =
+{
+    "    0    97    61    12     8     -     -\n",
+    "    1    88    54     0     0     -     -\n",
+    "    2   100    73    35    21     -     -\n",
+    "    3     4     1     0     0     -     -\n",
+    "    4    63    40     7     3     -     -\n",
+    "    5    71    45     0    16     -     -\n",
+    "    6    99    80    48     0     -     -\n",
+    "    7     0     0     0     0     -     -\n",
+};
+
+#define BENCH_ROW_COUNT                 (sizeof(s_dmon_rows) / sizeof(s_dmon_rows[0]))
+
+struct DmonColumns
+{
+    uint32_t                                id_index;
+    uint32_t                                sm_index;
+    uint32_t                                enc_index;
+    uint32_t                                dec_index;
+};
+
+static void split_parse_header(DmonColumns & dmon_columns)
+{
+    std::string headers(s_dmon_header);
+    Goofer::goofer_string_trim(headers, " #");
+
+    std::vector<std::string> titles;
+    Goofer::goofer_split_piece(headers, " \t", true, true, titles);
+    for (uint32_t index = 0; index < titles.size(); ++index)
+    {
+        const std::string & item = titles[index];
+        if (0 == stricmp("gpu", item.c_str()))
+        {
+            dmon_columns.id_index = index;
+        }
+        else if (0 == stricmp("sm", item.c_str()))
+        {
+            dmon_columns.sm_index = index;
+        }
+        else if (0 == stricmp("enc", item.c_str()))
+        {
+            dmon_columns.enc_index = index;
+        }
+        else if (0 == stricmp("dec", item.c_str()))
+        {
+            dmon_columns.dec_index = index;
+        }
+    }
+}
+
+static uint64_t split_parse_rows(const DmonColumns & dmon_columns, uint32_t pass_count)
+{
+    uint64_t check_sum = 0;
+    char line[256] = { 0x0 };
+
+    for (uint32_t pass_index = 0; pass_index < pass_count; ++pass_index)
+    {
+        for (std::size_t row_index = 0; row_index < BENCH_ROW_COUNT; ++row_index)
+        {
+            strncpy(line, s_dmon_rows[row_index], sizeof(line) - 1);
+
+            std::vector<std::string> values;
+            Goofer::goofer_split_piece(line, " \t", true, true, values);
+            if (values.size() <= dmon_columns.id_index)
+            {
+                continue;
+            }
+            uint32_t gpu_index = std::stoi(values[dmon_columns.id_index], nullptr);
+            uint32_t sm_percent = (values.size() > dmon_columns.sm_index ? std::stoi(values[dmon_columns.sm_index], nullptr) : 0);
+            uint32_t enc_percent = (values.size() > dmon_columns.enc_index ? std::stoi(values[dmon_columns.enc_index], nullptr) : 0);
+            uint32_t dec_percent = (values.size() > dmon_columns.dec_index ? std::stoi(values[dmon_columns.dec_index], nullptr) : 0);
+            check_sum += gpu_index + sm_percent + enc_percent + dec_percent;
+        }
+    }
+
+    return (check_sum);
+}
+
+static void inplace_parse_header(DmonColumns & dmon_columns)
+{
+    char line[256] = { 0x0 };
+    char * tokens[NVSMI_MAX_COLUMN_COUNT] = { nullptr };
+
+    strncpy(line, s_dmon_header, sizeof(line) - 1);
+    uint32_t title_count = split_nvsmi_line(skip_nvsmi_header_mark(line), tokens, NVSMI_MAX_COLUMN_COUNT);
+    dmon_columns.id_index = find_nvsmi_column(tokens, title_count, "gpu");
+    dmon_columns.sm_index = find_nvsmi_column(tokens, title_count, "sm");
+    dmon_columns.enc_index = find_nvsmi_column(tokens, title_count, "enc");
+    dmon_columns.dec_index = find_nvsmi_column(tokens, title_count, "dec");
+}
+
+static uint64_t inplace_parse_rows(const DmonColumns & dmon_columns, uint32_t pass_count)
+{
+    uint64_t check_sum = 0;
+    char line[256] = { 0x0 };
+    char * tokens[NVSMI_MAX_COLUMN_COUNT] = { nullptr };
+
+    for (uint32_t pass_index = 0; pass_index < pass_count; ++pass_index)
+    {
+        for (std::size_t row_index = 0; row_index < BENCH_ROW_COUNT; ++row_index)
+        {
+            strncpy(line, s_dmon_rows[row_index], sizeof(line) - 1);
+
+            uint32_t token_count = split_nvsmi_line(line, tokens, NVSMI_MAX_COLUMN_COUNT);
+            uint64_t gpu_index = 0;
+            if (token_count <= dmon_columns.id_index || nullptr == parse_uint64(tokens[dmon_columns.id_index], gpu_index))
+            {
+                continue;
+            }
+            check_sum += gpu_index;
+            check_sum += get_nvsmi_column_value(tokens, token_count, dmon_columns.sm_index);
+            check_sum += get_nvsmi_column_value(tokens, token_count, dmon_columns.enc_index);
+            check_sum += get_nvsmi_column_value(tokens, token_count, dmon_columns.dec_index);
+        }
+    }
+
+    return (check_sum);
+}
+
+static void print_result(const char * path_name, uint32_t pass_count, uint64_t elapsed_ns, uint64_t allocation_count, uint64_t check_sum)
+{
+    const double row_count = static_cast<double>(pass_count) * BENCH_ROW_COUNT;
+    printf("%-10s %8.1f ns/row  %6.2f allocations/row  (check sum %llu)\n", path_name, static_cast<double>(elapsed_ns) / row_count, static_cast<double>(allocation_count) / row_count, static_cast<unsigned long long>(check_sum));
+}
+
+static uint64_t steady_nanoseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t pass_count = (argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : BENCH_PASS_COUNT);
+
+    DmonColumns split_columns = { NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN };
+    split_parse_header(split_columns);
+
+    DmonColumns inplace_columns = { NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN, NVSMI_INVALID_COLUMN };
+    inplace_parse_header(inplace_columns);
+
+    uint64_t allocation_count = get_allocation_count();
+    uint64_t begin_time = steady_nanoseconds();
+    uint64_t split_sum = split_parse_rows(split_columns, pass_count);
+    print_result("split/stoi", pass_count, steady_nanoseconds() - begin_time, get_allocation_count() - allocation_count, split_sum);
+
+    allocation_count = get_allocation_count();
+    begin_time = steady_nanoseconds();
+    uint64_t inplace_sum = inplace_parse_rows(inplace_columns, pass_count);
+    print_result("in place", pass_count, steady_nanoseconds() - begin_time, get_allocation_count() - allocation_count, inplace_sum);
+
+    return (split_sum == inplace_sum ? 0 : 1);
+}
@@ -0,0 +1,185 @@
+/********************************************************
+ * Description : pdh gpu instance names, cached table against parsing each tick
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "../src/resource_monitor_impl.cpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench_allocation.h"
+
+/*
+ * usage: bench_pdh_instance [process_count] [tick_count]
+ *   builds the "GPU Engine" instances of process_count processes from the NVIDIA and AMD samples in get_process_gpu_utilization_percentage,
+ *   then classifies them tick_count times, once with the strstr chain and atoi of a std::string that ran on every tick before,
+ *   once through update_gpu_instance_table, which parses a name only when the name at its index changes
+ */
+
+#define BENCH_PROCESS_COUNT             200
+#define BENCH_TICK_COUNT                1000
+
+static const char * s_engine_suffixes[] =
+{
+    /* NVIDIA */
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_0_engtype_3D",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_10_engtype_Compute_1",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_11_engtype_VR",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_12_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_13_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_14_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_15_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_1_engtype_Compute_0",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_2_engtype_LegacyOverlay",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_3_engtype_VideoDecode",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_4_engtype_Security",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_5_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_6_engtype_Copy",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_7_engtype_VideoEncode",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_8_engtype_Graphics_1",
+    "_luid_0x00000000_0x0000DABC_phys_0_eng_9_engtype_Cuda",
+    /* AMD */
+    "_luid_0x00000000_0x0000B750_phys_0_eng_0_engtype_3D",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_10_engtype_Timer 0",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_11_engtype_Security 1",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_12_engtype_Video Decode 1",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_13_engtype_Video Encode 0",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_14_engtype_Video Codec 0",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_1_engtype_High Priority 3D",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_2_engtype_High Priority Compute",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_3_engtype_True Audio 0",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_4_engtype_True Audio 1",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_5_engtype_Compute 3",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_6_engtype_Compute 0",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_7_engtype_Compute 1",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_8_engtype_Copy",
+    "_luid_0x00000000_0x0000B750_phys_0_eng_9_engtype_Copy",
+};
+
+#define BENCH_SUFFIX_COUNT              (sizeof(s_engine_suffixes) / sizeof(s_engine_suffixes[0]))
+
+/*
+ * return: a sum over the engine types and pids, the same for both paths
+ */
+static uint64_t strstr_classify(const std::vector<PDH_FMT_COUNTERVALUE_ITEM> & item_array, uint32_t tick_count)
+{
+    uint64_t check_sum = 0;
+
+    for (uint32_t tick_index = 0; tick_index < tick_count; ++tick_index)
+    {
+        for (std::size_t item_index = 0; item_index < item_array.size(); ++item_index)
+        {
+            const PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+
+            GpuEngineType engine_type = GPU_ENGINE_TYPE_OTHER;
+            if (nullptr != strstr(item.szName, "_3D"))
+            {
+                engine_type = GPU_ENGINE_TYPE_3D;
+            }
+            else if (nullptr != strstr(item.szName, "_VR"))
+            {
+                engine_type = GPU_ENGINE_TYPE_VR;
+            }
+            else if (nullptr != strstr(item.szName, "Encode") || nullptr != strstr(item.szName, "Codec"))
+            {
+                engine_type = GPU_ENGINE_TYPE_ENCODE;
+            }
+            else if (nullptr != strstr(item.szName, "Decode"))
+            {
+                engine_type = GPU_ENGINE_TYPE_DECODE;
+            }
+            else
+            {
+                continue;
+            }
+
+            const char * pid_beg = item.szName + 4;
+            const char * pid_end = strchr(pid_beg, '_');
+            uint32_t process_id = atoi(std::string(pid_beg, pid_end).c_str());
+
+            check_sum += static_cast<uint64_t>(engine_type) * process_id;
+        }
+    }
+
+    return (check_sum);
+}
+
+static uint64_t table_classify(GpuInstanceTable & gpu_instance_table, const std::vector<PDH_FMT_COUNTERVALUE_ITEM> & item_array, uint32_t tick_count)
+{
+    uint64_t check_sum = 0;
+
+    for (uint32_t tick_index = 0; tick_index < tick_count; ++tick_index)
+    {
+        const GpuInstance * instance_array = update_gpu_instance_table(gpu_instance_table, &item_array[0], static_cast<ULONG>(item_array.size()));
+        for (std::size_t item_index = 0; item_index < item_array.size(); ++item_index)
+        {
+            const GpuInstance & gpu_instance = instance_array[item_index];
+            if (GPU_ENGINE_TYPE_OTHER == gpu_instance.engine_type)
+            {
+                continue;
+            }
+            check_sum += static_cast<uint64_t>(gpu_instance.engine_type) * gpu_instance.process_id;
+        }
+    }
+
+    return (check_sum);
+}
+
+static void print_result(const char * path_name, std::size_t item_count, uint32_t tick_count, uint64_t elapsed_ns, uint64_t allocation_count, uint64_t check_sum)
+{
+    printf("%-8s %10.1f us/tick  %8.1f ns/instance  %8.2f allocations/tick  (check sum %llu)\n", path_name, static_cast<double>(elapsed_ns) / tick_count / 1000.0, static_cast<double>(elapsed_ns) / tick_count / item_count, static_cast<double>(allocation_count) / tick_count, static_cast<unsigned long long>(check_sum));
+}
+
+static uint64_t steady_nanoseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t process_count = (argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : BENCH_PROCESS_COUNT);
+    uint32_t tick_count = (argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : BENCH_TICK_COUNT);
+
+    std::vector<std::string> instance_names;
+    for (uint32_t process_index = 0; process_index < process_count; ++process_index)
+    {
+        char process_name[32] = { 0x0 };
+        snprintf(process_name, sizeof(process_name), "pid_%u", 1000 + process_index * 4);
+        for (std::size_t suffix_index = 0; suffix_index < BENCH_SUFFIX_COUNT; ++suffix_index)
+        {
+            instance_names.push_back(std::string(process_name) + s_engine_suffixes[suffix_index]);
+        }
+    }
+
+    std::vector<PDH_FMT_COUNTERVALUE_ITEM> item_array(instance_names.size());
+    for (std::size_t item_index = 0; item_index < item_array.size(); ++item_index)
+    {
+        memset(&item_array[item_index], 0x0, sizeof(item_array[item_index]));
+        item_array[item_index].szName = const_cast<char *>(instance_names[item_index].c_str());
+    }
+
+    printf("%u processes, %u instances, %u ticks\n", process_count, static_cast<uint32_t>(item_array.size()), tick_count);
+
+    uint64_t allocation_count = get_allocation_count();
+    uint64_t begin_time = steady_nanoseconds();
+    uint64_t strstr_sum = strstr_classify(item_array, tick_count);
+    print_result("strstr", item_array.size(), tick_count, steady_nanoseconds() - begin_time, get_allocation_count() - allocation_count, strstr_sum);
+
+    /* the first tick parses every name, the others find the same names at the same indexes */
+    GpuInstanceTable gpu_instance_table;
+    allocation_count = get_allocation_count();
+    begin_time = steady_nanoseconds();
+    uint64_t first_sum = table_classify(gpu_instance_table, item_array, 1);
+    print_result("1st tick", item_array.size(), 1, steady_nanoseconds() - begin_time, get_allocation_count() - allocation_count, first_sum);
+
+    allocation_count = get_allocation_count();
+    begin_time = steady_nanoseconds();
+    uint64_t table_sum = table_classify(gpu_instance_table, item_array, tick_count);
+    print_result("table", item_array.size(), tick_count, steady_nanoseconds() - begin_time, get_allocation_count() - allocation_count, table_sum);
+
+    return (strstr_sum == table_sum ? 0 : 1);
+}
@@ -0,0 +1,171 @@
+/********************************************************
+ * Description : contention of readers against an active collector
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "resource_monitor.h"
+
+/*
+ * usage: bench_snapshot_publish [reader_count] [seconds] [process_id]
+ *   reader_count threads call get_system_resource and get_process_resource in a loop while every collector runs each 100 ms
+ *   on the tree of process_id (1 by default: every process), a reader should never wait for a collection pass
+ */
+
+#define BENCH_READER_COUNT              8
+#define BENCH_SECONDS                   5
+#define BENCH_COLLECTOR_INTERVAL_MS     100
+#define BENCH_LATENCY_BUCKET_COUNT      40      /* bucket n: latencies below 2^n ns */
+
+struct ReaderResult
+{
+    uint64_t                                call_count;
+    uint64_t                                max_latency_ns;
+    uint64_t                                latency_buckets[BENCH_LATENCY_BUCKET_COUNT];
+
+    ReaderResult();
+};
+
+ReaderResult::ReaderResult()
+    : call_count(0)
+    , max_latency_ns(0)
+{
+    for (std::size_t bucket_index = 0; bucket_index < BENCH_LATENCY_BUCKET_COUNT; ++bucket_index)
+    {
+        latency_buckets[bucket_index] = 0;
+    }
+}
+
+static uint64_t steady_nanoseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+static void reader_thread(ResourceMonitor & resource_monitor, uint32_t process_id, const std::atomic<bool> & running, ReaderResult & reader_result)
+{
+    SystemResource system_resource;
+    ProcessResource process_resource;
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        uint64_t begin_time = steady_nanoseconds();
+        resource_monitor.get_system_resource(system_resource);
+        resource_monitor.get_process_resource(process_id, process_resource);
+        uint64_t latency_ns = steady_nanoseconds() - begin_time;
+
+        std::size_t bucket_index = 0;
+        while (bucket_index + 1 < BENCH_LATENCY_BUCKET_COUNT && (static_cast<uint64_t>(1) << bucket_index) <= latency_ns)
+        {
+            ++bucket_index;
+        }
+        ++reader_result.latency_buckets[bucket_index];
+        ++reader_result.call_count;
+        if (reader_result.max_latency_ns < latency_ns)
+        {
+            reader_result.max_latency_ns = latency_ns;
+        }
+    }
+}
+
+/*
+ * return: the upper bound of the bucket holding the given fraction of the calls
+ */
+static uint64_t get_latency_percentile(const ReaderResult & total_result, double fraction)
+{
+    uint64_t rank = static_cast<uint64_t>(static_cast<double>(total_result.call_count) * fraction);
+    uint64_t call_count = 0;
+    for (std::size_t bucket_index = 0; bucket_index < BENCH_LATENCY_BUCKET_COUNT; ++bucket_index)
+    {
+        call_count += total_result.latency_buckets[bucket_index];
+        if (call_count > rank)
+        {
+            return (static_cast<uint64_t>(1) << bucket_index);
+        }
+    }
+    return (total_result.max_latency_ns);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t reader_count = (argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : BENCH_READER_COUNT);
+    uint32_t bench_seconds = (argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : BENCH_SECONDS);
+    uint32_t process_id = (argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 1);
+
+    ResourceMonitor resource_monitor;
+    if (!resource_monitor.init())
+    {
+        printf("resource monitor init failure\n");
+        return (1);
+    }
+
+    if (!resource_monitor.append_process(process_id, true))
+    {
+        printf("append process (%u) failure\n", process_id);
+        return (1);
+    }
+
+    for (int collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+    {
+        resource_monitor.set_collector_interval(static_cast<ResourceCollectorType>(collector_type), BENCH_COLLECTOR_INTERVAL_MS);
+    }
+
+    SystemResource system_resource;
+    resource_monitor.get_system_resource(system_resource);
+    uint64_t begin_sequence = system_resource.sample_sequence;
+
+    std::atomic<bool> running(true);
+    std::vector<ReaderResult> reader_results(reader_count);
+    std::vector<std::thread> reader_threads;
+    for (uint32_t reader_index = 0; reader_index < reader_count; ++reader_index)
+    {
+        reader_threads.push_back(std::thread(&reader_thread, std::ref(resource_monitor), process_id, std::cref(running), std::ref(reader_results[reader_index])));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(bench_seconds));
+    running = false;
+
+    for (std::vector<std::thread>::iterator iter = reader_threads.begin(); reader_threads.end() != iter; ++iter)
+    {
+        iter->join();
+    }
+
+    resource_monitor.get_system_resource(system_resource);
+    uint64_t publish_count = system_resource.sample_sequence - begin_sequence;
+
+    resource_monitor.exit();
+
+    ReaderResult total_result;
+    for (std::vector<ReaderResult>::const_iterator iter = reader_results.begin(); reader_results.end() != iter; ++iter)
+    {
+        total_result.call_count += iter->call_count;
+        if (total_result.max_latency_ns < iter->max_latency_ns)
+        {
+            total_result.max_latency_ns = iter->max_latency_ns;
+        }
+        for (std::size_t bucket_index = 0; bucket_index < BENCH_LATENCY_BUCKET_COUNT; ++bucket_index)
+        {
+            total_result.latency_buckets[bucket_index] += iter->latency_buckets[bucket_index];
+        }
+    }
+
+    printf("readers:          %u\n", reader_count);
+    printf("seconds:          %u\n", bench_seconds);
+    printf("snapshots:        %llu published\n", static_cast<unsigned long long>(publish_count));
+    printf("reads:            %llu (%.0f per second per reader)\n", static_cast<unsigned long long>(total_result.call_count), static_cast<double>(total_result.call_count) / bench_seconds / (0 == reader_count ? 1 : reader_count));
+    printf("latency p50:      < %llu ns\n", static_cast<unsigned long long>(get_latency_percentile(total_result, 0.5)));
+    printf("latency p99:      < %llu ns\n", static_cast<unsigned long long>(get_latency_percentile(total_result, 0.99)));
+    printf("latency p99.99:   < %llu ns\n", static_cast<unsigned long long>(get_latency_percentile(total_result, 0.9999)));
+    printf("latency max:      %llu ns\n", static_cast<unsigned long long>(total_result.max_latency_ns));
+
+    return (0);
+}
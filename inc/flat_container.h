@@ -0,0 +1,379 @@
+/********************************************************
+ * Description : sorted vector containers keyed by pid
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef FLAT_CONTAINER_H
+#define FLAT_CONTAINER_H
+
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/*
+ * FlatMap / FlatSet keep their items contiguous and sorted, a subset of the std::map / std::set interface:
+ *   lookups are binary searches over one block of memory, iteration is a linear scan,
+ *   clear() keeps the capacity, so a container refilled every pass stops allocating once it has grown;
+ *   insert and erase move the items behind them, and invalidate iterators and references like std::vector;
+ *   a pass that adds or drops many keys batches them instead: insert_pending() only appends (find() does not see the key
+ *   until merge_pending(), which sorts the pending keys and merges them in one sweep), erase_keys() drops sorted keys in one sweep
+ */
+template <typename key_t, typename value_t>
+class FlatMap
+{
+public:
+    typedef std::pair<key_t, value_t>                           value_type;
+    typedef typename std::vector<value_type>::iterator          iterator;
+    typedef typename std::vector<value_type>::const_iterator    const_iterator;
+
+public:
+    iterator begin()
+    {
+        return (m_items.begin());
+    }
+
+    iterator end()
+    {
+        return (m_items.end());
+    }
+
+    const_iterator begin() const
+    {
+        return (m_items.begin());
+    }
+
+    const_iterator end() const
+    {
+        return (m_items.end());
+    }
+
+    bool empty() const
+    {
+        return (m_items.empty());
+    }
+
+    std::size_t size() const
+    {
+        return (m_items.size());
+    }
+
+    void reserve(std::size_t capacity)
+    {
+        m_items.reserve(capacity);
+    }
+
+    void clear()
+    {
+        m_items.clear();
+        m_pending_items.clear();
+    }
+
+    iterator find(const key_t & key)
+    {
+        iterator iter = lower_bound(key);
+        return ((m_items.end() != iter && !(key < iter->first)) ? iter : m_items.end());
+    }
+
+    const_iterator find(const key_t & key) const
+    {
+        const_iterator iter = lower_bound(key);
+        return ((m_items.end() != iter && !(key < iter->first)) ? iter : m_items.end());
+    }
+
+    std::pair<iterator, bool> insert(const value_type & value)
+    {
+        iterator iter = lower_bound(value.first);
+        if (m_items.end() != iter && !(value.first < iter->first))
+        {
+            return (std::make_pair(iter, false));
+        }
+        return (std::make_pair(m_items.insert(iter, value), true));
+    }
+
+    value_t & operator [] (const key_t & key)
+    {
+        iterator iter = lower_bound(key);
+        if (m_items.end() == iter || key < iter->first)
+        {
+            iter = m_items.insert(iter, value_type(key, value_t()));
+        }
+        return (iter->second);
+    }
+
+    iterator erase(iterator iter)
+    {
+        return (m_items.erase(iter));
+    }
+
+    std::size_t erase(const key_t & key)
+    {
+        iterator iter = find(key);
+        if (m_items.end() == iter)
+        {
+            return (0);
+        }
+        m_items.erase(iter);
+        return (1);
+    }
+
+    /*
+     * the key must be neither in the map nor pending, the reference holds until the next insert_pending()
+     */
+    value_type & insert_pending(const value_type & value)
+    {
+        m_pending_items.push_back(value);
+        return (m_pending_items.back());
+    }
+
+    void merge_pending()
+    {
+        if (m_pending_items.empty())
+        {
+            return;
+        }
+
+        std::sort(m_pending_items.begin(), m_pending_items.end(), &FlatMap::item_less);
+
+        /* grow by the pending count, then merge from the back so no item is moved twice */
+        std::size_t item_index = m_items.size();
+        std::size_t pending_index = m_pending_items.size();
+        m_items.insert(m_items.end(), m_pending_items.begin(), m_pending_items.end());
+        std::size_t write_index = m_items.size();
+        while (0 != pending_index)
+        {
+            if (0 != item_index && m_pending_items[pending_index - 1].first < m_items[item_index - 1].first)
+            {
+                m_items[--write_index] = std::move(m_items[--item_index]);
+            }
+            else
+            {
+                m_items[--write_index] = m_pending_items[--pending_index];
+            }
+        }
+
+        m_pending_items.clear();
+    }
+
+    /*
+     * keys in ascending order, absent keys are skipped; return: items erased
+     */
+    template <typename input_iterator_t>
+    std::size_t erase_keys(input_iterator_t first, input_iterator_t last)
+    {
+        if (first == last)
+        {
+            return (0);
+        }
+
+        iterator iter_write = lower_bound(*first);
+        for (iterator iter_read = iter_write; m_items.end() != iter_read; ++iter_read)
+        {
+            while (first != last && *first < iter_read->first)
+            {
+                ++first;
+            }
+            if (first != last && !(iter_read->first < *first))
+            {
+                continue;
+            }
+            if (iter_write != iter_read)
+            {
+                *iter_write = std::move(*iter_read);
+            }
+            ++iter_write;
+        }
+
+        const std::size_t erase_count = static_cast<std::size_t>(m_items.end() - iter_write);
+        m_items.erase(iter_write, m_items.end());
+        return (erase_count);
+    }
+
+private:
+    static bool key_less(const value_type & item, const key_t & key)
+    {
+        return (item.first < key);
+    }
+
+    static bool item_less(const value_type & item, const value_type & other_item)
+    {
+        return (item.first < other_item.first);
+    }
+
+    iterator lower_bound(const key_t & key)
+    {
+        return (std::lower_bound(m_items.begin(), m_items.end(), key, &FlatMap::key_less));
+    }
+
+    const_iterator lower_bound(const key_t & key) const
+    {
+        return (std::lower_bound(m_items.begin(), m_items.end(), key, &FlatMap::key_less));
+    }
+
+private:
+    std::vector<value_type>                                     m_items;
+    std::vector<value_type>                                     m_pending_items;
+};
+
+template <typename key_t>
+class FlatSet
+{
+public:
+    typedef key_t                                               value_type;
+    typedef typename std::vector<key_t>::iterator               iterator;
+    typedef typename std::vector<key_t>::const_iterator         const_iterator;
+
+public:
+    iterator begin()
+    {
+        return (m_items.begin());
+    }
+
+    iterator end()
+    {
+        return (m_items.end());
+    }
+
+    const_iterator begin() const
+    {
+        return (m_items.begin());
+    }
+
+    const_iterator end() const
+    {
+        return (m_items.end());
+    }
+
+    bool empty() const
+    {
+        return (m_items.empty());
+    }
+
+    std::size_t size() const
+    {
+        return (m_items.size());
+    }
+
+    void clear()
+    {
+        m_items.clear();
+        m_pending_items.clear();
+    }
+
+    iterator find(const key_t & key)
+    {
+        iterator iter = std::lower_bound(m_items.begin(), m_items.end(), key);
+        return ((m_items.end() != iter && !(key < *iter)) ? iter : m_items.end());
+    }
+
+    const_iterator find(const key_t & key) const
+    {
+        const_iterator iter = std::lower_bound(m_items.begin(), m_items.end(), key);
+        return ((m_items.end() != iter && !(key < *iter)) ? iter : m_items.end());
+    }
+
+    std::pair<iterator, bool> insert(const key_t & key)
+    {
+        iterator iter = std::lower_bound(m_items.begin(), m_items.end(), key);
+        if (m_items.end() != iter && !(key < *iter))
+        {
+            return (std::make_pair(iter, false));
+        }
+        return (std::make_pair(m_items.insert(iter, key), true));
+    }
+
+    template <typename input_iterator_t>
+    void insert(input_iterator_t first, input_iterator_t last)
+    {
+        for (; first != last; ++first)
+        {
+            insert(*first);
+        }
+    }
+
+    std::size_t erase(const key_t & key)
+    {
+        iterator iter = find(key);
+        if (m_items.end() == iter)
+        {
+            return (0);
+        }
+        m_items.erase(iter);
+        return (1);
+    }
+
+    /*
+     * the key must be neither in the set nor pending
+     */
+    void insert_pending(const key_t & key)
+    {
+        m_pending_items.push_back(key);
+    }
+
+    void merge_pending()
+    {
+        if (m_pending_items.empty())
+        {
+            return;
+        }
+
+        std::sort(m_pending_items.begin(), m_pending_items.end());
+
+        std::size_t item_index = m_items.size();
+        std::size_t pending_index = m_pending_items.size();
+        m_items.insert(m_items.end(), m_pending_items.begin(), m_pending_items.end());
+        std::size_t write_index = m_items.size();
+        while (0 != pending_index)
+        {
+            if (0 != item_index && m_pending_items[pending_index - 1] < m_items[item_index - 1])
+            {
+                m_items[--write_index] = m_items[--item_index];
+            }
+            else
+            {
+                m_items[--write_index] = m_pending_items[--pending_index];
+            }
+        }
+
+        m_pending_items.clear();
+    }
+
+    template <typename input_iterator_t>
+    std::size_t erase_keys(input_iterator_t first, input_iterator_t last)
+    {
+        if (first == last)
+        {
+            return (0);
+        }
+
+        iterator iter_write = std::lower_bound(m_items.begin(), m_items.end(), *first);
+        for (iterator iter_read = iter_write; m_items.end() != iter_read; ++iter_read)
+        {
+            while (first != last && *first < *iter_read)
+            {
+                ++first;
+            }
+            if (first != last && !(*iter_read < *first))
+            {
+                continue;
+            }
+            *iter_write++ = *iter_read;
+        }
+
+        const std::size_t erase_count = static_cast<std::size_t>(m_items.end() - iter_write);
+        m_items.erase(iter_write, m_items.end());
+        return (erase_count);
+    }
+
+private:
+    std::vector<key_t>                                          m_items;
+    std::vector<key_t>                                          m_pending_items;
+};
+
+
+#endif // FLAT_CONTAINER_H
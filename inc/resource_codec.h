@@ -0,0 +1,40 @@
+/********************************************************
+ * Description : field and varint coding shared by the recorder and the snapshot diffs
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_CODEC_H
+#define RESOURCE_CODEC_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include "resource_monitor.h"
+
+/*
+ * every field of a resource as 64 bits, doubles by their bit pattern; a set bit of the double mask marks a double
+ */
+#define SYSTEM_FIELD_COUNT              18
+#define SYSTEM_DOUBLE_MASK              ((1u << 1) | (1u << 7) | (1u << 8) | (1u << 9) | (1u << 10))
+#define PROCESS_FIELD_COUNT             9
+#define PROCESS_DOUBLE_MASK             ((1u << 0) | (1u << 2) | (1u << 3) | (1u << 4) | (1u << 5))
+#define VARINT_SIZE_MAX                 10
+
+uint64_t double_bits(double value);
+double bits_double(uint64_t bits);
+void get_system_fields(const SystemResource & system_resource, uint64_t * fields);
+void set_system_fields(const uint64_t * fields, SystemResource & system_resource);
+void get_process_fields(const ProcessResource & process_resource, uint64_t * fields);
+void set_process_fields(const uint64_t * fields, ProcessResource & process_resource);
+
+uint64_t zigzag_encode(int64_t value);
+int64_t zigzag_decode(uint64_t value);
+std::size_t put_varint(uint64_t value, char * buffer); /* at most VARINT_SIZE_MAX bytes */
+bool get_varint(const char *& data, const char * data_end, uint64_t & value);
+
+
+#endif // RESOURCE_CODEC_H
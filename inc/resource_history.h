@@ -0,0 +1,102 @@
+/********************************************************
+ * Description : fixed memory sample history with windowed statistics
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_HISTORY_H
+#define RESOURCE_HISTORY_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <vector>
+#include "resource_monitor.h"
+
+#define RESOURCE_HISTORY_WINDOW_MAX     4
+#define RESOURCE_HISTORY_BUCKET_COUNT   257     /* zero, then 64 octaves of 4 buckets each */
+
+/*
+ * one window of one metric: running sum, a log scale histogram for the percentiles,
+ * and two monotonic queues (ring positions of the samples) for min and max
+ */
+struct HistoryWindowMetric
+{
+    double                                  value_sum;
+    uint32_t                                bucket_counts[RESOURCE_HISTORY_BUCKET_COUNT];
+    std::vector<uint32_t>                   min_queue;
+    uint32_t                                min_front;
+    uint32_t                                min_count;
+    std::vector<uint32_t>                   max_queue;
+    uint32_t                                max_front;
+    uint32_t                                max_count;
+
+    HistoryWindowMetric();
+};
+
+/*
+ * the last sample_capacity samples of one system or process, every memory is taken by init():
+ *   append() evicts what falls out of each window and updates every statistic in O(1) amortized,
+ *   get_statistics() reads min / max / mean at once and walks the histogram for the percentiles
+ */
+class ResourceHistory
+{
+public:
+    ResourceHistory();
+
+public:
+    bool init(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count);
+    void clear();
+    void append(uint64_t sample_time, const double * metric_values);
+    bool get_statistics(ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics) const;
+
+private:
+    ResourceHistory(const ResourceHistory &) = delete;
+    ResourceHistory & operator = (const ResourceHistory &) = delete;
+
+private:
+    double sample_value(uint64_t sample_sequence, uint32_t metric_type) const; /* a ring position works as well */
+    void evict(std::size_t window_index);
+
+private:
+    uint32_t                                m_sample_capacity;
+    std::size_t                             m_window_count;
+    uint32_t                                m_window_ms[RESOURCE_HISTORY_WINDOW_MAX];
+    uint64_t                                m_window_tail[RESOURCE_HISTORY_WINDOW_MAX];  /* sequence of the oldest sample in the window */
+    uint64_t                                m_sample_head;                               /* sequence of the next sample, sample n lives at n % m_sample_capacity */
+    std::vector<uint64_t>                   m_sample_times;
+    std::vector<double>                     m_sample_values;                             /* RESOURCE_METRIC_COUNT values per sample */
+    std::vector<HistoryWindowMetric>        m_window_metrics;                            /* RESOURCE_METRIC_COUNT items per window */
+};
+
+/*
+ * histories are built on the caller's thread and handed back for reuse, so the collector never allocates
+ */
+class ResourceHistoryPool
+{
+public:
+    ResourceHistoryPool();
+
+public:
+    bool reset(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count); /* drops every history, 0 capacity turns the pool off */
+    bool enabled() const;
+    ResourceHistory * acquire();
+    void release(ResourceHistory * resource_history);
+
+private:
+    ResourceHistoryPool(const ResourceHistoryPool &) = delete;
+    ResourceHistoryPool & operator = (const ResourceHistoryPool &) = delete;
+
+private:
+    uint32_t                                m_sample_capacity;
+    std::vector<uint32_t>                   m_window_ms;
+    std::list<ResourceHistory>              m_history_list;     /* every history made, list nodes never move */
+    std::vector<ResourceHistory *>          m_free_list;
+};
+
+
+#endif // RESOURCE_HISTORY_H
@@ -0,0 +1,72 @@
+/********************************************************
+ * Description : openmetrics text exporter of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_METRICS_EXPORTER_H
+#define RESOURCE_METRICS_EXPORTER_H
+
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include "resource_monitor.h"
+
+/*
+ * re-renders metrics_text and moves sample_sequence forward when a snapshot newer than sample_sequence was published,
+ * false (metrics_text untouched) while it was not
+ */
+typedef std::function<bool (uint64_t & sample_sequence, std::string & metrics_text)> metrics_render_t;
+
+/*
+ * openmetrics text of one snapshot: system gauges, per card gauges labelled gpu and name, per process gauges labelled pid
+ */
+void format_metrics_text(uint64_t sample_sequence, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources, const std::vector<std::pair<uint32_t, ProcessResource>> & process_resources, std::string & metrics_text);
+
+struct MetricsServer;
+
+/*
+ * answers GET /metrics over http on a local tcp or unix socket from one thread;
+ * the response is built at most once per published snapshot, when it is first scraped, and every scrape of that snapshot shares it
+ */
+class ResourceMetricsExporter
+{
+public:
+    ResourceMetricsExporter();
+    ~ResourceMetricsExporter();
+
+public:
+    bool start(const std::string & listen_address, const metrics_render_t & metrics_render);
+    void stop();
+    bool started() const;
+
+private:
+    ResourceMetricsExporter(const ResourceMetricsExporter &) = delete;
+    ResourceMetricsExporter & operator = (const ResourceMetricsExporter &) = delete;
+
+private:
+    void server_thread();
+    std::shared_ptr<const std::string> get_response(const std::string & request);
+
+private:
+    MetricsServer                         * m_metrics_server;     /* owned by the server thread while it runs */
+    metrics_render_t                        m_metrics_render;
+    volatile bool                           m_running;
+    std::thread                             m_server_thread;
+    uint64_t                                m_sample_sequence;    /* of m_metrics_text, owned by the server thread */
+    std::string                             m_metrics_text;
+    std::shared_ptr<const std::string>      m_metrics_response;   /* header and m_metrics_text, a client keeps the one it is sending */
+    std::shared_ptr<const std::string>      m_not_found_response;
+    std::shared_ptr<const std::string>      m_bad_request_response;
+};
+
+
+#endif // RESOURCE_METRICS_EXPORTER_H
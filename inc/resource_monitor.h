@@ -13,8 +13,11 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <map>
 #include <list>
 #include <string>
+#include <vector>
+#include <functional>
 
 #ifdef _MSC_VER
     #define RESOURCE_MONITOR_CDECL            __cdecl
@@ -43,6 +46,10 @@ struct RESOURCE_MONITOR_API ProcessResource
     double          gpu_enc_usage;
     double          gpu_dec_usage;
     uint64_t        gpu_mem_usage;
+    uint64_t        minor_faults;       /* page faults per second served from memory, linux only: 0 on windows */
+    uint64_t        major_faults;       /* page faults per second that read from disk, linux only */
+    uint64_t        sample_time;        /* steady clock milliseconds when the snapshot holding these values was published */
+    uint64_t        sample_sequence;    /* sequence of that snapshot, starts at 1 and grows by one on every publish */
 };
 
 struct RESOURCE_MONITOR_API SystemResource
@@ -61,12 +68,92 @@ struct RESOURCE_MONITOR_API SystemResource
     uint64_t        gpu_mem_usage;
     uint64_t        gpu_mem_total;
     uint64_t        gpu_temperature;
+    uint64_t        gpu_sm_clock;
+    uint64_t        gpu_mem_clock;
     uint64_t        net_send_bytes;
     uint64_t        net_recv_bytes;
+    uint64_t        sample_time;        /* same as ProcessResource */
+    uint64_t        sample_sequence;
 };
 
-class ResourceMonitorImpl;
+struct RESOURCE_MONITOR_API GraphicsCardResource
+{
+    char            gpu_name[128];
+    double          gpu_3d_usage;
+    double          gpu_enc_usage;
+    double          gpu_dec_usage;
+    uint64_t        gpu_mem_usage;
+    uint64_t        gpu_mem_total;
+    uint64_t        gpu_temperature;
+    uint64_t        gpu_sm_clock;
+    uint64_t        gpu_mem_clock;
+};
+
+/*
+ * the value after the colon is what adaptive mode watches, change_threshold is in its unit
+ */
+enum ResourceCollectorType
+{
+    RESOURCE_COLLECTOR_PROCESS_TREE,    /* walk the monitoring trees for new sub processes: count of sampled processes */
+    RESOURCE_COLLECTOR_PROCESS,         /* cpu and memory of monitoring processes: their cpu_usage summed, percent */
+    RESOURCE_COLLECTOR_MEMORY,          /* system memory: ram_usage of ram_total, percent */
+    RESOURCE_COLLECTOR_DISK,            /* system disk: disk_usage of disk_total, percent */
+    RESOURCE_COLLECTOR_CPU,             /* system cpu: cpu_usage, percent */
+    RESOURCE_COLLECTOR_GPU,             /* pdh on windows (process gpu too), sysfs on linux; nvidia cards are queried by their own threads: gpu_3d_usage, percent */
+    RESOURCE_COLLECTOR_NETWORK,         /* network interfaces: net_send_bytes plus net_recv_bytes, bytes per second */
+    RESOURCE_COLLECTOR_COUNT
+};
+
+enum ResourceMetricType
+{
+    RESOURCE_METRIC_CPU_USAGE,          /* percent */
+    RESOURCE_METRIC_RAM_USAGE,          /* bytes */
+    RESOURCE_METRIC_GPU_3D_USAGE,       /* percent */
+    RESOURCE_METRIC_GPU_MEM_USAGE,      /* bytes */
+    RESOURCE_METRIC_COUNT
+};
 
+struct RESOURCE_MONITOR_API ResourceThreshold
+{
+    uint32_t                process_id;         /* 0: system resource, otherwise a monitoring process (with its sub processes if it is a tree) */
+    ResourceMetricType      metric_type;
+    double                  raise_value;        /* raised when the value stays at or above it */
+    double                  clear_value;        /* cleared when the value stays at or below it, not above raise_value */
+    uint32_t                min_duration_ms;    /* how long the value must stay before raised or cleared, 0: on the first snapshot */
+};
+
+struct RESOURCE_MONITOR_API ResourceStatistics
+{
+    uint64_t                sample_count;       /* samples in the window */
+    double                  min_value;
+    double                  max_value;
+    double                  mean_value;
+    double                  p95_value;          /* approximate, within 12.5 percent */
+    double                  p99_value;          /* approximate, within 12.5 percent */
+};
+
+struct RESOURCE_MONITOR_API ResourceSnapshot
+{
+    uint64_t                                sample_sequence;    /* 0: empty */
+    SystemResource                          system_resource;
+    std::map<uint32_t, ProcessResource>     process_resources;
+
+    ResourceSnapshot();
+};
+
+/*
+ * applies what get_snapshot_diff produced on the remote side: a diff from base 0 replaces resource_snapshot,
+ * any other needs resource_snapshot at its base sequence; false leaves resource_snapshot as it was
+ */
+RESOURCE_MONITOR_API bool apply_snapshot_diff(const std::string & snapshot_diff, ResourceSnapshot & resource_snapshot);
+
+class ResourceMonitorClient;
+
+/*
+ * every ResourceMonitor of a process (with the same proc_root and sys_root on linux) shares one collector engine:
+ * the first init starts it, the last exit stops it, and each monitor sees only the processes it appended;
+ * collector intervals, history, recorder, shared export, metrics and stream exporters, snapshot retention, system and graphics card resources belong to the shared engine
+ */
 class RESOURCE_MONITOR_API ResourceMonitor
 {
 public:
@@ -75,16 +162,41 @@ public:
 
 public:
     bool init();
+#ifndef _MSC_VER
+    bool init(const std::string & proc_root, const std::string & sys_root); /* proc_root: "/proc", sys_root: "/sys", may point to a fixture tree */
+#endif // _MSC_VER
     void exit();
 
 public:
     bool append_process(uint32_t process_id, bool process_tree);
     bool remove_process(uint32_t process_id);
+    bool set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback); /* called on an internal thread when a monitoring process exits, it stays monitored until remove_process; the callback may call remove_process or exit */
+    bool set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms); /* every collector runs each 5000 ms by default, collectors due at the same time share one pass */
+    bool set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold); /* interval drops to min_interval_ms when the watched value moves more than change_threshold between runs, and doubles up to max_interval_ms while it does not; set_collector_interval leaves adaptive mode */
+    bool get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms); /* interval in effect now */
+    bool subscribe_threshold(const ResourceThreshold & threshold, const std::function<void (uint32_t subscription_id, const ResourceThreshold & threshold, bool raised, double value)> & threshold_callback, uint32_t & subscription_id); /* checked on every published snapshot, called on an internal thread when the state flips; a raised subscription clears at once with value 0 when its process leaves the snapshot, remove_process drops the subscriptions on that process */
+    bool unsubscribe_threshold(uint32_t subscription_id);
+    bool set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count); /* keep the last sample_capacity published samples of the system and of every monitoring process, with statistics over up to 4 windows (e.g. 60000, 300000, 3600000); clears any history, 0 capacity turns it off */
+    bool get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics); /* process_id 0: system, window_index: into window_ms of set_history */
+    bool start_recorder(const std::string & file_path); /* every published snapshot (system and monitoring processes) goes compressed into file_path (truncated) from a writer thread, read it with ResourceRecordReader */
+    bool stop_recorder();
+    bool start_shared_export(const std::string & segment_name, uint32_t process_capacity); /* every published snapshot also goes into the shared memory segment_name (shm_open name on linux, file mapping name on windows), for ResourceSharedReader in other processes; at most process_capacity processes */
+    bool stop_shared_export();
+    bool start_metrics_exporter(const std::string & listen_address); /* serves GET /metrics in openmetrics text over http on listen_address ("127.0.0.1:9101", ":9101", or "unix:/run/resource_monitor.sock" on linux); each published snapshot is formatted once, on its first scrape */
+    bool stop_metrics_exporter();
+    bool start_stream_exporter(const std::string & listen_address, uint32_t client_backlog); /* linux: every published snapshot is pushed as one influx line protocol frame to each client of listen_address ("unix:/run/resource_monitor.stream" or a tcp address as above); a client more than client_backlog frames behind (0: 64) is disconnected */
+    bool stop_stream_exporter();
+    bool set_snapshot_retention(uint32_t snapshot_count); /* keep the last snapshot_count published snapshots for get_snapshot_diff; clears what is kept, 0 turns it off */
 
 public:
     bool get_process_resource(uint32_t process_id, ProcessResource & process_resource);
+    bool get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses); /* process_statuses[i]: process_ids[i] is monitoring, may be nullptr */
+    bool get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources); /* every monitoring process */
     bool get_system_resource(SystemResource & system_resource);
     bool get_graphics_cards(std::list<std::string> & graphics_card_names);
+    bool get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources); /* one item per card, in the order of get_graphics_cards */
+    bool wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence); /* blocks until a snapshot newer than last_sequence is published, false on timeout or exit */
+    bool get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, std::string & snapshot_diff); /* only the fields and processes that changed from base_sequence (0: nothing, a full snapshot) to target_sequence (0: the latest kept), varint encoded, for apply_snapshot_diff; false when either is no longer kept, then ask again from base 0 */
 
 private:
     ResourceMonitor(const ResourceMonitor &) = delete;
@@ -93,7 +205,69 @@ private:
     ResourceMonitor & operator = (ResourceMonitor &&) = delete;
 
 private:
-    ResourceMonitorImpl           * m_resource_monitor_impl;
+    ResourceMonitorClient         * m_resource_monitor_client;
+};
+
+class SharedSnapshotReaderImpl;
+
+/*
+ * reads what start_shared_export publishes, from another process; reads are lock free and make no system call,
+ * every getter returns false once the exporting monitor stopped, or when it died while publishing (after waiting 200 ms)
+ */
+class RESOURCE_MONITOR_API ResourceSharedReader
+{
+public:
+    ResourceSharedReader();
+    virtual ~ResourceSharedReader();
+
+public:
+    bool open(const std::string & segment_name);
+    void close();
+
+public:
+    bool get_process_resource(uint32_t process_id, ProcessResource & process_resource);
+    bool get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources);
+    bool get_system_resource(SystemResource & system_resource);
+    bool get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources); /* at most 16 cards */
+
+private:
+    ResourceSharedReader(const ResourceSharedReader &) = delete;
+    ResourceSharedReader(ResourceSharedReader &&) = delete;
+    ResourceSharedReader & operator = (const ResourceSharedReader &) = delete;
+    ResourceSharedReader & operator = (ResourceSharedReader &&) = delete;
+
+private:
+    SharedSnapshotReaderImpl      * m_shared_reader_impl;
+};
+
+class ResourceRecordReaderImpl;
+
+/*
+ * sample_time of what it reads is unix epoch milliseconds, [begin_time, end_time) selects the records
+ */
+class RESOURCE_MONITOR_API ResourceRecordReader
+{
+public:
+    ResourceRecordReader();
+    virtual ~ResourceRecordReader();
+
+public:
+    bool open(const std::string & file_path);
+    void close();
+
+public:
+    bool get_recorded_processes(std::vector<uint32_t> & process_ids);
+    bool read_system_resources(uint64_t begin_time, uint64_t end_time, std::vector<SystemResource> & system_resources);
+    bool read_process_resources(uint32_t process_id, uint64_t begin_time, uint64_t end_time, std::vector<ProcessResource> & process_resources); /* only the blocks of process_id in the range are decoded */
+
+private:
+    ResourceRecordReader(const ResourceRecordReader &) = delete;
+    ResourceRecordReader(ResourceRecordReader &&) = delete;
+    ResourceRecordReader & operator = (const ResourceRecordReader &) = delete;
+    ResourceRecordReader & operator = (ResourceRecordReader &&) = delete;
+
+private:
+    ResourceRecordReaderImpl      * m_record_reader_impl;
 };
 
 
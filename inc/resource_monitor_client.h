@@ -0,0 +1,125 @@
+/********************************************************
+ * Description : resource monitor client of the shared collector engine
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_MONITOR_CLIENT_H
+#define RESOURCE_MONITOR_CLIENT_H
+
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <functional>
+#include "resource_monitor.h"
+#include "resource_monitor_impl.h"
+#include "flat_container.h"
+
+class ResourceMonitorClient;
+
+struct EngineProcess
+{
+    uint32_t                                client_count;         /* clients that appended the process */
+    bool                                    process_tree;
+
+    EngineProcess();
+};
+
+/*
+ * one collector engine per process (per proc_root and sys_root on linux), shared by every client that inits on it:
+ * the first client starts it, the last client stops it, the pid set of the engine is the union of what the clients append
+ */
+struct ResourceMonitorEngine
+{
+    std::string                             engine_key;
+    ResourceMonitorImpl                     resource_monitor_impl;
+    uint32_t                                client_count;         /* guarded by the engine registry mutex */
+    FlatMap<uint32_t, EngineProcess>        process_map;          /* guarded by the engine registry mutex */
+    std::list<ResourceMonitorClient *>      client_list;          /* guarded by the engine registry mutex */
+    std::mutex                              dispatch_mutex;
+    std::condition_variable                 dispatch_condition;   /* signaled when a dispatch ends */
+    std::thread::id                         dispatch_thread;      /* thread running process exit callbacks, a client waits it out before it leaves; guarded by dispatch_mutex */
+
+    ResourceMonitorEngine();
+};
+
+/*
+ * one ResourceMonitor on the shared engine: it sees only the processes it appended,
+ * collector intervals, history, recorder, shared export, metrics and stream exporters, snapshot retention and system resources belong to the engine
+ */
+class ResourceMonitorClient
+{
+public:
+    ResourceMonitorClient();
+    virtual ~ResourceMonitorClient();
+
+public:
+#ifdef _MSC_VER
+    bool init();
+#else
+    bool init(const std::string & proc_root, const std::string & sys_root);
+#endif // _MSC_VER
+    void exit();
+
+public:
+    bool append_process(uint32_t process_id, bool process_tree);
+    bool remove_process(uint32_t process_id);
+    bool set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback);
+    bool set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms);
+    bool set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold);
+    bool get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms);
+    bool subscribe_threshold(const ResourceThreshold & threshold, const threshold_callback_t & threshold_callback, uint32_t & subscription_id);
+    bool unsubscribe_threshold(uint32_t subscription_id);
+    bool set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count);
+    bool get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics);
+    bool start_recorder(const std::string & file_path);
+    bool stop_recorder();
+    bool start_shared_export(const std::string & segment_name, uint32_t process_capacity);
+    bool stop_shared_export();
+    bool start_metrics_exporter(const std::string & listen_address);
+    bool stop_metrics_exporter();
+    bool start_stream_exporter(const std::string & listen_address, uint32_t client_backlog);
+    bool stop_stream_exporter();
+    bool set_snapshot_retention(uint32_t snapshot_count);
+
+public:
+    bool get_process_resource(uint32_t process_id, ProcessResource & process_resource);
+    bool get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses);
+    bool get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources);
+    bool get_system_resource(SystemResource & system_resource);
+    bool get_graphics_cards(std::list<std::string> & graphics_card_names);
+    bool get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources);
+    bool wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence);
+    bool get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, std::string & snapshot_diff);
+
+public:
+    void notify_process_exit(uint32_t process_id); /* from the engine, on its process exit thread */
+
+private:
+    ResourceMonitorClient(const ResourceMonitorClient &) = delete;
+    ResourceMonitorClient & operator = (const ResourceMonitorClient &) = delete;
+
+private:
+    bool attach_engine(const std::string & engine_key, const std::string & proc_root, const std::string & sys_root);
+    bool owns_process(uint32_t process_id);
+    void move_filter_sequence();
+
+private:
+    ResourceMonitorEngine                 * m_engine;
+    FlatSet<uint32_t>                       m_process_ids;          /* appended by this client, written under the registry mutex and m_client_mutex */
+    FlatMap<uint32_t, uint32_t>             m_subscription_ids;     /* subscription id to its process id (0: system), guarded by m_client_mutex */
+    std::function<void (uint32_t)>          m_process_exit_callback; /* guarded by m_client_mutex */
+    uint64_t                                m_filter_sequence;      /* latest snapshot when m_process_ids last changed, guarded by m_client_mutex */
+    std::mutex                              m_client_mutex;
+};
+
+
+#endif // RESOURCE_MONITOR_CLIENT_H
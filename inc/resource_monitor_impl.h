@@ -11,17 +11,39 @@
 #define RESOURCE_MONITOR_IMPL_H
 
 
-#include <set>
 #include <map>
 #include <mutex>
+#include <atomic>
 #include <thread>
-#include <pdh.h>
-#include <wtypes.h>
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <condition_variable>
+#ifdef _MSC_VER
+    #include <pdh.h>
+    #include <wtypes.h>
+#endif // _MSC_VER
 #include "resource_monitor.h"
+#include "flat_container.h"
+#include "resource_history.h"
+#include "resource_recorder.h"
+#include "resource_shared_memory.h"
+#include "resource_metrics_exporter.h"
+#include "resource_stream_exporter.h"
+#include "resource_snapshot_diff.h"
+
+#ifdef _MSC_VER
+    typedef HANDLE  process_handle_t;   /* process handle opened by OpenProcess */
+    typedef HMODULE library_handle_t;   /* module handle opened by LoadLibrary */
+#else
+    typedef int     process_handle_t;   /* fd of /proc/[pid]/stat, kept open and re-read with pread, reads fail once the process is gone */
+    typedef void *  library_handle_t;   /* library handle opened by dlopen */
+#endif // _MSC_VER
 
 struct ProcessLeaf
 {
-    std::set<uint32_t>                      process_descendant_set;
+    FlatSet<uint32_t>                       process_descendant_set;
 
     ProcessLeaf();
 };
@@ -29,7 +51,7 @@ struct ProcessLeaf
 struct ProcessTree
 {
     bool                                    process_tree;
-    std::set<uint32_t>                      process_descendant_set;
+    FlatSet<uint32_t>                       process_descendant_set;
 
     ProcessTree(uint32_t ancestor, bool tree);
 };
@@ -37,32 +59,290 @@ struct ProcessTree
 struct ProcessHelper
 {
     uint32_t                                process_ancestor;
-    HANDLE                                  process_handle;
+    process_handle_t                        process_handle;
     uint64_t                                cpu_check_time;
     uint64_t                                cpu_system_time;
+    std::size_t                             snapshot_index;       /* position of process_ancestor in process_snapshot_map, checked before use */
+#ifdef _MSC_VER
+    struct ProcessExitWatch               * process_exit_watch;   /* wait registered on process_handle, nullptr: not watched */
+#else
+    uint64_t                                process_start_time;   /* starttime of the first stat read, another value means the pid was reused */
+    uint64_t                                minor_faults;         /* minflt and majflt of the last stat read, the base of the fault rates */
+    uint64_t                                major_faults;
+    int                                     process_exit_fd;      /* pidfd in SystemHelper::process_exit_fd, -1: not watched */
+#endif // _MSC_VER
 
-    ProcessHelper(uint32_t ancestor, HANDLE handle);
+    ProcessHelper(uint32_t ancestor, process_handle_t handle);
 };
 
 struct ProcessSnapshot
 {
     ProcessResource process_resource;
+    ProcessResource process_resource_total;   /* process_resource plus every nested monitoring tree, summed once per pass */
 
     ProcessSnapshot();
 };
 
+struct ProcessEntry
+{
+    uint32_t                                process_id;
+    uint32_t                                parent_process_id;
+#ifndef _MSC_VER
+    uint64_t                                process_start_time;   /* starttime of the stat, clock ticks after boot */
+#endif // _MSC_VER
+};
+
+struct ProcessNode
+{
+    uint32_t                                parent_process_id;
+    uint64_t                                process_order;        /* position in the process walk: snapshot index on windows, start time on linux; a child ordered before its parent holds a reused pid */
+    std::vector<uint32_t>                   child_process_list;
+
+    ProcessNode();
+};
+
+struct ProcessIndex
+{
+    bool                                    index_dirty;          /* rebuild from a full process walk on next update */
+#ifndef _MSC_VER
+    int                                     connector_fd;         /* netlink process connector, -1 while falling back to /proc rescans */
+#endif // _MSC_VER
+    std::unordered_map<uint32_t, ProcessNode>               process_node_map;     /* key: every process on the host */
+    std::vector<std::pair<uint32_t, uint32_t>>              process_ancestor_list;
+    std::vector<uint32_t>                                   process_stack;
+
+    ProcessIndex();
+};
+
+struct NvgpuQuery
+{
+    uint64_t                                gpu_count;
+    uint64_t                                gpu_mem_usage;
+    uint64_t                                gpu_mem_total;
+    uint64_t                                gpu_temperature;      /* hottest card */
+    uint64_t                                gpu_sm_clock;         /* MHz, average of all cards */
+    uint64_t                                gpu_mem_clock;        /* MHz, average of all cards */
+    std::vector<GraphicsCardResource>       graphics_card_resources;
+
+    NvgpuQuery();
+};
+
+/*
+ * the few nvml declarations we need, so neither nvml.h nor the nvidia driver is required at build time
+ */
+typedef int nvml_return_t;                  /* NVML_SUCCESS: 0 */
+typedef struct nvml_device_st * nvml_device_t;
+
+struct NvmlUtilization
+{
+    unsigned int                            gpu;
+    unsigned int                            memory;
+};
+
+struct NvmlMemory
+{
+    unsigned long long                      total;
+    unsigned long long                      free;
+    unsigned long long                      used;
+};
+
+struct NvmlLibrary
+{
+    library_handle_t                        library_handle;       /* nullptr: nvml is not available, fall back to nvidia-smi */
+    std::vector<nvml_device_t>              device_list;
+    nvml_return_t                        (* nvml_init)();
+    nvml_return_t                        (* nvml_shutdown)();
+    nvml_return_t                        (* nvml_device_get_count)(unsigned int * device_count);
+    nvml_return_t                        (* nvml_device_get_handle_by_index)(unsigned int index, nvml_device_t * device);
+    nvml_return_t                        (* nvml_device_get_name)(nvml_device_t device, char * name, unsigned int length);
+    nvml_return_t                        (* nvml_device_get_utilization_rates)(nvml_device_t device, NvmlUtilization * utilization);
+    nvml_return_t                        (* nvml_device_get_encoder_utilization)(nvml_device_t device, unsigned int * utilization, unsigned int * sampling_period_us);
+    nvml_return_t                        (* nvml_device_get_decoder_utilization)(nvml_device_t device, unsigned int * utilization, unsigned int * sampling_period_us);
+    nvml_return_t                        (* nvml_device_get_memory_info)(nvml_device_t device, NvmlMemory * memory);
+    nvml_return_t                        (* nvml_device_get_temperature)(nvml_device_t device, int sensor_type, unsigned int * temperature);
+    nvml_return_t                        (* nvml_device_get_clock_info)(nvml_device_t device, int clock_type, unsigned int * clock);
+
+    NvmlLibrary();
+};
+
+enum GpuEngineType
+{
+    GPU_ENGINE_TYPE_OTHER,
+    GPU_ENGINE_TYPE_3D,
+    GPU_ENGINE_TYPE_VR,
+    GPU_ENGINE_TYPE_ENCODE,
+    GPU_ENGINE_TYPE_DECODE,
+};
+
+struct GpuInstance
+{
+    uint32_t                                process_id;
+    uint64_t                                adapter_luid;
+    uint32_t                                adapter_phys;
+    GpuEngineType                           engine_type;
+};
+
+struct GpuInstanceTable
+{
+    std::vector<std::string>                instance_name_list;   /* pdh instance names, index by counter array item */
+    std::vector<GpuInstance>                instance_list;        /* parsed once when the name at that index changes */
+
+    GpuInstanceTable();
+};
+
+#ifdef _MSC_VER
+struct SystemHelper;
+
+/*
+ * context of a wait registered by RegisterWaitForSingleObject, the callback only queues the pid for the exit thread
+ */
+struct ProcessExitWatch
+{
+    uint32_t                                process_id;
+    HANDLE                                  wait_handle;
+    SystemHelper                          * system_helper;
+};
+#endif // _MSC_VER
+
+struct SystemHelper
+{
+#ifdef _MSC_VER
+    GpuInstanceTable                        gpu_engine_table;     /* \GPU Engine(*)\Utilization Percentage */
+    GpuInstanceTable                        gpu_memory_table;     /* \GPU Process Memory(*)\Dedicated Usage */
+    uint64_t                                page_size;
+    HANDLE                                  process_exit_event;   /* set when process_exit_list gets a pid, or on exit */
+    std::mutex                              process_exit_mutex;
+    std::vector<uint32_t>                   process_exit_list;    /* guarded by process_exit_mutex, filled by wait callbacks */
+#else
+    std::string                             proc_root;
+    std::string                             sys_root;
+    std::string                             gpu_device_path;      /* sysfs device of the graphics card used when nvidia-smi is not available */
+    int                                     proc_root_fd;
+    uint64_t                                clock_ticks;
+    uint64_t                                page_size;
+    uint64_t                                cpu_busy_time;
+    uint64_t                                cpu_total_time;
+    uint64_t                                net_check_time;
+    uint64_t                                net_send_bytes;
+    uint64_t                                net_recv_bytes;
+    int                                     process_exit_fd;      /* epoll over the pidfd of every helper */
+    int                                     process_wake_fd;      /* eventfd in process_exit_fd, wakes the exit thread on exit */
+#endif // _MSC_VER
+    std::vector<ProcessEntry>               process_entry_list;
+    ProcessIndex                            process_index;
+
+    SystemHelper();
+};
+
 struct SystemSnapshot
 {
     SystemResource                          system_resource;
+    SystemHelper                            system_helper;
     std::list<std::string>                  graphics_card_names;
-    std::map<uint32_t, ProcessLeaf>         process_leaf_map;     /* key: every monitoring process, value: sub processes which is a monitoring process too  */
-    std::map<uint32_t, ProcessTree>         process_tree_map;     /* key: every monitoring process, value: process and sub processes which is not a monitoring process */
-    std::map<uint32_t, ProcessHelper>       process_helper_map;   /* key: every monitoring process and their sub processes if need monitor a process tree */
-    std::map<uint32_t, ProcessSnapshot>     process_snapshot_map; /* key: every monitoring process */
+    std::vector<GraphicsCardResource>       graphics_card_resources;
+    FlatMap<uint32_t, ProcessLeaf>          process_leaf_map;     /* key: every monitoring process, value: sub processes which is a monitoring process too  */
+    FlatMap<uint32_t, ProcessTree>          process_tree_map;     /* key: every monitoring process, value: process and sub processes which is not a monitoring process */
+    FlatMap<uint32_t, ProcessHelper>        process_helper_map;   /* key: every monitoring process and their sub processes if need monitor a process tree */
+    FlatMap<uint32_t, ProcessSnapshot>      process_snapshot_map; /* key: every monitoring process */
+    std::vector<uint32_t>                   process_drop_list;    /* sub processes exited since the last pass, their helpers are closed but still in the tables */
 
     SystemSnapshot();
 };
 
+struct PublishedSnapshot
+{
+    std::atomic<uint32_t>                   reader_count;
+    uint64_t                                sample_time;
+    uint64_t                                sample_sequence;
+    SystemResource                          system_resource;
+    std::list<std::string>                  graphics_card_names;
+    std::vector<GraphicsCardResource>       graphics_card_resources;
+    FlatMap<uint32_t, ProcessSnapshot>      process_snapshot_map;
+
+    PublishedSnapshot();
+};
+
+struct CollectorSchedule
+{
+    uint32_t                                interval_ms;
+    uint64_t                                due_time;             /* steady clock milliseconds, moves on by whole intervals so it does not drift */
+    bool                                    adaptive;             /* interval follows the watched value between min_interval_ms and max_interval_ms */
+    uint32_t                                min_interval_ms;
+    uint32_t                                max_interval_ms;
+    double                                  change_threshold;
+    bool                                    watched_valid;
+    double                                  watched_value;        /* watched value of the last run */
+
+    CollectorSchedule();
+};
+
+typedef std::function<void (uint32_t, const ResourceThreshold &, bool, double)> threshold_callback_t;
+
+struct ThresholdRule
+{
+    ResourceThreshold                       threshold;
+    threshold_callback_t                    threshold_callback;
+    bool                                    raised;
+    uint64_t                                pending_time;         /* steady clock milliseconds since the value is past the edge of the state, 0: not pending */
+
+    ThresholdRule();
+};
+
+struct ThresholdEvent
+{
+    uint32_t                                subscription_id;
+    ResourceThreshold                       threshold;
+    threshold_callback_t                    threshold_callback;
+    bool                                    raised;
+    double                                  value;
+
+    ThresholdEvent();
+};
+
+/*
+ * one writer (serialized by the caller) fills a slot nobody reads and swaps the current index,
+ * readers pin the current slot with a reference count and never wait on the writer
+ */
+class SnapshotPublisher
+{
+public:
+    SnapshotPublisher();
+
+public:
+    PublishedSnapshot & begin_publish();
+    void end_publish(PublishedSnapshot & published_snapshot);
+
+public:
+    const PublishedSnapshot & acquire();
+    void release(const PublishedSnapshot & published_snapshot);
+
+private:
+    SnapshotPublisher(const SnapshotPublisher &) = delete;
+    SnapshotPublisher & operator = (const SnapshotPublisher &) = delete;
+
+private:
+    PublishedSnapshot                       m_published_snapshot[3];
+    std::atomic<uint32_t>                   m_published_index;
+};
+
+class PublishedSnapshotReader
+{
+public:
+    explicit PublishedSnapshotReader(SnapshotPublisher & snapshot_publisher);
+    ~PublishedSnapshotReader();
+
+public:
+    const PublishedSnapshot & snapshot() const;
+
+private:
+    PublishedSnapshotReader(const PublishedSnapshotReader &) = delete;
+    PublishedSnapshotReader & operator = (const PublishedSnapshotReader &) = delete;
+
+private:
+    SnapshotPublisher                     & m_snapshot_publisher;
+    const PublishedSnapshot               & m_published_snapshot;
+};
+
 class ResourceMonitorImpl
 {
 public:
@@ -70,39 +350,123 @@ public:
     virtual ~ResourceMonitorImpl();
 
 public:
+#ifdef _MSC_VER
     bool init();
+#else
+    bool init(const std::string & proc_root, const std::string & sys_root);
+#endif // _MSC_VER
     void exit();
+    bool in_callback_thread() const; /* the caller runs a process exit or threshold callback, exit would join its own thread */
 
 public:
     bool append_process(uint32_t process_id, bool process_tree);
     bool remove_process(uint32_t process_id);
+    bool set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback);
+    bool set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms);
+    bool set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold);
+    bool get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms);
+    bool subscribe_threshold(const ResourceThreshold & threshold, const threshold_callback_t & threshold_callback, uint32_t & subscription_id);
+    bool unsubscribe_threshold(uint32_t subscription_id);
+    bool set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count);
+    bool get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics);
+    bool start_recorder(const std::string & file_path);
+    bool stop_recorder();
+    bool start_shared_export(const std::string & segment_name, uint32_t process_capacity);
+    bool stop_shared_export();
+    bool start_metrics_exporter(const std::string & listen_address);
+    bool stop_metrics_exporter();
+    bool start_stream_exporter(const std::string & listen_address, uint32_t client_backlog);
+    bool stop_stream_exporter();
+    bool set_snapshot_retention(uint32_t snapshot_count);
 
 public:
     bool get_process_resource(uint32_t process_id, ProcessResource & process_resource);
+    bool get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses);
+    bool get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources);
     bool get_system_resource(SystemResource & system_resource);
     bool get_graphics_cards(std::list<std::string> & graphics_card_names);
+    bool get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources);
+    bool wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence);
+    bool get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, const FlatSet<uint32_t> * process_filter, std::string & snapshot_diff);
+
+private:
+    bool open_system_collectors();
+    bool start_collect_threads();
+    void stop_collect_threads();
+    void close_system_collectors(); /* the pdh query on windows, the proc root and the process connector on linux */
 
 private:
     void stuck_check_thread();
     void nvgpu_check_thread();
+    void nvgpu_query_thread();
+    void nvml_check_thread();
     void query_resource_thread();
+    void process_exit_thread();
+    void threshold_dispatch_thread();
+
+private:
+    void publish_system_snapshot();
+    void publish_nvgpu_resource(const SystemResource & nvgpu_resource, const std::vector<GraphicsCardResource> & graphics_card_resources);
+    void publish_nvgpu_query(const NvgpuQuery & nvgpu_query);
+    void publish_nvml_resource(const SystemResource & nvgpu_resource, const NvgpuQuery & nvgpu_query);
+    void notify_process_exit(const std::vector<uint32_t> & process_id_list);
+    void collect_resource(uint32_t collector_mask);
+    void evaluate_threshold_rules(const PublishedSnapshot & published_snapshot);
+    void append_history_samples(const PublishedSnapshot & published_snapshot);
+    void record_snapshot(const PublishedSnapshot & published_snapshot);
+    void export_snapshot(const PublishedSnapshot & published_snapshot);
+    bool render_metrics(uint64_t & sample_sequence, std::string & metrics_text);
+    void stream_snapshot(const PublishedSnapshot & published_snapshot);
+    void retain_snapshot(const PublishedSnapshot & published_snapshot);
 
 private:
     volatile bool                                       m_running;
-    bool                                                m_query_gpu_with_pdh;
-    uint64_t                                            m_nvsmi_alive_time;
+    bool                                                m_query_gpu_with_pdh;   /* pdh on windows, sysfs on linux: nvidia-smi is not available */
+    NvmlLibrary                                         m_nvml_library;         /* loaded: query nvidia cards with nvml instead of nvidia-smi */
+    uint64_t                                            m_nvsmi_alive_time;       /* nvidia-smi dmon */
+    uint64_t                                            m_nvsmi_query_alive_time; /* nvidia-smi --query-gpu */
     std::thread                                         m_stuck_check_thread;
     std::thread                                         m_nvgpu_check_thread;
+    std::thread                                         m_nvgpu_query_thread;
     std::thread                                         m_query_thread;
-    HANDLE                                              m_query_event;
+    std::thread                                         m_process_exit_thread;
+    std::function<void (uint32_t)>                      m_process_exit_callback;  /* guarded by m_process_exit_mutex */
+    std::mutex                                          m_process_exit_mutex;
+    std::mutex                                          m_query_mutex;
+    std::condition_variable                             m_query_condition;
+    CollectorSchedule                                   m_collector_schedules[RESOURCE_COLLECTOR_COUNT]; /* guarded by m_query_mutex */
+#ifdef _MSC_VER
+    std::vector<char>                                   m_counter_buffer;         /* formatted pdh counter arrays */
     PDH_HQUERY                                          m_query_handle;
     PDH_HCOUNTER                                        m_processor_counter;
     PDH_HCOUNTER                                        m_gpu_engine_counter;
     PDH_HCOUNTER                                        m_gpu_memory_counter;
     PDH_HCOUNTER                                        m_net_send_counter;
     PDH_HCOUNTER                                        m_net_recv_counter;
-    SystemSnapshot                                      m_system_snapshot;
+#endif // _MSC_VER
+    SystemSnapshot                                      m_system_snapshot;        /* owned by the collector, guarded by m_system_snapshot_mutex */
     std::mutex                                          m_system_snapshot_mutex;
+    SnapshotPublisher                                   m_snapshot_publisher;     /* what readers see, lock free */
+    uint64_t                                            m_sample_sequence;        /* of the last publish, written under both m_system_snapshot_mutex and m_sample_mutex */
+    std::mutex                                          m_sample_mutex;
+    std::condition_variable                             m_sample_condition;
+    FlatMap<uint32_t, ThresholdRule>                    m_threshold_rules;        /* key: subscription id, guarded by m_system_snapshot_mutex */
+    uint32_t                                            m_threshold_sequence;     /* last subscription id, guarded by m_system_snapshot_mutex */
+    std::thread                                         m_threshold_thread;
+    std::list<ThresholdEvent>                           m_threshold_events;       /* guarded by m_threshold_mutex */
+    std::mutex                                          m_threshold_mutex;
+    std::condition_variable                             m_threshold_condition;
+    ResourceHistoryPool                                 m_history_pool;           /* guarded by m_history_mutex */
+    FlatMap<uint32_t, ResourceHistory *>                m_history_map;            /* key: 0 for the system and every monitoring process, guarded by m_history_mutex */
+    std::mutex                                          m_history_mutex;
+    ResourceRecorder                                    m_resource_recorder;      /* started, stopped and fed under m_system_snapshot_mutex */
+    SharedSnapshotWriter                                m_shared_writer;          /* started, stopped and written under m_system_snapshot_mutex */
+    ResourceMetricsExporter                             m_metrics_exporter;       /* started and stopped under m_system_snapshot_mutex, renders from the publisher on its own thread */
+    ResourceStreamExporter                              m_stream_exporter;        /* started, stopped and fed under m_system_snapshot_mutex */
+    std::vector<std::pair<uint32_t, ProcessResource>>   m_stream_processes;       /* reused by stream_snapshot, guarded by m_system_snapshot_mutex */
+    std::size_t                                         m_stream_frame_size;      /* of the last frame, what the next one reserves */
+    SnapshotRetention                                   m_snapshot_retention;     /* filled under m_system_snapshot_mutex, guarded by m_retention_mutex */
+    std::mutex                                          m_retention_mutex;
 };
 
 
@@ -0,0 +1,178 @@
+/********************************************************
+ * Description : compressed on-disk recorder of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_RECORDER_H
+#define RESOURCE_RECORDER_H
+
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+#include "resource_monitor.h"
+#include "flat_container.h"
+
+/*
+ * file layout: a RecorderFileHeader, then blocks of block_size bytes,
+ * each block holds the records of one series (0: system, otherwise a process id) and starts with a RecorderBlockHeader;
+ * a record is the timestamp as zigzag varint delta-of-delta, the sequence as zigzag varint delta,
+ * then every field, doubles as varint of the xor with the previous value, integers as zigzag varint delta;
+ * the first record of a block is coded against zero, so any block decodes on its own;
+ * a block is written as it grows (its new records, then its header), so the slot at the end of the file may be short of block_size
+ */
+#define RECORDER_FILE_MAGIC             0x43524D52  /* "RMRC" */
+#define RECORDER_BLOCK_MAGIC            0x4B4C4252  /* "RBLK" */
+#define RECORDER_FILE_VERSION           2
+#define RECORDER_BLOCK_SIZE             16384
+#define RECORDER_FIELD_MAX              18
+
+struct RecorderFileHeader
+{
+    uint32_t                                file_magic;
+    uint32_t                                file_version;
+    uint32_t                                header_size;
+    uint32_t                                block_size;
+    uint64_t                                reserved[6];
+};
+
+struct RecorderBlockHeader
+{
+    uint32_t                                block_magic;
+    uint32_t                                series_id;
+    uint64_t                                first_time;           /* unix epoch milliseconds of the first and the last record */
+    uint64_t                                last_time;
+    uint32_t                                record_count;
+    uint32_t                                data_size;            /* bytes of records behind the header */
+};
+
+/*
+ * previous record of a series, what the next record is coded against
+ */
+struct RecorderCodecState
+{
+    uint64_t                                last_time;
+    int64_t                                 last_delta;
+    uint64_t                                last_sequence;
+    uint64_t                                last_fields[RECORDER_FIELD_MAX];
+
+    RecorderCodecState();
+};
+
+struct RecorderSeries
+{
+    uint64_t                                block_index;          /* slot of the open block in the file */
+    std::vector<char>                       block_buffer;         /* header and records of the open block, block_size bytes */
+    RecorderCodecState                      codec_state;
+    uint32_t                                written_size;         /* bytes of records of the open block already in the file */
+
+    RecorderSeries();
+};
+
+struct RecordFrame
+{
+    uint64_t                                sample_time;          /* steady clock milliseconds */
+    uint64_t                                sample_sequence;
+    SystemResource                          system_resource;
+    std::vector<std::pair<uint32_t, ProcessResource>> process_resources;
+
+    RecordFrame();
+};
+
+/*
+ * the collector fills a free frame between begin_append() and end_append() (one producer, no allocation once the frames have grown),
+ * a writer thread encodes the frames into blocks and writes them; a full queue drops the new frame
+ */
+class ResourceRecorder
+{
+public:
+    ResourceRecorder();
+    ~ResourceRecorder();
+
+public:
+    bool start(const std::string & file_path);
+    void stop();
+
+public:
+    RecordFrame * begin_append();
+    void end_append(RecordFrame * record_frame);
+
+private:
+    ResourceRecorder(const ResourceRecorder &) = delete;
+    ResourceRecorder & operator = (const ResourceRecorder &) = delete;
+
+private:
+    void writer_thread();
+    void write_frame(const RecordFrame & record_frame);
+    void write_record(uint32_t series_id, uint64_t record_time, uint64_t sample_sequence, const uint64_t * fields, std::size_t field_count, uint32_t double_mask);
+    bool write_block(RecorderSeries & recorder_series);
+    void retire_series(const RecordFrame & record_frame);
+    void flush_series();
+
+private:
+    FILE                                  * m_file;
+    uint64_t                                m_block_count;        /* slots handed out, owned by the writer thread */
+    uint64_t                                m_steady_base;        /* steady clock and unix epoch milliseconds at start */
+    uint64_t                                m_system_base;
+    FlatMap<uint32_t, RecorderSeries>       m_series_map;         /* owned by the writer thread */
+    std::thread                             m_writer_thread;
+    bool                                    m_running;            /* guarded by m_frame_mutex */
+    bool                                    m_dropping;           /* owned by the producer */
+    std::vector<RecordFrame>                m_frames;
+    std::size_t                             m_frame_head;         /* guarded by m_frame_mutex */
+    std::size_t                             m_frame_count;        /* guarded by m_frame_mutex */
+    std::mutex                              m_frame_mutex;
+    std::condition_variable                 m_frame_condition;
+};
+
+/*
+ * maps the whole file read only, block headers are scanned without decoding, only matching blocks are decoded
+ */
+class ResourceRecordReaderImpl
+{
+public:
+    ResourceRecordReaderImpl();
+    ~ResourceRecordReaderImpl();
+
+public:
+    bool open(const std::string & file_path);
+    void close();
+
+public:
+    bool get_recorded_processes(std::vector<uint32_t> & process_ids) const;
+    bool read_system_resources(uint64_t begin_time, uint64_t end_time, std::vector<SystemResource> & system_resources) const;
+    bool read_process_resources(uint32_t process_id, uint64_t begin_time, uint64_t end_time, std::vector<ProcessResource> & process_resources) const;
+
+private:
+    ResourceRecordReaderImpl(const ResourceRecordReaderImpl &) = delete;
+    ResourceRecordReaderImpl & operator = (const ResourceRecordReaderImpl &) = delete;
+
+private:
+    const RecorderBlockHeader * block_header(uint64_t block_index) const;
+
+private:
+#ifdef _MSC_VER
+    void                                  * m_file_handle;
+    void                                  * m_mapping_handle;
+#else
+    int                                     m_file_fd;
+#endif // _MSC_VER
+    const char                            * m_file_data;
+    std::size_t                             m_file_size;
+    uint32_t                                m_header_size;
+    uint32_t                                m_block_size;
+    uint64_t                                m_block_count;
+};
+
+
+#endif // RESOURCE_RECORDER_H
@@ -0,0 +1,124 @@
+/********************************************************
+ * Description : shared memory export of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_SHARED_MEMORY_H
+#define RESOURCE_SHARED_MEMORY_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include "resource_monitor.h"
+
+#define SHARED_SNAPSHOT_MAGIC           0x4D485352  /* "RSHM" */
+#define SHARED_SNAPSHOT_VERSION         2
+#define SHARED_SNAPSHOT_CARD_MAX        16
+
+struct SharedProcessEntry
+{
+    uint32_t                                process_id;
+    uint32_t                                reserved;
+    ProcessResource                         process_resource;
+};
+
+/*
+ * segment layout: this header, then process_capacity SharedProcessEntry sorted by process_id;
+ * write_sequence is a seqlock: odd while the writer is inside, a reader copies what it needs
+ * and keeps the copy only if the sequence is the same even number before and after
+ */
+struct SharedSnapshotHeader
+{
+    uint32_t                                magic;
+    uint32_t                                version;
+    uint32_t                                header_size;
+    uint32_t                                process_capacity;
+    std::atomic<uint64_t>                   write_sequence;
+    uint32_t                                writer_alive;         /* 0 once the writer stopped, the segment is stale */
+    uint32_t                                process_count;
+    uint32_t                                card_count;
+    uint32_t                                reserved;
+    uint64_t                                sample_time;
+    uint64_t                                sample_sequence;
+    SystemResource                          system_resource;
+    GraphicsCardResource                    card_resources[SHARED_SNAPSHOT_CARD_MAX];
+};
+
+class SharedSnapshotWriter
+{
+public:
+    SharedSnapshotWriter();
+    ~SharedSnapshotWriter();
+
+public:
+    bool start(const std::string & segment_name, uint32_t process_capacity);
+    void stop();
+    bool started() const;
+
+public:
+    void begin_write(uint64_t sample_time, uint64_t sample_sequence, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources);
+    void write_process(uint32_t process_id, const ProcessResource & process_resource); /* in ascending process_id order */
+    void end_write();
+
+private:
+    SharedSnapshotWriter(const SharedSnapshotWriter &) = delete;
+    SharedSnapshotWriter & operator = (const SharedSnapshotWriter &) = delete;
+
+private:
+    std::string                             m_segment_name;
+#ifdef _MSC_VER
+    void                                  * m_mapping_handle;
+#else
+    uint64_t                                m_segment_device;     /* identity of the object created, stop unlinks only that one */
+    uint64_t                                m_segment_inode;
+#endif // _MSC_VER
+    SharedSnapshotHeader                  * m_header;
+    SharedProcessEntry                    * m_process_entries;
+    std::size_t                             m_segment_size;
+    uint32_t                                m_process_count;
+    bool                                    m_overflowed;
+};
+
+class SharedSnapshotReaderImpl
+{
+public:
+    SharedSnapshotReaderImpl();
+    ~SharedSnapshotReaderImpl();
+
+public:
+    bool open(const std::string & segment_name);
+    void close();
+
+public:
+    bool get_system_resource(SystemResource & system_resource) const;
+    bool get_process_resource(uint32_t process_id, ProcessResource & process_resource) const;
+    bool get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources) const;
+    bool get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources) const;
+
+private:
+    SharedSnapshotReaderImpl(const SharedSnapshotReaderImpl &) = delete;
+    SharedSnapshotReaderImpl & operator = (const SharedSnapshotReaderImpl &) = delete;
+
+private:
+    bool begin_read(uint64_t & write_sequence) const;
+    bool end_read(uint64_t write_sequence) const;
+
+private:
+#ifdef _MSC_VER
+    void                                  * m_mapping_handle;
+#endif // _MSC_VER
+    const SharedSnapshotHeader            * m_header;
+    const SharedProcessEntry              * m_process_entries;
+    std::size_t                             m_segment_size;
+};
+
+
+#endif // RESOURCE_SHARED_MEMORY_H
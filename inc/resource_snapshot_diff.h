@@ -0,0 +1,78 @@
+/********************************************************
+ * Description : delta encoded diffs between published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_SNAPSHOT_DIFF_H
+#define RESOURCE_SNAPSHOT_DIFF_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include "resource_monitor.h"
+#include "flat_container.h"
+
+/*
+ * diff layout, every number a varint:
+ *   version, base sequence, target sequence minus base sequence, zigzag of target sample_time minus base sample_time,
+ *   system field mask, then each masked field,
+ *   removed process count, then each process id as the delta from the previous one,
+ *   changed process count, then each process id as the delta from the previous one, its field mask and each masked field;
+ * process ids strictly ascend, a zero delta after the first one is refused;
+ * a masked field is zigzag of the integer delta, or the xor of the double bits, against the base value (0 for a new process);
+ * base sequence 0 means an empty base: the diff holds the whole target
+ */
+#define SNAPSHOT_DIFF_VERSION           2
+
+struct DiffSnapshot
+{
+    uint64_t                                sample_sequence;      /* 0: empty */
+    SystemResource                          system_resource;      /* sample_time is the time of the snapshot */
+    std::vector<std::pair<uint32_t, ProcessResource>> process_resources;  /* ascending process_id */
+
+    DiffSnapshot();
+};
+
+/*
+ * the last snapshot_count published snapshots, the slots keep their memory and are refilled in turn
+ */
+class SnapshotRetention
+{
+public:
+    SnapshotRetention();
+
+public:
+    void reset(uint32_t snapshot_count); /* drops every snapshot, 0 turns it off */
+    bool enabled() const;
+    DiffSnapshot & append(); /* the slot of the oldest snapshot, for the caller to fill */
+    const DiffSnapshot * find(uint64_t sample_sequence) const; /* 0: the latest, nullptr when it is not kept */
+
+private:
+    SnapshotRetention(const SnapshotRetention &) = delete;
+    SnapshotRetention & operator = (const SnapshotRetention &) = delete;
+
+private:
+    std::vector<DiffSnapshot>               m_snapshots;
+    std::size_t                             m_snapshot_head;      /* slot of the next append */
+    std::size_t                             m_snapshot_count;     /* slots filled */
+};
+
+/*
+ * process_filter: only these processes are compared, nullptr for all
+ */
+void encode_snapshot_diff(const DiffSnapshot & base_snapshot, const DiffSnapshot & target_snapshot, const FlatSet<uint32_t> * process_filter, std::string & snapshot_diff);
+
+/*
+ * checked completely before anything is applied, resource_snapshot is untouched on failure
+ */
+bool decode_snapshot_diff(const std::string & snapshot_diff, ResourceSnapshot & resource_snapshot);
+
+
+#endif // RESOURCE_SNAPSHOT_DIFF_H
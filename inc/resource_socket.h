@@ -0,0 +1,45 @@
+/********************************************************
+ * Description : local listening sockets of the exporters
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_SOCKET_H
+#define RESOURCE_SOCKET_H
+
+
+#ifdef _MSC_VER
+    #include <winsock2.h>
+#else
+    #include <poll.h>
+    #include <sys/socket.h>
+#endif // _MSC_VER
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+    typedef SOCKET  socket_t;
+    #define BAD_SOCKET                  INVALID_SOCKET
+    #define SOCKET_SEND_FLAGS           0
+#else
+    typedef int     socket_t;
+    #define BAD_SOCKET                  (-1)
+    #define SOCKET_SEND_FLAGS           MSG_NOSIGNAL    /* a closed peer fails the send instead of raising SIGPIPE */
+#endif // _MSC_VER
+
+/*
+ * listen_address: "unix:/path/of/socket" (linux only, an old socket file is replaced),
+ * "host:port", or ":port" / "port" for 127.0.0.1:port; the socket is non blocking
+ */
+socket_t open_listen_socket(const std::string & listen_address);
+void close_listen_socket(socket_t listen_socket, const std::string & listen_address); /* removes the socket file of a unix address */
+socket_t accept_client_socket(socket_t listen_socket); /* non blocking, BAD_SOCKET when none is waiting */
+void close_socket(socket_t sock);
+bool socket_would_block();
+int poll_sockets(struct pollfd * poll_fds, std::size_t poll_count, int timeout_ms);
+
+
+#endif // RESOURCE_SOCKET_H
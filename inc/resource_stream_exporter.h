@@ -0,0 +1,72 @@
+/********************************************************
+ * Description : line protocol stream of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_STREAM_EXPORTER_H
+#define RESOURCE_STREAM_EXPORTER_H
+
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include "resource_monitor.h"
+
+/*
+ * one frame per snapshot, influx line protocol, one line per measurement and a timestamp in unix epoch nanoseconds:
+ *   resource_monitor_system sample_sequence=12u,cpu_count=8u,cpu_usage=3.5,... 1650000000000000000
+ *   resource_monitor_gpu,gpu=0,name=NVIDIA\ GeForce\ RTX\ 3080 gpu_3d_usage=40,... 1650000000000000000
+ *   resource_monitor_process,pid=1234 cpu_usage=12.5,ram_usage=104857600u,... 1650000000000000000
+ */
+void format_stream_frame(uint64_t sample_sequence, uint64_t frame_time_ns, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources, const std::vector<std::pair<uint32_t, ProcessResource>> & process_resources, std::string & stream_frame);
+
+struct StreamServer;
+
+/*
+ * the collector hands every encoded frame to all connected clients (a shared pointer each, the frame is encoded once),
+ * a writer thread sends each client what it has queued with one non blocking sendmsg;
+ * a client holding more than its backlog of unsent frames is too slow and is dropped
+ */
+class ResourceStreamExporter
+{
+public:
+    ResourceStreamExporter();
+    ~ResourceStreamExporter();
+
+public:
+    bool start(const std::string & listen_address, uint32_t client_backlog);
+    void stop();
+    bool started() const;
+    bool has_clients() const; /* without a client the collector skips the encoding */
+
+public:
+    void append_frame(const std::shared_ptr<const std::string> & stream_frame);
+
+private:
+    ResourceStreamExporter(const ResourceStreamExporter &) = delete;
+    ResourceStreamExporter & operator = (const ResourceStreamExporter &) = delete;
+
+private:
+    void writer_thread();
+    void wake_writer();
+
+private:
+    StreamServer                          * m_stream_server;
+    volatile bool                           m_running;
+    std::thread                             m_writer_thread;
+    std::atomic<uint32_t>                   m_client_count;
+    uint32_t                                m_client_backlog;     /* frames a client may have queued */
+    std::mutex                              m_client_mutex;       /* guards the client backlogs in m_stream_server */
+};
+
+
+#endif // RESOURCE_STREAM_EXPORTER_H
@@ -0,0 +1,132 @@
+/********************************************************
+ * Description : field and varint coding shared by the recorder and the snapshot diffs
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstring>
+#include "resource_codec.h"
+
+uint64_t double_bits(double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits);
+}
+
+double bits_double(uint64_t bits)
+{
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return (value);
+}
+
+void get_system_fields(const SystemResource & system_resource, uint64_t * fields)
+{
+    fields[0] = system_resource.cpu_count;
+    fields[1] = double_bits(system_resource.cpu_usage);
+    fields[2] = system_resource.ram_usage;
+    fields[3] = system_resource.ram_total;
+    fields[4] = system_resource.disk_usage;
+    fields[5] = system_resource.disk_total;
+    fields[6] = system_resource.gpu_count;
+    fields[7] = double_bits(system_resource.gpu_3d_usage);
+    fields[8] = double_bits(system_resource.gpu_vr_usage);
+    fields[9] = double_bits(system_resource.gpu_enc_usage);
+    fields[10] = double_bits(system_resource.gpu_dec_usage);
+    fields[11] = system_resource.gpu_mem_usage;
+    fields[12] = system_resource.gpu_mem_total;
+    fields[13] = system_resource.gpu_temperature;
+    fields[14] = system_resource.gpu_sm_clock;
+    fields[15] = system_resource.gpu_mem_clock;
+    fields[16] = system_resource.net_send_bytes;
+    fields[17] = system_resource.net_recv_bytes;
+}
+
+void set_system_fields(const uint64_t * fields, SystemResource & system_resource)
+{
+    system_resource.cpu_count = fields[0];
+    system_resource.cpu_usage = bits_double(fields[1]);
+    system_resource.ram_usage = fields[2];
+    system_resource.ram_total = fields[3];
+    system_resource.disk_usage = fields[4];
+    system_resource.disk_total = fields[5];
+    system_resource.gpu_count = fields[6];
+    system_resource.gpu_3d_usage = bits_double(fields[7]);
+    system_resource.gpu_vr_usage = bits_double(fields[8]);
+    system_resource.gpu_enc_usage = bits_double(fields[9]);
+    system_resource.gpu_dec_usage = bits_double(fields[10]);
+    system_resource.gpu_mem_usage = fields[11];
+    system_resource.gpu_mem_total = fields[12];
+    system_resource.gpu_temperature = fields[13];
+    system_resource.gpu_sm_clock = fields[14];
+    system_resource.gpu_mem_clock = fields[15];
+    system_resource.net_send_bytes = fields[16];
+    system_resource.net_recv_bytes = fields[17];
+}
+
+void get_process_fields(const ProcessResource & process_resource, uint64_t * fields)
+{
+    fields[0] = double_bits(process_resource.cpu_usage);
+    fields[1] = process_resource.ram_usage;
+    fields[2] = double_bits(process_resource.gpu_3d_usage);
+    fields[3] = double_bits(process_resource.gpu_vr_usage);
+    fields[4] = double_bits(process_resource.gpu_enc_usage);
+    fields[5] = double_bits(process_resource.gpu_dec_usage);
+    fields[6] = process_resource.gpu_mem_usage;
+    fields[7] = process_resource.minor_faults;
+    fields[8] = process_resource.major_faults;
+}
+
+void set_process_fields(const uint64_t * fields, ProcessResource & process_resource)
+{
+    process_resource.cpu_usage = bits_double(fields[0]);
+    process_resource.ram_usage = fields[1];
+    process_resource.gpu_3d_usage = bits_double(fields[2]);
+    process_resource.gpu_vr_usage = bits_double(fields[3]);
+    process_resource.gpu_enc_usage = bits_double(fields[4]);
+    process_resource.gpu_dec_usage = bits_double(fields[5]);
+    process_resource.gpu_mem_usage = fields[6];
+    process_resource.minor_faults = fields[7];
+    process_resource.major_faults = fields[8];
+}
+
+uint64_t zigzag_encode(int64_t value)
+{
+    return ((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+int64_t zigzag_decode(uint64_t value)
+{
+    return (static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+}
+
+std::size_t put_varint(uint64_t value, char * buffer)
+{
+    std::size_t size = 0;
+    while (value >= 0x80)
+    {
+        buffer[size++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer[size++] = static_cast<char>(value);
+    return (size);
+}
+
+bool get_varint(const char *& data, const char * data_end, uint64_t & value)
+{
+    value = 0;
+    for (uint32_t shift = 0; shift < 64 && data < data_end; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*data++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80))
+        {
+            return (true);
+        }
+    }
+    return (false);
+}
@@ -0,0 +1,353 @@
+/********************************************************
+ * Description : fixed memory sample history with windowed statistics
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "resource_history.h"
+
+#define HISTORY_BUCKET_MIN_EXPONENT     -15     /* values below 2^-16 count as zero */
+#define HISTORY_BUCKET_OCTAVE_COUNT     64
+#define HISTORY_BUCKET_OCTAVE_SPLIT     4
+
+/*
+ * a bucket spans an eighth of its octave's top, its middle is at most 12.5 percent off any value in it
+ */
+static uint32_t get_bucket_index(double value)
+{
+    if (!(value > 0.0))
+    {
+        return (0);
+    }
+
+    int exponent = 0;
+    double mantissa = frexp(value, &exponent);
+    int octave = exponent - HISTORY_BUCKET_MIN_EXPONENT;
+    if (octave < 0)
+    {
+        return (0);
+    }
+    if (octave >= HISTORY_BUCKET_OCTAVE_COUNT)
+    {
+        return (RESOURCE_HISTORY_BUCKET_COUNT - 1);
+    }
+
+    uint32_t split = static_cast<uint32_t>((mantissa - 0.5) * 2.0 * HISTORY_BUCKET_OCTAVE_SPLIT);
+    if (split >= HISTORY_BUCKET_OCTAVE_SPLIT)
+    {
+        split = HISTORY_BUCKET_OCTAVE_SPLIT - 1;
+    }
+
+    return (1 + static_cast<uint32_t>(octave) * HISTORY_BUCKET_OCTAVE_SPLIT + split);
+}
+
+static double get_bucket_value(uint32_t bucket_index)
+{
+    if (0 == bucket_index)
+    {
+        return (0.0);
+    }
+
+    uint32_t octave = (bucket_index - 1) / HISTORY_BUCKET_OCTAVE_SPLIT;
+    uint32_t split = (bucket_index - 1) % HISTORY_BUCKET_OCTAVE_SPLIT;
+
+    return (ldexp(0.5 + (split + 0.5) / (2.0 * HISTORY_BUCKET_OCTAVE_SPLIT), static_cast<int>(octave) + HISTORY_BUCKET_MIN_EXPONENT));
+}
+
+HistoryWindowMetric::HistoryWindowMetric()
+    : value_sum(0.0)
+    , bucket_counts()
+    , min_queue()
+    , min_front(0)
+    , min_count(0)
+    , max_queue()
+    , max_front(0)
+    , max_count(0)
+{
+    memset(bucket_counts, 0x0, sizeof(bucket_counts));
+}
+
+ResourceHistory::ResourceHistory()
+    : m_sample_capacity(0)
+    , m_window_count(0)
+    , m_window_ms()
+    , m_window_tail()
+    , m_sample_head(0)
+    , m_sample_times()
+    , m_sample_values()
+    , m_window_metrics()
+{
+    memset(m_window_ms, 0x0, sizeof(m_window_ms));
+    memset(m_window_tail, 0x0, sizeof(m_window_tail));
+}
+
+bool ResourceHistory::init(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count)
+{
+    if (0 == sample_capacity || nullptr == window_ms || 0 == window_count || window_count > RESOURCE_HISTORY_WINDOW_MAX)
+    {
+        return (false);
+    }
+
+    for (std::size_t window_index = 0; window_index < window_count; ++window_index)
+    {
+        if (0 == window_ms[window_index])
+        {
+            return (false);
+        }
+        m_window_ms[window_index] = window_ms[window_index];
+    }
+
+    m_sample_capacity = sample_capacity;
+    m_window_count = window_count;
+    m_sample_times.assign(sample_capacity, 0);
+    m_sample_values.assign(static_cast<std::size_t>(sample_capacity) * RESOURCE_METRIC_COUNT, 0.0);
+    m_window_metrics.resize(window_count * RESOURCE_METRIC_COUNT);
+    for (std::vector<HistoryWindowMetric>::iterator iter = m_window_metrics.begin(); m_window_metrics.end() != iter; ++iter)
+    {
+        iter->min_queue.assign(sample_capacity, 0);
+        iter->max_queue.assign(sample_capacity, 0);
+    }
+
+    clear();
+
+    return (true);
+}
+
+void ResourceHistory::clear()
+{
+    m_sample_head = 0;
+    memset(m_window_tail, 0x0, sizeof(m_window_tail));
+    for (std::vector<HistoryWindowMetric>::iterator iter = m_window_metrics.begin(); m_window_metrics.end() != iter; ++iter)
+    {
+        iter->value_sum = 0.0;
+        memset(iter->bucket_counts, 0x0, sizeof(iter->bucket_counts));
+        iter->min_front = 0;
+        iter->min_count = 0;
+        iter->max_front = 0;
+        iter->max_count = 0;
+    }
+}
+
+double ResourceHistory::sample_value(uint64_t sample_sequence, uint32_t metric_type) const
+{
+    return (m_sample_values[static_cast<std::size_t>(sample_sequence % m_sample_capacity) * RESOURCE_METRIC_COUNT + metric_type]);
+}
+
+void ResourceHistory::evict(std::size_t window_index)
+{
+    const uint64_t sample_sequence = m_window_tail[window_index];
+    const uint32_t sample_position = static_cast<uint32_t>(sample_sequence % m_sample_capacity);
+
+    for (uint32_t metric_type = 0; metric_type < RESOURCE_METRIC_COUNT; ++metric_type)
+    {
+        HistoryWindowMetric & window_metric = m_window_metrics[window_index * RESOURCE_METRIC_COUNT + metric_type];
+        const double value = sample_value(sample_sequence, metric_type);
+
+        window_metric.value_sum -= value;
+        --window_metric.bucket_counts[get_bucket_index(value)];
+
+        if (0 != window_metric.min_count && sample_position == window_metric.min_queue[window_metric.min_front])
+        {
+            window_metric.min_front = (window_metric.min_front + 1) % m_sample_capacity;
+            --window_metric.min_count;
+        }
+
+        if (0 != window_metric.max_count && sample_position == window_metric.max_queue[window_metric.max_front])
+        {
+            window_metric.max_front = (window_metric.max_front + 1) % m_sample_capacity;
+            --window_metric.max_count;
+        }
+
+        /* the running sum drifts with rounding, an empty window starts it over */
+        if (sample_sequence + 1 == m_sample_head)
+        {
+            window_metric.value_sum = 0.0;
+        }
+    }
+
+    ++m_window_tail[window_index];
+}
+
+void ResourceHistory::append(uint64_t sample_time, const double * metric_values)
+{
+    if (0 == m_sample_capacity)
+    {
+        return;
+    }
+
+    /* the slot about to be overwritten leaves every window which still holds it */
+    if (m_sample_head >= m_sample_capacity)
+    {
+        const uint64_t oldest_sequence = m_sample_head - m_sample_capacity;
+        for (std::size_t window_index = 0; window_index < m_window_count; ++window_index)
+        {
+            if (oldest_sequence == m_window_tail[window_index])
+            {
+                evict(window_index);
+            }
+        }
+    }
+
+    const uint32_t sample_position = static_cast<uint32_t>(m_sample_head % m_sample_capacity);
+    m_sample_times[sample_position] = sample_time;
+    memcpy(&m_sample_values[static_cast<std::size_t>(sample_position) * RESOURCE_METRIC_COUNT], metric_values, sizeof(double) * RESOURCE_METRIC_COUNT);
+
+    for (std::size_t window_index = 0; window_index < m_window_count; ++window_index)
+    {
+        for (uint32_t metric_type = 0; metric_type < RESOURCE_METRIC_COUNT; ++metric_type)
+        {
+            HistoryWindowMetric & window_metric = m_window_metrics[window_index * RESOURCE_METRIC_COUNT + metric_type];
+            const double value = metric_values[metric_type];
+
+            window_metric.value_sum += value;
+            ++window_metric.bucket_counts[get_bucket_index(value)];
+
+            /* a sample which can never be the min (max) again while this one stays leaves the queue */
+            while (0 != window_metric.min_count && value <= sample_value(window_metric.min_queue[(window_metric.min_front + window_metric.min_count - 1) % m_sample_capacity], metric_type))
+            {
+                --window_metric.min_count;
+            }
+            window_metric.min_queue[(window_metric.min_front + window_metric.min_count) % m_sample_capacity] = sample_position;
+            ++window_metric.min_count;
+
+            while (0 != window_metric.max_count && value >= sample_value(window_metric.max_queue[(window_metric.max_front + window_metric.max_count - 1) % m_sample_capacity], metric_type))
+            {
+                --window_metric.max_count;
+            }
+            window_metric.max_queue[(window_metric.max_front + window_metric.max_count) % m_sample_capacity] = sample_position;
+            ++window_metric.max_count;
+        }
+    }
+
+    ++m_sample_head;
+
+    for (std::size_t window_index = 0; window_index < m_window_count; ++window_index)
+    {
+        while (m_window_tail[window_index] < m_sample_head)
+        {
+            const uint64_t tail_time = m_sample_times[static_cast<std::size_t>(m_window_tail[window_index] % m_sample_capacity)];
+            if (sample_time < tail_time + m_window_ms[window_index])
+            {
+                break;
+            }
+            evict(window_index);
+        }
+    }
+}
+
+bool ResourceHistory::get_statistics(ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics) const
+{
+    memset(&resource_statistics, 0x0, sizeof(resource_statistics));
+
+    if (metric_type < 0 || metric_type >= RESOURCE_METRIC_COUNT || window_index >= m_window_count)
+    {
+        return (false);
+    }
+
+    const uint64_t sample_count = m_sample_head - m_window_tail[window_index];
+    if (0 == sample_count)
+    {
+        return (false);
+    }
+
+    const HistoryWindowMetric & window_metric = m_window_metrics[window_index * RESOURCE_METRIC_COUNT + metric_type];
+    resource_statistics.sample_count = sample_count;
+    resource_statistics.min_value = sample_value(window_metric.min_queue[window_metric.min_front], metric_type);
+    resource_statistics.max_value = sample_value(window_metric.max_queue[window_metric.max_front], metric_type);
+    resource_statistics.mean_value = std::min(std::max(window_metric.value_sum / sample_count, resource_statistics.min_value), resource_statistics.max_value);
+
+    const uint64_t p95_rank = (sample_count * 95 + 99) / 100;
+    const uint64_t p99_rank = (sample_count * 99 + 99) / 100;
+    uint64_t rank = 0;
+    bool p95_found = false;
+    for (uint32_t bucket_index = 0; bucket_index < RESOURCE_HISTORY_BUCKET_COUNT; ++bucket_index)
+    {
+        rank += window_metric.bucket_counts[bucket_index];
+        if (!p95_found && rank >= p95_rank)
+        {
+            resource_statistics.p95_value = std::min(std::max(get_bucket_value(bucket_index), resource_statistics.min_value), resource_statistics.max_value);
+            p95_found = true;
+        }
+        if (rank >= p99_rank)
+        {
+            resource_statistics.p99_value = std::min(std::max(get_bucket_value(bucket_index), resource_statistics.min_value), resource_statistics.max_value);
+            break;
+        }
+    }
+
+    return (true);
+}
+
+ResourceHistoryPool::ResourceHistoryPool()
+    : m_sample_capacity(0)
+    , m_window_ms()
+    , m_history_list()
+    , m_free_list()
+{
+
+}
+
+bool ResourceHistoryPool::reset(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count)
+{
+    m_free_list.clear();
+    m_history_list.clear();
+    m_window_ms.clear();
+    m_sample_capacity = 0;
+
+    if (0 == sample_capacity)
+    {
+        return (true);
+    }
+
+    ResourceHistory resource_history;
+    if (!resource_history.init(sample_capacity, window_ms, window_count))
+    {
+        return (false);
+    }
+
+    m_sample_capacity = sample_capacity;
+    m_window_ms.assign(window_ms, window_ms + window_count);
+
+    return (true);
+}
+
+bool ResourceHistoryPool::enabled() const
+{
+    return (0 != m_sample_capacity);
+}
+
+ResourceHistory * ResourceHistoryPool::acquire()
+{
+    if (!enabled())
+    {
+        return (nullptr);
+    }
+
+    if (!m_free_list.empty())
+    {
+        ResourceHistory * resource_history = m_free_list.back();
+        m_free_list.pop_back();
+        resource_history->clear();
+        return (resource_history);
+    }
+
+    m_history_list.emplace_back();
+    ResourceHistory & resource_history = m_history_list.back();
+    resource_history.init(m_sample_capacity, &m_window_ms[0], m_window_ms.size());
+
+    return (&resource_history);
+}
+
+void ResourceHistoryPool::release(ResourceHistory * resource_history)
+{
+    if (nullptr != resource_history)
+    {
+        m_free_list.push_back(resource_history);
+    }
+}
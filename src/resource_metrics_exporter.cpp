@@ -0,0 +1,488 @@
+/********************************************************
+ * Description : openmetrics text exporter of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "resource_socket.h"
+#include <list>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include "resource_metrics_exporter.h"
+#include "log/log.h"
+
+#define METRICS_CLIENT_MAX              64
+#define METRICS_CLIENT_TIMEOUT_MS       5000
+#define METRICS_REQUEST_MAX             8192
+#define METRICS_POLL_INTERVAL_MS        100
+#define METRICS_CONTENT_TYPE            "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+struct MetricsField
+{
+    const char                            * metric_name;
+    const char                            * metric_help;
+    std::size_t                             field_offset;
+    bool                                    field_double;         /* double, otherwise uint64_t */
+};
+
+static const MetricsField s_system_fields[] =
+{
+    { "resource_monitor_system_cpu_count",                         "logical processors",                              offsetof(SystemResource, cpu_count),       false },
+    { "resource_monitor_system_cpu_usage_percent",                 "cpu usage of the system",                         offsetof(SystemResource, cpu_usage),       true  },
+    { "resource_monitor_system_ram_usage_bytes",                   "memory in use",                                   offsetof(SystemResource, ram_usage),       false },
+    { "resource_monitor_system_ram_total_bytes",                   "memory installed",                                offsetof(SystemResource, ram_total),       false },
+    { "resource_monitor_system_disk_usage_bytes",                  "disk space in use",                               offsetof(SystemResource, disk_usage),      false },
+    { "resource_monitor_system_disk_total_bytes",                  "disk space",                                      offsetof(SystemResource, disk_total),      false },
+    { "resource_monitor_system_gpu_count",                         "graphics cards",                                  offsetof(SystemResource, gpu_count),       false },
+    { "resource_monitor_system_gpu_3d_usage_percent",              "3d engine usage of the graphics cards",           offsetof(SystemResource, gpu_3d_usage),    true  },
+    { "resource_monitor_system_gpu_vr_usage_percent",              "vr engine usage of the graphics cards",           offsetof(SystemResource, gpu_vr_usage),    true  },
+    { "resource_monitor_system_gpu_enc_usage_percent",             "encoder usage of the graphics cards",             offsetof(SystemResource, gpu_enc_usage),   true  },
+    { "resource_monitor_system_gpu_dec_usage_percent",             "decoder usage of the graphics cards",             offsetof(SystemResource, gpu_dec_usage),   true  },
+    { "resource_monitor_system_gpu_mem_usage_bytes",               "graphics memory in use",                          offsetof(SystemResource, gpu_mem_usage),   false },
+    { "resource_monitor_system_gpu_mem_total_bytes",               "graphics memory",                                 offsetof(SystemResource, gpu_mem_total),   false },
+    { "resource_monitor_system_gpu_temperature_celsius",           "hottest graphics card",                           offsetof(SystemResource, gpu_temperature), false },
+    { "resource_monitor_system_gpu_sm_clock_mhz",                  "average sm clock of the graphics cards",          offsetof(SystemResource, gpu_sm_clock),    false },
+    { "resource_monitor_system_gpu_mem_clock_mhz",                 "average memory clock of the graphics cards",      offsetof(SystemResource, gpu_mem_clock),   false },
+    { "resource_monitor_system_net_send_bytes_per_second",         "bytes sent by the network interfaces",            offsetof(SystemResource, net_send_bytes),  false },
+    { "resource_monitor_system_net_recv_bytes_per_second",         "bytes received by the network interfaces",        offsetof(SystemResource, net_recv_bytes),  false },
+};
+
+static const MetricsField s_card_fields[] =
+{
+    { "resource_monitor_gpu_3d_usage_percent",                     "3d engine usage of the graphics card",            offsetof(GraphicsCardResource, gpu_3d_usage),    true  },
+    { "resource_monitor_gpu_enc_usage_percent",                    "encoder usage of the graphics card",              offsetof(GraphicsCardResource, gpu_enc_usage),   true  },
+    { "resource_monitor_gpu_dec_usage_percent",                    "decoder usage of the graphics card",              offsetof(GraphicsCardResource, gpu_dec_usage),   true  },
+    { "resource_monitor_gpu_mem_usage_bytes",                      "graphics memory in use",                          offsetof(GraphicsCardResource, gpu_mem_usage),   false },
+    { "resource_monitor_gpu_mem_total_bytes",                      "graphics memory",                                 offsetof(GraphicsCardResource, gpu_mem_total),   false },
+    { "resource_monitor_gpu_temperature_celsius",                  "temperature of the graphics card",                offsetof(GraphicsCardResource, gpu_temperature), false },
+    { "resource_monitor_gpu_sm_clock_mhz",                         "sm clock of the graphics card",                   offsetof(GraphicsCardResource, gpu_sm_clock),    false },
+    { "resource_monitor_gpu_mem_clock_mhz",                        "memory clock of the graphics card",               offsetof(GraphicsCardResource, gpu_mem_clock),   false },
+};
+
+static const MetricsField s_process_fields[] =
+{
+    { "resource_monitor_process_cpu_usage_percent",                "cpu usage of the process (and its sub processes)",  offsetof(ProcessResource, cpu_usage),      true  },
+    { "resource_monitor_process_ram_usage_bytes",                  "memory of the process (and its sub processes)",     offsetof(ProcessResource, ram_usage),      false },
+    { "resource_monitor_process_gpu_3d_usage_percent",             "3d engine usage of the process",                    offsetof(ProcessResource, gpu_3d_usage),   true  },
+    { "resource_monitor_process_gpu_vr_usage_percent",             "vr engine usage of the process",                    offsetof(ProcessResource, gpu_vr_usage),   true  },
+    { "resource_monitor_process_gpu_enc_usage_percent",            "encoder usage of the process",                      offsetof(ProcessResource, gpu_enc_usage),  true  },
+    { "resource_monitor_process_gpu_dec_usage_percent",            "decoder usage of the process",                      offsetof(ProcessResource, gpu_dec_usage),  true  },
+    { "resource_monitor_process_gpu_mem_usage_bytes",              "graphics memory of the process",                    offsetof(ProcessResource, gpu_mem_usage),  false },
+    { "resource_monitor_process_minor_faults_per_second",          "page faults of the process served from memory",     offsetof(ProcessResource, minor_faults),   false },
+    { "resource_monitor_process_major_faults_per_second",          "page faults of the process that read from disk",    offsetof(ProcessResource, major_faults),   false },
+};
+
+struct MetricsClient
+{
+    socket_t                                client_socket;
+    uint64_t                                accept_time;
+    std::string                             request;
+    std::shared_ptr<const std::string>      response;             /* nullptr while the request is read */
+    std::size_t                             response_offset;
+
+    MetricsClient();
+};
+
+struct MetricsServer
+{
+    std::string                             listen_address;
+    socket_t                                listen_socket;
+    std::list<MetricsClient>                client_list;
+    std::vector<struct pollfd>              poll_fds;
+
+    MetricsServer();
+};
+
+MetricsClient::MetricsClient()
+    : client_socket(BAD_SOCKET)
+    , accept_time(0)
+    , request()
+    , response()
+    , response_offset(0)
+{
+
+}
+
+MetricsServer::MetricsServer()
+    : listen_address()
+    , listen_socket(BAD_SOCKET)
+    , client_list()
+    , poll_fds()
+{
+
+}
+
+static uint64_t metrics_milliseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+static void append_metric_family(std::string & metrics_text, const MetricsField & metrics_field)
+{
+    metrics_text += "# TYPE ";
+    metrics_text += metrics_field.metric_name;
+    metrics_text += " gauge\n# HELP ";
+    metrics_text += metrics_field.metric_name;
+    metrics_text += " ";
+    metrics_text += metrics_field.metric_help;
+    metrics_text += "\n";
+}
+
+static void append_metric_value(std::string & metrics_text, const MetricsField & metrics_field, const char * metric_labels, const void * resource)
+{
+    const char * field = reinterpret_cast<const char *>(resource) + metrics_field.field_offset;
+
+    char value_text[64] = { 0x0 };
+    if (metrics_field.field_double)
+    {
+        double value = 0.0;
+        memcpy(&value, field, sizeof(value));
+        if (std::isnan(value))
+        {
+            snprintf(value_text, sizeof(value_text), "NaN");
+        }
+        else if (std::isinf(value))
+        {
+            snprintf(value_text, sizeof(value_text), "%cInf", value > 0.0 ? '+' : '-');
+        }
+        else
+        {
+            snprintf(value_text, sizeof(value_text), "%.10g", value);
+        }
+    }
+    else
+    {
+        uint64_t value = 0;
+        memcpy(&value, field, sizeof(value));
+        snprintf(value_text, sizeof(value_text), "%llu", static_cast<unsigned long long>(value));
+    }
+
+    metrics_text += metrics_field.metric_name;
+    metrics_text += metric_labels;
+    metrics_text += " ";
+    metrics_text += value_text;
+    metrics_text += "\n";
+}
+
+/*
+ * label values escape backslash, double quote and line feed
+ */
+static void append_label_value(std::string & metric_labels, const char * label_value)
+{
+    for (const char * character = label_value; 0x0 != *character; ++character)
+    {
+        switch (*character)
+        {
+            case '\\':
+                metric_labels += "\\\\";
+                break;
+            case '"':
+                metric_labels += "\\\"";
+                break;
+            case '\n':
+                metric_labels += "\\n";
+                break;
+            default:
+                metric_labels += *character;
+                break;
+        }
+    }
+}
+
+void format_metrics_text(uint64_t sample_sequence, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources, const std::vector<std::pair<uint32_t, ProcessResource>> & process_resources, std::string & metrics_text)
+{
+    metrics_text.clear();
+
+    char sequence_text[64] = { 0x0 };
+    snprintf(sequence_text, sizeof(sequence_text), "resource_monitor_sample_sequence %llu\n", static_cast<unsigned long long>(sample_sequence));
+    metrics_text += "# TYPE resource_monitor_sample_sequence gauge\n# HELP resource_monitor_sample_sequence sequence of the snapshot these values come from\n";
+    metrics_text += sequence_text;
+
+    for (std::size_t field_index = 0; field_index < sizeof(s_system_fields) / sizeof(s_system_fields[0]); ++field_index)
+    {
+        append_metric_family(metrics_text, s_system_fields[field_index]);
+        append_metric_value(metrics_text, s_system_fields[field_index], "", &system_resource);
+    }
+
+    /* openmetrics wants the samples of a family together, so every family walks all the cards or processes */
+    std::vector<std::string> card_labels(graphics_card_resources.size());
+    for (std::size_t card_index = 0; card_index < graphics_card_resources.size(); ++card_index)
+    {
+        char gpu_label[32] = { 0x0 };
+        snprintf(gpu_label, sizeof(gpu_label), "{gpu=\"%u\",name=\"", static_cast<uint32_t>(card_index));
+        std::string & metric_labels = card_labels[card_index];
+        metric_labels = gpu_label;
+        append_label_value(metric_labels, graphics_card_resources[card_index].gpu_name);
+        metric_labels += "\"}";
+    }
+    for (std::size_t field_index = 0; !graphics_card_resources.empty() && field_index < sizeof(s_card_fields) / sizeof(s_card_fields[0]); ++field_index)
+    {
+        append_metric_family(metrics_text, s_card_fields[field_index]);
+        for (std::size_t card_index = 0; card_index < graphics_card_resources.size(); ++card_index)
+        {
+            append_metric_value(metrics_text, s_card_fields[field_index], card_labels[card_index].c_str(), &graphics_card_resources[card_index]);
+        }
+    }
+
+    for (std::size_t field_index = 0; !process_resources.empty() && field_index < sizeof(s_process_fields) / sizeof(s_process_fields[0]); ++field_index)
+    {
+        append_metric_family(metrics_text, s_process_fields[field_index]);
+        for (std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter = process_resources.begin(); process_resources.end() != iter; ++iter)
+        {
+            char pid_label[32] = { 0x0 };
+            snprintf(pid_label, sizeof(pid_label), "{pid=\"%u\"}", iter->first);
+            append_metric_value(metrics_text, s_process_fields[field_index], pid_label, &iter->second);
+        }
+    }
+
+    metrics_text += "# EOF\n";
+}
+
+static std::shared_ptr<const std::string> make_http_response(const char * status_line, const char * content_type, const std::string & content)
+{
+    char response_header[256] = { 0x0 };
+    snprintf(response_header, sizeof(response_header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %llu\r\nConnection: close\r\n\r\n", status_line, content_type, static_cast<unsigned long long>(content.size()));
+
+    std::shared_ptr<std::string> response = std::make_shared<std::string>();
+    response->reserve(strlen(response_header) + content.size());
+    response->append(response_header);
+    response->append(content);
+
+    return (response);
+}
+
+ResourceMetricsExporter::ResourceMetricsExporter()
+    : m_metrics_server(nullptr)
+    , m_metrics_render()
+    , m_running(false)
+    , m_server_thread()
+    , m_sample_sequence(0)
+    , m_metrics_text()
+    , m_metrics_response()
+    , m_not_found_response()
+    , m_bad_request_response()
+{
+
+}
+
+ResourceMetricsExporter::~ResourceMetricsExporter()
+{
+    stop();
+}
+
+bool ResourceMetricsExporter::start(const std::string & listen_address, const metrics_render_t & metrics_render)
+{
+    stop();
+
+    if (listen_address.empty() || !metrics_render)
+    {
+        return (false);
+    }
+
+    do
+    {
+        m_metrics_server = new MetricsServer;
+        if (nullptr == m_metrics_server)
+        {
+            break;
+        }
+
+        m_metrics_server->listen_address = listen_address;
+        m_metrics_server->listen_socket = open_listen_socket(listen_address);
+        if (BAD_SOCKET == m_metrics_server->listen_socket)
+        {
+            break;
+        }
+
+        m_metrics_render = metrics_render;
+        m_sample_sequence = 0;
+        m_metrics_text.clear();
+        m_metrics_response = make_http_response("503 Service Unavailable", "text/plain", "no snapshot yet\n");
+        m_not_found_response = make_http_response("404 Not Found", "text/plain", "only /metrics is served\n");
+        m_bad_request_response = make_http_response("400 Bad Request", "text/plain", "only GET is served\n");
+
+        m_running = true;
+        m_server_thread = std::thread(&ResourceMetricsExporter::server_thread, this);
+
+        RUN_LOG_DBG("metrics exporter start on (%s) success", listen_address.c_str());
+
+        return (true);
+    } while (false);
+
+    RUN_LOG_ERR("metrics exporter start on (%s) failure", listen_address.c_str());
+
+    stop();
+
+    return (false);
+}
+
+void ResourceMetricsExporter::stop()
+{
+    m_running = false;
+    if (m_server_thread.joinable())
+    {
+        m_server_thread.join();
+    }
+
+    if (nullptr != m_metrics_server)
+    {
+        for (std::list<MetricsClient>::iterator iter = m_metrics_server->client_list.begin(); m_metrics_server->client_list.end() != iter; ++iter)
+        {
+            close_socket(iter->client_socket);
+        }
+        close_listen_socket(m_metrics_server->listen_socket, m_metrics_server->listen_address);
+        delete m_metrics_server;
+        m_metrics_server = nullptr;
+    }
+
+    m_metrics_render = nullptr;
+    m_metrics_text.clear();
+    m_metrics_response.reset();
+    m_not_found_response.reset();
+    m_bad_request_response.reset();
+}
+
+bool ResourceMetricsExporter::started() const
+{
+    return (nullptr != m_metrics_server);
+}
+
+std::shared_ptr<const std::string> ResourceMetricsExporter::get_response(const std::string & request)
+{
+    /* request line: GET /metrics[?query] HTTP/1.x */
+    if (0 != request.compare(0, 4, "GET "))
+    {
+        return (m_bad_request_response);
+    }
+
+    std::string::size_type path_end = request.find_first_of(" ?\r\n", 4);
+    const std::string request_path = request.substr(4, std::string::npos == path_end ? std::string::npos : path_end - 4);
+    if ("/metrics" != request_path && "/" != request_path)
+    {
+        return (m_not_found_response);
+    }
+
+    if (m_metrics_render(m_sample_sequence, m_metrics_text))
+    {
+        m_metrics_response = make_http_response("200 OK", METRICS_CONTENT_TYPE, m_metrics_text);
+    }
+
+    return (m_metrics_response);
+}
+
+void ResourceMetricsExporter::server_thread()
+{
+    MetricsServer & metrics_server = *m_metrics_server;
+    std::list<MetricsClient> & client_list = metrics_server.client_list;
+    std::vector<struct pollfd> & poll_fds = metrics_server.poll_fds;
+
+    while (m_running)
+    {
+        poll_fds.resize(1 + client_list.size());
+        poll_fds[0].fd = metrics_server.listen_socket;
+        poll_fds[0].events = POLLIN;
+        poll_fds[0].revents = 0;
+        std::size_t poll_index = 1;
+        for (std::list<MetricsClient>::iterator iter = client_list.begin(); client_list.end() != iter; ++iter, ++poll_index)
+        {
+            poll_fds[poll_index].fd = iter->client_socket;
+            poll_fds[poll_index].events = (iter->response ? POLLOUT : POLLIN);
+            poll_fds[poll_index].revents = 0;
+        }
+
+        if (poll_sockets(&poll_fds[0], poll_fds.size(), METRICS_POLL_INTERVAL_MS) < 0)
+        {
+            continue;
+        }
+
+        const uint64_t current_time = metrics_milliseconds();
+
+        /* clients first, the poll results follow the list order */
+        poll_index = 1;
+        std::list<MetricsClient>::iterator iter = client_list.begin();
+        while (client_list.end() != iter)
+        {
+            MetricsClient & metrics_client = *iter;
+            const short revents = poll_fds[poll_index++].revents;
+            bool client_done = (current_time >= metrics_client.accept_time + METRICS_CLIENT_TIMEOUT_MS);
+
+            if (!client_done && 0 != (revents & (POLLERR | POLLHUP | POLLNVAL)) && !metrics_client.response)
+            {
+                client_done = true;
+            }
+            else if (!client_done && 0 != (revents & POLLIN) && !metrics_client.response)
+            {
+                char request_buffer[2048];
+                int read_size = recv(metrics_client.client_socket, request_buffer, sizeof(request_buffer), 0);
+                if (read_size > 0)
+                {
+                    metrics_client.request.append(request_buffer, read_size);
+                    if (std::string::npos != metrics_client.request.find("\r\n\r\n") || std::string::npos != metrics_client.request.find("\n\n"))
+                    {
+                        metrics_client.response = get_response(metrics_client.request);
+                        metrics_client.response_offset = 0;
+                    }
+                    else if (metrics_client.request.size() > METRICS_REQUEST_MAX)
+                    {
+                        client_done = true;
+                    }
+                }
+                else if (0 == read_size || !socket_would_block())
+                {
+                    client_done = true;
+                }
+            }
+            else if (!client_done && 0 != (revents & (POLLOUT | POLLERR | POLLHUP)) && metrics_client.response)
+            {
+                const std::string & response = *metrics_client.response;
+                int send_size = send(metrics_client.client_socket, response.data() + metrics_client.response_offset, static_cast<int>(response.size() - metrics_client.response_offset), SOCKET_SEND_FLAGS);
+                if (send_size > 0)
+                {
+                    metrics_client.response_offset += send_size;
+                    client_done = (metrics_client.response_offset >= response.size());
+                }
+                else if (!socket_would_block())
+                {
+                    client_done = true;
+                }
+            }
+
+            if (client_done)
+            {
+                close_socket(metrics_client.client_socket);
+                client_list.erase(iter++);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        if (0 != (poll_fds[0].revents & POLLIN))
+        {
+            while (true)
+            {
+                socket_t client_socket = accept_client_socket(metrics_server.listen_socket);
+                if (BAD_SOCKET == client_socket)
+                {
+                    break;
+                }
+                if (client_list.size() >= METRICS_CLIENT_MAX)
+                {
+                    RUN_LOG_WAR("metrics exporter drops a scrape while (%u) scrapes are in flight", static_cast<uint32_t>(client_list.size()));
+                    close_socket(client_socket);
+                    continue;
+                }
+                client_list.push_back(MetricsClient());
+                client_list.back().client_socket = client_socket;
+                client_list.back().accept_time = current_time;
+            }
+        }
+    }
+}
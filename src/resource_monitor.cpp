@@ -7,11 +7,15 @@
  * Copyright(C): 2021-2022
  ********************************************************/
 
+#include <cstring>
 #include "resource_monitor.h"
-#include "resource_monitor_impl.h"
+#include "resource_monitor_client.h"
+#include "resource_recorder.h"
+#include "resource_shared_memory.h"
+#include "resource_snapshot_diff.h"
 
 ResourceMonitor::ResourceMonitor()
-    : m_resource_monitor_impl(nullptr)
+    : m_resource_monitor_client(nullptr)
 {
 
 }
@@ -23,17 +27,18 @@ ResourceMonitor::~ResourceMonitor()
 
 bool ResourceMonitor::init()
 {
+#ifdef _MSC_VER
     exit();
 
     do
     {
-        m_resource_monitor_impl = new ResourceMonitorImpl;
-        if (nullptr == m_resource_monitor_impl)
+        m_resource_monitor_client = new ResourceMonitorClient;
+        if (nullptr == m_resource_monitor_client)
         {
             break;
         }
 
-        if (!m_resource_monitor_impl->init())
+        if (!m_resource_monitor_client->init())
         {
             break;
         }
@@ -44,39 +49,319 @@ bool ResourceMonitor::init()
     exit();
 
     return (false);
+#else
+    return (init("/proc", "/sys"));
+#endif // _MSC_VER
 }
 
+#ifndef _MSC_VER
+bool ResourceMonitor::init(const std::string & proc_root, const std::string & sys_root)
+{
+    exit();
+
+    do
+    {
+        m_resource_monitor_client = new ResourceMonitorClient;
+        if (nullptr == m_resource_monitor_client)
+        {
+            break;
+        }
+
+        if (!m_resource_monitor_client->init(proc_root, sys_root))
+        {
+            break;
+        }
+
+        return (true);
+    } while (false);
+
+    exit();
+
+    return (false);
+}
+#endif // _MSC_VER
+
 void ResourceMonitor::exit()
 {
-    if (nullptr != m_resource_monitor_impl)
+    if (nullptr != m_resource_monitor_client)
     {
-        m_resource_monitor_impl->exit();
-        delete m_resource_monitor_impl;
-        m_resource_monitor_impl = nullptr;
+        m_resource_monitor_client->exit();
+        delete m_resource_monitor_client;
+        m_resource_monitor_client = nullptr;
     }
 }
 
 bool ResourceMonitor::append_process(uint32_t process_id, bool process_tree)
 {
-    return (nullptr != m_resource_monitor_impl && m_resource_monitor_impl->append_process(process_id, process_tree));
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->append_process(process_id, process_tree));
 }
 
 bool ResourceMonitor::remove_process(uint32_t process_id)
 {
-    return (nullptr != m_resource_monitor_impl && m_resource_monitor_impl->remove_process(process_id));
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->remove_process(process_id));
+}
+
+bool ResourceMonitor::set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->set_process_exit_callback(process_exit_callback));
+}
+
+bool ResourceMonitor::set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->set_collector_interval(collector_type, interval_ms));
+}
+
+bool ResourceMonitor::set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->set_collector_adaptive(collector_type, min_interval_ms, max_interval_ms, change_threshold));
+}
+
+bool ResourceMonitor::get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_collector_interval(collector_type, interval_ms));
+}
+
+bool ResourceMonitor::subscribe_threshold(const ResourceThreshold & threshold, const std::function<void (uint32_t subscription_id, const ResourceThreshold & threshold, bool raised, double value)> & threshold_callback, uint32_t & subscription_id)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->subscribe_threshold(threshold, threshold_callback, subscription_id));
+}
+
+bool ResourceMonitor::unsubscribe_threshold(uint32_t subscription_id)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->unsubscribe_threshold(subscription_id));
+}
+
+bool ResourceMonitor::set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->set_history(sample_capacity, window_ms, window_count));
+}
+
+bool ResourceMonitor::get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_resource_statistics(process_id, metric_type, window_index, resource_statistics));
+}
+
+bool ResourceMonitor::start_recorder(const std::string & file_path)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->start_recorder(file_path));
+}
+
+bool ResourceMonitor::stop_recorder()
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->stop_recorder());
+}
+
+bool ResourceMonitor::start_shared_export(const std::string & segment_name, uint32_t process_capacity)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->start_shared_export(segment_name, process_capacity));
+}
+
+bool ResourceMonitor::stop_shared_export()
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->stop_shared_export());
+}
+
+bool ResourceMonitor::start_metrics_exporter(const std::string & listen_address)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->start_metrics_exporter(listen_address));
+}
+
+bool ResourceMonitor::stop_metrics_exporter()
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->stop_metrics_exporter());
+}
+
+bool ResourceMonitor::start_stream_exporter(const std::string & listen_address, uint32_t client_backlog)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->start_stream_exporter(listen_address, client_backlog));
+}
+
+bool ResourceMonitor::stop_stream_exporter()
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->stop_stream_exporter());
+}
+
+bool ResourceMonitor::set_snapshot_retention(uint32_t snapshot_count)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->set_snapshot_retention(snapshot_count));
 }
 
 bool ResourceMonitor::get_process_resource(uint32_t process_id, ProcessResource & process_resource)
 {
-    return (nullptr != m_resource_monitor_impl && m_resource_monitor_impl->get_process_resource(process_id, process_resource));
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_process_resource(process_id, process_resource));
+}
+
+bool ResourceMonitor::get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_process_resources(process_ids, process_count, process_resources, process_statuses));
+}
+
+bool ResourceMonitor::get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_all_process_resources(process_resources));
 }
 
 bool ResourceMonitor::get_system_resource(SystemResource & system_resource)
 {
-    return (nullptr != m_resource_monitor_impl && m_resource_monitor_impl->get_system_resource(system_resource));
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_system_resource(system_resource));
 }
 
 bool ResourceMonitor::get_graphics_cards(std::list<std::string> & graphics_card_names)
 {
-    return (nullptr != m_resource_monitor_impl && m_resource_monitor_impl->get_graphics_cards(graphics_card_names));
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_graphics_cards(graphics_card_names));
+}
+
+bool ResourceMonitor::get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_graphics_card_resources(graphics_card_resources));
+}
+
+bool ResourceMonitor::wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->wait_for_sample(last_sequence, timeout_ms, sample_sequence));
+}
+
+bool ResourceMonitor::get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, std::string & snapshot_diff)
+{
+    return (nullptr != m_resource_monitor_client && m_resource_monitor_client->get_snapshot_diff(base_sequence, target_sequence, snapshot_diff));
+}
+
+ResourceSnapshot::ResourceSnapshot()
+    : sample_sequence(0)
+    , system_resource()
+    , process_resources()
+{
+    memset(&system_resource, 0x0, sizeof(system_resource));
+}
+
+bool apply_snapshot_diff(const std::string & snapshot_diff, ResourceSnapshot & resource_snapshot)
+{
+    return (decode_snapshot_diff(snapshot_diff, resource_snapshot));
+}
+
+ResourceSharedReader::ResourceSharedReader()
+    : m_shared_reader_impl(nullptr)
+{
+
+}
+
+ResourceSharedReader::~ResourceSharedReader()
+{
+    close();
+}
+
+bool ResourceSharedReader::open(const std::string & segment_name)
+{
+    close();
+
+    do
+    {
+        m_shared_reader_impl = new SharedSnapshotReaderImpl;
+        if (nullptr == m_shared_reader_impl)
+        {
+            break;
+        }
+
+        if (!m_shared_reader_impl->open(segment_name))
+        {
+            break;
+        }
+
+        return (true);
+    } while (false);
+
+    close();
+
+    return (false);
+}
+
+void ResourceSharedReader::close()
+{
+    if (nullptr != m_shared_reader_impl)
+    {
+        m_shared_reader_impl->close();
+        delete m_shared_reader_impl;
+        m_shared_reader_impl = nullptr;
+    }
+}
+
+bool ResourceSharedReader::get_process_resource(uint32_t process_id, ProcessResource & process_resource)
+{
+    return (nullptr != m_shared_reader_impl && m_shared_reader_impl->get_process_resource(process_id, process_resource));
+}
+
+bool ResourceSharedReader::get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources)
+{
+    return (nullptr != m_shared_reader_impl && m_shared_reader_impl->get_all_process_resources(process_resources));
+}
+
+bool ResourceSharedReader::get_system_resource(SystemResource & system_resource)
+{
+    return (nullptr != m_shared_reader_impl && m_shared_reader_impl->get_system_resource(system_resource));
+}
+
+bool ResourceSharedReader::get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    return (nullptr != m_shared_reader_impl && m_shared_reader_impl->get_graphics_card_resources(graphics_card_resources));
+}
+
+ResourceRecordReader::ResourceRecordReader()
+    : m_record_reader_impl(nullptr)
+{
+
+}
+
+ResourceRecordReader::~ResourceRecordReader()
+{
+    close();
+}
+
+bool ResourceRecordReader::open(const std::string & file_path)
+{
+    close();
+
+    do
+    {
+        m_record_reader_impl = new ResourceRecordReaderImpl;
+        if (nullptr == m_record_reader_impl)
+        {
+            break;
+        }
+
+        if (!m_record_reader_impl->open(file_path))
+        {
+            break;
+        }
+
+        return (true);
+    } while (false);
+
+    close();
+
+    return (false);
+}
+
+void ResourceRecordReader::close()
+{
+    if (nullptr != m_record_reader_impl)
+    {
+        m_record_reader_impl->close();
+        delete m_record_reader_impl;
+        m_record_reader_impl = nullptr;
+    }
+}
+
+bool ResourceRecordReader::get_recorded_processes(std::vector<uint32_t> & process_ids)
+{
+    return (nullptr != m_record_reader_impl && m_record_reader_impl->get_recorded_processes(process_ids));
+}
+
+bool ResourceRecordReader::read_system_resources(uint64_t begin_time, uint64_t end_time, std::vector<SystemResource> & system_resources)
+{
+    return (nullptr != m_record_reader_impl && m_record_reader_impl->read_system_resources(begin_time, end_time, system_resources));
+}
+
+bool ResourceRecordReader::read_process_resources(uint32_t process_id, uint64_t begin_time, uint64_t end_time, std::vector<ProcessResource> & process_resources)
+{
+    return (nullptr != m_record_reader_impl && m_record_reader_impl->read_process_resources(process_id, begin_time, end_time, process_resources));
 }
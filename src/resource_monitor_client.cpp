@@ -0,0 +1,600 @@
+/********************************************************
+ * Description : resource monitor client of the shared collector engine
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include "resource_monitor_client.h"
+#include "log/log.h"
+
+/*
+ * lock order: engine dispatch_mutex, then the registry mutex, then m_client_mutex of a client, then the mutexes of the engine
+ */
+static std::mutex                                       s_engine_mutex;
+static std::map<std::string, ResourceMonitorEngine *>   s_engine_map;
+
+EngineProcess::EngineProcess()
+    : client_count(0)
+    , process_tree(false)
+{
+
+}
+
+ResourceMonitorEngine::ResourceMonitorEngine()
+    : engine_key()
+    , resource_monitor_impl()
+    , client_count(0)
+    , process_map()
+    , client_list()
+    , dispatch_mutex()
+    , dispatch_condition()
+    , dispatch_thread()
+{
+
+}
+
+static void dispatch_process_exit(ResourceMonitorEngine * engine, uint32_t process_id)
+{
+    std::vector<ResourceMonitorClient *> client_list;
+    {
+        std::lock_guard<std::mutex> dispatch_locker(engine->dispatch_mutex);
+        engine->dispatch_thread = std::this_thread::get_id();
+
+        std::lock_guard<std::mutex> locker(s_engine_mutex);
+        client_list.assign(engine->client_list.begin(), engine->client_list.end());
+    }
+
+    /*
+     * called without any lock, a callback may remove_process or exit; a client leaving from another thread waits for the end of the dispatch,
+     * one leaving from a callback is out of client_list before its turn
+     */
+    for (std::vector<ResourceMonitorClient *>::iterator iter = client_list.begin(); client_list.end() != iter; ++iter)
+    {
+        {
+            std::lock_guard<std::mutex> locker(s_engine_mutex);
+            if (engine->client_list.end() == std::find(engine->client_list.begin(), engine->client_list.end(), *iter))
+            {
+                continue;
+            }
+        }
+        (*iter)->notify_process_exit(process_id);
+    }
+
+    {
+        std::lock_guard<std::mutex> dispatch_locker(engine->dispatch_mutex);
+        engine->dispatch_thread = std::thread::id();
+    }
+    engine->dispatch_condition.notify_all();
+}
+
+static void destroy_engine(ResourceMonitorEngine * engine)
+{
+    RUN_LOG_DBG("resource monitor engine (%s) stop", engine->engine_key.c_str());
+    engine->resource_monitor_impl.exit();
+    delete engine;
+}
+
+ResourceMonitorClient::ResourceMonitorClient()
+    : m_engine(nullptr)
+    , m_process_ids()
+    , m_subscription_ids()
+    , m_process_exit_callback()
+    , m_filter_sequence(0)
+    , m_client_mutex()
+{
+
+}
+
+ResourceMonitorClient::~ResourceMonitorClient()
+{
+    exit();
+}
+
+#ifdef _MSC_VER
+bool ResourceMonitorClient::init()
+{
+    exit();
+
+    return (attach_engine("", "", ""));
+}
+#else
+bool ResourceMonitorClient::init(const std::string & proc_root, const std::string & sys_root)
+{
+    exit();
+
+    return (attach_engine(proc_root + "|" + sys_root, proc_root, sys_root));
+}
+#endif // _MSC_VER
+
+static ResourceMonitorEngine * create_engine(const std::string & engine_key, const std::string & proc_root, const std::string & sys_root)
+{
+    ResourceMonitorEngine * engine = nullptr;
+
+    do
+    {
+        engine = new ResourceMonitorEngine;
+        if (nullptr == engine)
+        {
+            break;
+        }
+
+        engine->engine_key = engine_key;
+
+#ifdef _MSC_VER
+        if (!engine->resource_monitor_impl.init())
+#else
+        if (!engine->resource_monitor_impl.init(proc_root, sys_root))
+#endif // _MSC_VER
+        {
+            break;
+        }
+
+        engine->resource_monitor_impl.set_process_exit_callback(std::bind(&dispatch_process_exit, engine, std::placeholders::_1));
+
+        RUN_LOG_DBG("resource monitor engine (%s) start", engine_key.c_str());
+
+        return (engine);
+    } while (false);
+
+    if (nullptr != engine)
+    {
+        engine->resource_monitor_impl.exit();
+        delete engine;
+    }
+
+    RUN_LOG_ERR("resource monitor engine (%s) start failure", engine_key.c_str());
+
+    return (nullptr);
+}
+
+bool ResourceMonitorClient::attach_engine(const std::string & engine_key, const std::string & proc_root, const std::string & sys_root)
+{
+    std::lock_guard<std::mutex> locker(s_engine_mutex);
+
+    ResourceMonitorEngine * engine = nullptr;
+
+    std::map<std::string, ResourceMonitorEngine *>::iterator iter = s_engine_map.find(engine_key);
+    if (s_engine_map.end() != iter)
+    {
+        engine = iter->second;
+    }
+    else
+    {
+        engine = create_engine(engine_key, proc_root, sys_root);
+        if (nullptr == engine)
+        {
+            return (false);
+        }
+        s_engine_map[engine_key] = engine;
+    }
+
+    ++engine->client_count;
+    engine->client_list.push_back(this);
+    m_engine = engine;
+
+    return (true);
+}
+
+void ResourceMonitorClient::exit()
+{
+    ResourceMonitorEngine * engine = m_engine;
+    if (nullptr == engine)
+    {
+        return;
+    }
+
+    /* waits out a process exit dispatch that may still call this client, unless this is one of its callbacks */
+    std::unique_lock<std::mutex> dispatch_locker(engine->dispatch_mutex);
+    while (std::thread::id() != engine->dispatch_thread && std::this_thread::get_id() != engine->dispatch_thread)
+    {
+        engine->dispatch_condition.wait(dispatch_locker);
+    }
+
+    bool last_client = false;
+    {
+        std::lock_guard<std::mutex> locker(s_engine_mutex);
+
+        FlatMap<uint32_t, uint32_t> subscription_ids;
+        FlatSet<uint32_t> process_ids;
+        {
+            std::lock_guard<std::mutex> client_locker(m_client_mutex);
+            subscription_ids = m_subscription_ids;
+            m_subscription_ids.clear();
+            process_ids = m_process_ids;
+            m_process_ids.clear();
+            m_process_exit_callback = nullptr;
+        }
+
+        for (FlatMap<uint32_t, uint32_t>::iterator iter = subscription_ids.begin(); subscription_ids.end() != iter; ++iter)
+        {
+            engine->resource_monitor_impl.unsubscribe_threshold(iter->first);
+        }
+
+        for (FlatSet<uint32_t>::iterator iter = process_ids.begin(); process_ids.end() != iter; ++iter)
+        {
+            FlatMap<uint32_t, EngineProcess>::iterator iter_process = engine->process_map.find(*iter);
+            if (engine->process_map.end() != iter_process && 0 == --iter_process->second.client_count)
+            {
+                engine->process_map.erase(iter_process);
+                engine->resource_monitor_impl.remove_process(*iter);
+            }
+        }
+
+        engine->client_list.remove(this);
+        if (0 == --engine->client_count)
+        {
+            s_engine_map.erase(engine->engine_key);
+            last_client = true;
+        }
+
+        m_engine = nullptr;
+    }
+
+    dispatch_locker.unlock();
+
+    /* stopped outside the registry, its process exit thread may be waiting on it */
+    if (last_client)
+    {
+        if (engine->resource_monitor_impl.in_callback_thread())
+        {
+            /* an engine thread cannot join itself, another thread stops the engine once this callback returned */
+            std::thread(std::bind(&destroy_engine, engine)).detach();
+        }
+        else
+        {
+            destroy_engine(engine);
+        }
+    }
+}
+
+bool ResourceMonitorClient::owns_process(uint32_t process_id)
+{
+    std::lock_guard<std::mutex> locker(m_client_mutex);
+    return (m_process_ids.end() != m_process_ids.find(process_id));
+}
+
+/*
+ * under m_client_mutex, right after m_process_ids changes: diffs up to the latest snapshot were filtered by the old set
+ */
+void ResourceMonitorClient::move_filter_sequence()
+{
+    SystemResource system_resource;
+    memset(&system_resource, 0x0, sizeof(system_resource));
+    m_engine->resource_monitor_impl.get_system_resource(system_resource);
+    m_filter_sequence = system_resource.sample_sequence;
+}
+
+bool ResourceMonitorClient::append_process(uint32_t process_id, bool process_tree)
+{
+    if (nullptr == m_engine || 0 == process_id)
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> locker(s_engine_mutex);
+
+    if (owns_process(process_id))
+    {
+        return (true);
+    }
+
+    FlatMap<uint32_t, EngineProcess>::iterator iter = m_engine->process_map.find(process_id);
+    if (m_engine->process_map.end() != iter)
+    {
+        if (iter->second.process_tree != process_tree)
+        {
+            RUN_LOG_ERR("append process (%u) tree (%s) to monitor failure: another monitor watches it with tree (%s)", process_id, process_tree ? "true" : "false", iter->second.process_tree ? "true" : "false");
+            return (false);
+        }
+    }
+    else
+    {
+        if (!m_engine->resource_monitor_impl.append_process(process_id, process_tree))
+        {
+            return (false);
+        }
+        iter = m_engine->process_map.insert(std::make_pair(process_id, EngineProcess())).first;
+        iter->second.process_tree = process_tree;
+    }
+
+    ++iter->second.client_count;
+
+    {
+        std::lock_guard<std::mutex> client_locker(m_client_mutex);
+        m_process_ids.insert(process_id);
+        move_filter_sequence();
+    }
+
+    return (true);
+}
+
+bool ResourceMonitorClient::remove_process(uint32_t process_id)
+{
+    if (nullptr == m_engine || 0 == process_id)
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> locker(s_engine_mutex);
+
+    std::vector<uint32_t> subscription_ids;
+    {
+        std::lock_guard<std::mutex> client_locker(m_client_mutex);
+        if (0 == m_process_ids.erase(process_id))
+        {
+            RUN_LOG_ERR("remove process (%u) from monitor failure", process_id);
+            return (false);
+        }
+        move_filter_sequence();
+
+        /* subscriptions on the process go with it, another client may still watch it */
+        for (FlatMap<uint32_t, uint32_t>::iterator iter = m_subscription_ids.begin(); m_subscription_ids.end() != iter;)
+        {
+            if (process_id == iter->second)
+            {
+                subscription_ids.push_back(iter->first);
+                iter = m_subscription_ids.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    for (std::vector<uint32_t>::iterator iter = subscription_ids.begin(); subscription_ids.end() != iter; ++iter)
+    {
+        m_engine->resource_monitor_impl.unsubscribe_threshold(*iter);
+    }
+
+    FlatMap<uint32_t, EngineProcess>::iterator iter = m_engine->process_map.find(process_id);
+    if (m_engine->process_map.end() != iter && 0 == --iter->second.client_count)
+    {
+        m_engine->process_map.erase(iter);
+        return (m_engine->resource_monitor_impl.remove_process(process_id));
+    }
+
+    return (true);
+}
+
+bool ResourceMonitorClient::set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback)
+{
+    if (nullptr == m_engine)
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> locker(m_client_mutex);
+    m_process_exit_callback = process_exit_callback;
+
+    return (true);
+}
+
+void ResourceMonitorClient::notify_process_exit(uint32_t process_id)
+{
+    /* called without the lock, the callback may replace itself or remove the process */
+    std::function<void (uint32_t)> process_exit_callback;
+    {
+        std::lock_guard<std::mutex> locker(m_client_mutex);
+        if (m_process_ids.end() == m_process_ids.find(process_id))
+        {
+            return;
+        }
+        process_exit_callback = m_process_exit_callback;
+    }
+
+    if (process_exit_callback)
+    {
+        process_exit_callback(process_id);
+    }
+}
+
+bool ResourceMonitorClient::set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.set_collector_interval(collector_type, interval_ms));
+}
+
+bool ResourceMonitorClient::set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.set_collector_adaptive(collector_type, min_interval_ms, max_interval_ms, change_threshold));
+}
+
+bool ResourceMonitorClient::get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.get_collector_interval(collector_type, interval_ms));
+}
+
+bool ResourceMonitorClient::subscribe_threshold(const ResourceThreshold & threshold, const threshold_callback_t & threshold_callback, uint32_t & subscription_id)
+{
+    if (nullptr == m_engine)
+    {
+        return (false);
+    }
+
+    /* under the registry, a remove_process in between would miss the subscription */
+    std::lock_guard<std::mutex> locker(s_engine_mutex);
+
+    if (0 != threshold.process_id && !owns_process(threshold.process_id))
+    {
+        return (false);
+    }
+
+    if (!m_engine->resource_monitor_impl.subscribe_threshold(threshold, threshold_callback, subscription_id))
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> client_locker(m_client_mutex);
+    m_subscription_ids[subscription_id] = threshold.process_id;
+
+    return (true);
+}
+
+bool ResourceMonitorClient::unsubscribe_threshold(uint32_t subscription_id)
+{
+    if (nullptr == m_engine)
+    {
+        return (false);
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_client_mutex);
+        if (0 == m_subscription_ids.erase(subscription_id))
+        {
+            return (false);
+        }
+    }
+
+    return (m_engine->resource_monitor_impl.unsubscribe_threshold(subscription_id));
+}
+
+bool ResourceMonitorClient::set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.set_history(sample_capacity, window_ms, window_count));
+}
+
+bool ResourceMonitorClient::get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics)
+{
+    return (nullptr != m_engine && (0 == process_id || owns_process(process_id)) && m_engine->resource_monitor_impl.get_resource_statistics(process_id, metric_type, window_index, resource_statistics));
+}
+
+bool ResourceMonitorClient::start_recorder(const std::string & file_path)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.start_recorder(file_path));
+}
+
+bool ResourceMonitorClient::stop_recorder()
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.stop_recorder());
+}
+
+bool ResourceMonitorClient::start_shared_export(const std::string & segment_name, uint32_t process_capacity)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.start_shared_export(segment_name, process_capacity));
+}
+
+bool ResourceMonitorClient::stop_shared_export()
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.stop_shared_export());
+}
+
+bool ResourceMonitorClient::start_metrics_exporter(const std::string & listen_address)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.start_metrics_exporter(listen_address));
+}
+
+bool ResourceMonitorClient::stop_metrics_exporter()
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.stop_metrics_exporter());
+}
+
+bool ResourceMonitorClient::start_stream_exporter(const std::string & listen_address, uint32_t client_backlog)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.start_stream_exporter(listen_address, client_backlog));
+}
+
+bool ResourceMonitorClient::stop_stream_exporter()
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.stop_stream_exporter());
+}
+
+bool ResourceMonitorClient::set_snapshot_retention(uint32_t snapshot_count)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.set_snapshot_retention(snapshot_count));
+}
+
+bool ResourceMonitorClient::get_process_resource(uint32_t process_id, ProcessResource & process_resource)
+{
+    return (nullptr != m_engine && owns_process(process_id) && m_engine->resource_monitor_impl.get_process_resource(process_id, process_resource));
+}
+
+bool ResourceMonitorClient::get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses)
+{
+    if (nullptr == m_engine || !m_engine->resource_monitor_impl.get_process_resources(process_ids, process_count, process_resources, process_statuses))
+    {
+        return (false);
+    }
+
+    /* the engine answers from one snapshot, what other clients appended is masked afterwards */
+    std::lock_guard<std::mutex> locker(m_client_mutex);
+    for (std::size_t process_index = 0; process_index < process_count; ++process_index)
+    {
+        if (m_process_ids.end() == m_process_ids.find(process_ids[process_index]))
+        {
+            memset(&process_resources[process_index], 0x0, sizeof(process_resources[process_index]));
+            if (nullptr != process_statuses)
+            {
+                process_statuses[process_index] = false;
+            }
+        }
+    }
+
+    return (true);
+}
+
+bool ResourceMonitorClient::get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources)
+{
+    if (nullptr == m_engine || !m_engine->resource_monitor_impl.get_all_process_resources(process_resources))
+    {
+        process_resources.clear();
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> locker(m_client_mutex);
+    std::map<uint32_t, ProcessResource>::iterator iter = process_resources.begin();
+    while (process_resources.end() != iter)
+    {
+        if (m_process_ids.end() == m_process_ids.find(iter->first))
+        {
+            process_resources.erase(iter++);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    return (true);
+}
+
+bool ResourceMonitorClient::get_system_resource(SystemResource & system_resource)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.get_system_resource(system_resource));
+}
+
+bool ResourceMonitorClient::get_graphics_cards(std::list<std::string> & graphics_card_names)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.get_graphics_cards(graphics_card_names));
+}
+
+bool ResourceMonitorClient::get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.get_graphics_card_resources(graphics_card_resources));
+}
+
+bool ResourceMonitorClient::wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence)
+{
+    return (nullptr != m_engine && m_engine->resource_monitor_impl.wait_for_sample(last_sequence, timeout_ms, sample_sequence));
+}
+
+bool ResourceMonitorClient::get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, std::string & snapshot_diff)
+{
+    if (nullptr == m_engine)
+    {
+        return (false);
+    }
+
+    /* the set is held while the diff is encoded, a base from before the last change of the set has to start over from base 0 */
+    std::lock_guard<std::mutex> locker(m_client_mutex);
+    if (0 != base_sequence && base_sequence <= m_filter_sequence)
+    {
+        return (false);
+    }
+
+    return (m_engine->resource_monitor_impl.get_snapshot_diff(base_sequence, target_sequence, &m_process_ids, snapshot_diff));
+}
@@ -7,20 +7,45 @@
  * Copyright(C): 2021-2022
  ********************************************************/
 
-#include <pdh.h>
-#include <pdhmsg.h>
-#include <dxgi.h>
-#include <d3d11.h>
-#include <dxgi1_2.h>
-#include <atlbase.h>
-#include <psapi.h>
-#include <tlhelp32.h>
-#include <versionhelpers.h>
+#ifdef _MSC_VER
+    #include <pdh.h>
+    #include <pdhmsg.h>
+    #include <dxgi.h>
+    #include <d3d11.h>
+    #include <dxgi1_2.h>
+    #include <atlbase.h>
+    #include <psapi.h>
+    #include <tlhelp32.h>
+    #include <versionhelpers.h>
+#else
+    #include <fcntl.h>
+    #include <dirent.h>
+    #include <limits.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <strings.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <poll.h>
+    #include <errno.h>
+    #include <sys/socket.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/syscall.h>
+    #include <linux/netlink.h>
+    #include <linux/connector.h>
+    #include <linux/cn_proc.h>
+    #include <dlfcn.h>
+#endif // _MSC_VER
 #include <map>
 #include <vector>
 #include <string>
+#include <cstring>
 #include <numeric>
 #include <codecvt>
+#include <chrono>
+#include <algorithm>
 #include "resource_monitor_impl.h"
 #include "filesystem/hardware.h"
 #include "charset/charset.h"
@@ -29,6 +54,45 @@
 #include "time/time.h"
 #include "log/log.h"
 
+#ifdef _MSC_VER
+    #define SYSTEM_DISK_PATH "C:"
+#else
+    #define SYSTEM_DISK_PATH "/"
+    #define stricmp strcasecmp
+#endif // _MSC_VER
+
+static const char * parse_uint64(const char * str, uint64_t & value)
+{
+    value = 0;
+
+    while (' ' == *str || '\t' == *str)
+    {
+        ++str;
+    }
+
+    if (*str < '0' || *str > '9')
+    {
+        return (nullptr);
+    }
+
+    while (*str >= '0' && *str <= '9')
+    {
+        value = value * 10 + static_cast<uint64_t>(*str - '0');
+        ++str;
+    }
+
+    return (str);
+}
+
+#ifdef _MSC_VER
+
+static uint64_t get_system_page_size()
+{
+    SYSTEM_INFO si = { 0x0 };
+    GetSystemInfo(&si);
+    return (static_cast<uint64_t>(si.dwPageSize));
+}
+
 static void kill_process(uint32_t process_id)
 {
     if (0 == process_id)
@@ -75,6 +139,184 @@ static void kill_nvsmi_process()
     }
 }
 
+#else
+
+/*
+ * procfs regenerates the content on every read from offset 0, so an fd kept open can be read again and again
+ */
+static bool read_proc_fd(int file_fd, char * buffer, std::size_t buffer_size)
+{
+    std::size_t data_size = 0;
+    while (data_size + 1 < buffer_size)
+    {
+        ssize_t read_size = pread(file_fd, buffer + data_size, buffer_size - data_size - 1, static_cast<off_t>(data_size));
+        if (read_size < 0)
+        {
+            return (false);
+        }
+        if (0 == read_size)
+        {
+            break;
+        }
+        data_size += static_cast<std::size_t>(read_size);
+    }
+
+    buffer[data_size] = 0x0;
+
+    return (data_size > 0);
+}
+
+static bool read_proc_file(int dir_fd, const char * file_name, char * buffer, std::size_t buffer_size)
+{
+    int file_fd = openat(dir_fd, file_name, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+    {
+        return (false);
+    }
+
+    bool ret = read_proc_fd(file_fd, buffer, buffer_size);
+
+    close(file_fd);
+
+    return (ret);
+}
+
+static const char * skip_fields(const char * str, uint32_t field_count)
+{
+    while (field_count-- > 0)
+    {
+        while (' ' == *str)
+        {
+            ++str;
+        }
+        while (0x0 != *str && ' ' != *str)
+        {
+            ++str;
+        }
+    }
+    return (str);
+}
+
+struct ProcessStat
+{
+    char                                    state;
+    uint32_t                                parent_process_id;
+    uint64_t                                minor_faults;
+    uint64_t                                major_faults;
+    uint64_t                                user_time;
+    uint64_t                                kernel_time;
+    uint64_t                                start_time;
+    uint64_t                                resident_pages;
+};
+
+static bool parse_process_stat(const char * buffer, ProcessStat & process_stat)
+{
+    /*
+     * pid (comm) state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime cutime cstime priority nice num_threads itrealvalue starttime vsize rss ...
+     * comm may contain spaces and parentheses, so fields are counted from the last ')'
+     */
+    const char * str = strrchr(buffer, ')');
+    if (nullptr == str || ' ' != str[1])
+    {
+        return (false);
+    }
+    str += 2;
+
+    process_stat.state = *str++;
+
+    uint64_t value = 0;
+    if (nullptr == (str = parse_uint64(str, value)))
+    {
+        return (false);
+    }
+    process_stat.parent_process_id = static_cast<uint32_t>(value);
+
+    str = skip_fields(str, 5);
+    if (nullptr == (str = parse_uint64(str, process_stat.minor_faults)))
+    {
+        return (false);
+    }
+    str = skip_fields(str, 1);
+    if (nullptr == (str = parse_uint64(str, process_stat.major_faults)))
+    {
+        return (false);
+    }
+    str = skip_fields(str, 1);
+    if (nullptr == (str = parse_uint64(str, process_stat.user_time)))
+    {
+        return (false);
+    }
+    if (nullptr == (str = parse_uint64(str, process_stat.kernel_time)))
+    {
+        return (false);
+    }
+
+    str = skip_fields(str, 6);
+    if (nullptr == (str = parse_uint64(str, process_stat.start_time)))
+    {
+        return (false);
+    }
+
+    str = skip_fields(str, 1);
+    if (nullptr == (str = parse_uint64(str, process_stat.resident_pages)))
+    {
+        return (false);
+    }
+
+    return (true);
+}
+
+static bool process_stat_is_alive(const ProcessStat & process_stat)
+{
+    return ('Z' != process_stat.state && 'X' != process_stat.state && 'x' != process_stat.state);
+}
+
+static uint64_t monotonic_microseconds()
+{
+    struct timespec ts = { 0x0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000 + static_cast<uint64_t>(ts.tv_nsec) / 1000);
+}
+
+static void kill_nvsmi_process()
+{
+    DIR * dir = opendir("/proc");
+    if (nullptr == dir)
+    {
+        return;
+    }
+
+    std::list<uint32_t> process_id_list;
+
+    int dir_fd = dirfd(dir);
+    for (struct dirent * entry = readdir(dir); nullptr != entry; entry = readdir(dir))
+    {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9')
+        {
+            continue;
+        }
+
+        char comm_path[NAME_MAX + 8] = { 0x0 };
+        snprintf(comm_path, sizeof(comm_path), "%s/comm", entry->d_name);
+
+        char comm[64] = { 0x0 };
+        if (read_proc_file(dir_fd, comm_path, comm, sizeof(comm)) && 0 == strcmp("nvidia-smi\n", comm))
+        {
+            process_id_list.push_back(static_cast<uint32_t>(strtoul(entry->d_name, nullptr, 10)));
+        }
+    }
+
+    closedir(dir);
+
+    for (std::list<uint32_t>::const_iterator iter = process_id_list.begin(); process_id_list.end() != iter; ++iter)
+    {
+        uint32_t process_id = *iter;
+        kill(static_cast<pid_t>(process_id), SIGKILL);
+    }
+}
+
+#endif // _MSC_VER
+
 ProcessLeaf::ProcessLeaf()
     : process_descendant_set()
 {
@@ -88,31 +330,254 @@ ProcessTree::ProcessTree(uint32_t ancestor, bool tree)
     process_descendant_set.insert(ancestor);
 }
 
-ProcessHelper::ProcessHelper(uint32_t ancestor, HANDLE handle)
+ProcessHelper::ProcessHelper(uint32_t ancestor, process_handle_t handle)
     : process_ancestor(ancestor)
     , process_handle(handle)
     , cpu_check_time(0)
     , cpu_system_time(0)
+    , snapshot_index(0)
+#ifdef _MSC_VER
+    , process_exit_watch(nullptr)
+#else
+    , process_start_time(~static_cast<uint64_t>(0))
+    , minor_faults(0)
+    , major_faults(0)
+    , process_exit_fd(-1)
+#endif // _MSC_VER
 {
 
 }
 
 ProcessSnapshot::ProcessSnapshot()
     : process_resource()
+    , process_resource_total()
 {
     memset(&process_resource, 0x0, sizeof(process_resource));
+    memset(&process_resource_total, 0x0, sizeof(process_resource_total));
+}
+
+ProcessNode::ProcessNode()
+    : parent_process_id(0)
+    , process_order(0)
+    , child_process_list()
+{
+
+}
+
+ProcessIndex::ProcessIndex()
+    : index_dirty(true)
+#ifndef _MSC_VER
+    , connector_fd(-1)
+#endif // _MSC_VER
+    , process_node_map()
+    , process_ancestor_list()
+    , process_stack()
+{
+
+}
+
+NvgpuQuery::NvgpuQuery()
+    : gpu_count(0)
+    , gpu_mem_usage(0)
+    , gpu_mem_total(0)
+    , gpu_temperature(0)
+    , gpu_sm_clock(0)
+    , gpu_mem_clock(0)
+    , graphics_card_resources()
+{
+
+}
+
+NvmlLibrary::NvmlLibrary()
+    : library_handle(nullptr)
+    , device_list()
+    , nvml_init(nullptr)
+    , nvml_shutdown(nullptr)
+    , nvml_device_get_count(nullptr)
+    , nvml_device_get_handle_by_index(nullptr)
+    , nvml_device_get_name(nullptr)
+    , nvml_device_get_utilization_rates(nullptr)
+    , nvml_device_get_encoder_utilization(nullptr)
+    , nvml_device_get_decoder_utilization(nullptr)
+    , nvml_device_get_memory_info(nullptr)
+    , nvml_device_get_temperature(nullptr)
+    , nvml_device_get_clock_info(nullptr)
+{
+
+}
+
+GpuInstanceTable::GpuInstanceTable()
+    : instance_name_list()
+    , instance_list()
+{
+
+}
+
+SystemHelper::SystemHelper()
+#ifdef _MSC_VER
+    : gpu_engine_table()
+    , gpu_memory_table()
+    , page_size(get_system_page_size())
+    , process_exit_event(nullptr)
+    , process_exit_mutex()
+    , process_exit_list()
+    , process_entry_list()
+    , process_index()
+#else
+    : proc_root()
+    , sys_root()
+    , gpu_device_path()
+    , proc_root_fd(-1)
+    , clock_ticks(static_cast<uint64_t>(sysconf(_SC_CLK_TCK)))
+    , page_size(static_cast<uint64_t>(sysconf(_SC_PAGESIZE)))
+    , cpu_busy_time(0)
+    , cpu_total_time(0)
+    , net_check_time(0)
+    , net_send_bytes(0)
+    , net_recv_bytes(0)
+    , process_exit_fd(-1)
+    , process_wake_fd(-1)
+    , process_entry_list()
+    , process_index()
+#endif // _MSC_VER
+{
+
 }
 
 SystemSnapshot::SystemSnapshot()
     : system_resource()
+    , system_helper()
+    , graphics_card_names()
+    , graphics_card_resources()
     , process_leaf_map()
     , process_tree_map()
     , process_helper_map()
     , process_snapshot_map()
+    , process_drop_list()
+{
+    memset(&system_resource, 0x0, sizeof(system_resource));
+}
+
+PublishedSnapshot::PublishedSnapshot()
+    : reader_count(0)
+    , sample_time(0)
+    , sample_sequence(0)
+    , system_resource()
+    , graphics_card_names()
+    , graphics_card_resources()
+    , process_snapshot_map()
 {
     memset(&system_resource, 0x0, sizeof(system_resource));
 }
 
+#define COLLECTOR_DEFAULT_INTERVAL_MS   5000
+#define COLLECTOR_MIN_INTERVAL_MS       100
+#define COLLECTOR_MASK(collector_type)  (static_cast<uint32_t>(1) << (collector_type))
+
+CollectorSchedule::CollectorSchedule()
+    : interval_ms(COLLECTOR_DEFAULT_INTERVAL_MS)
+    , due_time(0)
+    , adaptive(false)
+    , min_interval_ms(COLLECTOR_DEFAULT_INTERVAL_MS)
+    , max_interval_ms(COLLECTOR_DEFAULT_INTERVAL_MS)
+    , change_threshold(0.0)
+    , watched_valid(false)
+    , watched_value(0.0)
+{
+
+}
+
+ThresholdRule::ThresholdRule()
+    : threshold()
+    , threshold_callback()
+    , raised(false)
+    , pending_time(0)
+{
+    memset(&threshold, 0x0, sizeof(threshold));
+}
+
+ThresholdEvent::ThresholdEvent()
+    : subscription_id(0)
+    , threshold()
+    , threshold_callback()
+    , raised(false)
+    , value(0.0)
+{
+    memset(&threshold, 0x0, sizeof(threshold));
+}
+
+SnapshotPublisher::SnapshotPublisher()
+    : m_published_snapshot()
+    , m_published_index(0)
+{
+
+}
+
+PublishedSnapshot & SnapshotPublisher::begin_publish()
+{
+    const uint32_t slot_count = static_cast<uint32_t>(sizeof(m_published_snapshot) / sizeof(m_published_snapshot[0]));
+    const uint32_t published_index = m_published_index.load(std::memory_order_seq_cst);
+
+    /*
+     * a reader which loaded an old index may still bump its count after this check,
+     * it will see the index moved on and back off before touching the slot
+     */
+    while (true)
+    {
+        for (uint32_t offset = 1; offset < slot_count; ++offset)
+        {
+            PublishedSnapshot & published_snapshot = m_published_snapshot[(published_index + offset) % slot_count];
+            if (0 == published_snapshot.reader_count.load(std::memory_order_seq_cst))
+            {
+                return (published_snapshot);
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void SnapshotPublisher::end_publish(PublishedSnapshot & published_snapshot)
+{
+    m_published_index.store(static_cast<uint32_t>(&published_snapshot - m_published_snapshot), std::memory_order_seq_cst);
+}
+
+const PublishedSnapshot & SnapshotPublisher::acquire()
+{
+    while (true)
+    {
+        uint32_t published_index = m_published_index.load(std::memory_order_seq_cst);
+        PublishedSnapshot & published_snapshot = m_published_snapshot[published_index];
+        published_snapshot.reader_count.fetch_add(1, std::memory_order_seq_cst);
+        if (published_index == m_published_index.load(std::memory_order_seq_cst))
+        {
+            return (published_snapshot);
+        }
+        published_snapshot.reader_count.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+void SnapshotPublisher::release(const PublishedSnapshot & published_snapshot)
+{
+    const_cast<PublishedSnapshot &>(published_snapshot).reader_count.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+PublishedSnapshotReader::PublishedSnapshotReader(SnapshotPublisher & snapshot_publisher)
+    : m_snapshot_publisher(snapshot_publisher)
+    , m_published_snapshot(snapshot_publisher.acquire())
+{
+
+}
+
+PublishedSnapshotReader::~PublishedSnapshotReader()
+{
+    m_snapshot_publisher.release(m_published_snapshot);
+}
+
+const PublishedSnapshot & PublishedSnapshotReader::snapshot() const
+{
+    return (m_published_snapshot);
+}
+
 static ProcessResource & operator += (ProcessResource & process_resource, const ProcessSnapshot & process_snapshot)
 {
     process_resource.cpu_usage += process_snapshot.process_resource.cpu_usage;
@@ -122,125 +587,125 @@ static ProcessResource & operator += (ProcessResource & process_resource, const
     process_resource.gpu_enc_usage += process_snapshot.process_resource.gpu_enc_usage;
     process_resource.gpu_dec_usage += process_snapshot.process_resource.gpu_dec_usage;
     process_resource.gpu_mem_usage += process_snapshot.process_resource.gpu_mem_usage;
+    process_resource.minor_faults += process_snapshot.process_resource.minor_faults;
+    process_resource.major_faults += process_snapshot.process_resource.major_faults;
     return (process_resource);
 }
 
+#ifdef _MSC_VER
+
 static bool process_is_alive(HANDLE process_handle)
 {
     DWORD process_exit_code = 0;
     return (nullptr != process_handle && GetExitCodeProcess(process_handle, &process_exit_code) && STILL_ACTIVE == process_exit_code);
 }
 
-static bool append_process_to_monitor(SystemSnapshot & system_snapshot, uint32_t process_id, bool process_tree)
+static bool open_process_handle(SystemSnapshot & system_snapshot, uint32_t process_id, process_handle_t & process_handle)
 {
-    if (0 == process_id)
+    if (GetCurrentProcessId() == process_id)
     {
-        return (false);
+        process_handle = GetCurrentProcess();
     }
-
-    std::map<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
-
-    std::map<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_id);
-    if (process_tree_map.end() != iter_tree)
+    else
     {
-        return (true);
+        process_handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | SYNCHRONIZE, FALSE, process_id);
     }
+    return (nullptr != process_handle);
+}
 
-    std::map<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
-    if (process_helper_map.end() != iter_helper)
-    {
-        iter_tree = process_tree_map.find(iter_helper->second.process_ancestor);
-        if (process_tree_map.end() != iter_tree)
-        {
-            iter_tree->second.process_descendant_set.erase(process_id);
-        }
-        process_tree_map.insert(std::make_pair(process_id, ProcessTree(process_id, process_tree)));
-        process_snapshot_map.insert(std::make_pair(process_id, ProcessSnapshot()));
-        return (true);
-    }
-    else
+static void close_process_handle(uint32_t process_id, process_handle_t process_handle)
+{
+    if (nullptr != process_handle && GetCurrentProcessId() != process_id)
     {
-        HANDLE process_handle = nullptr;
-        if (GetCurrentProcessId() == process_id)
-        {
-            process_handle = GetCurrentProcess();
-        }
-        else
-        {
-            process_handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process_id);
-        }
-
-        if (nullptr != process_handle)
-        {
-            process_tree_map.insert(std::make_pair(process_id, ProcessTree(process_id, process_tree)));
-            process_helper_map.insert(std::make_pair(process_id, ProcessHelper(process_id, process_handle)));
-            process_snapshot_map.insert(std::make_pair(process_id, ProcessSnapshot()));
-            return (true);
-        }
+        CloseHandle(process_handle);
     }
+}
 
-    return (false);
+static void reopen_process_handle(SystemSnapshot & system_snapshot, uint32_t process_id, ProcessHelper & process_helper)
+{
+    /* a process handle holds the process object, it never turns into another process */
 }
 
-static bool remove_process_from_monitor(SystemSnapshot & system_snapshot, uint32_t process_id)
+static VOID CALLBACK process_exit_callback(PVOID context, BOOLEAN timer_fired)
 {
-    if (0 == process_id)
+    ProcessExitWatch * process_exit_watch = reinterpret_cast<ProcessExitWatch *>(context);
+    SystemHelper & system_helper = *process_exit_watch->system_helper;
     {
-        return (false);
+        std::lock_guard<std::mutex> locker(system_helper.process_exit_mutex);
+        system_helper.process_exit_list.push_back(process_exit_watch->process_id);
     }
+    SetEvent(system_helper.process_exit_event);
+}
 
-    std::map<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
-
-    std::map<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_id);
-    if (process_tree_map.end() == iter_tree)
+static void watch_process_exit(SystemSnapshot & system_snapshot, uint32_t process_id, ProcessHelper & process_helper)
+{
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    if (nullptr == system_helper.process_exit_event || nullptr == process_helper.process_handle || nullptr != process_helper.process_exit_watch || GetCurrentProcessId() == process_id)
     {
-        return (false);
+        return;
     }
 
-    std::set<uint32_t> & process_descendant_set = iter_tree->second.process_descendant_set;
-    for (std::set<uint32_t>::iterator iter_descendant = process_descendant_set.begin(); process_descendant_set.end() != iter_descendant; ++iter_descendant)
+    ProcessExitWatch * process_exit_watch = new ProcessExitWatch;
+    process_exit_watch->process_id = process_id;
+    process_exit_watch->wait_handle = nullptr;
+    process_exit_watch->system_helper = &system_helper;
+    if (!RegisterWaitForSingleObject(&process_exit_watch->wait_handle, process_helper.process_handle, process_exit_callback, process_exit_watch, INFINITE, WT_EXECUTEONLYONCE))
     {
-        uint32_t process_descendant = *iter_descendant;
-        std::map<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_descendant);
-        if (process_helper_map.end() != iter_helper)
-        {
-            if (GetCurrentProcessId() != process_descendant)
-            {
-                CloseHandle(iter_helper->second.process_handle);
-            }
-            process_helper_map.erase(iter_helper);
-        }
+        delete process_exit_watch;
+        return;
     }
-    process_snapshot_map.erase(process_id);
-    process_tree_map.erase(iter_tree);
 
-    return (true);
+    process_helper.process_exit_watch = process_exit_watch;
 }
 
-static bool update_process_tree(SystemSnapshot & system_snapshot)
+static void unwatch_process_exit(ProcessHelper & process_helper)
 {
-    std::map<uint32_t, ProcessLeaf> & process_leaf_map = system_snapshot.process_leaf_map;
-    process_leaf_map.clear();
-
-    std::map<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    if (process_tree_map.empty() || process_helper_map.empty())
+    if (nullptr != process_helper.process_exit_watch)
     {
-        return (true);
+        /* waits for a running callback, which only takes process_exit_mutex */
+        UnregisterWaitEx(process_helper.process_exit_watch->wait_handle, INVALID_HANDLE_VALUE);
+        delete process_helper.process_exit_watch;
+        process_helper.process_exit_watch = nullptr;
     }
+}
 
-    std::map<uint32_t, uint32_t> process_ancestor_map;
-    for (std::map<uint32_t, ProcessTree>::iterator iter = process_tree_map.begin(); process_tree_map.end() != iter; ++iter)
-    {
-        if (iter->second.process_tree)
-        {
-            process_ancestor_map[iter->first] = iter->first;
-        }
+static void close_process_helper(uint32_t process_id, ProcessHelper & process_helper)
+{
+    unwatch_process_exit(process_helper);
+    close_process_handle(process_id, process_helper.process_handle);
+    process_helper.process_handle = nullptr;
+}
+
+static void close_process_exit_watcher(SystemSnapshot & system_snapshot)
+{
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    if (nullptr != system_helper.process_exit_event)
+    {
+        CloseHandle(system_helper.process_exit_event);
+        system_helper.process_exit_event = nullptr;
     }
+    system_helper.process_exit_list.clear();
+}
+
+static bool open_process_exit_watcher(SystemSnapshot & system_snapshot)
+{
+    close_process_exit_watcher(system_snapshot);
+
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    system_helper.process_exit_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+    return (nullptr != system_helper.process_exit_event);
+}
+
+static void wake_process_exit_watcher(SystemSnapshot & system_snapshot)
+{
+    SetEvent(system_snapshot.system_helper.process_exit_event);
+}
+
+static bool snapshot_process_entries(SystemSnapshot & system_snapshot)
+{
+    std::vector<ProcessEntry> & process_entry_list = system_snapshot.system_helper.process_entry_list;
+    process_entry_list.clear();
 
     HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
     if (INVALID_HANDLE_VALUE == snapshot)
@@ -252,1352 +717,4482 @@ static bool update_process_tree(SystemSnapshot & system_snapshot)
 
     for (BOOL ok = Process32First(snapshot, &pe); TRUE == ok; ok = Process32Next(snapshot, &pe))
     {
-        std::map<uint32_t, uint32_t>::iterator iter = process_ancestor_map.find(pe.th32ParentProcessID);
-        if (process_ancestor_map.end() != iter)
-        {
-            if (process_ancestor_map.end() != process_ancestor_map.find(pe.th32ProcessID))
-            {
-                ProcessLeaf & process_leaf = process_leaf_map[pe.th32ParentProcessID];
-                process_leaf.process_descendant_set.insert(pe.th32ProcessID);
-            }
-            else
-            {
-                process_ancestor_map[pe.th32ProcessID] = iter->second;
-            }
-        }
+        ProcessEntry process_entry = { pe.th32ProcessID, pe.th32ParentProcessID };
+        process_entry_list.push_back(process_entry);
     }
 
     CloseHandle(snapshot);
 
-    for (std::map<uint32_t, uint32_t>::iterator iter_ancestor = process_ancestor_map.begin(); process_ancestor_map.end() != iter_ancestor; ++iter_ancestor)
-    {
-        uint32_t process_id = iter_ancestor->first;
-        uint32_t process_ancestor = iter_ancestor->second;
-        std::map<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_ancestor);
-        if (process_tree_map.end() != iter_tree)
-        {
-            std::map<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
-            if (process_helper_map.end() != iter_helper)
-            {
-                if (process_ancestor != iter_helper->second.process_ancestor)
-                {
-                    std::map<uint32_t, ProcessTree>::iterator iter = process_tree_map.find(iter_helper->second.process_ancestor);
-                    if (process_tree_map.end() != iter)
-                    {
-                        iter->second.process_descendant_set.erase(process_id);
-                    }
-                    iter_tree->second.process_descendant_set.insert(process_id);
-                    iter_helper->second.process_ancestor = process_ancestor;
-                }
-            }
-            else
-            {
-                HANDLE process_handle = nullptr;
-                if (GetCurrentProcessId() == process_id)
-                {
-                    process_handle = GetCurrentProcess();
-                }
-                else
-                {
-                    process_handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process_id);
-                }
-                if (nullptr != process_handle)
-                {
-                    iter_tree->second.process_descendant_set.insert(process_id);
-                    process_helper_map.insert(std::make_pair(process_id, ProcessHelper(process_ancestor, process_handle)));
-                }
-            }
-        }
-    }
-
-    for (std::map<uint32_t, ProcessLeaf>::iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; ++iter_leaf)
-    {
-        std::set<uint32_t> & process_descendant_set = iter_leaf->second.process_descendant_set;
-        std::list<uint32_t> process_descendant_list(process_descendant_set.begin(), process_descendant_set.end());
-        while (!process_descendant_list.empty())
-        {
-            uint32_t process_descendant = process_descendant_list.front();
-            process_descendant_list.pop_front();
-            std::map<uint32_t, ProcessLeaf>::iterator iter_sub_leaf = process_leaf_map.find(process_descendant);
-            if (process_leaf_map.end() != iter_sub_leaf)
-            {
-                std::set<uint32_t> & sub_process_descendant_set = iter_sub_leaf->second.process_descendant_set;
-                process_descendant_set.insert(sub_process_descendant_set.begin(), sub_process_descendant_set.end());
-                process_descendant_list.insert(process_descendant_list.end(), sub_process_descendant_set.begin(), sub_process_descendant_set.end());
-            }
-        }
-    }
-
     return (true);
 }
 
-static uint64_t file_time_to_utc_time(FILETIME file_time)
-{
-    uint64_t utc_time = file_time.dwHighDateTime;
-    utc_time <<= 32;
-    utc_time |= file_time.dwLowDateTime;
-    return (utc_time);
-}
+#else
 
-static bool get_process_cpu_usage(ProcessHelper & process_helper, ProcessSnapshot & process_snapshot, SystemSnapshot & system_snapshot)
+static bool open_process_handle(SystemSnapshot & system_snapshot, uint32_t process_id, process_handle_t & process_handle)
 {
-    SystemResource & system_resource = system_snapshot.system_resource;
-    if (0 == system_resource.cpu_count || nullptr == process_helper.process_handle)
-    {
-        return (false);
-    }
-
-    if (!process_is_alive(process_helper.process_handle))
-    {
-        return (false);
-    }
-
-    FILETIME current_time = { 0x0 };
-    GetSystemTimeAsFileTime(&current_time);
-    uint64_t cpu_check_time = file_time_to_utc_time(current_time);
-
-    FILETIME creation_time = { 0x0 };
-    FILETIME exit_time = { 0x0 };
-    FILETIME kernel_time = { 0x0 };
-    FILETIME user_time = { 0x0 };
-    if (!GetProcessTimes(process_helper.process_handle, &creation_time, &exit_time, &kernel_time, &user_time))
+    char stat_path[32] = { 0x0 };
+    snprintf(stat_path, sizeof(stat_path), "%u/stat", process_id);
+    process_handle = openat(system_snapshot.system_helper.proc_root_fd, stat_path, O_RDONLY | O_CLOEXEC);
+    if (process_handle < 0)
     {
         return (false);
     }
 
-    uint64_t cpu_system_time = file_time_to_utc_time(kernel_time) + file_time_to_utc_time(user_time);
-    if (0 == process_helper.cpu_check_time || process_helper.cpu_check_time >= cpu_check_time || process_helper.cpu_system_time > cpu_system_time)
+    /* a zombie has already exited, watching it would only report the exit again on every walk */
+    char buffer[512] = { 0x0 };
+    ProcessStat process_stat = { 0x0 };
+    if (!read_proc_fd(process_handle, buffer, sizeof(buffer)) || !parse_process_stat(buffer, process_stat) || !process_stat_is_alive(process_stat))
     {
-        process_helper.cpu_check_time = cpu_check_time;
-        process_helper.cpu_system_time = cpu_system_time;
+        close(process_handle);
+        process_handle = -1;
         return (false);
     }
 
-    uint64_t check_time_delta = cpu_check_time - process_helper.cpu_check_time;
-    uint64_t system_time_delta = cpu_system_time - process_helper.cpu_system_time;
-
-    ProcessResource & process_resource = process_snapshot.process_resource;
-    process_resource.cpu_usage += static_cast<double>(100.0 * system_time_delta / system_resource.cpu_count / check_time_delta);
-
-    process_helper.cpu_check_time = cpu_check_time;
-    process_helper.cpu_system_time = cpu_system_time;
-
     return (true);
 }
 
-static bool get_process_memory_usage(ProcessHelper & process_helper, ProcessSnapshot & process_snapshot)
+static void close_process_handle(uint32_t process_id, process_handle_t process_handle)
 {
-    if (nullptr == process_helper.process_handle)
+    if (process_handle >= 0)
     {
-        return (false);
+        close(process_handle);
     }
+}
 
-    if (!process_is_alive(process_helper.process_handle))
+static void watch_process_exit(SystemSnapshot & system_snapshot, uint32_t process_id, ProcessHelper & process_helper)
+{
+#ifdef SYS_pidfd_open
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    if (system_helper.process_exit_fd < 0 || process_helper.process_handle < 0 || process_helper.process_exit_fd >= 0)
     {
-        return (false);
+        return;
     }
 
-    ProcessResource & process_resource = process_snapshot.process_resource;
-
-    SYSTEM_INFO si = { 0x0 };
-    GetSystemInfo(&si);
-    PSAPI_WORKING_SET_INFORMATION pwsi = { 0x0 };
-    if (QueryWorkingSet(process_helper.process_handle, &pwsi, sizeof(pwsi)) || ERROR_BAD_LENGTH == GetLastError())
+    /* a pidfd turns readable when the process exits, kernels before 5.3 leave the stat reads to find it */
+    int process_exit_fd = static_cast<int>(syscall(SYS_pidfd_open, static_cast<pid_t>(process_id), 0));
+    if (process_exit_fd < 0)
     {
-        process_resource.ram_usage += pwsi.NumberOfEntries * si.dwPageSize;
-        return (true);
+        return;
     }
 
-    PROCESS_MEMORY_COUNTERS pmc = { 0x0 };
-    if (GetProcessMemoryInfo(process_helper.process_handle, &pmc, sizeof(pmc)))
+    struct epoll_event event;
+    memset(&event, 0x0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = (static_cast<uint64_t>(process_id) << 32) | static_cast<uint32_t>(process_exit_fd);
+    if (0 != epoll_ctl(system_helper.process_exit_fd, EPOLL_CTL_ADD, process_exit_fd, &event))
     {
-        process_resource.ram_usage += pmc.WorkingSetSize;
-        return (true);
+        close(process_exit_fd);
+        return;
     }
 
-    return (false);
+    process_helper.process_exit_fd = process_exit_fd;
+#endif // SYS_pidfd_open
 }
 
-static bool get_system_cpu_count(SystemSnapshot & system_snapshot)
+static void unwatch_process_exit(ProcessHelper & process_helper)
 {
-    SystemResource & system_resource = system_snapshot.system_resource;
-    std::size_t core_count = 0;
-    if (Goofer::get_system_cpu_core_count(core_count))
+    if (process_helper.process_exit_fd >= 0)
     {
-        system_resource.cpu_count = static_cast<uint64_t>(core_count);
-        return (true);
-    }
-    else
-    {
-        system_resource.cpu_count = 0;
-        return (false);
+        /* closing the only reference also drops it from the epoll set */
+        close(process_helper.process_exit_fd);
+        process_helper.process_exit_fd = -1;
     }
 }
 
-static bool get_system_memory_usage(SystemSnapshot & system_snapshot)
+static void close_process_helper(uint32_t process_id, ProcessHelper & process_helper)
 {
-    SystemResource & system_resource = system_snapshot.system_resource;
-    uint64_t total_size = 0;
-    uint64_t avail_size = 0;
-    if (Goofer::get_system_memory_usage(total_size, avail_size))
+    unwatch_process_exit(process_helper);
+    close_process_handle(process_id, process_helper.process_handle);
+    process_helper.process_handle = -1;
+}
+
+static void close_process_exit_watcher(SystemSnapshot & system_snapshot)
+{
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    if (system_helper.process_wake_fd >= 0)
     {
-        system_resource.ram_total = total_size;
-        system_resource.ram_usage = total_size - avail_size;
-        return (true);
+        close(system_helper.process_wake_fd);
+        system_helper.process_wake_fd = -1;
     }
-    else
+    if (system_helper.process_exit_fd >= 0)
     {
-        system_resource.ram_total = 0;
-        system_resource.ram_usage = 0;
-        return (false);
+        close(system_helper.process_exit_fd);
+        system_helper.process_exit_fd = -1;
     }
 }
 
-static bool get_process_cpu_usage(SystemSnapshot & system_snapshot)
+static bool open_process_exit_watcher(SystemSnapshot & system_snapshot)
 {
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
-    for (std::map<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    close_process_exit_watcher(system_snapshot);
+
+    SystemHelper & system_helper = system_snapshot.system_helper;
+
+    /* pids under a fixture proc root are not host pids, there is nothing to watch */
+    if ("/proc" != system_helper.proc_root)
     {
-        iter->second.process_resource.cpu_usage = 0;
+        return (false);
     }
 
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    for (std::map<uint32_t, ProcessHelper>::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+    do
     {
-        get_process_cpu_usage(iter->second, process_snapshot_map[iter->second.process_ancestor], system_snapshot);
-    }
+        system_helper.process_exit_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (system_helper.process_exit_fd < 0)
+        {
+            break;
+        }
 
-    return (true);
+        system_helper.process_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (system_helper.process_wake_fd < 0)
+        {
+            break;
+        }
+
+        /* pid 0 in the event data marks the wake fd */
+        struct epoll_event event;
+        memset(&event, 0x0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = static_cast<uint32_t>(system_helper.process_wake_fd);
+        if (0 != epoll_ctl(system_helper.process_exit_fd, EPOLL_CTL_ADD, system_helper.process_wake_fd, &event))
+        {
+            break;
+        }
+
+        return (true);
+    } while (false);
+
+    close_process_exit_watcher(system_snapshot);
+
+    return (false);
 }
 
-static bool get_process_memory_usage(SystemSnapshot & system_snapshot)
+static void wake_process_exit_watcher(SystemSnapshot & system_snapshot)
 {
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
-    for (std::map<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    uint64_t value = 1;
+    if (static_cast<ssize_t>(sizeof(value)) != write(system_snapshot.system_helper.process_wake_fd, &value, sizeof(value)))
     {
-        iter->second.process_resource.ram_usage = 0;
+        RUN_LOG_WAR("wake process exit thread failed");
     }
+}
 
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    for (std::map<uint32_t, ProcessHelper>::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+static void reopen_process_handle(SystemSnapshot & system_snapshot, uint32_t process_id, ProcessHelper & process_helper)
+{
+    if (process_helper.process_handle >= 0)
     {
-        get_process_memory_usage(iter->second, process_snapshot_map[iter->second.process_ancestor]);
+        return;
     }
 
-    return (true);
+    if (open_process_handle(system_snapshot, process_id, process_helper.process_handle))
+    {
+        process_helper.cpu_check_time = 0;
+        process_helper.cpu_system_time = 0;
+        process_helper.process_start_time = ~static_cast<uint64_t>(0);
+        watch_process_exit(system_snapshot, process_id, process_helper);
+    }
 }
 
-static bool get_formatted_counter_array(PDH_HCOUNTER counter_handle, DWORD value_format, std::vector<char> & buffer, PDH_FMT_COUNTERVALUE_ITEM *& item_array, ULONG & item_count)
+static bool process_entry_less(const ProcessEntry & lhs, const ProcessEntry & rhs)
 {
-    item_array = nullptr;
-    item_count = 0;
+    return (lhs.process_id < rhs.process_id);
+}
 
-    ULONG buffer_size = 0;
-    PDH_STATUS status = PdhGetFormattedCounterArray(counter_handle, value_format, &buffer_size, &item_count, item_array);
-    if (PDH_MORE_DATA == status)
+static bool snapshot_process_entries(SystemSnapshot & system_snapshot)
+{
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    std::vector<ProcessEntry> & process_entry_list = system_helper.process_entry_list;
+    process_entry_list.clear();
+
+    int dir_fd = dup(system_helper.proc_root_fd);
+    if (dir_fd < 0)
     {
-        buffer.resize(buffer_size);
-        item_array = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM *>(&buffer[0]);
-        status = PdhGetFormattedCounterArray(counter_handle, value_format, &buffer_size, &item_count, item_array);
+        return (false);
     }
 
-    if (ERROR_SUCCESS != status)
+    DIR * dir = fdopendir(dir_fd);
+    if (nullptr == dir)
     {
-        item_array = nullptr;
-        item_count = 0;
+        close(dir_fd);
         return (false);
     }
 
-    return (item_count > 0);
-}
-
-static bool get_processor_utilization_percentage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
-{
-    SystemResource & system_resource = system_snapshot.system_resource;
+    rewinddir(dir);
 
-    if (nullptr == counter_handle)
+    for (struct dirent * entry = readdir(dir); nullptr != entry; entry = readdir(dir))
     {
-        if (0 == system_resource.cpu_count)
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9')
         {
-            return (false);
+            continue;
         }
 
-        std::vector<size_t> cpu_usage;
-        if (!Goofer::get_system_cpu_usage(cpu_usage))
-        {
-            return (false);
-        }
+        char stat_path[NAME_MAX + 8] = { 0x0 };
+        snprintf(stat_path, sizeof(stat_path), "%s/stat", entry->d_name);
 
-        if (cpu_usage.empty())
+        char buffer[512] = { 0x0 };
+        ProcessStat process_stat = { 0x0 };
+        if (read_proc_file(system_helper.proc_root_fd, stat_path, buffer, sizeof(buffer)) && parse_process_stat(buffer, process_stat))
         {
-            return (false);
+            ProcessEntry process_entry = { static_cast<uint32_t>(strtoul(entry->d_name, nullptr, 10)), process_stat.parent_process_id, process_stat.start_time };
+            process_entry_list.push_back(process_entry);
         }
+    }
 
-        system_resource.cpu_usage = 1.0 * std::accumulate(cpu_usage.begin(), cpu_usage.end(), static_cast<size_t>(0)) / system_resource.cpu_count;
+    closedir(dir);
 
-        return (true);
-    }
+    /* procfs lists processes by ascending pid, keep fixture trees in the same order */
+    std::sort(process_entry_list.begin(), process_entry_list.end(), process_entry_less);
 
-    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
-    ULONG item_count = 0;
-    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, buffer, item_array, item_count))
+    return (true);
+}
+
+#endif // _MSC_VER
+
+/*
+ * one sweep over each table for every sub process exited since the last pass, instead of one erase (a move of the items behind it) per exit
+ */
+static void drop_exited_processes(SystemSnapshot & system_snapshot)
+{
+    std::vector<uint32_t> & process_drop_list = system_snapshot.process_drop_list;
+    if (process_drop_list.empty())
     {
-        return (false);
+        return;
     }
 
-    system_resource.cpu_usage = 0;
-    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    std::sort(process_drop_list.begin(), process_drop_list.end());
+
+    FlatMap<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
+    for (FlatMap<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.begin(); process_tree_map.end() != iter_tree; ++iter_tree)
     {
-        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
-        system_resource.cpu_usage += item.FmtValue.doubleValue;
+        iter_tree->second.process_descendant_set.erase_keys(process_drop_list.begin(), process_drop_list.end());
     }
+    system_snapshot.process_helper_map.erase_keys(process_drop_list.begin(), process_drop_list.end());
 
-    return (true);
+    process_drop_list.clear();
 }
 
-static bool get_nvidia_gpu_enc(double & gpu_percent_total, double & gpu_percent_using, uint64_t & nvsmi_alive_time)
+static bool append_process_to_monitor(SystemSnapshot & system_snapshot, uint32_t process_id, bool process_tree)
 {
-    gpu_percent_total = 0.0;
-    gpu_percent_using = 0.0;
-
-    static bool s_check_tool_not_exist = false;
-
-    if (s_check_tool_not_exist)
+    if (0 == process_id)
     {
         return (false);
     }
 
-    FILE * file = goofer_popen("nvidia-smi dmon -s u -c 1", "r");
-    if (nullptr == file)
+    drop_exited_processes(system_snapshot);
+
+    FlatMap<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+
+    FlatMap<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_id);
+    if (process_tree_map.end() != iter_tree)
     {
-        s_check_tool_not_exist = true;
-        return (false);
+        return (true);
     }
 
-    nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-    do
+    FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
+    if (process_helper_map.end() != iter_helper)
     {
-        char line[128] = { 0x0 };
-        if (nullptr == fgets(line, sizeof(line) - 1, file))
+        iter_tree = process_tree_map.find(iter_helper->second.process_ancestor);
+        if (process_tree_map.end() != iter_tree)
         {
-            break;
+            iter_tree->second.process_descendant_set.erase(process_id);
         }
-
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-        std::vector<std::string> titles;
-        Goofer::goofer_split_piece(line, " \t", true, true, titles);
-        std::vector<std::string>::iterator iter = std::find(titles.begin(), titles.end(), "enc");
-        if (titles.end() == iter)
-        {
-            break;
-        }
-
-        uint32_t index = static_cast<uint32_t>(iter - titles.begin());
-        if ("#" == titles.front())
+        process_tree_map.insert(std::make_pair(process_id, ProcessTree(process_id, process_tree)));
+        process_snapshot_map.insert(std::make_pair(process_id, ProcessSnapshot()));
+        return (true);
+    }
+    else
+    {
+        process_handle_t process_handle;
+        if (open_process_handle(system_snapshot, process_id, process_handle))
         {
-            index -= 1;
+            process_tree_map.insert(std::make_pair(process_id, ProcessTree(process_id, process_tree)));
+            watch_process_exit(system_snapshot, process_id, process_helper_map.insert(std::make_pair(process_id, ProcessHelper(process_id, process_handle))).first->second);
+            process_snapshot_map.insert(std::make_pair(process_id, ProcessSnapshot()));
+            return (true);
         }
+    }
 
-        if (nullptr == fgets(line, sizeof(line) - 1, file))
-        {
-            break;
-        }
+    return (false);
+}
 
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+static bool remove_process_from_monitor(SystemSnapshot & system_snapshot, uint32_t process_id)
+{
+    if (0 == process_id)
+    {
+        return (false);
+    }
+
+    FlatMap<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+
+    drop_exited_processes(system_snapshot);
 
-        std::vector<std::string> units;
-        Goofer::goofer_split_piece(line, " \t", true, true, units);
+    FlatMap<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_id);
+    if (process_tree_map.end() == iter_tree)
+    {
+        return (false);
+    }
 
-        if (titles.size() != units.size())
+    FlatSet<uint32_t> & process_descendant_set = iter_tree->second.process_descendant_set;
+    for (FlatSet<uint32_t>::iterator iter_descendant = process_descendant_set.begin(); process_descendant_set.end() != iter_descendant; ++iter_descendant)
+    {
+        uint32_t process_descendant = *iter_descendant;
+        FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_descendant);
+        if (process_helper_map.end() != iter_helper)
         {
-            break;
+            close_process_helper(process_descendant, iter_helper->second);
         }
+    }
+    process_helper_map.erase_keys(process_descendant_set.begin(), process_descendant_set.end());
+    process_snapshot_map.erase(process_id);
+    process_tree_map.erase(iter_tree);
 
-        while (nullptr != fgets(line, sizeof(line) - 1, file))
+    return (true);
+}
+
+static void unlink_process_node(ProcessIndex & process_index, uint32_t parent_process_id, uint32_t process_id)
+{
+    std::unordered_map<uint32_t, ProcessNode>::iterator iter_parent = process_index.process_node_map.find(parent_process_id);
+    if (process_index.process_node_map.end() == iter_parent)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> & child_process_list = iter_parent->second.child_process_list;
+    std::vector<uint32_t>::iterator iter_child = std::find(child_process_list.begin(), child_process_list.end(), process_id);
+    if (child_process_list.end() != iter_child)
+    {
+        *iter_child = child_process_list.back();
+        child_process_list.pop_back();
+    }
+}
+
+static void insert_process_node(ProcessIndex & process_index, uint32_t process_id, uint32_t parent_process_id, uint64_t process_order)
+{
+    std::pair<std::unordered_map<uint32_t, ProcessNode>::iterator, bool> result = process_index.process_node_map.insert(std::make_pair(process_id, ProcessNode()));
+    ProcessNode & process_node = result.first->second;
+    if (!result.second)
+    {
+        if (process_node.parent_process_id == parent_process_id)
         {
-            std::vector<std::string> values;
-            Goofer::goofer_split_piece(line, " \t", true, true, values);
-            if (values.size() > index)
-            {
-                gpu_percent_total += 100.0;
-                gpu_percent_using += std::stoi(values[index], nullptr);
-            }
-            nvsmi_alive_time = Goofer::goofer_monotonic_time();
+            process_node.process_order = process_order;
+            return;
         }
-    } while (false);
+        unlink_process_node(process_index, process_node.parent_process_id, process_id);
+    }
 
-    goofer_pclose(file);
+    process_node.parent_process_id = parent_process_id;
+    process_node.process_order = process_order;
 
-    nvsmi_alive_time = 0;
+    if (process_id != parent_process_id)
+    {
+        process_index.process_node_map[parent_process_id].child_process_list.push_back(process_id);
+    }
+}
+
+static bool rebuild_process_index(SystemSnapshot & system_snapshot)
+{
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+    process_index.process_node_map.clear();
+    process_index.index_dirty = true;
+
+    if (!snapshot_process_entries(system_snapshot))
+    {
+        return (false);
+    }
+
+    const std::vector<ProcessEntry> & process_entry_list = system_snapshot.system_helper.process_entry_list;
+    for (std::size_t entry_index = 0; entry_index < process_entry_list.size(); ++entry_index)
+    {
+        const ProcessEntry & process_entry = process_entry_list[entry_index];
+#ifdef _MSC_VER
+        insert_process_node(process_index, process_entry.process_id, process_entry.parent_process_id, entry_index);
+#else
+        insert_process_node(process_index, process_entry.process_id, process_entry.parent_process_id, process_entry.process_start_time);
+#endif // _MSC_VER
+    }
+
+    process_index.index_dirty = false;
 
     return (true);
 }
 
-static bool get_process_gpu_utilization_percentage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot, uint64_t & nvsmi_alive_time)
+#ifndef _MSC_VER
+
+static bool get_process_origin(SystemSnapshot & system_snapshot, uint32_t process_id, uint32_t & parent_process_id, uint64_t & process_start_time)
 {
-    if (0 == system_snapshot.system_resource.gpu_count)
+    char stat_path[32] = { 0x0 };
+    snprintf(stat_path, sizeof(stat_path), "%u/stat", process_id);
+
+    char buffer[512] = { 0x0 };
+    ProcessStat process_stat = { 0x0 };
+    if (!read_proc_file(system_snapshot.system_helper.proc_root_fd, stat_path, buffer, sizeof(buffer)) || !parse_process_stat(buffer, process_stat))
     {
         return (false);
     }
 
-    if (nullptr == counter_handle)
+    parent_process_id = process_stat.parent_process_id;
+    process_start_time = process_stat.start_time;
+
+    return (true);
+}
+
+/*
+ * the event carries no start time in the units of stat, a child gone before its stat is read takes the order of its parent
+ */
+static uint64_t get_forked_process_order(SystemSnapshot & system_snapshot, uint32_t process_id, uint32_t parent_process_id)
+{
+    uint32_t stat_parent_process_id = 0;
+    uint64_t process_start_time = 0;
+    if (get_process_origin(system_snapshot, process_id, stat_parent_process_id, process_start_time))
     {
-#if 0
-        static uint64_t s_last_check_time = 0;
+        return (process_start_time);
+    }
 
-        uint64_t current_time = Goofer::goofer_time();
-        if (current_time >= s_last_check_time && current_time < s_last_check_time + 5)
+    const ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+    std::unordered_map<uint32_t, ProcessNode>::const_iterator iter_parent = process_index.process_node_map.find(parent_process_id);
+    return (process_index.process_node_map.end() != iter_parent ? iter_parent->second.process_order : 0);
+}
+
+static void erase_process_node(SystemSnapshot & system_snapshot, uint32_t process_id)
+{
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+    std::unordered_map<uint32_t, ProcessNode>::iterator iter_node = process_index.process_node_map.find(process_id);
+    if (process_index.process_node_map.end() == iter_node)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> child_process_list;
+    child_process_list.swap(iter_node->second.child_process_list);
+    unlink_process_node(process_index, iter_node->second.parent_process_id, process_id);
+    process_index.process_node_map.erase(iter_node);
+
+    /* the kernel reparents orphans before the exit event is sent, pick up their new parents */
+    for (std::vector<uint32_t>::const_iterator iter_child = child_process_list.begin(); child_process_list.end() != iter_child; ++iter_child)
+    {
+        uint32_t parent_process_id = 0;
+        uint64_t process_start_time = 0;
+        if (get_process_origin(system_snapshot, *iter_child, parent_process_id, process_start_time))
         {
-            return (true);
+            insert_process_node(process_index, *iter_child, parent_process_id, process_start_time);
         }
+        else
+        {
+            erase_process_node(system_snapshot, *iter_child);
+        }
+    }
+}
 
-        s_last_check_time = current_time;
+static bool control_process_connector(int connector_fd, enum proc_cn_mcast_op mcast_op)
+{
+    uint64_t buffer[(NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op)) + sizeof(uint64_t) - 1) / sizeof(uint64_t)] = { 0x0 };
 
-        double gpu_percent_total = 0.0;
-        double gpu_percent_using = 0.0;
-        if (!get_nvidia_gpu_enc(gpu_percent_total, gpu_percent_using, nvsmi_alive_time))
+    struct nlmsghdr * nl_hdr = reinterpret_cast<struct nlmsghdr *>(buffer);
+    nl_hdr->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    nl_hdr->nlmsg_type = NLMSG_DONE;
+    nl_hdr->nlmsg_pid = 0;
+
+    struct cn_msg * cn_hdr = reinterpret_cast<struct cn_msg *>(NLMSG_DATA(nl_hdr));
+    cn_hdr->id.idx = CN_IDX_PROC;
+    cn_hdr->id.val = CN_VAL_PROC;
+    cn_hdr->len = sizeof(enum proc_cn_mcast_op);
+    memcpy(cn_hdr->data, &mcast_op, sizeof(mcast_op));
+
+    return (send(connector_fd, nl_hdr, nl_hdr->nlmsg_len, 0) == static_cast<ssize_t>(nl_hdr->nlmsg_len));
+}
+
+/*
+ * return: 1 - events applied, 0 - no more events, -1 - events lost or socket broken
+ */
+static int recv_process_connector(SystemSnapshot & system_snapshot, bool apply_events, bool & acked)
+{
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+
+    uint64_t buffer[1024] = { 0x0 };
+    struct sockaddr_nl address;
+    socklen_t address_size = sizeof(address);
+    ssize_t recv_size = recvfrom(process_index.connector_fd, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr *>(&address), &address_size);
+    if (recv_size < 0)
+    {
+        if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
         {
-            return (false);
+            return (0);
         }
+        return (-1);
+    }
 
-        SystemResource & system_resource = system_snapshot.system_resource;
-        if (gpu_percent_total > -0.1 && gpu_percent_total < 0.1)
+    if (0 != address.nl_pid)
+    {
+        return (1);
+    }
+
+    int remain_size = static_cast<int>(recv_size);
+    for (struct nlmsghdr * nl_hdr = reinterpret_cast<struct nlmsghdr *>(buffer); NLMSG_OK(nl_hdr, remain_size); nl_hdr = NLMSG_NEXT(nl_hdr, remain_size))
+    {
+        if (NLMSG_NOOP == nl_hdr->nlmsg_type || NLMSG_ERROR == nl_hdr->nlmsg_type)
         {
-            system_resource.gpu_enc_usage = 100.0;
+            continue;
         }
-        else
+
+        const struct cn_msg * cn_hdr = reinterpret_cast<const struct cn_msg *>(NLMSG_DATA(nl_hdr));
+        if (CN_IDX_PROC != cn_hdr->id.idx || CN_VAL_PROC != cn_hdr->id.val)
         {
-            system_resource.gpu_enc_usage = 100.0 * gpu_percent_using / gpu_percent_total;
+            continue;
+        }
+
+        const struct proc_event * event = reinterpret_cast<const struct proc_event *>(cn_hdr->data);
+        if (proc_event::PROC_EVENT_NONE == event->what)
+        {
+            acked = true;
+        }
+        else if (!apply_events)
+        {
+            continue;
+        }
+        else if (proc_event::PROC_EVENT_FORK == event->what)
+        {
+            /* threads fork too, only new thread group leaders are processes */
+            if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid)
+            {
+                uint32_t process_id = static_cast<uint32_t>(event->event_data.fork.child_tgid);
+                uint32_t parent_process_id = static_cast<uint32_t>(event->event_data.fork.parent_tgid);
+                insert_process_node(process_index, process_id, parent_process_id, get_forked_process_order(system_snapshot, process_id, parent_process_id));
+            }
+        }
+        else if (proc_event::PROC_EVENT_EXIT == event->what)
+        {
+            if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid)
+            {
+                erase_process_node(system_snapshot, static_cast<uint32_t>(event->event_data.exit.process_tgid));
+            }
         }
-#endif
-        return (true);
     }
 
-    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
-    ULONG item_count = 0;
-    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, buffer, item_array, item_count))
+    return (1);
+}
+
+static void close_process_connector(SystemSnapshot & system_snapshot)
+{
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+    if (process_index.connector_fd >= 0)
     {
-        return (false);
+        control_process_connector(process_index.connector_fd, PROC_CN_MCAST_IGNORE);
+        close(process_index.connector_fd);
+        process_index.connector_fd = -1;
     }
+    process_index.index_dirty = true;
+}
+
+static bool open_process_connector(SystemSnapshot & system_snapshot)
+{
+    close_process_connector(system_snapshot);
 
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
 
-    for (std::map<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    /* events carry host pids, they are meaningless against a fixture proc root */
+    if ("/proc" != system_snapshot.system_helper.proc_root)
     {
-        ProcessResource & process_resource = iter->second.process_resource;
-        process_resource.gpu_3d_usage = 0;
-        process_resource.gpu_vr_usage = 0;
-        process_resource.gpu_enc_usage = 0;
-        process_resource.gpu_dec_usage = 0;
+        return (false);
     }
 
-    SystemResource & system_resource = system_snapshot.system_resource;
-    system_resource.gpu_3d_usage = 0;
-    system_resource.gpu_vr_usage = 0;
-    system_resource.gpu_enc_usage = 0;
-    system_resource.gpu_dec_usage = 0;
-
-    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    do
     {
-        /*
-         * NVIDIA
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_0_engtype_3D
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_10_engtype_Compute_1
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_11_engtype_VR
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_12_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_13_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_14_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_15_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_1_engtype_Compute_0
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_2_engtype_LegacyOverlay
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_3_engtype_VideoDecode
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_4_engtype_Security
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_5_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_6_engtype_Copy
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_7_engtype_VideoEncode
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_8_engtype_Graphics_1
-         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_9_engtype_Cuda
-         *  AMD
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_0_engtype_3D - 25.7208
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_10_engtype_Timer 0 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_11_engtype_Security 1 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_12_engtype_Video Decode 1 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_13_engtype_Video Encode 0 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_14_engtype_Video Codec 0 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_1_engtype_High Priority 3D - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_2_engtype_High Priority Compute - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_3_engtype_True Audio 0 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_4_engtype_True Audio 1 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_5_engtype_Compute 3 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_6_engtype_Compute 0 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_7_engtype_Compute 1 - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_8_engtype_Copy - 0
-         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_9_engtype_Copy - 0
-         */
-        double gpu_3d_usage = 0;
-        double gpu_vr_usage = 0;
-        double gpu_enc_usage = 0;
-        double gpu_dec_usage = 0;
+        process_index.connector_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (process_index.connector_fd < 0)
+        {
+            break;
+        }
 
-        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
-        if (nullptr != strstr(item.szName, "_3D"))
+        int buffer_size = 4 * 1024 * 1024;
+        if (0 != setsockopt(process_index.connector_fd, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size)))
         {
-            gpu_3d_usage = item.FmtValue.doubleValue;
+            setsockopt(process_index.connector_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
         }
-        else if (nullptr != strstr(item.szName, "_VR"))
+
+        struct sockaddr_nl address;
+        memset(&address, 0x0, sizeof(address));
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = CN_IDX_PROC;
+        address.nl_pid = 0;
+        if (0 != bind(process_index.connector_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)))
         {
-            gpu_vr_usage = item.FmtValue.doubleValue;
+            break;
         }
-        else if (nullptr != strstr(item.szName, "Encode") || nullptr != strstr(item.szName, "Codec"))
+
+        if (!control_process_connector(process_index.connector_fd, PROC_CN_MCAST_LISTEN))
         {
-            gpu_enc_usage = item.FmtValue.doubleValue;
+            break;
         }
-        else if (nullptr != strstr(item.szName, "Decode"))
+
+        /* the kernel silently ignores listeners outside the initial user and pid namespace, only trust an acknowledged subscription */
+        bool acked = false;
+        uint64_t deadline = monotonic_microseconds() + 200000;
+        while (!acked)
         {
-            gpu_dec_usage = item.FmtValue.doubleValue;
+            uint64_t current_time = monotonic_microseconds();
+            if (current_time >= deadline)
+            {
+                break;
+            }
+            struct pollfd poll_fd = { process_index.connector_fd, POLLIN, 0 };
+            if (poll(&poll_fd, 1, static_cast<int>((deadline - current_time + 999) / 1000)) <= 0)
+            {
+                continue;
+            }
+            if (recv_process_connector(system_snapshot, false, acked) < 0)
+            {
+                break;
+            }
         }
-        else
+
+        if (!acked)
         {
-            continue;
+            break;
+        }
+
+        process_index.index_dirty = true;
+
+        return (true);
+    } while (false);
+
+    close_process_connector(system_snapshot);
+
+    return (false);
+}
+
+#endif // _MSC_VER
+
+static bool update_process_index(SystemSnapshot & system_snapshot)
+{
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+
+#ifndef _MSC_VER
+    if (process_index.connector_fd >= 0)
+    {
+        bool acked = false;
+        int result = 0;
+        while ((result = recv_process_connector(system_snapshot, !process_index.index_dirty, acked)) > 0)
+        {
+        }
+
+        if (result < 0)
+        {
+            RUN_LOG_WAR("process connector lost events, rescan processes");
+            process_index.index_dirty = true;
+            while (recv_process_connector(system_snapshot, false, acked) > 0)
+            {
+            }
+        }
+
+        if (!process_index.index_dirty)
+        {
+            return (true);
+        }
+    }
+#endif // _MSC_VER
+
+    return (rebuild_process_index(system_snapshot));
+}
+
+static bool process_is_tree_root(const FlatMap<uint32_t, ProcessTree> & process_tree_map, uint32_t process_id)
+{
+    FlatMap<uint32_t, ProcessTree>::const_iterator iter = process_tree_map.find(process_id);
+    return (process_tree_map.end() != iter && iter->second.process_tree);
+}
+
+static bool update_process_tree(SystemSnapshot & system_snapshot)
+{
+    drop_exited_processes(system_snapshot);
+
+    /* the leaf entries and their storage are kept from the last pass, only their contents are rebuilt */
+    FlatMap<uint32_t, ProcessLeaf> & process_leaf_map = system_snapshot.process_leaf_map;
+    for (FlatMap<uint32_t, ProcessLeaf>::iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; ++iter_leaf)
+    {
+        iter_leaf->second.process_descendant_set.clear();
+    }
+
+    FlatMap<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    if (process_tree_map.empty() || process_helper_map.empty())
+    {
+        process_leaf_map.clear();
+        return (true);
+    }
+
+    ProcessIndex & process_index = system_snapshot.system_helper.process_index;
+    std::vector<std::pair<uint32_t, uint32_t>> & process_ancestor_list = process_index.process_ancestor_list;
+    std::vector<uint32_t> & process_stack = process_index.process_stack;
+    process_ancestor_list.clear();
+
+    for (FlatMap<uint32_t, ProcessTree>::iterator iter = process_tree_map.begin(); process_tree_map.end() != iter; ++iter)
+    {
+        if (iter->second.process_tree)
+        {
+            process_ancestor_list.push_back(std::make_pair(iter->first, iter->first));
+        }
+    }
+
+    if (process_ancestor_list.empty())
+    {
+        process_leaf_map.clear();
+        return (true);
+    }
+
+    if (!update_process_index(system_snapshot))
+    {
+        return (false);
+    }
+
+    /*
+     * walk down from every tree root, a walk stops at nested tree roots which get their own walk;
+     * a process only inherits the ancestor of a parent that started no later than it, a younger parent holds a reused pid;
+     * processes started in the same clock tick tie, so a walk also stops after as many steps as the index has processes
+     */
+    const std::unordered_map<uint32_t, ProcessNode> & process_node_map = process_index.process_node_map;
+    const std::size_t tree_root_count = process_ancestor_list.size();
+    for (std::size_t root_index = 0; root_index < tree_root_count; ++root_index)
+    {
+        const uint32_t process_ancestor = process_ancestor_list[root_index].first;
+
+        process_stack.clear();
+        process_stack.push_back(process_ancestor);
+        std::size_t walk_count = 0;
+        while (!process_stack.empty() && walk_count++ < process_node_map.size())
+        {
+            const uint32_t process_id = process_stack.back();
+            process_stack.pop_back();
+
+            std::unordered_map<uint32_t, ProcessNode>::const_iterator iter_node = process_node_map.find(process_id);
+            if (process_node_map.end() == iter_node)
+            {
+                continue;
+            }
+
+            const ProcessNode & process_node = iter_node->second;
+            const std::vector<uint32_t> & child_process_list = process_node.child_process_list;
+            for (std::vector<uint32_t>::const_iterator iter_child = child_process_list.begin(); child_process_list.end() != iter_child; ++iter_child)
+            {
+                const uint32_t child_process_id = *iter_child;
+                if (process_ancestor != process_id)
+                {
+                    std::unordered_map<uint32_t, ProcessNode>::const_iterator iter_child_node = process_node_map.find(child_process_id);
+                    if (process_node_map.end() == iter_child_node || iter_child_node->second.process_order < process_node.process_order)
+                    {
+                        continue;
+                    }
+                }
+
+                if (process_is_tree_root(process_tree_map, child_process_id))
+                {
+                    ProcessLeaf & process_leaf = process_leaf_map[process_id];
+                    process_leaf.process_descendant_set.insert(child_process_id);
+                }
+                else
+                {
+                    process_ancestor_list.push_back(std::make_pair(child_process_id, process_ancestor));
+                    process_stack.push_back(child_process_id);
+                }
+            }
+        }
+    }
+
+    /*
+     * a process has one parent and the walks stop at tree roots, so a pid is in the list once;
+     * new helpers are appended and merged after the loop, a pass that finds many new processes sorts them once
+     */
+    for (std::vector<std::pair<uint32_t, uint32_t>>::const_iterator iter_ancestor = process_ancestor_list.begin(); process_ancestor_list.end() != iter_ancestor; ++iter_ancestor)
+    {
+        uint32_t process_id = iter_ancestor->first;
+        uint32_t process_ancestor = iter_ancestor->second;
+        FlatMap<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.find(process_ancestor);
+        if (process_tree_map.end() != iter_tree)
+        {
+            FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
+            if (process_helper_map.end() != iter_helper)
+            {
+                if (process_ancestor != process_id)
+                {
+                    reopen_process_handle(system_snapshot, process_id, iter_helper->second);
+                }
+                if (process_ancestor != iter_helper->second.process_ancestor)
+                {
+                    FlatMap<uint32_t, ProcessTree>::iterator iter = process_tree_map.find(iter_helper->second.process_ancestor);
+                    if (process_tree_map.end() != iter)
+                    {
+                        iter->second.process_descendant_set.erase(process_id);
+                    }
+                    iter_tree->second.process_descendant_set.insert(process_id);
+                    iter_helper->second.process_ancestor = process_ancestor;
+                }
+            }
+            else
+            {
+                process_handle_t process_handle;
+                if (open_process_handle(system_snapshot, process_id, process_handle))
+                {
+                    iter_tree->second.process_descendant_set.insert_pending(process_id);
+                    watch_process_exit(system_snapshot, process_id, process_helper_map.insert_pending(std::make_pair(process_id, ProcessHelper(process_ancestor, process_handle))).second);
+                }
+            }
+        }
+    }
+
+    process_helper_map.merge_pending();
+    for (FlatMap<uint32_t, ProcessTree>::iterator iter_tree = process_tree_map.begin(); process_tree_map.end() != iter_tree; ++iter_tree)
+    {
+        iter_tree->second.process_descendant_set.merge_pending();
+    }
+
+    for (FlatMap<uint32_t, ProcessLeaf>::iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; )
+    {
+        if (iter_leaf->second.process_descendant_set.empty())
+        {
+            iter_leaf = process_leaf_map.erase(iter_leaf);
+        }
+        else
+        {
+            ++iter_leaf;
+        }
+    }
+
+    for (FlatMap<uint32_t, ProcessLeaf>::iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; ++iter_leaf)
+    {
+        FlatSet<uint32_t> & process_descendant_set = iter_leaf->second.process_descendant_set;
+        process_stack.assign(process_descendant_set.begin(), process_descendant_set.end());
+        for (std::size_t stack_index = 0; stack_index < process_stack.size(); ++stack_index)
+        {
+            FlatMap<uint32_t, ProcessLeaf>::iterator iter_sub_leaf = process_leaf_map.find(process_stack[stack_index]);
+            if (process_leaf_map.end() != iter_sub_leaf)
+            {
+                FlatSet<uint32_t> & sub_process_descendant_set = iter_sub_leaf->second.process_descendant_set;
+                process_descendant_set.insert(sub_process_descendant_set.begin(), sub_process_descendant_set.end());
+                process_stack.insert(process_stack.end(), sub_process_descendant_set.begin(), sub_process_descendant_set.end());
+            }
+        }
+    }
+
+    return (true);
+}
+
+/*
+ * check time and cpu time are in the same unit, the first sample of a process only sets the base
+ */
+static bool update_process_cpu_usage(ProcessHelper & process_helper, uint64_t cpu_check_time, uint64_t cpu_system_time, uint64_t cpu_count, ProcessResource & process_resource)
+{
+    if (0 == cpu_count || 0 == process_helper.cpu_check_time || process_helper.cpu_check_time >= cpu_check_time || process_helper.cpu_system_time > cpu_system_time)
+    {
+        process_helper.cpu_check_time = cpu_check_time;
+        process_helper.cpu_system_time = cpu_system_time;
+        return (false);
+    }
+
+    uint64_t check_time_delta = cpu_check_time - process_helper.cpu_check_time;
+    uint64_t system_time_delta = cpu_system_time - process_helper.cpu_system_time;
+
+    process_resource.cpu_usage += static_cast<double>(100.0 * system_time_delta / cpu_count / check_time_delta);
+
+    process_helper.cpu_check_time = cpu_check_time;
+    process_helper.cpu_system_time = cpu_system_time;
+
+    return (true);
+}
+
+#ifdef _MSC_VER
+
+static uint64_t file_time_to_utc_time(FILETIME file_time)
+{
+    uint64_t utc_time = file_time.dwHighDateTime;
+    utc_time <<= 32;
+    utc_time |= file_time.dwLowDateTime;
+    return (utc_time);
+}
+
+/*
+ * liveness is checked once, then cpu times and working set are read from the same handle
+ */
+static bool get_process_usage(uint32_t process_id, ProcessHelper & process_helper, ProcessResource & process_resource, SystemSnapshot & system_snapshot)
+{
+    /* a watched process is closed by the exit thread when it exits, only an unwatched one needs the check */
+    if (nullptr == process_helper.process_handle || (nullptr == process_helper.process_exit_watch && !process_is_alive(process_helper.process_handle)))
+    {
+        return (false);
+    }
+
+    FILETIME current_time = { 0x0 };
+    GetSystemTimeAsFileTime(&current_time);
+
+    FILETIME creation_time = { 0x0 };
+    FILETIME exit_time = { 0x0 };
+    FILETIME kernel_time = { 0x0 };
+    FILETIME user_time = { 0x0 };
+    if (GetProcessTimes(process_helper.process_handle, &creation_time, &exit_time, &kernel_time, &user_time))
+    {
+        update_process_cpu_usage(process_helper, file_time_to_utc_time(current_time), file_time_to_utc_time(kernel_time) + file_time_to_utc_time(user_time), system_snapshot.system_resource.cpu_count, process_resource);
+    }
+
+    PSAPI_WORKING_SET_INFORMATION pwsi = { 0x0 };
+    if (QueryWorkingSet(process_helper.process_handle, &pwsi, sizeof(pwsi)) || ERROR_BAD_LENGTH == GetLastError())
+    {
+        process_resource.ram_usage += pwsi.NumberOfEntries * system_snapshot.system_helper.page_size;
+        return (true);
+    }
+
+    PROCESS_MEMORY_COUNTERS pmc = { 0x0 };
+    if (GetProcessMemoryInfo(process_helper.process_handle, &pmc, sizeof(pmc)))
+    {
+        process_resource.ram_usage += pmc.WorkingSetSize;
+        return (true);
+    }
+
+    return (false);
+}
+
+static bool get_system_cpu_count(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    std::size_t core_count = 0;
+    if (Goofer::get_system_cpu_core_count(core_count))
+    {
+        system_resource.cpu_count = static_cast<uint64_t>(core_count);
+        return (true);
+    }
+    else
+    {
+        system_resource.cpu_count = 0;
+        return (false);
+    }
+}
+
+static bool get_system_memory_usage(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    uint64_t total_size = 0;
+    uint64_t avail_size = 0;
+    if (Goofer::get_system_memory_usage(total_size, avail_size))
+    {
+        system_resource.ram_total = total_size;
+        system_resource.ram_usage = total_size - avail_size;
+        return (true);
+    }
+    else
+    {
+        system_resource.ram_total = 0;
+        system_resource.ram_usage = 0;
+        return (false);
+    }
+}
+
+#else
+
+/*
+ * stat carries the state, the cpu times and the resident pages, so one read covers the process
+ */
+static bool get_process_usage(uint32_t process_id, ProcessHelper & process_helper, ProcessResource & process_resource, SystemSnapshot & system_snapshot)
+{
+    if (process_helper.process_handle < 0)
+    {
+        return (false);
+    }
+
+    char buffer[512] = { 0x0 };
+    ProcessStat process_stat = { 0x0 };
+    if (!read_proc_fd(process_helper.process_handle, buffer, sizeof(buffer)) || !parse_process_stat(buffer, process_stat))
+    {
+        /* the process is gone, the handle is opened again if its pid shows up under the tree later */
+        close_process_helper(process_id, process_helper);
+        return (false);
+    }
+
+    if (~static_cast<uint64_t>(0) == process_helper.process_start_time)
+    {
+        process_helper.process_start_time = process_stat.start_time;
+    }
+    else if (process_helper.process_start_time != process_stat.start_time)
+    {
+        close_process_helper(process_id, process_helper);
+        return (false);
+    }
+
+    if (!process_stat_is_alive(process_stat))
+    {
+        return (false);
+    }
+
+    const SystemHelper & system_helper = system_snapshot.system_helper;
+    const uint64_t check_time = monotonic_microseconds();
+    const uint64_t last_check_time = process_helper.cpu_check_time;
+    update_process_cpu_usage(process_helper, check_time, (process_stat.user_time + process_stat.kernel_time) * 1000000 / system_helper.clock_ticks, system_snapshot.system_resource.cpu_count, process_resource);
+
+    process_resource.ram_usage += process_stat.resident_pages * system_helper.page_size;
+
+    /*
+     * the fault counters come with the same stat read, their base is the cpu check time;
+     * read_bytes / write_bytes of /proc/<pid>/io are not sampled: that file needs ptrace access to the process,
+     * which a monitor of other users' processes rarely has, and a second kept-open fd per process would double the fds held
+     */
+    if (0 != last_check_time && last_check_time < check_time && process_helper.minor_faults <= process_stat.minor_faults && process_helper.major_faults <= process_stat.major_faults)
+    {
+        process_resource.minor_faults += (process_stat.minor_faults - process_helper.minor_faults) * 1000000 / (check_time - last_check_time);
+        process_resource.major_faults += (process_stat.major_faults - process_helper.major_faults) * 1000000 / (check_time - last_check_time);
+    }
+    process_helper.minor_faults = process_stat.minor_faults;
+    process_helper.major_faults = process_stat.major_faults;
+
+    return (true);
+}
+
+static bool get_system_cpu_count(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.cpu_count = 0;
+
+    int file_fd = openat(system_snapshot.system_helper.proc_root_fd, "stat", O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+    {
+        return (false);
+    }
+
+    /*
+     * cpu  user nice system idle iowait irq softirq steal guest guest_nice
+     * cpu0 ...
+     * read in chunks, a host with many cpus has a stat larger than any fixed buffer
+     */
+    char buffer[4096];
+    char line_head[4] = { 0x0 };
+    std::size_t head_size = 0; /* characters of the current line seen, up to 4 */
+    bool read_failed = false;
+    while (true)
+    {
+        ssize_t read_size = read(file_fd, buffer, sizeof(buffer));
+        if (read_size < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            read_failed = true;
+            break;
+        }
+        if (0 == read_size)
+        {
+            break;
+        }
+
+        for (ssize_t buffer_index = 0; buffer_index < read_size; ++buffer_index)
+        {
+            if ('\n' == buffer[buffer_index])
+            {
+                head_size = 0;
+            }
+            else if (head_size < sizeof(line_head))
+            {
+                line_head[head_size++] = buffer[buffer_index];
+                if (sizeof(line_head) == head_size && 0 == strncmp(line_head, "cpu", 3) && line_head[3] >= '0' && line_head[3] <= '9')
+                {
+                    system_resource.cpu_count += 1;
+                }
+            }
+        }
+    }
+
+    close(file_fd);
+
+    if (read_failed)
+    {
+        system_resource.cpu_count = 0;
+    }
+
+    return (0 != system_resource.cpu_count);
+}
+
+static bool get_system_memory_usage(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.ram_total = 0;
+    system_resource.ram_usage = 0;
+
+    /*
+     * MemTotal:       16318480 kB
+     * MemFree:          592524 kB
+     * MemAvailable:    9542660 kB
+     * Buffers:          765476 kB
+     * Cached:          7870156 kB
+     */
+    char buffer[4096] = { 0x0 };
+    if (!read_proc_file(system_snapshot.system_helper.proc_root_fd, "meminfo", buffer, sizeof(buffer)))
+    {
+        return (false);
+    }
+
+    uint64_t total_size = ~static_cast<uint64_t>(0);
+    uint64_t avail_size = ~static_cast<uint64_t>(0);
+    uint64_t free_size = 0;
+    uint64_t buffers_size = 0;
+    uint64_t cached_size = 0;
+
+    const struct
+    {
+        const char *    name;
+        uint64_t *      value;
+    } memory_items[] =
+    {
+        { "MemTotal:",     &total_size   },
+        { "MemAvailable:", &avail_size   },
+        { "MemFree:",      &free_size    },
+        { "Buffers:",      &buffers_size },
+        { "Cached:",       &cached_size  },
+    };
+
+    for (const char * line = buffer; nullptr != line && 0x0 != *line; line = strchr(line, '\n'), line = (nullptr != line ? line + 1 : nullptr))
+    {
+        for (std::size_t index = 0; index < sizeof(memory_items) / sizeof(memory_items[0]); ++index)
+        {
+            std::size_t name_size = strlen(memory_items[index].name);
+            if (0 == strncmp(line, memory_items[index].name, name_size))
+            {
+                parse_uint64(line + name_size, *memory_items[index].value);
+                break;
+            }
+        }
+    }
+
+    if (~static_cast<uint64_t>(0) == total_size)
+    {
+        return (false);
+    }
+
+    if (~static_cast<uint64_t>(0) == avail_size)
+    {
+        avail_size = free_size + buffers_size + cached_size;
+    }
+
+    if (avail_size > total_size)
+    {
+        avail_size = total_size;
+    }
+
+    system_resource.ram_total = total_size * 1024;
+    system_resource.ram_usage = (total_size - avail_size) * 1024;
+
+    return (true);
+}
+
+#endif // _MSC_VER
+
+static ProcessSnapshot & get_ancestor_snapshot(FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map, ProcessHelper & process_helper)
+{
+    /* the snapshot map only changes when a process is appended or removed, so the cached position is nearly always right */
+    if (process_helper.snapshot_index < process_snapshot_map.size())
+    {
+        FlatMap<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin() + process_helper.snapshot_index;
+        if (process_helper.process_ancestor == iter->first)
+        {
+            return (iter->second);
+        }
+    }
+
+    ProcessSnapshot & process_snapshot = process_snapshot_map[process_helper.process_ancestor];
+    process_helper.snapshot_index = static_cast<std::size_t>(process_snapshot_map.find(process_helper.process_ancestor) - process_snapshot_map.begin());
+    return (process_snapshot);
+}
+
+static bool get_process_usage(SystemSnapshot & system_snapshot)
+{
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        iter->second.process_resource.cpu_usage = 0;
+        iter->second.process_resource.ram_usage = 0;
+        iter->second.process_resource.minor_faults = 0;
+        iter->second.process_resource.major_faults = 0;
+    }
+
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    for (FlatMap<uint32_t, ProcessHelper>::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+    {
+        get_process_usage(iter->first, iter->second, get_ancestor_snapshot(process_snapshot_map, iter->second).process_resource, system_snapshot);
+    }
+
+    return (true);
+}
+
+/*
+ * return: true - a monitoring process exited, it keeps its entries until remove_process;
+ *         a sub process is closed at once and dropped from the tables by the next pass, see drop_exited_processes
+ */
+static bool apply_process_exit(SystemSnapshot & system_snapshot, uint32_t process_id)
+{
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
+    if (process_helper_map.end() == iter_helper)
+    {
+        return (false);
+    }
+
+    close_process_helper(process_id, iter_helper->second);
+
+    FlatMap<uint32_t, ProcessTree> & process_tree_map = system_snapshot.process_tree_map;
+    if (process_tree_map.end() != process_tree_map.find(process_id))
+    {
+        return (true);
+    }
+
+    system_snapshot.process_drop_list.push_back(process_id);
+
+    return (false);
+}
+
+/*
+ * readers get process_resource_total as it is, so the leaf sums are done here once instead of on every read
+ */
+static void aggregate_process_resource(SystemSnapshot & system_snapshot)
+{
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        ProcessSnapshot & process_snapshot = iter->second;
+        memcpy(&process_snapshot.process_resource_total, &process_snapshot.process_resource, sizeof(process_snapshot.process_resource_total));
+    }
+
+    /* a leaf set already holds every nested tree root below it, not only the direct ones */
+    const FlatMap<uint32_t, ProcessLeaf> & process_leaf_map = system_snapshot.process_leaf_map;
+    for (FlatMap<uint32_t, ProcessLeaf>::const_iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; ++iter_leaf)
+    {
+        FlatMap<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(iter_leaf->first);
+        if (process_snapshot_map.end() == iter_snapshot)
+        {
+            continue;
+        }
+
+        ProcessResource & process_resource_total = iter_snapshot->second.process_resource_total;
+        const FlatSet<uint32_t> & process_descendant_set = iter_leaf->second.process_descendant_set;
+        for (FlatSet<uint32_t>::const_iterator iter_descendant = process_descendant_set.begin(); process_descendant_set.end() != iter_descendant; ++iter_descendant)
+        {
+            FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter_descendant_snapshot = process_snapshot_map.find(*iter_descendant);
+            if (process_snapshot_map.end() != iter_descendant_snapshot)
+            {
+                process_resource_total += iter_descendant_snapshot->second;
+            }
+        }
+    }
+}
+
+#ifdef _MSC_VER
+
+static bool get_formatted_counter_array(PDH_HCOUNTER counter_handle, DWORD value_format, std::vector<char> & buffer, PDH_FMT_COUNTERVALUE_ITEM *& item_array, ULONG & item_count)
+{
+    item_array = nullptr;
+    item_count = 0;
+
+    ULONG buffer_size = 0;
+    PDH_STATUS status = PdhGetFormattedCounterArray(counter_handle, value_format, &buffer_size, &item_count, item_array);
+    if (PDH_MORE_DATA == status)
+    {
+        buffer.resize(buffer_size);
+        item_array = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM *>(&buffer[0]);
+        status = PdhGetFormattedCounterArray(counter_handle, value_format, &buffer_size, &item_count, item_array);
+    }
+
+    if (ERROR_SUCCESS != status)
+    {
+        item_array = nullptr;
+        item_count = 0;
+        return (false);
+    }
+
+    return (item_count > 0);
+}
+
+static bool get_processor_utilization_percentage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+
+    if (nullptr == counter_handle)
+    {
+        if (0 == system_resource.cpu_count)
+        {
+            return (false);
+        }
+
+        std::vector<size_t> cpu_usage;
+        if (!Goofer::get_system_cpu_usage(cpu_usage))
+        {
+            return (false);
+        }
+
+        if (cpu_usage.empty())
+        {
+            return (false);
+        }
+
+        system_resource.cpu_usage = 1.0 * std::accumulate(cpu_usage.begin(), cpu_usage.end(), static_cast<size_t>(0)) / system_resource.cpu_count;
+
+        return (true);
+    }
+
+    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
+    ULONG item_count = 0;
+    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, buffer, item_array, item_count))
+    {
+        return (false);
+    }
+
+    system_resource.cpu_usage = 0;
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+        system_resource.cpu_usage += item.FmtValue.doubleValue;
+    }
+
+    return (true);
+}
+
+#else
+
+static bool get_processor_utilization_percentage(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    SystemHelper & system_helper = system_snapshot.system_helper;
+
+    /*
+     * cpu  user nice system idle iowait irq softirq steal guest guest_nice
+     */
+    char buffer[256] = { 0x0 };
+    if (!read_proc_file(system_helper.proc_root_fd, "stat", buffer, sizeof(buffer)) || 0 != strncmp(buffer, "cpu ", 4))
+    {
+        return (false);
+    }
+
+    uint64_t cpu_times[8] = { 0x0 };
+    const char * str = buffer + 4;
+    for (std::size_t index = 0; index < sizeof(cpu_times) / sizeof(cpu_times[0]) && nullptr != str; ++index)
+    {
+        str = parse_uint64(str, cpu_times[index]);
+    }
+
+    uint64_t cpu_total_time = std::accumulate(cpu_times, cpu_times + sizeof(cpu_times) / sizeof(cpu_times[0]), static_cast<uint64_t>(0));
+    uint64_t cpu_busy_time = cpu_total_time - cpu_times[3] - cpu_times[4];
+    if (0 == system_helper.cpu_total_time || system_helper.cpu_total_time >= cpu_total_time || system_helper.cpu_busy_time > cpu_busy_time)
+    {
+        system_helper.cpu_busy_time = cpu_busy_time;
+        system_helper.cpu_total_time = cpu_total_time;
+        return (false);
+    }
+
+    system_resource.cpu_usage = 100.0 * (cpu_busy_time - system_helper.cpu_busy_time) / (cpu_total_time - system_helper.cpu_total_time);
+
+    system_helper.cpu_busy_time = cpu_busy_time;
+    system_helper.cpu_total_time = cpu_total_time;
+
+    return (true);
+}
+
+#endif // _MSC_VER
+
+#define NVSMI_MAX_COLUMN_COUNT      32
+#define NVSMI_INVALID_COLUMN        static_cast<uint32_t>(~0)
+
+/*
+ * nvidia-smi dmon
+ *     # gpu    sm   mem   enc   dec
+ *     # Idx     %     %     %     %
+ *         0    12     5     0     0
+ *         1     -     -     -     -
+ */
+static char * skip_nvsmi_header_mark(char * line)
+{
+    while ('#' == *line)
+    {
+        ++line;
+    }
+    return (line);
+}
+
+static bool is_nvsmi_blank(char c)
+{
+    return (' ' == c || '\t' == c || '\r' == c || '\n' == c);
+}
+
+/* split in place: blanks become terminators, tokens point into the line */
+static uint32_t split_nvsmi_line(char * line, char * tokens[], uint32_t max_token_count)
+{
+    uint32_t token_count = 0;
+    while (token_count < max_token_count)
+    {
+        while (is_nvsmi_blank(*line))
+        {
+            ++line;
+        }
+        if (0x0 == *line)
+        {
+            break;
+        }
+        tokens[token_count++] = line;
+        while (0x0 != *line && !is_nvsmi_blank(*line))
+        {
+            ++line;
+        }
+        if (0x0 == *line)
+        {
+            break;
+        }
+        *line++ = 0x0;
+    }
+    return (token_count);
+}
+
+static uint32_t find_nvsmi_column(char * const tokens[], uint32_t token_count, const char * column_name)
+{
+    for (uint32_t index = 0; index < token_count; ++index)
+    {
+        if (0 == stricmp(column_name, tokens[index]))
+        {
+            return (index);
+        }
+    }
+    return (NVSMI_INVALID_COLUMN);
+}
+
+static uint64_t get_nvsmi_column_value(char * const tokens[], uint32_t token_count, uint32_t column_index)
+{
+    uint64_t value = 0;
+    if (column_index < token_count)
+    {
+        parse_uint64(tokens[column_index], value); /* "-": not supported, reads as 0 */
+    }
+    return (value);
+}
+
+#ifdef _MSC_VER
+
+static bool get_nvidia_gpu_enc(double & gpu_percent_total, double & gpu_percent_using, uint64_t & nvsmi_alive_time)
+{
+    gpu_percent_total = 0.0;
+    gpu_percent_using = 0.0;
+
+    static bool s_check_tool_not_exist = false;
+
+    if (s_check_tool_not_exist)
+    {
+        return (false);
+    }
+
+    FILE * file = goofer_popen("nvidia-smi dmon -s u -c 1", "r");
+    if (nullptr == file)
+    {
+        s_check_tool_not_exist = true;
+        return (false);
+    }
+
+    nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+    do
+    {
+        char line[128] = { 0x0 };
+        if (nullptr == fgets(line, sizeof(line) - 1, file))
+        {
+            break;
+        }
+
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+        char * tokens[NVSMI_MAX_COLUMN_COUNT] = { nullptr };
+        uint32_t title_count = split_nvsmi_line(skip_nvsmi_header_mark(line), tokens, NVSMI_MAX_COLUMN_COUNT);
+        uint32_t index = find_nvsmi_column(tokens, title_count, "enc");
+        if (NVSMI_INVALID_COLUMN == index)
+        {
+            break;
+        }
+
+        if (nullptr == fgets(line, sizeof(line) - 1, file))
+        {
+            break;
+        }
+
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+        if (title_count != split_nvsmi_line(skip_nvsmi_header_mark(line), tokens, NVSMI_MAX_COLUMN_COUNT))
+        {
+            break;
+        }
+
+        while (nullptr != fgets(line, sizeof(line) - 1, file))
+        {
+            uint32_t token_count = split_nvsmi_line(line, tokens, NVSMI_MAX_COLUMN_COUNT);
+            if (token_count > index)
+            {
+                gpu_percent_total += 100.0;
+                gpu_percent_using += get_nvsmi_column_value(tokens, token_count, index);
+            }
+            nvsmi_alive_time = Goofer::goofer_monotonic_time();
+        }
+    } while (false);
+
+    goofer_pclose(file);
+
+    nvsmi_alive_time = 0;
+
+    return (true);
+}
+
+static const char * parse_gpu_instance_field(const char * str, const char * field_name, int field_base, uint64_t & value)
+{
+    std::size_t name_size = strlen(field_name);
+    if (0 != strncmp(str, field_name, name_size))
+    {
+        return (nullptr);
+    }
+
+    char * value_end = nullptr;
+    value = strtoull(str + name_size, &value_end, field_base);
+
+    return (value_end == str + name_size ? nullptr : value_end);
+}
+
+/*
+ * GPU Engine:
+ *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_0_engtype_3D
+ * GPU Process Memory:
+ *    pid_25832_luid_0x000000_0x00DABC_phys_0
+ */
+static void parse_gpu_instance(const char * instance_name, GpuInstance & gpu_instance)
+{
+    gpu_instance.process_id = 0;
+    gpu_instance.adapter_luid = 0;
+    gpu_instance.adapter_phys = 0;
+
+    if (nullptr != strstr(instance_name, "_3D"))
+    {
+        gpu_instance.engine_type = GPU_ENGINE_TYPE_3D;
+    }
+    else if (nullptr != strstr(instance_name, "_VR"))
+    {
+        gpu_instance.engine_type = GPU_ENGINE_TYPE_VR;
+    }
+    else if (nullptr != strstr(instance_name, "Encode") || nullptr != strstr(instance_name, "Codec"))
+    {
+        gpu_instance.engine_type = GPU_ENGINE_TYPE_ENCODE;
+    }
+    else if (nullptr != strstr(instance_name, "Decode"))
+    {
+        gpu_instance.engine_type = GPU_ENGINE_TYPE_DECODE;
+    }
+    else
+    {
+        gpu_instance.engine_type = GPU_ENGINE_TYPE_OTHER;
+    }
+
+    uint64_t process_id = 0;
+    const char * str = parse_gpu_instance_field(instance_name, "pid_", 10, process_id);
+    if (nullptr == str)
+    {
+        return;
+    }
+    gpu_instance.process_id = static_cast<uint32_t>(process_id);
+
+    uint64_t luid_high_part = 0;
+    uint64_t luid_low_part = 0;
+    if (nullptr == (str = parse_gpu_instance_field(str, "_luid_0x", 16, luid_high_part)) || nullptr == (str = parse_gpu_instance_field(str, "_0x", 16, luid_low_part)))
+    {
+        return;
+    }
+    gpu_instance.adapter_luid = (luid_high_part << 32) | (luid_low_part & 0xFFFFFFFF);
+
+    uint64_t adapter_phys = 0;
+    if (nullptr == parse_gpu_instance_field(str, "_phys_", 10, adapter_phys))
+    {
+        return;
+    }
+    gpu_instance.adapter_phys = static_cast<uint32_t>(adapter_phys);
+}
+
+/*
+ * the instance set of a counter barely changes between two ticks, so a name is only parsed when the name at its index changes
+ */
+static const GpuInstance * update_gpu_instance_table(GpuInstanceTable & gpu_instance_table, const PDH_FMT_COUNTERVALUE_ITEM * item_array, ULONG item_count)
+{
+    std::vector<std::string> & instance_name_list = gpu_instance_table.instance_name_list;
+    std::vector<GpuInstance> & instance_list = gpu_instance_table.instance_list;
+
+    instance_name_list.resize(item_count);
+    instance_list.resize(item_count);
+
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        std::string & instance_name = instance_name_list[item_index];
+        if (instance_name != item_array[item_index].szName)
+        {
+            instance_name = item_array[item_index].szName;
+            parse_gpu_instance(instance_name.c_str(), instance_list[item_index]);
+        }
+    }
+
+    return (instance_list.data());
+}
+
+static bool get_process_gpu_utilization_percentage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot, uint64_t & nvsmi_alive_time)
+{
+    if (0 == system_snapshot.system_resource.gpu_count)
+    {
+        return (false);
+    }
+
+    if (nullptr == counter_handle)
+    {
+#if 0
+        static uint64_t s_last_check_time = 0;
+
+        uint64_t current_time = Goofer::goofer_time();
+        if (current_time >= s_last_check_time && current_time < s_last_check_time + 5)
+        {
+            return (true);
+        }
+
+        s_last_check_time = current_time;
+
+        double gpu_percent_total = 0.0;
+        double gpu_percent_using = 0.0;
+        if (!get_nvidia_gpu_enc(gpu_percent_total, gpu_percent_using, nvsmi_alive_time))
+        {
+            return (false);
+        }
+
+        SystemResource & system_resource = system_snapshot.system_resource;
+        if (gpu_percent_total > -0.1 && gpu_percent_total < 0.1)
+        {
+            system_resource.gpu_enc_usage = 100.0;
+        }
+        else
+        {
+            system_resource.gpu_enc_usage = 100.0 * gpu_percent_using / gpu_percent_total;
+        }
+#endif
+        return (true);
+    }
+
+    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
+    ULONG item_count = 0;
+    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, buffer, item_array, item_count))
+    {
+        return (false);
+    }
+
+    const GpuInstance * instance_array = update_gpu_instance_table(system_snapshot.system_helper.gpu_engine_table, item_array, item_count);
+
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+
+    for (FlatMap<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        ProcessResource & process_resource = iter->second.process_resource;
+        process_resource.gpu_3d_usage = 0;
+        process_resource.gpu_vr_usage = 0;
+        process_resource.gpu_enc_usage = 0;
+        process_resource.gpu_dec_usage = 0;
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.gpu_3d_usage = 0;
+    system_resource.gpu_vr_usage = 0;
+    system_resource.gpu_enc_usage = 0;
+    system_resource.gpu_dec_usage = 0;
+
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        /*
+         * NVIDIA
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_0_engtype_3D
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_10_engtype_Compute_1
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_11_engtype_VR
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_12_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_13_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_14_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_15_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_1_engtype_Compute_0
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_2_engtype_LegacyOverlay
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_3_engtype_VideoDecode
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_4_engtype_Security
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_5_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_6_engtype_Copy
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_7_engtype_VideoEncode
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_8_engtype_Graphics_1
+         *    pid_25832_luid_0x00000000_0x0000DABC_phys_0_eng_9_engtype_Cuda
+         *  AMD
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_0_engtype_3D - 25.7208
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_10_engtype_Timer 0 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_11_engtype_Security 1 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_12_engtype_Video Decode 1 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_13_engtype_Video Encode 0 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_14_engtype_Video Codec 0 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_1_engtype_High Priority 3D - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_2_engtype_High Priority Compute - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_3_engtype_True Audio 0 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_4_engtype_True Audio 1 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_5_engtype_Compute 3 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_6_engtype_Compute 0 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_7_engtype_Compute 1 - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_8_engtype_Copy - 0
+         *    pid_18360_luid_0x00000000_0x0000B750_phys_0_eng_9_engtype_Copy - 0
+         */
+        double gpu_3d_usage = 0;
+        double gpu_vr_usage = 0;
+        double gpu_enc_usage = 0;
+        double gpu_dec_usage = 0;
+
+        const PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+        const GpuInstance & gpu_instance = instance_array[item_index];
+        if (GPU_ENGINE_TYPE_3D == gpu_instance.engine_type)
+        {
+            gpu_3d_usage = item.FmtValue.doubleValue;
+        }
+        else if (GPU_ENGINE_TYPE_VR == gpu_instance.engine_type)
+        {
+            gpu_vr_usage = item.FmtValue.doubleValue;
+        }
+        else if (GPU_ENGINE_TYPE_ENCODE == gpu_instance.engine_type)
+        {
+            gpu_enc_usage = item.FmtValue.doubleValue;
+        }
+        else if (GPU_ENGINE_TYPE_DECODE == gpu_instance.engine_type)
+        {
+            gpu_dec_usage = item.FmtValue.doubleValue;
+        }
+        else
+        {
+            continue;
+        }
+
+        FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(gpu_instance.process_id);
+        if (process_helper_map.end() != iter_helper)
+        {
+            FlatMap<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(iter_helper->second.process_ancestor);
+            if (process_snapshot_map.end() != iter_snapshot)
+            {
+                ProcessResource & process_resource = iter_snapshot->second.process_resource;
+                process_resource.gpu_3d_usage += gpu_3d_usage;
+                process_resource.gpu_vr_usage += gpu_vr_usage;
+                process_resource.gpu_enc_usage += gpu_enc_usage;
+                process_resource.gpu_dec_usage += gpu_dec_usage;
+            }
+        }
+        system_resource.gpu_3d_usage += gpu_3d_usage;
+        system_resource.gpu_vr_usage += gpu_vr_usage;
+        system_resource.gpu_enc_usage += gpu_enc_usage;
+        system_resource.gpu_dec_usage += gpu_dec_usage;
+    }
+
+    return (true);
+}
+
+#else
+
+static bool read_sysfs_uint64(const std::string & file_path, uint64_t & value)
+{
+    char buffer[64] = { 0x0 };
+    return (read_proc_file(AT_FDCWD, file_path.c_str(), buffer, sizeof(buffer)) && nullptr != parse_uint64(buffer, value));
+}
+
+static bool get_system_gpu_utilization_percentage(SystemSnapshot & system_snapshot)
+{
+    if (0 == system_snapshot.system_resource.gpu_count)
+    {
+        return (false);
+    }
+
+    const std::string & gpu_device_path = system_snapshot.system_helper.gpu_device_path;
+    if (gpu_device_path.empty())
+    {
+        return (true);
+    }
+
+    /*
+     * amdgpu: /sys/class/drm/card0/device/gpu_busy_percent
+     */
+    uint64_t gpu_busy_percent = 0;
+    if (!read_sysfs_uint64(gpu_device_path + "/gpu_busy_percent", gpu_busy_percent))
+    {
+        return (false);
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.gpu_3d_usage = static_cast<double>(gpu_busy_percent);
+
+    return (true);
+}
+
+#endif // _MSC_VER
+
+#ifdef _MSC_VER
+
+static bool get_process_gpu_dedicated_memory_usage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot, uint64_t & nvsmi_alive_time)
+{
+    if (0 == system_snapshot.system_resource.gpu_count)
+    {
+        return (false);
+    }
+
+    if (nullptr == counter_handle)
+    {
+        return (true);
+    }
+
+    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
+    ULONG item_count = 0;
+    if (!get_formatted_counter_array(counter_handle, PDH_FMT_LARGE, buffer, item_array, item_count))
+    {
+        return (false);
+    }
+
+    const GpuInstance * instance_array = update_gpu_instance_table(system_snapshot.system_helper.gpu_memory_table, item_array, item_count);
+
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+
+    for (FlatMap<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        ProcessResource & process_resource = iter->second.process_resource;
+        process_resource.gpu_mem_usage = 0;
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.gpu_mem_usage = 0;
+
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        /*
+         * pid_25832_luid_0x000000_0x00DABC_phys_0
+         */
+        const PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+        uint64_t gpu_mem_usage = static_cast<uint64_t>(item.FmtValue.largeValue);
+        FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(instance_array[item_index].process_id);
+        if (process_helper_map.end() != iter_helper)
+        {
+            FlatMap<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(iter_helper->second.process_ancestor);
+            if (process_snapshot_map.end() != iter_snapshot)
+            {
+                ProcessResource & process_resource = iter_snapshot->second.process_resource;
+                process_resource.gpu_mem_usage += gpu_mem_usage;
+                if (process_resource.gpu_mem_usage > system_resource.gpu_mem_total)
+                {
+                    process_resource.gpu_mem_usage = system_resource.gpu_mem_total;
+                }
+            }
+        }
+        system_resource.gpu_mem_usage += gpu_mem_usage;
+    }
+
+    if (system_resource.gpu_mem_usage > system_resource.gpu_mem_total)
+    {
+        system_resource.gpu_mem_usage = system_resource.gpu_mem_total;
+    }
+
+    return (true);
+}
+
+#else
+
+static bool get_system_gpu_dedicated_memory_usage(SystemSnapshot & system_snapshot)
+{
+    if (0 == system_snapshot.system_resource.gpu_count)
+    {
+        return (false);
+    }
+
+    const std::string & gpu_device_path = system_snapshot.system_helper.gpu_device_path;
+    if (gpu_device_path.empty())
+    {
+        return (true);
+    }
+
+    /*
+     * amdgpu: /sys/class/drm/card0/device/mem_info_vram_used
+     */
+    uint64_t gpu_mem_usage = 0;
+    if (!read_sysfs_uint64(gpu_device_path + "/mem_info_vram_used", gpu_mem_usage))
+    {
+        return (false);
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.gpu_mem_usage = std::min<uint64_t>(gpu_mem_usage, system_resource.gpu_mem_total);
+
+    return (true);
+}
+
+#endif // _MSC_VER
+
+/*
+ * nvidia-smi --query-gpu=count,index,name,memory.total,memory.used,temperature.gpu,clocks.sm,clocks.mem --format=csv,noheader,nounits
+ *     2, 0, NVIDIA GeForce RTX 3090, 24576, 1024, 45, 1395, 9751
+ *     2, 1, NVIDIA GeForce RTX 3090, 24576, 512, [N/A], 210, 405
+ * count on every row tells when the last row of a frame is in
+ */
+#define NVSMI_QUERY_GPU_COMMAND "nvidia-smi --query-gpu=count,index,name,memory.total,memory.used,temperature.gpu,clocks.sm,clocks.mem --format=csv,noheader,nounits"
+
+static GraphicsCardResource & get_graphics_card_resource(std::vector<GraphicsCardResource> & graphics_card_resources, uint64_t gpu_index)
+{
+    if (graphics_card_resources.size() <= gpu_index)
+    {
+        GraphicsCardResource graphics_card_resource;
+        memset(&graphics_card_resource, 0x0, sizeof(graphics_card_resource));
+        graphics_card_resources.resize(static_cast<std::size_t>(gpu_index + 1), graphics_card_resource);
+    }
+    return (graphics_card_resources[static_cast<std::size_t>(gpu_index)]);
+}
+
+static void set_graphics_card_name(GraphicsCardResource & graphics_card_resource, const char * name_beg, const char * name_end)
+{
+    while (name_beg < name_end && (' ' == *name_beg || '\t' == *name_beg))
+    {
+        ++name_beg;
+    }
+    while (name_beg < name_end && (' ' == name_end[-1] || '\t' == name_end[-1] || '\r' == name_end[-1] || '\n' == name_end[-1]))
+    {
+        --name_end;
+    }
+    std::size_t name_size = std::min<std::size_t>(name_end - name_beg, sizeof(graphics_card_resource.gpu_name) - 1);
+    memcpy(graphics_card_resource.gpu_name, name_beg, name_size);
+    graphics_card_resource.gpu_name[name_size] = 0x0;
+}
+
+static bool parse_nvidia_gpu_query(char * line, uint64_t gpu_index, NvgpuQuery & query_frame)
+{
+    char * name_beg = strchr(line, ',');
+    if (nullptr == name_beg)
+    {
+        return (false);
+    }
+
+    /* the name is the only field which may hold a comma, so take the numbers from the back */
+    uint64_t gpu_values[5] = { 0 };
+    for (uint32_t index = 5; index > 0; --index)
+    {
+        char * value_beg = strrchr(name_beg + 1, ',');
+        if (nullptr == value_beg)
+        {
+            return (false);
+        }
+        *value_beg = 0x0;
+        parse_uint64(value_beg + 1, gpu_values[index - 1]); /* [N/A] -> 0 */
+    }
+
+    GraphicsCardResource & graphics_card_resource = get_graphics_card_resource(query_frame.graphics_card_resources, gpu_index);
+    set_graphics_card_name(graphics_card_resource, name_beg + 1, name_beg + 1 + strlen(name_beg + 1));
+    graphics_card_resource.gpu_mem_total = gpu_values[0] * 1024 * 1024;
+    graphics_card_resource.gpu_mem_usage = gpu_values[1] * 1024 * 1024;
+    graphics_card_resource.gpu_temperature = gpu_values[2];
+    graphics_card_resource.gpu_sm_clock = gpu_values[3];
+    graphics_card_resource.gpu_mem_clock = gpu_values[4];
+
+    query_frame.gpu_count = std::max<uint64_t>(query_frame.gpu_count, gpu_index + 1);
+
+    return (0x0 != graphics_card_resource.gpu_name[0]);
+}
+
+static void finish_nvidia_gpu_query(NvgpuQuery & query_frame)
+{
+    query_frame.graphics_card_resources.resize(static_cast<std::size_t>(query_frame.gpu_count));
+    query_frame.gpu_mem_usage = 0;
+    query_frame.gpu_mem_total = 0;
+    query_frame.gpu_temperature = 0;
+    query_frame.gpu_sm_clock = 0;
+    query_frame.gpu_mem_clock = 0;
+
+    if (0 == query_frame.gpu_count)
+    {
+        return;
+    }
+
+    const std::vector<GraphicsCardResource> & graphics_card_resources = query_frame.graphics_card_resources;
+    for (std::vector<GraphicsCardResource>::const_iterator iter = graphics_card_resources.begin(); graphics_card_resources.end() != iter; ++iter)
+    {
+        query_frame.gpu_mem_usage += iter->gpu_mem_usage;
+        query_frame.gpu_mem_total += iter->gpu_mem_total;
+        query_frame.gpu_temperature = std::max<uint64_t>(query_frame.gpu_temperature, iter->gpu_temperature);
+        query_frame.gpu_sm_clock += iter->gpu_sm_clock;
+        query_frame.gpu_mem_clock += iter->gpu_mem_clock;
+    }
+    query_frame.gpu_sm_clock /= query_frame.gpu_count;
+    query_frame.gpu_mem_clock /= query_frame.gpu_count;
+}
+
+static void complete_nvidia_gpu_query(NvgpuQuery & query_frame, NvgpuQuery & nvgpu_query, const std::function<void (const NvgpuQuery &)> & frame_callback)
+{
+    finish_nvidia_gpu_query(query_frame);
+    nvgpu_query = query_frame;
+    if (frame_callback)
+    {
+        frame_callback(nvgpu_query);
+    }
+    query_frame.gpu_count = 0;
+}
+
+/*
+ * loop_interval_ms == 0: run nvidia-smi once, nvgpu_query holds the result when it returns
+ * loop_interval_ms != 0: keep one nvidia-smi session (-lms) alive, frame_callback is called for every frame it streams
+ */
+static bool get_nvidia_gpu_query(uint32_t loop_interval_ms, NvgpuQuery & nvgpu_query, uint64_t & nvsmi_alive_time, volatile bool & running, const std::function<void (const NvgpuQuery &)> & frame_callback)
+{
+    static bool s_check_tool_not_exist = false;
+
+    if (s_check_tool_not_exist)
+    {
+        return (false);
+    }
+
+    std::string command(NVSMI_QUERY_GPU_COMMAND);
+    if (0 != loop_interval_ms)
+    {
+        command += " -lms " + std::to_string(loop_interval_ms);
+    }
+
+    FILE * file = goofer_popen(command.c_str(), "r");
+    if (nullptr == file)
+    {
+        s_check_tool_not_exist = true;
+        return (false);
+    }
+
+    nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+    NvgpuQuery query_frame;
+    uint64_t gpu_index = 0;
+    bool got_frame = false;
+
+    char line[256] = { 0x0 };
+    while (running && nullptr != fgets(line, sizeof(line) - 1, file))
+    {
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+        uint64_t gpu_total = 0;
+        const char * index_end = parse_uint64(line, gpu_total);
+        if (nullptr == index_end || ',' != *index_end || nullptr == (index_end = parse_uint64(index_end + 1, gpu_index)))
+        {
+            continue;
+        }
+
+        /* a frame that starts over before its last row came in went short of rows, it goes out as it is */
+        if (0 == gpu_index && 0 != query_frame.gpu_count)
+        {
+            complete_nvidia_gpu_query(query_frame, nvgpu_query, frame_callback);
+            got_frame = true;
+        }
+
+        /* rows of a frame are filled in place, the card array is reused from frame to frame */
+        parse_nvidia_gpu_query(line + (index_end - line), gpu_index, query_frame);
+
+        /* the last row completes the frame, it goes out now and not when the next frame begins */
+        if (gpu_index + 1 >= gpu_total)
+        {
+            complete_nvidia_gpu_query(query_frame, nvgpu_query, frame_callback);
+            got_frame = true;
+        }
+    }
+
+    goofer_pclose(file);
+
+    nvsmi_alive_time = 0;
+
+    /* a one shot query cut short may end with a partial frame */
+    if (0 == loop_interval_ms && 0 != query_frame.gpu_count)
+    {
+        finish_nvidia_gpu_query(query_frame);
+        nvgpu_query = query_frame;
+        got_frame = true;
+    }
+
+    return (got_frame);
+}
+
+#ifdef _MSC_VER
+    #define NVML_LIBRARY_NAME "nvml.dll"
+#else
+    #define NVML_LIBRARY_NAME "libnvidia-ml.so.1"
+#endif // _MSC_VER
+
+#define NVML_SUCCESS                0
+#define NVML_TEMPERATURE_GPU        0
+#define NVML_CLOCK_SM               1
+#define NVML_CLOCK_MEM              2
+#define NVML_DEVICE_NAME_BUFFER_SIZE 96
+
+static void * get_library_symbol(library_handle_t library_handle, const char * symbol_name)
+{
+#ifdef _MSC_VER
+    return (reinterpret_cast<void *>(GetProcAddress(library_handle, symbol_name)));
+#else
+    return (dlsym(library_handle, symbol_name));
+#endif // _MSC_VER
+}
+
+template <typename function_t>
+static bool get_library_function(library_handle_t library_handle, const char * symbol_name, function_t & function)
+{
+    function = reinterpret_cast<function_t>(get_library_symbol(library_handle, symbol_name));
+    return (nullptr != function);
+}
+
+static void unload_nvml_library(NvmlLibrary & nvml_library)
+{
+    if (nullptr == nvml_library.library_handle)
+    {
+        return;
+    }
+
+    if (nullptr != nvml_library.nvml_shutdown)
+    {
+        nvml_library.nvml_shutdown();
+    }
+
+#ifdef _MSC_VER
+    FreeLibrary(nvml_library.library_handle);
+#else
+    dlclose(nvml_library.library_handle);
+#endif // _MSC_VER
+
+    nvml_library = NvmlLibrary();
+}
+
+static bool load_nvml_library(NvmlLibrary & nvml_library)
+{
+    unload_nvml_library(nvml_library);
+
+#ifdef _MSC_VER
+    nvml_library.library_handle = LoadLibraryA(NVML_LIBRARY_NAME);
+#else
+    nvml_library.library_handle = dlopen(NVML_LIBRARY_NAME, RTLD_NOW | RTLD_LOCAL);
+#endif // _MSC_VER
+    if (nullptr == nvml_library.library_handle)
+    {
+        return (false);
+    }
+
+    do
+    {
+        library_handle_t library_handle = nvml_library.library_handle;
+        if (!get_library_function(library_handle, "nvmlInit_v2", nvml_library.nvml_init) ||
+            !get_library_function(library_handle, "nvmlDeviceGetCount_v2", nvml_library.nvml_device_get_count) ||
+            !get_library_function(library_handle, "nvmlDeviceGetHandleByIndex_v2", nvml_library.nvml_device_get_handle_by_index) ||
+            !get_library_function(library_handle, "nvmlDeviceGetName", nvml_library.nvml_device_get_name) ||
+            !get_library_function(library_handle, "nvmlDeviceGetUtilizationRates", nvml_library.nvml_device_get_utilization_rates) ||
+            !get_library_function(library_handle, "nvmlDeviceGetEncoderUtilization", nvml_library.nvml_device_get_encoder_utilization) ||
+            !get_library_function(library_handle, "nvmlDeviceGetDecoderUtilization", nvml_library.nvml_device_get_decoder_utilization) ||
+            !get_library_function(library_handle, "nvmlDeviceGetMemoryInfo", nvml_library.nvml_device_get_memory_info) ||
+            !get_library_function(library_handle, "nvmlDeviceGetTemperature", nvml_library.nvml_device_get_temperature) ||
+            !get_library_function(library_handle, "nvmlDeviceGetClockInfo", nvml_library.nvml_device_get_clock_info))
+        {
+            RUN_LOG_WAR("load nvml library failure while some nvml function is not found");
+            break;
+        }
+
+        if (NVML_SUCCESS != nvml_library.nvml_init())
+        {
+            RUN_LOG_WAR("load nvml library failure while nvml init failed");
+            break;
+        }
+
+        /* shutdown only pairs with a successful init */
+        get_library_function(library_handle, "nvmlShutdown", nvml_library.nvml_shutdown);
+
+        unsigned int device_count = 0;
+        if (NVML_SUCCESS != nvml_library.nvml_device_get_count(&device_count) || 0 == device_count)
+        {
+            break;
+        }
+
+        for (unsigned int device_index = 0; device_index < device_count; ++device_index)
+        {
+            nvml_device_t device = nullptr;
+            if (NVML_SUCCESS != nvml_library.nvml_device_get_handle_by_index(device_index, &device))
+            {
+                break;
+            }
+            nvml_library.device_list.push_back(device);
+        }
+
+        if (nvml_library.device_list.size() != device_count)
+        {
+            break;
+        }
+
+        return (true);
+    } while (false);
+
+    unload_nvml_library(nvml_library);
+
+    return (false);
+}
+
+static bool get_nvml_gpu_detail(NvmlLibrary & nvml_library, SystemResource & nvgpu_resource, NvgpuQuery & nvgpu_query)
+{
+    if (nullptr == nvml_library.library_handle)
+    {
+        return (false);
+    }
+
+    const std::vector<nvml_device_t> & device_list = nvml_library.device_list;
+
+    double sm_percent = 0.0;
+    double enc_percent = 0.0;
+    double dec_percent = 0.0;
+
+    nvgpu_query.gpu_count = 0;
+
+    /* nvml reports what it can read, an unsupported field on one card reads as 0 like [N/A] from nvidia-smi */
+    for (std::size_t device_index = 0; device_index < device_list.size(); ++device_index)
+    {
+        nvml_device_t device = device_list[device_index];
+
+        GraphicsCardResource & graphics_card_resource = get_graphics_card_resource(nvgpu_query.graphics_card_resources, device_index);
+        memset(&graphics_card_resource, 0x0, sizeof(graphics_card_resource));
+
+        char name[NVML_DEVICE_NAME_BUFFER_SIZE] = { 0x0 };
+        if (NVML_SUCCESS != nvml_library.nvml_device_get_name(device, name, sizeof(name) - 1))
+        {
+            return (false);
+        }
+        set_graphics_card_name(graphics_card_resource, name, name + strlen(name));
+
+        NvmlUtilization utilization = { 0 };
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_utilization_rates(device, &utilization))
+        {
+            graphics_card_resource.gpu_3d_usage = utilization.gpu;
+        }
+
+        unsigned int sampling_period_us = 0;
+        unsigned int enc_utilization = 0;
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_encoder_utilization(device, &enc_utilization, &sampling_period_us))
+        {
+            graphics_card_resource.gpu_enc_usage = enc_utilization;
+        }
+
+        unsigned int dec_utilization = 0;
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_decoder_utilization(device, &dec_utilization, &sampling_period_us))
+        {
+            graphics_card_resource.gpu_dec_usage = dec_utilization;
+        }
+
+        NvmlMemory memory = { 0 };
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_memory_info(device, &memory))
+        {
+            graphics_card_resource.gpu_mem_total = memory.total;
+            graphics_card_resource.gpu_mem_usage = memory.used;
+        }
+
+        unsigned int temperature = 0;
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_temperature(device, NVML_TEMPERATURE_GPU, &temperature))
+        {
+            graphics_card_resource.gpu_temperature = temperature;
+        }
+
+        unsigned int sm_clock = 0;
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_clock_info(device, NVML_CLOCK_SM, &sm_clock))
+        {
+            graphics_card_resource.gpu_sm_clock = sm_clock;
+        }
+
+        unsigned int mem_clock = 0;
+        if (NVML_SUCCESS == nvml_library.nvml_device_get_clock_info(device, NVML_CLOCK_MEM, &mem_clock))
+        {
+            graphics_card_resource.gpu_mem_clock = mem_clock;
+        }
+
+        sm_percent += graphics_card_resource.gpu_3d_usage;
+        enc_percent += graphics_card_resource.gpu_enc_usage;
+        dec_percent += graphics_card_resource.gpu_dec_usage;
+        nvgpu_query.gpu_count += 1;
+    }
+
+    if (0 == nvgpu_query.gpu_count)
+    {
+        return (false);
+    }
+
+    finish_nvidia_gpu_query(nvgpu_query);
+
+    nvgpu_resource.gpu_3d_usage = sm_percent / nvgpu_query.gpu_count;
+    nvgpu_resource.gpu_enc_usage = enc_percent / nvgpu_query.gpu_count;
+    nvgpu_resource.gpu_dec_usage = dec_percent / nvgpu_query.gpu_count;
+
+    return (true);
+}
+
+/*
+ * name, memory, temperature and clocks of every card, from nvml or nvidia-smi --query-gpu
+ */
+static void apply_nvgpu_query(SystemSnapshot & system_snapshot, const NvgpuQuery & nvgpu_query)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.gpu_count = nvgpu_query.gpu_count;
+    system_resource.gpu_mem_usage = nvgpu_query.gpu_mem_usage;
+    system_resource.gpu_mem_total = nvgpu_query.gpu_mem_total;
+    system_resource.gpu_temperature = nvgpu_query.gpu_temperature;
+    system_resource.gpu_sm_clock = nvgpu_query.gpu_sm_clock;
+    system_resource.gpu_mem_clock = nvgpu_query.gpu_mem_clock;
+
+    std::vector<GraphicsCardResource> & graphics_card_resources = system_snapshot.graphics_card_resources;
+    const std::vector<GraphicsCardResource> & query_card_resources = nvgpu_query.graphics_card_resources;
+
+    bool names_changed = graphics_card_resources.size() != query_card_resources.size();
+    for (std::size_t card_index = 0; card_index < query_card_resources.size(); ++card_index)
+    {
+        const GraphicsCardResource & query_card_resource = query_card_resources[card_index];
+        GraphicsCardResource & graphics_card_resource = get_graphics_card_resource(graphics_card_resources, card_index);
+        if (0 != strcmp(graphics_card_resource.gpu_name, query_card_resource.gpu_name))
+        {
+            memcpy(graphics_card_resource.gpu_name, query_card_resource.gpu_name, sizeof(graphics_card_resource.gpu_name));
+            names_changed = true;
+        }
+        graphics_card_resource.gpu_mem_usage = query_card_resource.gpu_mem_usage;
+        graphics_card_resource.gpu_mem_total = query_card_resource.gpu_mem_total;
+        graphics_card_resource.gpu_temperature = query_card_resource.gpu_temperature;
+        graphics_card_resource.gpu_sm_clock = query_card_resource.gpu_sm_clock;
+        graphics_card_resource.gpu_mem_clock = query_card_resource.gpu_mem_clock;
+    }
+    graphics_card_resources.resize(query_card_resources.size());
+
+    if (names_changed)
+    {
+        std::list<std::string> & graphics_card_names = system_snapshot.graphics_card_names;
+        graphics_card_names.clear();
+        for (std::vector<GraphicsCardResource>::const_iterator iter = graphics_card_resources.begin(); graphics_card_resources.end() != iter; ++iter)
+        {
+            graphics_card_names.push_back(iter->gpu_name);
+        }
+    }
+}
+
+/*
+ * 3d, encoder and decoder load of every card, from nvml or nvidia-smi dmon
+ */
+static void apply_nvgpu_usage(SystemSnapshot & system_snapshot, const std::vector<GraphicsCardResource> & usage_card_resources)
+{
+    std::vector<GraphicsCardResource> & graphics_card_resources = system_snapshot.graphics_card_resources;
+    std::size_t card_count = std::min<std::size_t>(graphics_card_resources.size(), usage_card_resources.size());
+    for (std::size_t card_index = 0; card_index < card_count; ++card_index)
+    {
+        const GraphicsCardResource & usage_card_resource = usage_card_resources[card_index];
+        GraphicsCardResource & graphics_card_resource = graphics_card_resources[card_index];
+        graphics_card_resource.gpu_3d_usage = usage_card_resource.gpu_3d_usage;
+        graphics_card_resource.gpu_enc_usage = usage_card_resource.gpu_enc_usage;
+        graphics_card_resource.gpu_dec_usage = usage_card_resource.gpu_dec_usage;
+    }
+}
+
+static bool get_system_gpu_dedicated_memory_total(SystemSnapshot & system_snapshot, bool & query_gpu_with_pdh, NvmlLibrary & nvml_library, uint64_t & nvsmi_alive_time)
+{
+    std::list<std::string> & graphics_card_names = system_snapshot.graphics_card_names;
+    SystemResource & system_resource = system_snapshot.system_resource;
+
+    graphics_card_names.clear();
+    system_snapshot.graphics_card_resources.clear();
+    system_resource.gpu_count = 0;
+    system_resource.gpu_mem_total = 0;
+    system_resource.gpu_mem_usage = 0;
+
+    if (load_nvml_library(nvml_library))
+    {
+        NvgpuQuery nvgpu_query;
+        if (get_nvml_gpu_detail(nvml_library, system_resource, nvgpu_query))
+        {
+            apply_nvgpu_query(system_snapshot, nvgpu_query);
+            query_gpu_with_pdh = false;
+            return (true);
+        }
+        unload_nvml_library(nvml_library);
+    }
+
+    do
+    {
+        NvgpuQuery nvgpu_query;
+        volatile bool running = true;
+        if (!get_nvidia_gpu_query(0, nvgpu_query, nvsmi_alive_time, running, nullptr))
+        {
+            break;
+        }
+
+        apply_nvgpu_query(system_snapshot, nvgpu_query);
+
+        query_gpu_with_pdh = false;
+
+        return (true);
+    } while (false);
+
+    graphics_card_names.clear();
+    system_snapshot.graphics_card_resources.clear();
+    system_resource.gpu_count = 0;
+    system_resource.gpu_mem_total = 0;
+    system_resource.gpu_mem_usage = 0;
+
+#ifdef _MSC_VER
+    ATL::CComPtr<IDXGIFactory1> dxgi_factory;
+    if (S_OK == CreateDXGIFactory1(IsWindowsVistaSP2OrGreater() ? __uuidof(IDXGIFactory2) : __uuidof(IDXGIFactory1), reinterpret_cast<void **>(&dxgi_factory)))
+    {
+        UINT adapter_index = 0;
+        while (true)
+        {
+            ATL::CComPtr<IDXGIAdapter1> dxgi_adapter;
+            if (DXGI_ERROR_NOT_FOUND == dxgi_factory->EnumAdapters1(adapter_index++, &dxgi_adapter))
+            {
+                break;
+            }
+
+            DXGI_ADAPTER_DESC adapter_desc = { 0x0 };
+            HRESULT result = dxgi_adapter->GetDesc(&adapter_desc);
+            if (result < 0)
+            {
+                continue;
+            }
+
+            if (0x1414 == adapter_desc.VendorId)
+            {
+                continue;
+            }
+
+            graphics_card_names.emplace_back(Goofer::unicode_to_utf8(adapter_desc.Description));
+            system_resource.gpu_count += 1;
+            system_resource.gpu_mem_total += static_cast<uint64_t>(adapter_desc.DedicatedVideoMemory);
+
+            break;
+        }
+    }
+#else
+    SystemHelper & system_helper = system_snapshot.system_helper;
+    system_helper.gpu_device_path.clear();
+
+    /*
+     * /sys/class/drm/card0/device/vendor               0x1002
+     * /sys/class/drm/card0/device/device               0x73bf
+     * /sys/class/drm/card0/device/product_name         (optional)
+     * /sys/class/drm/card0/device/mem_info_vram_total  17163091968
+     */
+    std::string drm_path(system_helper.sys_root + "/class/drm");
+    DIR * dir = opendir(drm_path.c_str());
+    if (nullptr != dir)
+    {
+        std::vector<std::string> card_names;
+        for (struct dirent * entry = readdir(dir); nullptr != entry; entry = readdir(dir))
+        {
+            if (0 == strncmp(entry->d_name, "card", 4) && nullptr == strchr(entry->d_name, '-'))
+            {
+                card_names.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+
+        std::sort(card_names.begin(), card_names.end());
+
+        for (std::vector<std::string>::const_iterator iter = card_names.begin(); card_names.end() != iter; ++iter)
+        {
+            std::string device_path(drm_path + "/" + *iter + "/device");
+
+            uint64_t vram_total = 0;
+            if (!read_sysfs_uint64(device_path + "/mem_info_vram_total", vram_total) || 0 == vram_total)
+            {
+                continue;
+            }
+
+            char buffer[128] = { 0x0 };
+            std::string graphics_card_name;
+            if (read_proc_file(AT_FDCWD, (device_path + "/product_name").c_str(), buffer, sizeof(buffer)))
+            {
+                graphics_card_name = buffer;
+                Goofer::goofer_string_trim(graphics_card_name);
+            }
+            if (graphics_card_name.empty())
+            {
+                std::string vendor_id;
+                std::string device_id;
+                if (read_proc_file(AT_FDCWD, (device_path + "/vendor").c_str(), buffer, sizeof(buffer)))
+                {
+                    vendor_id = buffer;
+                    Goofer::goofer_string_trim(vendor_id);
+                }
+                if (read_proc_file(AT_FDCWD, (device_path + "/device").c_str(), buffer, sizeof(buffer)))
+                {
+                    device_id = buffer;
+                    Goofer::goofer_string_trim(device_id);
+                }
+                graphics_card_name = "GPU " + vendor_id + ":" + device_id;
+            }
+
+            graphics_card_names.emplace_back(graphics_card_name);
+            system_resource.gpu_count += 1;
+            system_resource.gpu_mem_total += vram_total;
+            system_helper.gpu_device_path = device_path;
+
+            break;
+        }
+    }
+#endif // _MSC_VER
+
+    if (system_resource.gpu_count > 0)
+    {
+        GraphicsCardResource & graphics_card_resource = get_graphics_card_resource(system_snapshot.graphics_card_resources, 0);
+        const std::string & graphics_card_name = graphics_card_names.front();
+        set_graphics_card_name(graphics_card_resource, graphics_card_name.c_str(), graphics_card_name.c_str() + graphics_card_name.size());
+        graphics_card_resource.gpu_mem_total = system_resource.gpu_mem_total;
+    }
+
+    query_gpu_with_pdh = true;
+
+    return (system_resource.gpu_count > 0);
+}
+
+/*
+ * pdh and sysfs watch a single card, which is the whole system
+ */
+static void mirror_system_gpu_resource(SystemSnapshot & system_snapshot)
+{
+    std::vector<GraphicsCardResource> & graphics_card_resources = system_snapshot.graphics_card_resources;
+    if (graphics_card_resources.empty())
+    {
+        return;
+    }
+
+    const SystemResource & system_resource = system_snapshot.system_resource;
+    GraphicsCardResource & graphics_card_resource = graphics_card_resources.front();
+    graphics_card_resource.gpu_3d_usage = system_resource.gpu_3d_usage;
+    graphics_card_resource.gpu_enc_usage = system_resource.gpu_enc_usage;
+    graphics_card_resource.gpu_dec_usage = system_resource.gpu_dec_usage;
+    graphics_card_resource.gpu_mem_usage = system_resource.gpu_mem_usage;
+    graphics_card_resource.gpu_mem_total = system_resource.gpu_mem_total;
+}
+
+static bool get_nvidia_gpu_detail(SystemResource & system_resource, std::vector<GraphicsCardResource> & graphics_card_resources, uint64_t & nvsmi_alive_time, volatile bool & running, const std::function<void (const SystemResource &, const std::vector<GraphicsCardResource> &)> & frame_callback)
+{
+    static bool s_check_tool_not_exist = false;
+
+    if (s_check_tool_not_exist)
+    {
+        return (false);
+    }
+
+    FILE * file = goofer_popen("nvidia-smi dmon -s u", "r");
+    if (nullptr == file)
+    {
+        s_check_tool_not_exist = true;
+        return (false);
+    }
+
+    uint32_t id_index = NVSMI_INVALID_COLUMN;
+    uint32_t sm_index = NVSMI_INVALID_COLUMN;
+    uint32_t enc_index = NVSMI_INVALID_COLUMN;
+    uint32_t dec_index = NVSMI_INVALID_COLUMN;
+
+    char line[256] = { 0x0 };
+    char * tokens[NVSMI_MAX_COLUMN_COUNT] = { nullptr };
+
+    do
+    {
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+        if (nullptr == fgets(line, sizeof(line) - 1, file))
+        {
+            break;
+        }
+
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+
+        /* the column map is built once per session, rows are then read by index */
+        uint32_t title_count = split_nvsmi_line(skip_nvsmi_header_mark(line), tokens, NVSMI_MAX_COLUMN_COUNT);
+        id_index = find_nvsmi_column(tokens, title_count, "gpu");
+        sm_index = find_nvsmi_column(tokens, title_count, "sm");
+        enc_index = find_nvsmi_column(tokens, title_count, "enc");
+        dec_index = find_nvsmi_column(tokens, title_count, "dec");
+    } while (false);
+
+    uint32_t sm_percent = 0;
+    uint32_t enc_percent = 0;
+    uint32_t dec_percent = 0;
+    uint32_t gpu_count = 0;
+
+    while (running && nullptr != fgets(line, sizeof(line) - 1, file))
+    {
+        if (nullptr != strchr(line, '#'))
+        {
+            continue;
+        }
+        uint32_t token_count = split_nvsmi_line(line, tokens, NVSMI_MAX_COLUMN_COUNT);
+        uint64_t gpu_index = 0;
+        if (token_count <= id_index || nullptr == parse_uint64(tokens[id_index], gpu_index))
+        {
+            continue;
+        }
+        if (0 == gpu_index)
+        {
+            if (0 != gpu_count)
+            {
+                system_resource.gpu_3d_usage = sm_percent / gpu_count;
+                system_resource.gpu_enc_usage = enc_percent / gpu_count;
+                system_resource.gpu_dec_usage = dec_percent / gpu_count;
+                frame_callback(system_resource, graphics_card_resources);
+            }
+            sm_percent = 0;
+            enc_percent = 0;
+            dec_percent = 0;
+            gpu_count = 0;
+        }
+        GraphicsCardResource & graphics_card_resource = get_graphics_card_resource(graphics_card_resources, gpu_index);
+        graphics_card_resource.gpu_3d_usage = static_cast<double>(get_nvsmi_column_value(tokens, token_count, sm_index));
+        graphics_card_resource.gpu_enc_usage = static_cast<double>(get_nvsmi_column_value(tokens, token_count, enc_index));
+        graphics_card_resource.gpu_dec_usage = static_cast<double>(get_nvsmi_column_value(tokens, token_count, dec_index));
+        sm_percent += static_cast<uint32_t>(graphics_card_resource.gpu_3d_usage);
+        enc_percent += static_cast<uint32_t>(graphics_card_resource.gpu_enc_usage);
+        dec_percent += static_cast<uint32_t>(graphics_card_resource.gpu_dec_usage);
+        gpu_count += 1;
+        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+    }
+
+    goofer_pclose(file);
+
+    nvsmi_alive_time = 0;
+
+    return (true);
+}
+
+static bool get_system_disk_usage(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    uint64_t total_size = 0;
+    uint64_t avail_size = 0;
+    if (Goofer::get_system_disk_usage(SYSTEM_DISK_PATH, total_size, avail_size))
+    {
+        system_resource.disk_total = total_size;
+        system_resource.disk_usage = total_size - avail_size;
+        return (true);
+    }
+    else
+    {
+        system_resource.disk_total = 0;
+        system_resource.disk_usage = 0;
+        return (false);
+    }
+}
+
+#ifdef _MSC_VER
+
+static bool get_network_interface_send_bytes_per_second(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
+{
+    if (nullptr == counter_handle)
+    {
+        return (false);
+    }
+
+    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
+    ULONG item_count = 0;
+    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE, buffer, item_array, item_count))
+    {
+        return (false);
+    }
+
+    double total_send_bytes = 0.0;
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+        total_send_bytes += item.FmtValue.doubleValue;
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.net_send_bytes = static_cast<uint64_t>(total_send_bytes);
+
+    return (true);
+}
+
+static bool get_network_interface_recv_bytes_per_second(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
+{
+    if (nullptr == counter_handle)
+    {
+        return (false);
+    }
+
+    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
+    ULONG item_count = 0;
+    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE, buffer, item_array, item_count))
+    {
+        return (false);
+    }
+
+    double total_recv_bytes = 0.0;
+    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    {
+        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
+        total_recv_bytes += item.FmtValue.doubleValue;
+    }
+
+    SystemResource & system_resource = system_snapshot.system_resource;
+    system_resource.net_recv_bytes = static_cast<uint64_t>(total_recv_bytes);
+
+    return (true);
+}
+
+#else
+
+static bool get_network_interface_bytes_per_second(SystemSnapshot & system_snapshot)
+{
+    SystemResource & system_resource = system_snapshot.system_resource;
+    SystemHelper & system_helper = system_snapshot.system_helper;
+
+    /*
+     * Inter-|   Receive                                                |  Transmit
+     *  face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed
+     *     lo: 1234567    8910    0    0    0     0          0         0  1234567    8910    0    0    0     0       0          0
+     *   eth0: 98765432  123456    0    0    0     0          0         0 87654321  654321    0    0    0     0       0          0
+     */
+    char buffer[16384] = { 0x0 };
+    if (!read_proc_file(system_helper.proc_root_fd, "net/dev", buffer, sizeof(buffer)))
+    {
+        return (false);
+    }
+
+    uint64_t net_check_time = monotonic_microseconds();
+    uint64_t net_recv_bytes = 0;
+    uint64_t net_send_bytes = 0;
+
+    for (const char * line = buffer; nullptr != line && 0x0 != *line; line = strchr(line, '\n'), line = (nullptr != line ? line + 1 : nullptr))
+    {
+        const char * name_end = strchr(line, ':');
+        const char * line_end = strchr(line, '\n');
+        if (nullptr == name_end || (nullptr != line_end && name_end > line_end))
+        {
+            continue;
+        }
+
+        const char * name_beg = line;
+        while (' ' == *name_beg)
+        {
+            ++name_beg;
+        }
+        if (2 == name_end - name_beg && 0 == strncmp(name_beg, "lo", 2))
+        {
+            continue;
+        }
+
+        uint64_t recv_bytes = 0;
+        uint64_t send_bytes = 0;
+        const char * str = parse_uint64(name_end + 1, recv_bytes);
+        if (nullptr == str)
+        {
+            continue;
+        }
+        str = skip_fields(str, 7);
+        if (nullptr == parse_uint64(str, send_bytes))
+        {
+            continue;
+        }
+
+        net_recv_bytes += recv_bytes;
+        net_send_bytes += send_bytes;
+    }
+
+    if (0 == system_helper.net_check_time || system_helper.net_check_time >= net_check_time || system_helper.net_recv_bytes > net_recv_bytes || system_helper.net_send_bytes > net_send_bytes)
+    {
+        system_resource.net_send_bytes = 0;
+        system_resource.net_recv_bytes = 0;
+    }
+    else
+    {
+        uint64_t check_time_delta = net_check_time - system_helper.net_check_time;
+        system_resource.net_send_bytes = (net_send_bytes - system_helper.net_send_bytes) * 1000000 / check_time_delta;
+        system_resource.net_recv_bytes = (net_recv_bytes - system_helper.net_recv_bytes) * 1000000 / check_time_delta;
+    }
+
+    system_helper.net_check_time = net_check_time;
+    system_helper.net_send_bytes = net_send_bytes;
+    system_helper.net_recv_bytes = net_recv_bytes;
+
+    return (true);
+}
+
+#endif // _MSC_VER
+
+ResourceMonitorImpl::ResourceMonitorImpl()
+    : m_running(false)
+    , m_query_gpu_with_pdh(false)
+    , m_nvml_library()
+    , m_nvsmi_alive_time(0)
+    , m_nvsmi_query_alive_time(0)
+    , m_stuck_check_thread()
+    , m_nvgpu_check_thread()
+    , m_nvgpu_query_thread()
+    , m_query_thread()
+    , m_process_exit_thread()
+    , m_process_exit_callback()
+    , m_process_exit_mutex()
+    , m_query_mutex()
+    , m_query_condition()
+    , m_collector_schedules()
+#ifdef _MSC_VER
+    , m_counter_buffer()
+    , m_query_handle(nullptr)
+    , m_processor_counter(nullptr)
+    , m_gpu_engine_counter(nullptr)
+    , m_gpu_memory_counter(nullptr)
+    , m_net_send_counter(nullptr)
+    , m_net_recv_counter(nullptr)
+#endif // _MSC_VER
+    , m_system_snapshot()
+    , m_system_snapshot_mutex()
+    , m_snapshot_publisher()
+    , m_sample_sequence(0)
+    , m_sample_mutex()
+    , m_sample_condition()
+    , m_threshold_rules()
+    , m_threshold_sequence(0)
+    , m_threshold_thread()
+    , m_threshold_events()
+    , m_threshold_mutex()
+    , m_threshold_condition()
+    , m_history_pool()
+    , m_history_map()
+    , m_history_mutex()
+    , m_resource_recorder()
+    , m_shared_writer()
+    , m_metrics_exporter()
+    , m_stream_exporter()
+    , m_stream_processes()
+    , m_stream_frame_size(0)
+    , m_snapshot_retention()
+    , m_retention_mutex()
+{
+
+}
+
+ResourceMonitorImpl::~ResourceMonitorImpl()
+{
+    exit();
+}
+
+/*
+ * the first samples shared by both platforms, the stuck check thread watches nvidia-smi while the gpu total is queried
+ */
+bool ResourceMonitorImpl::open_system_collectors()
+{
+    m_stuck_check_thread = std::thread(&::ResourceMonitorImpl::stuck_check_thread, this);
+    if (!m_stuck_check_thread.joinable())
+    {
+        RUN_LOG_ERR("resource monitor init failure while stuck check thread create failed");
+        return (false);
+    }
+
+    if (!get_system_cpu_count(m_system_snapshot))
+    {
+        RUN_LOG_ERR("resource monitor init failure while get system cpu count failed");
+        return (false);
+    }
+
+    if (!get_system_memory_usage(m_system_snapshot))
+    {
+        RUN_LOG_ERR("resource monitor init failure while get system memory usage failed");
+        return (false);
+    }
+
+    if (!get_system_gpu_dedicated_memory_total(m_system_snapshot, m_query_gpu_with_pdh, m_nvml_library, m_nvsmi_alive_time))
+    {
+        RUN_LOG_WAR("resource monitor init warning while get system gpu dedicated memory total failed");
+    }
+
+    return (true);
+}
+
+/*
+ * publishes the first snapshot, then starts the gpu threads that fit what was found, the exit watcher and the sampling threads
+ */
+bool ResourceMonitorImpl::start_collect_threads()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+        publish_system_snapshot();
+    }
+
+    if (m_query_gpu_with_pdh)
+    {
+        if (m_stuck_check_thread.joinable())
+        {
+            m_stuck_check_thread.join();
+        }
+    }
+    else if (nullptr != m_nvml_library.library_handle)
+    {
+        if (m_stuck_check_thread.joinable())
+        {
+            m_stuck_check_thread.join();
+        }
+
+        m_nvgpu_check_thread = std::thread(&ResourceMonitorImpl::nvml_check_thread, this);
+        if (!m_nvgpu_check_thread.joinable())
+        {
+            RUN_LOG_ERR("resource monitor init failure while nvml check thread create failed");
+            return (false);
+        }
+    }
+    else
+    {
+        m_nvgpu_check_thread = std::thread(&ResourceMonitorImpl::nvgpu_check_thread, this);
+        if (!m_nvgpu_check_thread.joinable())
+        {
+            RUN_LOG_ERR("resource monitor init failure while nvgpu check thread create failed");
+            return (false);
+        }
+
+        m_nvgpu_query_thread = std::thread(&ResourceMonitorImpl::nvgpu_query_thread, this);
+        if (!m_nvgpu_query_thread.joinable())
+        {
+            RUN_LOG_ERR("resource monitor init failure while nvgpu query thread create failed");
+            return (false);
+        }
+    }
+
+    if (open_process_exit_watcher(m_system_snapshot))
+    {
+        m_process_exit_thread = std::thread(&ResourceMonitorImpl::process_exit_thread, this);
+        if (!m_process_exit_thread.joinable())
+        {
+            RUN_LOG_ERR("resource monitor init failure while process exit thread create failed");
+            return (false);
+        }
+    }
+    else
+    {
+        RUN_LOG_WAR("resource monitor init warning while process exit watcher is not available, exited processes are found by sampling");
+    }
+
+    m_threshold_thread = std::thread(&ResourceMonitorImpl::threshold_dispatch_thread, this);
+    if (!m_threshold_thread.joinable())
+    {
+        RUN_LOG_ERR("resource monitor init failure while threshold dispatch thread create failed");
+        return (false);
+    }
+
+    m_query_thread = std::thread(&ResourceMonitorImpl::query_resource_thread, this);
+    if (!m_query_thread.joinable())
+    {
+        RUN_LOG_ERR("resource monitor init failure while query resource thread create failed");
+        return (false);
+    }
+
+    return (true);
+}
+
+/*
+ * joins every thread, stops the sinks fed by the query thread, then closes the process helpers and the exit watcher
+ */
+void ResourceMonitorImpl::stop_collect_threads()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_sample_mutex);
+    }
+    m_sample_condition.notify_all();
+
+    if (m_stuck_check_thread.joinable())
+    {
+        RUN_LOG_DBG("resource monitor exit while stuck check thread exit begin");
+        m_stuck_check_thread.join();
+        RUN_LOG_DBG("resource monitor exit while stuck check thread exit end");
+    }
+
+    if (m_nvgpu_check_thread.joinable())
+    {
+        kill_nvsmi_process();
+        RUN_LOG_DBG("resource monitor exit while nvgpu check thread exit begin");
+        m_nvgpu_check_thread.join();
+        RUN_LOG_DBG("resource monitor exit while nvgpu check thread exit end");
+    }
+
+    if (m_nvgpu_query_thread.joinable())
+    {
+        kill_nvsmi_process();
+        RUN_LOG_DBG("resource monitor exit while nvgpu query thread exit begin");
+        m_nvgpu_query_thread.join();
+        RUN_LOG_DBG("resource monitor exit while nvgpu query thread exit end");
+    }
+
+    unload_nvml_library(m_nvml_library);
+
+    if (m_query_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_query_mutex);
+        }
+        m_query_condition.notify_all();
+        RUN_LOG_DBG("resource monitor exit while query resource thread exit begin");
+        m_query_thread.join();
+        RUN_LOG_DBG("resource monitor exit while query resource thread exit end");
+    }
+
+    if (m_threshold_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_threshold_mutex);
+        }
+        m_threshold_condition.notify_all();
+        RUN_LOG_DBG("resource monitor exit while threshold dispatch thread exit begin");
+        m_threshold_thread.join();
+        RUN_LOG_DBG("resource monitor exit while threshold dispatch thread exit end");
+    }
+    m_threshold_events.clear();
+    m_threshold_rules.clear();
+
+    m_history_map.clear();
+    m_history_pool.reset(0, nullptr, 0);
+
+    m_resource_recorder.stop();
+    m_shared_writer.stop();
+    m_metrics_exporter.stop();
+    m_stream_exporter.stop();
+
+    {
+        std::lock_guard<std::mutex> locker(m_retention_mutex);
+        m_snapshot_retention.reset(0);
+    }
+
+    if (m_process_exit_thread.joinable())
+    {
+        wake_process_exit_watcher(m_system_snapshot);
+        RUN_LOG_DBG("resource monitor exit while process exit thread exit begin");
+        m_process_exit_thread.join();
+        RUN_LOG_DBG("resource monitor exit while process exit thread exit end");
+    }
+
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = m_system_snapshot.process_helper_map;
+    for (FlatMap<uint32_t, ProcessHelper>::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+    {
+        close_process_helper(iter->first, iter->second);
+    }
+    process_helper_map.clear();
+    m_system_snapshot.process_tree_map.clear();
+    m_system_snapshot.process_leaf_map.clear();
+    m_system_snapshot.process_snapshot_map.clear();
+    m_system_snapshot.process_drop_list.clear();
+
+    close_process_exit_watcher(m_system_snapshot);
+}
+
+#ifdef _MSC_VER
+
+bool ResourceMonitorImpl::init()
+{
+    exit();
+
+    do
+    {
+        RUN_LOG_DBG("resource monitor init begin");
+
+        m_running = true;
+
+        m_query_gpu_with_pdh = false;
+
+        if (!open_system_collectors())
+        {
+            break;
+        }
+
+        if (!get_system_disk_usage(m_system_snapshot))
+        {
+            RUN_LOG_ERR("resource monitor init failure while get system disk usage failed");
+            break;
+        }
+
+        if (ERROR_SUCCESS != PdhOpenQuery(nullptr, 0, &m_query_handle) || nullptr == m_query_handle)
+        {
+            RUN_LOG_ERR("resource monitor init failure while create query handle failed");
+            break;
+        }
+
+        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Processor(_Total)\\% Processor Time", 0, &m_processor_counter))
+        {
+            RUN_LOG_WAR("resource monitor init warning while add processor time counter failed");
+        }
+
+        if (m_query_gpu_with_pdh && m_system_snapshot.system_resource.gpu_count > 0)
+        {
+            if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\GPU Engine(*)\\Utilization Percentage", 0, &m_gpu_engine_counter))
+            {
+                RUN_LOG_WAR("resource monitor init warning while add gpu engine utilization percentage counter failed");
+            }
+
+            if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\GPU Process Memory(*)\\Dedicated Usage", 0, &m_gpu_memory_counter))
+            {
+                RUN_LOG_WAR("resource monitor init warning while add gpu process memory dedicated usage counter failed");
+            }
+        }
+
+        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Network Interface(*)\\Bytes Sent/sec", 0, &m_net_send_counter))
+        {
+            RUN_LOG_WAR("resource monitor init warning while add network interface bytes send per second counter failed");
+        }
+
+        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Network Interface(*)\\Bytes Received/sec", 0, &m_net_recv_counter))
+        {
+            RUN_LOG_WAR("resource monitor init warning while add network interface bytes recv per second counter failed");
+        }
+
+        /* the first collection is the base of the rate counters, later ones are made by the pdh collectors when they are due */
+        if (ERROR_SUCCESS != PdhCollectQueryData(m_query_handle))
+        {
+            RUN_LOG_ERR("resource monitor init failure while collect query data failed");
+            break;
+        }
+
+        if (!start_collect_threads())
+        {
+            break;
+        }
+
+        RUN_LOG_DBG("resource monitor init success");
+
+        return (true);
+    } while (false);
+
+    exit();
+
+    return (false);
+}
+
+void ResourceMonitorImpl::close_system_collectors()
+{
+    if (nullptr != m_processor_counter)
+    {
+        PdhRemoveCounter(m_processor_counter);
+        m_processor_counter = nullptr;
+    }
+
+    if (nullptr != m_gpu_engine_counter)
+    {
+        PdhRemoveCounter(m_gpu_engine_counter);
+        m_gpu_engine_counter = nullptr;
+    }
+
+    if (nullptr != m_gpu_memory_counter)
+    {
+        PdhRemoveCounter(m_gpu_memory_counter);
+        m_gpu_memory_counter = nullptr;
+    }
+
+    if (nullptr != m_net_send_counter)
+    {
+        PdhRemoveCounter(m_net_send_counter);
+        m_net_send_counter = nullptr;
+    }
+
+    if (nullptr != m_net_recv_counter)
+    {
+        PdhRemoveCounter(m_net_recv_counter);
+        m_net_recv_counter = nullptr;
+    }
+
+    if (nullptr != m_query_handle)
+    {
+        PdhCloseQuery(m_query_handle);
+        m_query_handle = nullptr;
+    }
+}
+
+#else
+
+bool ResourceMonitorImpl::init(const std::string & proc_root, const std::string & sys_root)
+{
+    exit();
+
+    do
+    {
+        RUN_LOG_DBG("resource monitor init begin");
+
+        m_running = true;
+
+        m_query_gpu_with_pdh = false;
+
+        SystemHelper & system_helper = m_system_snapshot.system_helper;
+        system_helper.proc_root = proc_root;
+        system_helper.sys_root = sys_root;
+        system_helper.proc_root_fd = open(proc_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (system_helper.proc_root_fd < 0)
+        {
+            RUN_LOG_ERR("resource monitor init failure while open proc root (%s) failed", proc_root.c_str());
+            break;
+        }
+
+        if (!open_process_connector(m_system_snapshot))
+        {
+            RUN_LOG_WAR("resource monitor init warning while process connector is not available, process tree falls back to proc rescans");
+        }
+
+        if (!open_system_collectors())
+        {
+            break;
+        }
+
+        if (!get_system_disk_usage(m_system_snapshot))
+        {
+            RUN_LOG_WAR("resource monitor init warning while get system disk usage failed");
+        }
+
+        get_processor_utilization_percentage(m_system_snapshot);
+        get_network_interface_bytes_per_second(m_system_snapshot);
+
+        if (!start_collect_threads())
+        {
+            break;
+        }
+
+        RUN_LOG_DBG("resource monitor init success");
+
+        return (true);
+    } while (false);
+
+    exit();
+
+    return (false);
+}
+
+void ResourceMonitorImpl::close_system_collectors()
+{
+    close_process_connector(m_system_snapshot);
+
+    SystemHelper & system_helper = m_system_snapshot.system_helper;
+    if (system_helper.proc_root_fd >= 0)
+    {
+        close(system_helper.proc_root_fd);
+        system_helper.proc_root_fd = -1;
+    }
+}
+
+#endif // _MSC_VER
+
+void ResourceMonitorImpl::exit()
+{
+    if (m_running)
+    {
+        RUN_LOG_DBG("resource monitor exit begin");
+
+        m_running = false;
+
+        stop_collect_threads();
+        close_system_collectors();
+
+        RUN_LOG_DBG("resource monitor exit end");
+    }
+}
+
+bool ResourceMonitorImpl::in_callback_thread() const
+{
+    const std::thread::id thread_id = std::this_thread::get_id();
+    return (m_process_exit_thread.get_id() == thread_id || m_threshold_thread.get_id() == thread_id);
+}
+
+void ResourceMonitorImpl::stuck_check_thread()
+{
+    while (m_running && !m_query_gpu_with_pdh && nullptr == m_nvml_library.library_handle)
+    {
+        uint64_t current_time = Goofer::goofer_monotonic_time();
+        uint64_t nvsmi_alive_time = m_nvsmi_alive_time;
+        uint64_t nvsmi_query_alive_time = m_nvsmi_query_alive_time;
+        if ((0 == nvsmi_alive_time || nvsmi_alive_time + 3 > current_time) && (0 == nvsmi_query_alive_time || nvsmi_query_alive_time + 3 > current_time))
+        {
+            Goofer::goofer_ms_sleep(50);
+            continue;
+        }
+        kill_nvsmi_process();
+    }
+}
+
+void ResourceMonitorImpl::nvgpu_check_thread()
+{
+    SystemResource nvgpu_resource;
+    {
+        std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+        memcpy(&nvgpu_resource, &m_system_snapshot.system_resource, sizeof(nvgpu_resource));
+    }
+
+    std::vector<GraphicsCardResource> graphics_card_resources;
+
+    std::function<void (const SystemResource &, const std::vector<GraphicsCardResource> &)> frame_callback = std::bind(&ResourceMonitorImpl::publish_nvgpu_resource, this, std::placeholders::_1, std::placeholders::_2);
+
+    while (m_running)
+    {
+        if (!get_nvidia_gpu_detail(nvgpu_resource, graphics_card_resources, m_nvsmi_alive_time, m_running, frame_callback))
+        {
+            Goofer::goofer_ms_sleep(1000);
+        }
+    }
+}
+
+void ResourceMonitorImpl::nvgpu_query_thread()
+{
+    NvgpuQuery nvgpu_query;
+
+    std::function<void (const NvgpuQuery &)> frame_callback = std::bind(&ResourceMonitorImpl::publish_nvgpu_query, this, std::placeholders::_1);
+
+    while (m_running)
+    {
+        if (!get_nvidia_gpu_query(1000, nvgpu_query, m_nvsmi_query_alive_time, m_running, frame_callback))
+        {
+            Goofer::goofer_ms_sleep(1000);
+        }
+    }
+}
+
+void ResourceMonitorImpl::nvml_check_thread()
+{
+    SystemResource nvgpu_resource;
+    {
+        std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+        memcpy(&nvgpu_resource, &m_system_snapshot.system_resource, sizeof(nvgpu_resource));
+    }
+
+    NvgpuQuery nvgpu_query;
+
+    while (m_running)
+    {
+        if (get_nvml_gpu_detail(m_nvml_library, nvgpu_resource, nvgpu_query))
+        {
+            publish_nvml_resource(nvgpu_resource, nvgpu_query);
+        }
+
+        for (uint32_t index = 0; m_running && index < 20; ++index)
+        {
+            Goofer::goofer_ms_sleep(50);
+        }
+    }
+}
+
+#ifdef _MSC_VER
+
+void ResourceMonitorImpl::collect_resource(uint32_t collector_mask)
+{
+    /* every pdh counter is in one query, it is collected once for all the pdh collectors due in this pass */
+    if (0 != (collector_mask & (COLLECTOR_MASK(RESOURCE_COLLECTOR_CPU) | COLLECTOR_MASK(RESOURCE_COLLECTOR_GPU) | COLLECTOR_MASK(RESOURCE_COLLECTOR_NETWORK))))
+    {
+        PdhCollectQueryData(m_query_handle);
+    }
+
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_PROCESS_TREE)))
+    {
+        update_process_tree(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_PROCESS)))
+    {
+        get_process_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_MEMORY)))
+    {
+        get_system_memory_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_DISK)))
+    {
+        get_system_disk_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_CPU)))
+    {
+        get_processor_utilization_percentage(m_processor_counter, m_counter_buffer, m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_GPU)))
+    {
+        get_process_gpu_utilization_percentage(m_gpu_engine_counter, m_counter_buffer, m_system_snapshot, m_nvsmi_alive_time);
+        get_process_gpu_dedicated_memory_usage(m_gpu_memory_counter, m_counter_buffer, m_system_snapshot, m_nvsmi_alive_time);
+        if (m_query_gpu_with_pdh)
+        {
+            mirror_system_gpu_resource(m_system_snapshot);
+        }
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_NETWORK)))
+    {
+        get_network_interface_send_bytes_per_second(m_net_send_counter, m_counter_buffer, m_system_snapshot);
+        get_network_interface_recv_bytes_per_second(m_net_recv_counter, m_counter_buffer, m_system_snapshot);
+    }
+}
+
+void ResourceMonitorImpl::process_exit_thread()
+{
+    SystemHelper & system_helper = m_system_snapshot.system_helper;
+    std::vector<uint32_t> process_exit_list;
+    std::vector<uint32_t> monitor_exit_list;
+
+    while (m_running)
+    {
+        WaitForSingleObject(system_helper.process_exit_event, INFINITE);
+
+        {
+            std::lock_guard<std::mutex> locker(system_helper.process_exit_mutex);
+            process_exit_list.swap(system_helper.process_exit_list);
+        }
+
+        monitor_exit_list.clear();
+
+        {
+            std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+            /* the pid may have been removed, or reused by a new helper, since the wait fired */
+            FlatMap<uint32_t, ProcessHelper> & process_helper_map = m_system_snapshot.process_helper_map;
+            for (std::vector<uint32_t>::const_iterator iter = process_exit_list.begin(); process_exit_list.end() != iter; ++iter)
+            {
+                FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(*iter);
+                if (process_helper_map.end() == iter_helper || nullptr == iter_helper->second.process_exit_watch || process_is_alive(iter_helper->second.process_handle))
+                {
+                    continue;
+                }
+                if (apply_process_exit(m_system_snapshot, *iter))
+                {
+                    monitor_exit_list.push_back(*iter);
+                }
+            }
+        }
+
+        process_exit_list.clear();
+
+        notify_process_exit(monitor_exit_list);
+    }
+}
+
+#else
+
+void ResourceMonitorImpl::collect_resource(uint32_t collector_mask)
+{
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_PROCESS_TREE)))
+    {
+        update_process_tree(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_PROCESS)))
+    {
+        get_process_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_MEMORY)))
+    {
+        get_system_memory_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_DISK)))
+    {
+        get_system_disk_usage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_CPU)))
+    {
+        get_processor_utilization_percentage(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_GPU)) && m_query_gpu_with_pdh)
+    {
+        get_system_gpu_utilization_percentage(m_system_snapshot);
+        get_system_gpu_dedicated_memory_usage(m_system_snapshot);
+        mirror_system_gpu_resource(m_system_snapshot);
+    }
+    if (0 != (collector_mask & COLLECTOR_MASK(RESOURCE_COLLECTOR_NETWORK)))
+    {
+        get_network_interface_bytes_per_second(m_system_snapshot);
+    }
+}
+
+void ResourceMonitorImpl::process_exit_thread()
+{
+    const int process_exit_fd = m_system_snapshot.system_helper.process_exit_fd;
+    struct epoll_event event_array[64];
+    std::vector<uint32_t> monitor_exit_list;
+
+    while (m_running)
+    {
+        int event_count = epoll_wait(process_exit_fd, event_array, static_cast<int>(sizeof(event_array) / sizeof(event_array[0])), -1);
+        if (event_count <= 0)
+        {
+            continue;
+        }
+
+        monitor_exit_list.clear();
+
+        {
+            std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+            /* the pidfd may have been closed with its helper since epoll_wait returned */
+            FlatMap<uint32_t, ProcessHelper> & process_helper_map = m_system_snapshot.process_helper_map;
+            for (int index = 0; index < event_count; ++index)
+            {
+                uint32_t process_id = static_cast<uint32_t>(event_array[index].data.u64 >> 32);
+                int process_watch_fd = static_cast<int>(event_array[index].data.u64 & 0xFFFFFFFF);
+                if (0 == process_id)
+                {
+                    continue;
+                }
+                FlatMap<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
+                if (process_helper_map.end() == iter_helper || process_watch_fd != iter_helper->second.process_exit_fd)
+                {
+                    continue;
+                }
+                if (apply_process_exit(m_system_snapshot, process_id))
+                {
+                    monitor_exit_list.push_back(process_id);
+                }
+            }
+        }
+
+        notify_process_exit(monitor_exit_list);
+    }
+}
+
+#endif // _MSC_VER
+
+static uint64_t steady_milliseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+/*
+ * return: mask of the collectors due at current_time; a due collector moves on by one interval, or restarts from current_time after a stall
+ */
+static uint32_t take_due_collectors(CollectorSchedule * collector_schedules, uint64_t current_time)
+{
+    uint32_t collector_mask = 0;
+    for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+    {
+        CollectorSchedule & collector_schedule = collector_schedules[collector_type];
+        if (collector_schedule.due_time > current_time)
+        {
+            continue;
+        }
+        collector_mask |= COLLECTOR_MASK(collector_type);
+        collector_schedule.due_time += collector_schedule.interval_ms;
+        if (collector_schedule.due_time <= current_time)
+        {
+            collector_schedule.due_time = current_time + collector_schedule.interval_ms;
+        }
+    }
+    return (collector_mask);
+}
+
+static uint64_t get_next_due_time(const CollectorSchedule * collector_schedules)
+{
+    uint64_t next_due_time = collector_schedules[0].due_time;
+    for (uint32_t collector_type = 1; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+    {
+        next_due_time = std::min<uint64_t>(next_due_time, collector_schedules[collector_type].due_time);
+    }
+    return (next_due_time);
+}
+
+static double get_collector_watched_value(const SystemSnapshot & system_snapshot, uint32_t collector_type)
+{
+    const SystemResource & system_resource = system_snapshot.system_resource;
+    switch (collector_type)
+    {
+        case RESOURCE_COLLECTOR_PROCESS_TREE:
+        {
+            return (static_cast<double>(system_snapshot.process_helper_map.size()));
+        }
+        case RESOURCE_COLLECTOR_PROCESS:
+        {
+            double cpu_usage = 0.0;
+            const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+            for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+            {
+                cpu_usage += iter->second.process_resource.cpu_usage;
+            }
+            return (cpu_usage);
+        }
+        case RESOURCE_COLLECTOR_MEMORY:
+        {
+            return (0 == system_resource.ram_total ? 0.0 : 100.0 * system_resource.ram_usage / system_resource.ram_total);
+        }
+        case RESOURCE_COLLECTOR_DISK:
+        {
+            return (0 == system_resource.disk_total ? 0.0 : 100.0 * system_resource.disk_usage / system_resource.disk_total);
+        }
+        case RESOURCE_COLLECTOR_CPU:
+        {
+            return (system_resource.cpu_usage);
+        }
+        case RESOURCE_COLLECTOR_GPU:
+        {
+            return (system_resource.gpu_3d_usage);
+        }
+        case RESOURCE_COLLECTOR_NETWORK:
+        {
+            return (static_cast<double>(system_resource.net_send_bytes + system_resource.net_recv_bytes));
         }
-
-        const char * pid_beg = item.szName + 4;
-        const char * pid_end = strchr(pid_beg, '_');
-        uint32_t process_id = atoi(std::string(pid_beg, pid_end).c_str());
-        std::map<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
-        if (process_helper_map.end() != iter_helper)
+        default:
         {
-            std::map<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(iter_helper->second.process_ancestor);
-            if (process_snapshot_map.end() != iter_snapshot)
-            {
-                ProcessResource & process_resource = iter_snapshot->second.process_resource;
-                process_resource.gpu_3d_usage += gpu_3d_usage;
-                process_resource.gpu_vr_usage += gpu_vr_usage;
-                process_resource.gpu_enc_usage += gpu_enc_usage;
-                process_resource.gpu_dec_usage += gpu_dec_usage;
-            }
+            return (0.0);
         }
-        system_resource.gpu_3d_usage += gpu_3d_usage;
-        system_resource.gpu_vr_usage += gpu_vr_usage;
-        system_resource.gpu_enc_usage += gpu_enc_usage;
-        system_resource.gpu_dec_usage += gpu_dec_usage;
     }
-
-    return (true);
 }
 
-static bool get_nvidia_gpu_mem(uint64_t & video_memory_size_total, uint64_t & video_memory_size_avail, uint64_t & nvsmi_alive_time)
+/*
+ * a move beyond the threshold drops the interval to the minimum at once, a quiet run doubles it up to the maximum;
+ * take_due_collectors has moved due_time on by the last interval, it is moved by the new one instead, so the runs keep
+ * their cadence however long the pass took, and only restart from current_time after a stall
+ */
+static void adapt_collector_schedule(CollectorSchedule & collector_schedule, double watched_value, uint64_t current_time)
 {
-    video_memory_size_total = 0;
-    video_memory_size_avail = 0;
-
-    static bool s_check_tool_not_exist = false;
-
-    if (s_check_tool_not_exist)
-    {
-        return (false);
-    }
-
-    FILE * file = goofer_popen("nvidia-smi --format=csv,noheader --query-gpu=memory.total,memory.free", "r");
-    if (nullptr == file)
+    if (!collector_schedule.adaptive)
     {
-        s_check_tool_not_exist = true;
-        return (false);
+        return;
     }
 
-    nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-    uint64_t memory_size_total = 0;
-    uint64_t memory_size_avail = 0;
-    char memory_size_total_unit[16] = { 0x0 };
-    char memory_size_avail_unit[16] = { 0x0 };
+    const uint64_t last_interval_ms = collector_schedule.interval_ms;
 
-    while (4 == fscanf(file, "%I64u %s %I64u %s", &memory_size_total, memory_size_total_unit, &memory_size_avail, memory_size_avail_unit))
+    if (collector_schedule.watched_valid)
     {
-        if ('G' == memory_size_total_unit[0])
+        double change = watched_value > collector_schedule.watched_value ? watched_value - collector_schedule.watched_value : collector_schedule.watched_value - watched_value;
+        if (change > collector_schedule.change_threshold)
         {
-            memory_size_total *= 1024;
+            collector_schedule.interval_ms = collector_schedule.min_interval_ms;
         }
-        if ('G' == memory_size_avail_unit[0])
+        else
         {
-            memory_size_avail *= 1024;
+            collector_schedule.interval_ms = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(collector_schedule.interval_ms) * 2, collector_schedule.max_interval_ms));
         }
-        video_memory_size_total += memory_size_total * 1024 * 1024;
-        video_memory_size_avail += memory_size_avail * 1024 * 1024;
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
     }
 
-    goofer_pclose(file);
-
-    nvsmi_alive_time = 0;
+    collector_schedule.watched_valid = true;
+    collector_schedule.watched_value = watched_value;
 
-    return (true);
+    const uint64_t due_time = collector_schedule.due_time - std::min<uint64_t>(collector_schedule.due_time, last_interval_ms) + collector_schedule.interval_ms;
+    collector_schedule.due_time = (due_time > current_time ? due_time : current_time + collector_schedule.interval_ms);
 }
 
-static bool get_process_gpu_dedicated_memory_usage(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot, uint64_t & nvsmi_alive_time)
+void ResourceMonitorImpl::query_resource_thread()
 {
-    if (0 == system_snapshot.system_resource.gpu_count)
     {
-        return (false);
+        std::lock_guard<std::mutex> locker(m_query_mutex);
+        uint64_t current_time = steady_milliseconds();
+        for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+        {
+            m_collector_schedules[collector_type].due_time = current_time + m_collector_schedules[collector_type].interval_ms;
+        }
     }
 
-    if (nullptr == counter_handle)
+    while (m_running)
     {
-#if 0
-        static uint64_t s_last_check_time = 0;
+        uint32_t collector_mask = 0;
 
-        uint64_t current_time = Goofer::goofer_time();
-        if (current_time >= s_last_check_time && current_time < s_last_check_time + 5)
         {
-            return (true);
+            std::unique_lock<std::mutex> locker(m_query_mutex);
+            while (m_running)
+            {
+                uint64_t current_time = steady_milliseconds();
+                collector_mask = take_due_collectors(m_collector_schedules, current_time);
+                if (0 != collector_mask)
+                {
+                    break;
+                }
+                m_query_condition.wait_for(locker, std::chrono::milliseconds(get_next_due_time(m_collector_schedules) - current_time));
+            }
         }
 
-        s_last_check_time = current_time;
-
-        uint64_t video_memory_size_total = 0;
-        uint64_t video_memory_size_avail = 0;
-        if (!get_nvidia_gpu_mem(video_memory_size_total, video_memory_size_avail, nvsmi_alive_time))
+        if (!m_running)
         {
-            return (false);
+            break;
         }
 
-        SystemResource & system_resource = system_snapshot.system_resource;
-        system_resource.gpu_mem_total = video_memory_size_total;
-        system_resource.gpu_mem_usage = video_memory_size_total - video_memory_size_avail;
-#endif
-        return (true);
-    }
+        double watched_values[RESOURCE_COLLECTOR_COUNT] = { 0.0 };
 
-    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
-    ULONG item_count = 0;
-    if (!get_formatted_counter_array(counter_handle, PDH_FMT_LARGE, buffer, item_array, item_count))
-    {
-        return (false);
-    }
+        {
+            std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-    std::map<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = system_snapshot.process_snapshot_map;
+            collect_resource(collector_mask);
+            aggregate_process_resource(m_system_snapshot);
 
-    for (std::map<uint32_t, ProcessSnapshot>::iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
-    {
-        ProcessResource & process_resource = iter->second.process_resource;
-        process_resource.gpu_mem_usage = 0;
-    }
+            publish_system_snapshot();
 
-    SystemResource & system_resource = system_snapshot.system_resource;
-    system_resource.gpu_mem_usage = 0;
+            for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+            {
+                if (0 != (collector_mask & COLLECTOR_MASK(collector_type)))
+                {
+                    watched_values[collector_type] = get_collector_watched_value(m_system_snapshot, collector_type);
+                }
+            }
+        }
 
-    for (ULONG item_index = 0; item_index < item_count; ++item_index)
-    {
-        /*
-         * pid_25832_luid_0x000000_0x00DABC_phys_0
-         */
-        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
-        uint64_t gpu_mem_usage = static_cast<uint64_t>(item.FmtValue.largeValue);
-        const char * pid_beg = item.szName + 4;
-        const char * pid_end = strchr(pid_beg, '_');
-        uint32_t process_id = atoi(std::string(pid_beg, pid_end).c_str());
-        std::map<uint32_t, ProcessHelper>::iterator iter_helper = process_helper_map.find(process_id);
-        if (process_helper_map.end() != iter_helper)
         {
-            std::map<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(iter_helper->second.process_ancestor);
-            if (process_snapshot_map.end() != iter_snapshot)
+            std::lock_guard<std::mutex> locker(m_query_mutex);
+            uint64_t current_time = steady_milliseconds();
+            for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
             {
-                ProcessResource & process_resource = iter_snapshot->second.process_resource;
-                process_resource.gpu_mem_usage += gpu_mem_usage;
-                if (process_resource.gpu_mem_usage > system_resource.gpu_mem_total)
+                if (0 != (collector_mask & COLLECTOR_MASK(collector_type)))
                 {
-                    process_resource.gpu_mem_usage = system_resource.gpu_mem_total;
+                    adapt_collector_schedule(m_collector_schedules[collector_type], watched_values[collector_type], current_time);
                 }
             }
         }
-        system_resource.gpu_mem_usage += gpu_mem_usage;
     }
+}
 
-    if (system_resource.gpu_mem_usage > system_resource.gpu_mem_total)
+bool ResourceMonitorImpl::set_collector_interval(ResourceCollectorType collector_type, uint32_t interval_ms)
+{
+    if (!m_running || collector_type < 0 || collector_type >= RESOURCE_COLLECTOR_COUNT || interval_ms < COLLECTOR_MIN_INTERVAL_MS)
     {
-        system_resource.gpu_mem_usage = system_resource.gpu_mem_total;
+        return (false);
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_query_mutex);
+        CollectorSchedule & collector_schedule = m_collector_schedules[collector_type];
+        collector_schedule.interval_ms = interval_ms;
+        collector_schedule.due_time = steady_milliseconds() + interval_ms;
+        collector_schedule.adaptive = false;
     }
+    m_query_condition.notify_all();
 
     return (true);
 }
 
-static bool get_nvidia_card_names(uint64_t & graphics_card_count, std::list<std::string> & graphics_card_names, uint64_t & nvsmi_alive_time)
+bool ResourceMonitorImpl::set_collector_adaptive(ResourceCollectorType collector_type, uint32_t min_interval_ms, uint32_t max_interval_ms, double change_threshold)
 {
-    graphics_card_count = 0;
-    graphics_card_names.clear();
-
-    FILE * file = goofer_popen("nvidia-smi --format=csv,noheader --query-gpu=name", "r");
-    if (nullptr == file)
+    if (!m_running || collector_type < 0 || collector_type >= RESOURCE_COLLECTOR_COUNT || min_interval_ms < COLLECTOR_MIN_INTERVAL_MS || min_interval_ms > max_interval_ms || change_threshold < 0.0)
     {
         return (false);
     }
 
-    nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-    char buffer[128] = { 0x0 };
-    while (nullptr != fgets(buffer, sizeof(buffer) - 1, file))
     {
-        std::string graphics_card_name(buffer);
-        Goofer::goofer_string_trim(graphics_card_name);
-        if (!graphics_card_name.empty())
-        {
-            graphics_card_count += 1;
-            graphics_card_names.push_back(graphics_card_name);
-        }
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+        std::lock_guard<std::mutex> locker(m_query_mutex);
+        CollectorSchedule & collector_schedule = m_collector_schedules[collector_type];
+        collector_schedule.adaptive = true;
+        collector_schedule.min_interval_ms = min_interval_ms;
+        collector_schedule.max_interval_ms = max_interval_ms;
+        collector_schedule.change_threshold = change_threshold;
+        collector_schedule.watched_valid = false;
+        collector_schedule.interval_ms = min_interval_ms;
+        collector_schedule.due_time = steady_milliseconds() + min_interval_ms;
     }
+    m_query_condition.notify_all();
 
-    goofer_pclose(file);
-
-    nvsmi_alive_time = 0;
-
-    return (0 != graphics_card_count);
+    return (true);
 }
 
-static bool get_system_gpu_dedicated_memory_total(SystemSnapshot & system_snapshot, bool & query_gpu_with_pdh, uint64_t & nvsmi_alive_time)
+bool ResourceMonitorImpl::get_collector_interval(ResourceCollectorType collector_type, uint32_t & interval_ms)
 {
-    std::list<std::string> & graphics_card_names = system_snapshot.graphics_card_names;
-    SystemResource & system_resource = system_snapshot.system_resource;
-
-    graphics_card_names.clear();
-    system_resource.gpu_count = 0;
-    system_resource.gpu_mem_total = 0;
-    system_resource.gpu_mem_usage = 0;
-
-    do
+    if (!m_running || collector_type < 0 || collector_type >= RESOURCE_COLLECTOR_COUNT)
     {
-        if (!get_nvidia_card_names(system_resource.gpu_count, graphics_card_names, nvsmi_alive_time))
-        {
-            break;
-        }
-
-        uint64_t video_memory_size_total = 0;
-        uint64_t video_memory_size_avail = 0;
-        if (!get_nvidia_gpu_mem(video_memory_size_total, video_memory_size_avail, nvsmi_alive_time))
-        {
-            break;
-        }
+        return (false);
+    }
 
-        SystemResource & system_resource = system_snapshot.system_resource;
-        system_resource.gpu_mem_total = video_memory_size_total;
-        system_resource.gpu_mem_usage = video_memory_size_total - video_memory_size_avail;
+    std::lock_guard<std::mutex> locker(m_query_mutex);
+    interval_ms = m_collector_schedules[collector_type].interval_ms;
 
-        query_gpu_with_pdh = false;
+    return (true);
+}
 
-        return (true);
-    } while (false);
+bool ResourceMonitorImpl::append_process(uint32_t process_id, bool process_tree)
+{
+    if (!m_running || 0 == process_id)
+    {
+        return (false);
+    }
 
-    graphics_card_names.clear();
-    system_resource.gpu_count = 0;
-    system_resource.gpu_mem_total = 0;
-    system_resource.gpu_mem_usage = 0;
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-    ATL::CComPtr<IDXGIFactory1> dxgi_factory;
-    if (S_OK == CreateDXGIFactory1(IsWindowsVistaSP2OrGreater() ? __uuidof(IDXGIFactory2) : __uuidof(IDXGIFactory1), reinterpret_cast<void **>(&dxgi_factory)))
+    if (append_process_to_monitor(m_system_snapshot, process_id, process_tree))
     {
-        UINT adapter_index = 0;
-        while (true)
         {
-            ATL::CComPtr<IDXGIAdapter1> dxgi_adapter;
-            if (DXGI_ERROR_NOT_FOUND == dxgi_factory->EnumAdapters1(adapter_index++, &dxgi_adapter))
-            {
-                break;
-            }
-
-            DXGI_ADAPTER_DESC adapter_desc = { 0x0 };
-            HRESULT result = dxgi_adapter->GetDesc(&adapter_desc);
-            if (result < 0)
-            {
-                continue;
-            }
-
-            if (0x1414 == adapter_desc.VendorId)
+            std::lock_guard<std::mutex> history_locker(m_history_mutex);
+            if (m_history_pool.enabled() && m_history_map.end() == m_history_map.find(process_id))
             {
-                continue;
+                m_history_map[process_id] = m_history_pool.acquire();
             }
-
-            graphics_card_names.emplace_back(Goofer::unicode_to_utf8(adapter_desc.Description));
-            system_resource.gpu_count += 1;
-            system_resource.gpu_mem_total += static_cast<uint64_t>(adapter_desc.DedicatedVideoMemory);
-
-            break;
         }
+        aggregate_process_resource(m_system_snapshot);
+        publish_system_snapshot();
+        RUN_LOG_DBG("append process (%u) tree (%s) to monitor success", process_id, process_tree ? "true" : "false");
+        return (true);
+    }
+    else
+    {
+        RUN_LOG_ERR("append process (%u) tree (%s) to monitor failure", process_id, process_tree ? "true" : "false");
+        return (false);
     }
-
-    query_gpu_with_pdh = true;
-
-    return (system_resource.gpu_count > 0);
 }
 
-static bool get_nvidia_gpu_temperature(uint64_t & gpu_temperature, uint64_t & nvsmi_alive_time)
+bool ResourceMonitorImpl::remove_process(uint32_t process_id)
 {
-    static bool s_check_tool_not_exist = false;
-
-    if (s_check_tool_not_exist)
+    if (!m_running || 0 == process_id)
     {
         return (false);
     }
 
-    FILE * file = goofer_popen("nvidia-smi --format=csv,noheader,nounits --query-gpu=temperature.gpu", "r");
-    if (nullptr == file)
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    if (remove_process_from_monitor(m_system_snapshot, process_id))
     {
-        s_check_tool_not_exist = true;
+        {
+            std::lock_guard<std::mutex> history_locker(m_history_mutex);
+            FlatMap<uint32_t, ResourceHistory *>::iterator iter_history = m_history_map.find(process_id);
+            if (m_history_map.end() != iter_history)
+            {
+                m_history_pool.release(iter_history->second);
+                m_history_map.erase(iter_history);
+            }
+        }
+        aggregate_process_resource(m_system_snapshot);
+        publish_system_snapshot();
+        RUN_LOG_DBG("remove process (%u) from monitor success", process_id);
+        return (true);
+    }
+    else
+    {
+        RUN_LOG_ERR("remove process (%u) from monitor failure", process_id);
         return (false);
     }
+}
 
-    nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-    fscanf(file, "%I64u", &gpu_temperature);
-
-    goofer_pclose(file);
+bool ResourceMonitorImpl::set_process_exit_callback(const std::function<void (uint32_t process_id)> & process_exit_callback)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-    nvsmi_alive_time = 0;
+    std::lock_guard<std::mutex> locker(m_process_exit_mutex);
+    m_process_exit_callback = process_exit_callback;
 
     return (true);
 }
 
-static bool get_system_gpu_temperature(SystemSnapshot & system_snapshot, uint64_t & nvsmi_alive_time)
+void ResourceMonitorImpl::notify_process_exit(const std::vector<uint32_t> & process_id_list)
 {
-    SystemResource & system_resource = system_snapshot.system_resource;
+    if (process_id_list.empty())
+    {
+        return;
+    }
 
-    if (get_nvidia_gpu_temperature(system_resource.gpu_temperature, nvsmi_alive_time))
+    /* called without the lock, the callback may replace itself */
+    std::function<void (uint32_t)> process_exit_callback;
     {
-        return (true);
+        std::lock_guard<std::mutex> locker(m_process_exit_mutex);
+        process_exit_callback = m_process_exit_callback;
     }
-    else
+
+    for (std::vector<uint32_t>::const_iterator iter = process_id_list.begin(); process_id_list.end() != iter; ++iter)
     {
-        system_resource.gpu_temperature = 0;
-        return (false);
+        RUN_LOG_DBG("monitoring process (%u) exited", *iter);
+        if (process_exit_callback)
+        {
+            process_exit_callback(*iter);
+        }
     }
 }
 
-static bool get_nvidia_gpu_detail(SystemResource & system_resource, uint64_t & nvsmi_alive_time, volatile bool & running)
-{
-    static bool s_check_tool_not_exist = false;
+#define THRESHOLD_EVENT_QUEUE_LIMIT     1024
 
-    if (s_check_tool_not_exist)
+bool ResourceMonitorImpl::subscribe_threshold(const ResourceThreshold & threshold, const threshold_callback_t & threshold_callback, uint32_t & subscription_id)
+{
+    if (!m_running || threshold.metric_type < 0 || threshold.metric_type >= RESOURCE_METRIC_COUNT || threshold.clear_value > threshold.raise_value || !threshold_callback)
     {
         return (false);
     }
 
-    FILE * file = goofer_popen("nvidia-smi dmon -s u", "r");
-    if (nullptr == file)
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    subscription_id = ++m_threshold_sequence;
+    ThresholdRule & threshold_rule = m_threshold_rules[subscription_id];
+    memcpy(&threshold_rule.threshold, &threshold, sizeof(threshold_rule.threshold));
+    threshold_rule.threshold_callback = threshold_callback;
+
+    RUN_LOG_DBG("subscribe threshold (%u) on process (%u) metric (%d) raise (%g) clear (%g) duration (%u ms)", subscription_id, threshold.process_id, threshold.metric_type, threshold.raise_value, threshold.clear_value, threshold.min_duration_ms);
+
+    return (true);
+}
+
+bool ResourceMonitorImpl::unsubscribe_threshold(uint32_t subscription_id)
+{
+    if (!m_running)
     {
-        s_check_tool_not_exist = true;
         return (false);
     }
 
-    uint32_t id_index = ~0;
-    uint32_t sm_index = ~0;
-    uint32_t mem_index = ~0;
-    uint32_t enc_index = ~0;
-    uint32_t dec_index = ~0;
-
-    char line[128] = { 0x0 };
-
-    do
     {
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
+        std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+        if (0 == m_threshold_rules.erase(subscription_id))
+        {
+            return (false);
+        }
+    }
 
-        if (nullptr == fgets(line, sizeof(line) - 1, file))
+    /* events already queued for it are dropped, one being delivered right now still completes */
+    std::lock_guard<std::mutex> locker(m_threshold_mutex);
+    for (std::list<ThresholdEvent>::iterator iter = m_threshold_events.begin(); m_threshold_events.end() != iter;)
+    {
+        if (subscription_id == iter->subscription_id)
+        {
+            iter = m_threshold_events.erase(iter);
+        }
+        else
         {
-            break;
+            ++iter;
         }
+    }
 
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
-
-        std::string headers(line);
-        Goofer::goofer_string_trim(headers, " #");
+    return (true);
+}
 
-        std::vector<std::string> titles;
-        Goofer::goofer_split_piece(headers, " \t", true, true, titles);
-        for (uint32_t index = 0; index < titles.size(); ++index)
+static bool get_threshold_value(const PublishedSnapshot & published_snapshot, const ResourceThreshold & threshold, double & value)
+{
+    if (0 == threshold.process_id)
+    {
+        const SystemResource & system_resource = published_snapshot.system_resource;
+        switch (threshold.metric_type)
         {
-            const std::string & item = titles[index];
-            if (0 == stricmp("gpu", item.c_str()))
+            case RESOURCE_METRIC_CPU_USAGE:
             {
-                id_index = index;
+                value = system_resource.cpu_usage;
+                return (true);
             }
-            else if (0 == stricmp("sm", item.c_str()))
+            case RESOURCE_METRIC_RAM_USAGE:
             {
-                sm_index = index;
+                value = static_cast<double>(system_resource.ram_usage);
+                return (true);
             }
-            else if (0 == stricmp("mem", item.c_str()))
+            case RESOURCE_METRIC_GPU_3D_USAGE:
             {
-                mem_index = index;
+                value = system_resource.gpu_3d_usage;
+                return (true);
             }
-            else if (0 == stricmp("enc", item.c_str()))
+            case RESOURCE_METRIC_GPU_MEM_USAGE:
             {
-                enc_index = index;
+                value = static_cast<double>(system_resource.gpu_mem_usage);
+                return (true);
             }
-            else if (0 == stricmp("dec", item.c_str()))
+            default:
             {
-                dec_index = index;
+                return (false);
             }
         }
-    } while (false);
+    }
 
-    uint32_t sm_percent = 0;
-    uint32_t mem_percent = 0;
-    uint32_t enc_percent = 0;
-    uint32_t dec_percent = 0;
-    uint32_t gpu_count = 0;
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter_snapshot = process_snapshot_map.find(threshold.process_id);
+    if (process_snapshot_map.end() == iter_snapshot)
+    {
+        return (false);
+    }
 
-    while (running && nullptr != fgets(line, sizeof(line) - 1, file))
+    const ProcessResource & process_resource = iter_snapshot->second.process_resource_total;
+    switch (threshold.metric_type)
     {
-        if (nullptr != strchr(line, '#'))
-        {
-            continue;
-        }
-        std::vector<std::string> values;
-        Goofer::goofer_split_piece(line, " \t", true, true, values);
-        if (values.size() <= id_index)
+        case RESOURCE_METRIC_CPU_USAGE:
         {
-            continue;
-        }
-        if (0 == std::stoi(values[id_index], nullptr))
-        {
-            if (0 != gpu_count)
-            {
-                system_resource.gpu_3d_usage = sm_percent / gpu_count;
-                system_resource.gpu_mem_usage = (mem_percent / gpu_count) * system_resource.gpu_mem_total / 100;
-                system_resource.gpu_enc_usage = enc_percent / gpu_count;
-                system_resource.gpu_dec_usage = dec_percent / gpu_count;
-            }
-            sm_percent = 0;
-            mem_percent = 0;
-            enc_percent = 0;
-            dec_percent = 0;
-            gpu_count = 0;
+            value = process_resource.cpu_usage;
+            return (true);
         }
-        if (values.size() > sm_index)
+        case RESOURCE_METRIC_RAM_USAGE:
         {
-            sm_percent += std::stoi(values[sm_index], nullptr);
+            value = static_cast<double>(process_resource.ram_usage);
+            return (true);
         }
-        if (values.size() > mem_index)
+        case RESOURCE_METRIC_GPU_3D_USAGE:
         {
-            mem_percent += std::stoi(values[mem_index], nullptr);
+            value = process_resource.gpu_3d_usage;
+            return (true);
         }
-        if (values.size() > enc_index)
+        case RESOURCE_METRIC_GPU_MEM_USAGE:
         {
-            enc_percent += std::stoi(values[enc_index], nullptr);
+            value = static_cast<double>(process_resource.gpu_mem_usage);
+            return (true);
         }
-        if (values.size() > dec_index)
+        default:
         {
-            dec_percent += std::stoi(values[dec_index], nullptr);
+            return (false);
         }
-        gpu_count += 1;
-        nvsmi_alive_time = Goofer::goofer_monotonic_time();
     }
-
-    goofer_pclose(file);
-
-    nvsmi_alive_time = 0;
-
-    return (true);
 }
 
-static bool get_system_disk_usage(SystemSnapshot & system_snapshot)
+/*
+ * return: the state flipped; the value must stay past raise_value (or clear_value) for min_duration_ms first,
+ * a snapshot without the value (process not monitoring) restarts the wait
+ */
+static bool update_threshold_rule(ThresholdRule & threshold_rule, bool value_valid, double value, uint64_t current_time)
 {
-    SystemResource & system_resource = system_snapshot.system_resource;
-    uint64_t total_size = 0;
-    uint64_t avail_size = 0;
-    if (Goofer::get_system_disk_usage("C:", total_size, avail_size))
+    const ResourceThreshold & threshold = threshold_rule.threshold;
+
+    /* the process left the snapshot, a raised rule would never see a value to clear on, so it clears at once */
+    if (!value_valid && threshold_rule.raised)
     {
-        system_resource.disk_total = total_size;
-        system_resource.disk_usage = total_size - avail_size;
+        threshold_rule.raised = false;
+        threshold_rule.pending_time = 0;
         return (true);
     }
-    else
+
+    const bool value_past_edge = value_valid && (threshold_rule.raised ? value <= threshold.clear_value : value >= threshold.raise_value);
+    if (!value_past_edge)
+    {
+        threshold_rule.pending_time = 0;
+        return (false);
+    }
+
+    if (0 == threshold_rule.pending_time)
+    {
+        threshold_rule.pending_time = current_time;
+    }
+
+    if (current_time - threshold_rule.pending_time < threshold.min_duration_ms)
     {
-        system_resource.disk_total = 0;
-        system_resource.disk_usage = 0;
         return (false);
     }
+
+    threshold_rule.raised = !threshold_rule.raised;
+    threshold_rule.pending_time = 0;
+
+    return (true);
 }
 
-static bool get_network_interface_send_bytes_per_second(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
+void ResourceMonitorImpl::evaluate_threshold_rules(const PublishedSnapshot & published_snapshot)
 {
-    if (nullptr == counter_handle)
+    if (m_threshold_rules.empty())
     {
-        return (false);
+        return;
     }
 
-    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
-    ULONG item_count = 0;
-    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE, buffer, item_array, item_count))
+    std::list<ThresholdEvent> threshold_events;
+
+    for (FlatMap<uint32_t, ThresholdRule>::iterator iter = m_threshold_rules.begin(); m_threshold_rules.end() != iter; ++iter)
     {
-        return (false);
+        ThresholdRule & threshold_rule = iter->second;
+        double value = 0.0;
+        bool value_valid = get_threshold_value(published_snapshot, threshold_rule.threshold, value);
+        if (update_threshold_rule(threshold_rule, value_valid, value, published_snapshot.sample_time))
+        {
+            threshold_events.push_back(ThresholdEvent());
+            ThresholdEvent & threshold_event = threshold_events.back();
+            threshold_event.subscription_id = iter->first;
+            memcpy(&threshold_event.threshold, &threshold_rule.threshold, sizeof(threshold_event.threshold));
+            threshold_event.threshold_callback = threshold_rule.threshold_callback;
+            threshold_event.raised = threshold_rule.raised;
+            threshold_event.value = value;
+        }
     }
 
-    double total_send_bytes = 0.0;
-    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    if (threshold_events.empty())
     {
-        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
-        total_send_bytes += item.FmtValue.doubleValue;
+        return;
     }
 
-    SystemResource & system_resource = system_snapshot.system_resource;
-    system_resource.net_send_bytes = static_cast<uint64_t>(total_send_bytes);
+    {
+        std::lock_guard<std::mutex> locker(m_threshold_mutex);
+        m_threshold_events.splice(m_threshold_events.end(), threshold_events);
+        while (m_threshold_events.size() > THRESHOLD_EVENT_QUEUE_LIMIT)
+        {
+            RUN_LOG_WAR("threshold (%u) event dropped while dispatch falls behind", m_threshold_events.front().subscription_id);
+            m_threshold_events.pop_front();
+        }
+    }
+    m_threshold_condition.notify_all();
+}
 
-    return (true);
+void ResourceMonitorImpl::threshold_dispatch_thread()
+{
+    std::unique_lock<std::mutex> locker(m_threshold_mutex);
+
+    while (m_running)
+    {
+        if (m_threshold_events.empty())
+        {
+            m_threshold_condition.wait(locker);
+            continue;
+        }
+
+        ThresholdEvent threshold_event = m_threshold_events.front();
+        m_threshold_events.pop_front();
+
+        /* called without the lock, a slow handler only delays the handlers behind it */
+        locker.unlock();
+        threshold_event.threshold_callback(threshold_event.subscription_id, threshold_event.threshold, threshold_event.raised, threshold_event.value);
+        locker.lock();
+    }
 }
 
-static bool get_network_interface_recv_bytes_per_second(PDH_HCOUNTER counter_handle, std::vector<char> & buffer, SystemSnapshot & system_snapshot)
+bool ResourceMonitorImpl::set_history(uint32_t sample_capacity, const uint32_t * window_ms, std::size_t window_count)
 {
-    if (nullptr == counter_handle)
+    if (!m_running)
     {
         return (false);
     }
 
-    PDH_FMT_COUNTERVALUE_ITEM * item_array = nullptr;
-    ULONG item_count = 0;
-    if (!get_formatted_counter_array(counter_handle, PDH_FMT_DOUBLE, buffer, item_array, item_count))
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    std::lock_guard<std::mutex> history_locker(m_history_mutex);
+
+    m_history_map.clear();
+    if (!m_history_pool.reset(sample_capacity, window_ms, window_count))
     {
+        RUN_LOG_ERR("set history capacity (%u) windows (%u) failure while the arguments are invalid", sample_capacity, static_cast<uint32_t>(window_count));
         return (false);
     }
 
-    double total_recv_bytes = 0.0;
-    for (ULONG item_index = 0; item_index < item_count; ++item_index)
+    if (m_history_pool.enabled())
     {
-        PDH_FMT_COUNTERVALUE_ITEM & item = item_array[item_index];
-        total_recv_bytes += item.FmtValue.doubleValue;
+        m_history_map.reserve(m_system_snapshot.process_snapshot_map.size() + 1);
+        m_history_map[0] = m_history_pool.acquire();
+        const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = m_system_snapshot.process_snapshot_map;
+        for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+        {
+            m_history_map[iter->first] = m_history_pool.acquire();
+        }
     }
 
-    SystemResource & system_resource = system_snapshot.system_resource;
-    system_resource.net_recv_bytes = static_cast<uint64_t>(total_recv_bytes);
-
     return (true);
 }
 
-ResourceMonitorImpl::ResourceMonitorImpl()
-    : m_running(false)
-    , m_query_gpu_with_pdh(false)
-    , m_nvsmi_alive_time(0)
-    , m_stuck_check_thread()
-    , m_nvgpu_check_thread()
-    , m_query_thread()
-    , m_query_event(nullptr)
-    , m_query_handle(nullptr)
-    , m_processor_counter(nullptr)
-    , m_gpu_engine_counter(nullptr)
-    , m_gpu_memory_counter(nullptr)
-    , m_net_send_counter(nullptr)
-    , m_net_recv_counter(nullptr)
-    , m_system_snapshot()
-    , m_system_snapshot_mutex()
+bool ResourceMonitorImpl::get_resource_statistics(uint32_t process_id, ResourceMetricType metric_type, std::size_t window_index, ResourceStatistics & resource_statistics)
 {
+    if (!m_running)
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> locker(m_history_mutex);
+
+    FlatMap<uint32_t, ResourceHistory *>::const_iterator iter_history = m_history_map.find(process_id);
+    if (m_history_map.end() == iter_history)
+    {
+        return (false);
+    }
 
+    return (iter_history->second->get_statistics(metric_type, window_index, resource_statistics));
 }
 
-ResourceMonitorImpl::~ResourceMonitorImpl()
+static void get_metric_values(const SystemResource & system_resource, double * metric_values)
 {
-    exit();
+    metric_values[RESOURCE_METRIC_CPU_USAGE] = system_resource.cpu_usage;
+    metric_values[RESOURCE_METRIC_RAM_USAGE] = static_cast<double>(system_resource.ram_usage);
+    metric_values[RESOURCE_METRIC_GPU_3D_USAGE] = system_resource.gpu_3d_usage;
+    metric_values[RESOURCE_METRIC_GPU_MEM_USAGE] = static_cast<double>(system_resource.gpu_mem_usage);
 }
 
-bool ResourceMonitorImpl::init()
+static void get_metric_values(const ProcessResource & process_resource, double * metric_values)
 {
-    exit();
-
-    do
-    {
-        RUN_LOG_DBG("resource monitor init begin");
-
-        m_running = true;
+    metric_values[RESOURCE_METRIC_CPU_USAGE] = process_resource.cpu_usage;
+    metric_values[RESOURCE_METRIC_RAM_USAGE] = static_cast<double>(process_resource.ram_usage);
+    metric_values[RESOURCE_METRIC_GPU_3D_USAGE] = process_resource.gpu_3d_usage;
+    metric_values[RESOURCE_METRIC_GPU_MEM_USAGE] = static_cast<double>(process_resource.gpu_mem_usage);
+}
 
-        m_query_gpu_with_pdh = false;
+void ResourceMonitorImpl::append_history_samples(const PublishedSnapshot & published_snapshot)
+{
+    std::lock_guard<std::mutex> locker(m_history_mutex);
 
-        m_stuck_check_thread = std::thread(&::ResourceMonitorImpl::stuck_check_thread, this);
-        if (!m_stuck_check_thread.joinable())
-        {
-            RUN_LOG_ERR("resource monitor init failure while stuck check thread create failed");
-            break;
-        }
+    if (m_history_map.empty())
+    {
+        return;
+    }
 
-        if (!get_system_cpu_count(m_system_snapshot))
-        {
-            RUN_LOG_ERR("resource monitor init failure while get system cpu count failed");
-            break;
-        }
+    double metric_values[RESOURCE_METRIC_COUNT] = { 0.0 };
 
-        if (!get_system_memory_usage(m_system_snapshot))
+    /* both maps are sorted by pid, one merge pass pairs every history with its snapshot */
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter_snapshot = process_snapshot_map.begin();
+    for (FlatMap<uint32_t, ResourceHistory *>::iterator iter = m_history_map.begin(); m_history_map.end() != iter; ++iter)
+    {
+        if (0 == iter->first)
         {
-            RUN_LOG_ERR("resource monitor init failure while get system memory usage failed");
-            break;
+            get_metric_values(published_snapshot.system_resource, metric_values);
+            iter->second->append(published_snapshot.sample_time, metric_values);
+            continue;
         }
 
-        if (!get_system_disk_usage(m_system_snapshot))
+        while (process_snapshot_map.end() != iter_snapshot && iter_snapshot->first < iter->first)
         {
-            RUN_LOG_ERR("resource monitor init failure while get system disk usage failed");
-            break;
+            ++iter_snapshot;
         }
-
-        if (!get_system_gpu_dedicated_memory_total(m_system_snapshot, m_query_gpu_with_pdh, m_nvsmi_alive_time))
+        if (process_snapshot_map.end() != iter_snapshot && iter_snapshot->first == iter->first)
         {
-            RUN_LOG_WAR("resource monitor init warning while get system gpu dedicated memory total failed");
+            get_metric_values(iter_snapshot->second.process_resource_total, metric_values);
+            iter->second->append(published_snapshot.sample_time, metric_values);
         }
+    }
+}
 
-        m_query_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        if (nullptr == m_query_event)
-        {
-            RUN_LOG_ERR("resource monitor init failure while create query event failed");
-            break;
-        }
+bool ResourceMonitorImpl::start_recorder(const std::string & file_path)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-        if (ERROR_SUCCESS != PdhOpenQuery(nullptr, 0, &m_query_handle) || nullptr == m_query_handle)
-        {
-            RUN_LOG_ERR("resource monitor init failure while create query handle failed");
-            break;
-        }
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Processor(_Total)\\% Processor Time", 0, &m_processor_counter))
-        {
-            RUN_LOG_WAR("resource monitor init warning while add processor time counter failed");
-        }
+    return (m_resource_recorder.start(file_path));
+}
 
-        if (m_query_gpu_with_pdh && m_system_snapshot.system_resource.gpu_count > 0)
-        {
-            if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\GPU Engine(*)\\Utilization Percentage", 0, &m_gpu_engine_counter))
-            {
-                RUN_LOG_WAR("resource monitor init warning while add gpu engine utilization percentage counter failed");
-            }
+bool ResourceMonitorImpl::stop_recorder()
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-            if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\GPU Process Memory(*)\\Dedicated Usage", 0, &m_gpu_memory_counter))
-            {
-                RUN_LOG_WAR("resource monitor init warning while add gpu process memory dedicated usage counter failed");
-            }
-        }
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Network Interface(*)\\Bytes Sent/sec", 0, &m_net_send_counter))
-        {
-            RUN_LOG_WAR("resource monitor init warning while add network interface bytes send per second counter failed");
-        }
+    m_resource_recorder.stop();
 
-        if (ERROR_SUCCESS != PdhAddCounter(m_query_handle, "\\Network Interface(*)\\Bytes Received/sec", 0, &m_net_recv_counter))
-        {
-            RUN_LOG_WAR("resource monitor init warning while add network interface bytes recv per second counter failed");
-        }
+    return (true);
+}
 
-        if (ERROR_SUCCESS != PdhCollectQueryDataEx(m_query_handle, 5, m_query_event))
-        {
-            RUN_LOG_ERR("resource monitor init failure while collect query data start failed");
-            break;
-        }
+void ResourceMonitorImpl::record_snapshot(const PublishedSnapshot & published_snapshot)
+{
+    RecordFrame * record_frame = m_resource_recorder.begin_append();
+    if (nullptr == record_frame)
+    {
+        return;
+    }
 
-        if (m_query_gpu_with_pdh)
-        {
-            if (m_stuck_check_thread.joinable())
-            {
-                m_stuck_check_thread.join();
-            }
-        }
-        else
-        {
-            m_nvgpu_check_thread = std::thread(&ResourceMonitorImpl::nvgpu_check_thread, this);
-            if (!m_nvgpu_check_thread.joinable())
-            {
-                RUN_LOG_ERR("resource monitor init failure while nvgpu check thread create failed");
-                break;
-            }
-        }
+    record_frame->sample_time = published_snapshot.sample_time;
+    record_frame->sample_sequence = published_snapshot.sample_sequence;
+    memcpy(&record_frame->system_resource, &published_snapshot.system_resource, sizeof(record_frame->system_resource));
+    record_frame->process_resources.clear();
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        record_frame->process_resources.push_back(std::make_pair(iter->first, iter->second.process_resource_total));
+    }
 
-        m_query_thread = std::thread(&ResourceMonitorImpl::query_resource_thread, this);
-        if (!m_query_thread.joinable())
-        {
-            RUN_LOG_ERR("resource monitor init failure while query resource thread create failed");
-            break;
-        }
+    m_resource_recorder.end_append(record_frame);
+}
 
-        RUN_LOG_DBG("resource monitor init success");
+bool ResourceMonitorImpl::start_shared_export(const std::string & segment_name, uint32_t process_capacity)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-        return (true);
-    } while (false);
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-    exit();
+    if (!m_shared_writer.start(segment_name, process_capacity))
+    {
+        return (false);
+    }
 
-    return (false);
+    /* readers find the current snapshot at once, not only after the next pass */
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+    export_snapshot(reader.snapshot());
+
+    return (true);
 }
 
-void ResourceMonitorImpl::exit()
+bool ResourceMonitorImpl::stop_shared_export()
 {
-    if (m_running)
+    if (!m_running)
     {
-        RUN_LOG_DBG("resource monitor exit begin");
+        return (false);
+    }
 
-        m_running = false;
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-        if (m_stuck_check_thread.joinable())
-        {
-            RUN_LOG_DBG("resource monitor exit while stuck check thread exit begin");
-            m_stuck_check_thread.join();
-            RUN_LOG_DBG("resource monitor exit while stuck check thread exit end");
-        }
+    m_shared_writer.stop();
 
-        if (m_nvgpu_check_thread.joinable())
-        {
-            kill_nvsmi_process();
-            RUN_LOG_DBG("resource monitor exit while nvgpu check thread exit begin");
-            m_nvgpu_check_thread.join();
-            RUN_LOG_DBG("resource monitor exit while nvgpu check thread exit end");
-        }
+    return (true);
+}
 
-        if (m_query_thread.joinable())
-        {
-            SetEvent(m_query_event);
-            RUN_LOG_DBG("resource monitor exit while query resource thread exit begin");
-            m_query_thread.join();
-            RUN_LOG_DBG("resource monitor exit while query resource thread exit end");
-        }
+void ResourceMonitorImpl::export_snapshot(const PublishedSnapshot & published_snapshot)
+{
+    if (!m_shared_writer.started())
+    {
+        return;
+    }
 
-        if (nullptr != m_processor_counter)
-        {
-            PdhRemoveCounter(m_processor_counter);
-            m_processor_counter = nullptr;
-        }
+    m_shared_writer.begin_write(published_snapshot.sample_time, published_snapshot.sample_sequence, published_snapshot.system_resource, published_snapshot.graphics_card_resources);
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        m_shared_writer.write_process(iter->first, iter->second.process_resource_total);
+    }
+    m_shared_writer.end_write();
+}
 
-        if (nullptr != m_gpu_engine_counter)
-        {
-            PdhRemoveCounter(m_gpu_engine_counter);
-            m_gpu_engine_counter = nullptr;
-        }
+bool ResourceMonitorImpl::start_metrics_exporter(const std::string & listen_address)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-        if (nullptr != m_gpu_memory_counter)
-        {
-            PdhRemoveCounter(m_gpu_memory_counter);
-            m_gpu_memory_counter = nullptr;
-        }
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-        if (nullptr != m_net_send_counter)
-        {
-            PdhRemoveCounter(m_net_send_counter);
-            m_net_send_counter = nullptr;
-        }
+    return (m_metrics_exporter.start(listen_address, std::bind(&ResourceMonitorImpl::render_metrics, this, std::placeholders::_1, std::placeholders::_2)));
+}
 
-        if (nullptr != m_net_recv_counter)
-        {
-            PdhRemoveCounter(m_net_recv_counter);
-            m_net_recv_counter = nullptr;
-        }
+bool ResourceMonitorImpl::stop_metrics_exporter()
+{
+    if (!m_running)
+    {
+        return (false);
+    }
 
-        if (nullptr != m_query_handle)
-        {
-            PdhCloseQuery(m_query_handle);
-            m_query_handle = nullptr;
-        }
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
 
-        if (nullptr != m_query_event)
-        {
-            CloseHandle(m_query_event);
-            m_query_event = nullptr;
-        }
+    m_metrics_exporter.stop();
 
-        RUN_LOG_DBG("resource monitor exit end");
+    return (true);
+}
+
+bool ResourceMonitorImpl::start_stream_exporter(const std::string & listen_address, uint32_t client_backlog)
+{
+    if (!m_running)
+    {
+        return (false);
     }
+
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    return (m_stream_exporter.start(listen_address, client_backlog));
 }
 
-void ResourceMonitorImpl::stuck_check_thread()
+bool ResourceMonitorImpl::stop_stream_exporter()
 {
-    while (m_running && !m_query_gpu_with_pdh)
+    if (!m_running)
     {
-        uint64_t nvsmi_alive_time = m_nvsmi_alive_time;
-        if (0 == nvsmi_alive_time || nvsmi_alive_time + 3 > Goofer::goofer_monotonic_time())
-        {
-            Goofer::goofer_ms_sleep(50);
-            continue;
-        }
-        kill_nvsmi_process();
+        return (false);
     }
+
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    m_stream_exporter.stop();
+
+    return (true);
 }
 
-void ResourceMonitorImpl::nvgpu_check_thread()
+/*
+ * encoded once here, every client gets the same frame
+ */
+void ResourceMonitorImpl::stream_snapshot(const PublishedSnapshot & published_snapshot)
 {
-    SystemResource & system_resource = m_system_snapshot.system_resource;
+    if (!m_stream_exporter.has_clients())
+    {
+        return;
+    }
 
-    while (m_running)
+    m_stream_processes.clear();
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
     {
-        if (!get_nvidia_gpu_detail(system_resource, m_nvsmi_alive_time, m_running))
-        {
-            Goofer::goofer_ms_sleep(1000);
-        }
+        m_stream_processes.push_back(std::make_pair(iter->first, iter->second.process_resource_total));
     }
+
+    const uint64_t frame_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+    std::shared_ptr<std::string> stream_frame = std::make_shared<std::string>();
+    stream_frame->reserve(m_stream_frame_size + m_stream_frame_size / 8);
+    format_stream_frame(published_snapshot.sample_sequence, frame_time_ns, published_snapshot.system_resource, published_snapshot.graphics_card_resources, m_stream_processes, *stream_frame);
+    m_stream_frame_size = stream_frame->size();
+
+    m_stream_exporter.append_frame(stream_frame);
 }
 
-void ResourceMonitorImpl::query_resource_thread()
+bool ResourceMonitorImpl::set_snapshot_retention(uint32_t snapshot_count)
 {
-    std::vector<char> buffer;
+    if (!m_running)
+    {
+        return (false);
+    }
+
+    std::lock_guard<std::mutex> snapshot_locker(m_system_snapshot_mutex);
 
-    while (m_running)
     {
-        if (WAIT_OBJECT_0 != WaitForSingleObject(m_query_event, INFINITE))
-        {
-            break;
-        }
+        std::lock_guard<std::mutex> retention_locker(m_retention_mutex);
+        m_snapshot_retention.reset(snapshot_count);
+    }
 
-        if (!m_running)
-        {
-            break;
-        }
+    /* a diff can be asked for at once, not only after the next pass */
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+    if (0 != reader.snapshot().sample_sequence)
+    {
+        retain_snapshot(reader.snapshot());
+    }
 
-        std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    return (true);
+}
 
-        update_process_tree(m_system_snapshot);
-        get_process_cpu_usage(m_system_snapshot);
-        get_process_memory_usage(m_system_snapshot);
-        get_system_memory_usage(m_system_snapshot);
-        get_system_disk_usage(m_system_snapshot);
-    //  get_system_gpu_temperature(m_system_snapshot, m_nvsmi_alive_time);
-        get_processor_utilization_percentage(m_processor_counter, buffer, m_system_snapshot);
-        get_process_gpu_utilization_percentage(m_gpu_engine_counter, buffer, m_system_snapshot, m_nvsmi_alive_time);
-        get_process_gpu_dedicated_memory_usage(m_gpu_memory_counter, buffer, m_system_snapshot, m_nvsmi_alive_time);
-        get_network_interface_send_bytes_per_second(m_net_send_counter, buffer, m_system_snapshot);
-        get_network_interface_recv_bytes_per_second(m_net_recv_counter, buffer, m_system_snapshot);
+/*
+ * a copy per publish into a slot that keeps its memory, the diffs are encoded only when asked for
+ */
+void ResourceMonitorImpl::retain_snapshot(const PublishedSnapshot & published_snapshot)
+{
+    std::lock_guard<std::mutex> locker(m_retention_mutex);
+
+    if (!m_snapshot_retention.enabled())
+    {
+        return;
+    }
+
+    DiffSnapshot & diff_snapshot = m_snapshot_retention.append();
+    diff_snapshot.sample_sequence = published_snapshot.sample_sequence;
+    memcpy(&diff_snapshot.system_resource, &published_snapshot.system_resource, sizeof(diff_snapshot.system_resource));
+    diff_snapshot.process_resources.clear();
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        diff_snapshot.process_resources.push_back(std::make_pair(iter->first, iter->second.process_resource_total));
     }
 }
 
-bool ResourceMonitorImpl::append_process(uint32_t process_id, bool process_tree)
+bool ResourceMonitorImpl::get_snapshot_diff(uint64_t base_sequence, uint64_t target_sequence, const FlatSet<uint32_t> * process_filter, std::string & snapshot_diff)
 {
-    if (!m_running || 0 == process_id)
+    if (!m_running)
     {
         return (false);
     }
 
-    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    std::lock_guard<std::mutex> locker(m_retention_mutex);
 
-    if (append_process_to_monitor(m_system_snapshot, process_id, process_tree))
+    const DiffSnapshot * target_snapshot = m_snapshot_retention.find(target_sequence);
+    if (nullptr == target_snapshot)
     {
-        RUN_LOG_DBG("append process (%u) tree (%s) to monitor success", process_id, process_tree ? "true" : "false");
+        return (false);
+    }
+
+    if (0 == base_sequence)
+    {
+        DiffSnapshot empty_snapshot;
+        encode_snapshot_diff(empty_snapshot, *target_snapshot, process_filter, snapshot_diff);
         return (true);
     }
-    else
+
+    const DiffSnapshot * base_snapshot = m_snapshot_retention.find(base_sequence);
+    if (nullptr == base_snapshot || base_snapshot->sample_sequence > target_snapshot->sample_sequence)
     {
-        RUN_LOG_ERR("append process (%u) tree (%s) to monitor failure", process_id, process_tree ? "true" : "false");
         return (false);
     }
+
+    encode_snapshot_diff(*base_snapshot, *target_snapshot, process_filter, snapshot_diff);
+
+    return (true);
 }
 
-bool ResourceMonitorImpl::remove_process(uint32_t process_id)
+/*
+ * on the exporter thread when a scrape comes in, so nothing is formatted for snapshots nobody scrapes
+ */
+bool ResourceMonitorImpl::render_metrics(uint64_t & sample_sequence, std::string & metrics_text)
 {
-    if (!m_running || 0 == process_id)
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+    const PublishedSnapshot & published_snapshot = reader.snapshot();
+
+    if (0 == published_snapshot.sample_sequence || sample_sequence == published_snapshot.sample_sequence)
     {
         return (false);
     }
 
-    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
-
-    if (remove_process_from_monitor(m_system_snapshot, process_id))
+    std::vector<std::pair<uint32_t, ProcessResource>> process_resources;
+    process_resources.reserve(published_snapshot.process_snapshot_map.size());
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
     {
-        RUN_LOG_DBG("remove process (%u) from monitor success", process_id);
-        return (true);
+        process_resources.push_back(std::make_pair(iter->first, iter->second.process_resource_total));
     }
-    else
+
+    format_metrics_text(published_snapshot.sample_sequence, published_snapshot.system_resource, published_snapshot.graphics_card_resources, process_resources, metrics_text);
+    sample_sequence = published_snapshot.sample_sequence;
+
+    return (true);
+}
+
+static bool get_published_process_resource(const PublishedSnapshot & published_snapshot, uint32_t process_id, ProcessResource & process_resource)
+{
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter_snapshot = process_snapshot_map.find(process_id);
+    if (process_snapshot_map.end() == iter_snapshot)
     {
-        RUN_LOG_ERR("remove process (%u) from monitor failure", process_id);
         return (false);
     }
+
+    memcpy(&process_resource, &iter_snapshot->second.process_resource_total, sizeof(process_resource));
+    process_resource.sample_time = published_snapshot.sample_time;
+    process_resource.sample_sequence = published_snapshot.sample_sequence;
+
+    return (true);
 }
 
 bool ResourceMonitorImpl::get_process_resource(uint32_t process_id, ProcessResource & process_resource)
@@ -1607,27 +5202,59 @@ bool ResourceMonitorImpl::get_process_resource(uint32_t process_id, ProcessResou
         return (false);
     }
 
-    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+
+    return (get_published_process_resource(reader.snapshot(), process_id, process_resource));
+}
+
+bool ResourceMonitorImpl::get_process_resources(const uint32_t * process_ids, std::size_t process_count, ProcessResource * process_resources, bool * process_statuses)
+{
+    if (!m_running || (0 != process_count && (nullptr == process_ids || nullptr == process_resources)))
+    {
+        return (false);
+    }
+
+    /* one snapshot for the whole batch, so every result comes from the same tick */
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+    const PublishedSnapshot & published_snapshot = reader.snapshot();
 
-    std::map<uint32_t, ProcessSnapshot> & process_snapshot_map = m_system_snapshot.process_snapshot_map;
-    std::map<uint32_t, ProcessSnapshot>::iterator iter_snapshot = process_snapshot_map.find(process_id);
-    if (process_snapshot_map.end() != iter_snapshot)
+    for (std::size_t process_index = 0; process_index < process_count; ++process_index)
     {
-        memcpy(&process_resource, &iter_snapshot->second.process_resource, sizeof(process_resource));
-        std::map<uint32_t, ProcessLeaf> & process_leaf_map = m_system_snapshot.process_leaf_map;
-        std::map<uint32_t, ProcessLeaf>::iterator iter_leaf = process_leaf_map.find(process_id);
-        if (process_leaf_map.end() != iter_leaf)
+        ProcessResource & process_resource = process_resources[process_index];
+        bool process_status = (0 != process_ids[process_index] && get_published_process_resource(published_snapshot, process_ids[process_index], process_resource));
+        if (!process_status)
         {
-            std::set<uint32_t> & process_descendant_set = iter_leaf->second.process_descendant_set;
-            for (std::set<uint32_t>::iterator iter_descendant = process_descendant_set.begin(); process_descendant_set.end() != iter_descendant; ++iter_descendant)
-            {
-                process_resource += process_snapshot_map[*iter_descendant];
-            }
+            memset(&process_resource, 0x0, sizeof(process_resource));
+        }
+        if (nullptr != process_statuses)
+        {
+            process_statuses[process_index] = process_status;
         }
-        return (true);
     }
 
-    return (false);
+    return (true);
+}
+
+bool ResourceMonitorImpl::get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources)
+{
+    process_resources.clear();
+
+    if (!m_running)
+    {
+        return (false);
+    }
+
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+    const PublishedSnapshot & published_snapshot = reader.snapshot();
+
+    const FlatMap<uint32_t, ProcessSnapshot> & process_snapshot_map = published_snapshot.process_snapshot_map;
+    for (FlatMap<uint32_t, ProcessSnapshot>::const_iterator iter = process_snapshot_map.begin(); process_snapshot_map.end() != iter; ++iter)
+    {
+        std::map<uint32_t, ProcessResource>::iterator iter_resource = process_resources.insert(process_resources.end(), std::make_pair(iter->first, ProcessResource()));
+        get_published_process_resource(published_snapshot, iter->first, iter_resource->second);
+    }
+
+    return (true);
 }
 
 bool ResourceMonitorImpl::get_system_resource(SystemResource & system_resource)
@@ -1637,9 +5264,9 @@ bool ResourceMonitorImpl::get_system_resource(SystemResource & system_resource)
         return (false);
     }
 
-    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    PublishedSnapshotReader reader(m_snapshot_publisher);
 
-    memcpy(&system_resource, &m_system_snapshot.system_resource, sizeof(system_resource));
+    memcpy(&system_resource, &reader.snapshot().system_resource, sizeof(system_resource));
 
     return (true);
 }
@@ -1651,9 +5278,120 @@ bool ResourceMonitorImpl::get_graphics_cards(std::list<std::string> & graphics_c
         return (false);
     }
 
-    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+    PublishedSnapshotReader reader(m_snapshot_publisher);
+
+    graphics_card_names = reader.snapshot().graphics_card_names;
+
+    return (true);
+}
+
+bool ResourceMonitorImpl::get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
+
+    PublishedSnapshotReader reader(m_snapshot_publisher);
 
-    graphics_card_names = m_system_snapshot.graphics_card_names;
+    graphics_card_resources = reader.snapshot().graphics_card_resources;
 
     return (true);
 }
+
+bool ResourceMonitorImpl::wait_for_sample(uint64_t last_sequence, uint32_t timeout_ms, uint64_t & sample_sequence)
+{
+    if (!m_running)
+    {
+        return (false);
+    }
+
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    std::unique_lock<std::mutex> locker(m_sample_mutex);
+    while (m_running && m_sample_sequence <= last_sequence)
+    {
+        if (std::cv_status::timeout == m_sample_condition.wait_until(locker, deadline))
+        {
+            break;
+        }
+    }
+    sample_sequence = m_sample_sequence;
+
+    return (m_running && sample_sequence > last_sequence);
+}
+
+void ResourceMonitorImpl::publish_system_snapshot()
+{
+    PublishedSnapshot & published_snapshot = m_snapshot_publisher.begin_publish();
+
+    const uint64_t sample_sequence = m_sample_sequence + 1;
+
+    published_snapshot.sample_time = steady_milliseconds();
+    published_snapshot.sample_sequence = sample_sequence;
+    memcpy(&published_snapshot.system_resource, &m_system_snapshot.system_resource, sizeof(published_snapshot.system_resource));
+    published_snapshot.system_resource.sample_time = published_snapshot.sample_time;
+    published_snapshot.system_resource.sample_sequence = sample_sequence;
+    published_snapshot.graphics_card_names = m_system_snapshot.graphics_card_names;
+    published_snapshot.graphics_card_resources = m_system_snapshot.graphics_card_resources;
+    published_snapshot.process_snapshot_map = m_system_snapshot.process_snapshot_map;
+
+    m_snapshot_publisher.end_publish(published_snapshot);
+
+    /* the sequence moves only after the slot is visible, a woken waiter always reads the snapshot it waited for or a newer one */
+    {
+        std::lock_guard<std::mutex> locker(m_sample_mutex);
+        m_sample_sequence = sample_sequence;
+    }
+    m_sample_condition.notify_all();
+
+    evaluate_threshold_rules(published_snapshot);
+
+    append_history_samples(published_snapshot);
+
+    record_snapshot(published_snapshot);
+
+    export_snapshot(published_snapshot);
+
+    stream_snapshot(published_snapshot);
+
+    retain_snapshot(published_snapshot);
+}
+
+void ResourceMonitorImpl::publish_nvgpu_resource(const SystemResource & nvgpu_resource, const std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    SystemResource & system_resource = m_system_snapshot.system_resource;
+    system_resource.gpu_3d_usage = nvgpu_resource.gpu_3d_usage;
+    system_resource.gpu_enc_usage = nvgpu_resource.gpu_enc_usage;
+    system_resource.gpu_dec_usage = nvgpu_resource.gpu_dec_usage;
+
+    apply_nvgpu_usage(m_system_snapshot, graphics_card_resources);
+
+    publish_system_snapshot();
+}
+
+void ResourceMonitorImpl::publish_nvgpu_query(const NvgpuQuery & nvgpu_query)
+{
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    apply_nvgpu_query(m_system_snapshot, nvgpu_query);
+
+    publish_system_snapshot();
+}
+
+void ResourceMonitorImpl::publish_nvml_resource(const SystemResource & nvgpu_resource, const NvgpuQuery & nvgpu_query)
+{
+    std::lock_guard<std::mutex> locker(m_system_snapshot_mutex);
+
+    SystemResource & system_resource = m_system_snapshot.system_resource;
+    system_resource.gpu_3d_usage = nvgpu_resource.gpu_3d_usage;
+    system_resource.gpu_enc_usage = nvgpu_resource.gpu_enc_usage;
+    system_resource.gpu_dec_usage = nvgpu_resource.gpu_dec_usage;
+
+    apply_nvgpu_query(m_system_snapshot, nvgpu_query);
+    apply_nvgpu_usage(m_system_snapshot, nvgpu_query.graphics_card_resources);
+
+    publish_system_snapshot();
+}
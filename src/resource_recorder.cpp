@@ -0,0 +1,678 @@
+/********************************************************
+ * Description : compressed on-disk recorder of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifdef _MSC_VER
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif // _MSC_VER
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include "resource_recorder.h"
+#include "resource_codec.h"
+#include "log/log.h"
+
+#ifdef _MSC_VER
+    #define recorder_fseek _fseeki64
+#else
+    #define recorder_fseek fseeko
+#endif // _MSC_VER
+
+#define RECORDER_QUEUE_LIMIT            64
+#define RECORDER_FLUSH_INTERVAL_MS      1000
+#define RECORDER_RECORD_MAX             ((2 + RECORDER_FIELD_MAX) * 10)
+
+/*
+ * return: bytes of the record, codec_state moves on to it
+ */
+static std::size_t encode_record(RecorderCodecState & codec_state, uint64_t record_time, uint64_t sample_sequence, const uint64_t * fields, std::size_t field_count, uint32_t double_mask, char * buffer)
+{
+    std::size_t size = 0;
+
+    const int64_t delta = static_cast<int64_t>(record_time - codec_state.last_time);
+    size += put_varint(zigzag_encode(delta - codec_state.last_delta), buffer + size);
+    size += put_varint(zigzag_encode(static_cast<int64_t>(sample_sequence - codec_state.last_sequence)), buffer + size);
+    codec_state.last_delta = delta;
+    codec_state.last_time = record_time;
+    codec_state.last_sequence = sample_sequence;
+
+    for (std::size_t field_index = 0; field_index < field_count; ++field_index)
+    {
+        if (0 != (double_mask & (1u << field_index)))
+        {
+            size += put_varint(fields[field_index] ^ codec_state.last_fields[field_index], buffer + size);
+        }
+        else
+        {
+            size += put_varint(zigzag_encode(static_cast<int64_t>(fields[field_index] - codec_state.last_fields[field_index])), buffer + size);
+        }
+        codec_state.last_fields[field_index] = fields[field_index];
+    }
+
+    return (size);
+}
+
+static bool decode_record(RecorderCodecState & codec_state, const char *& data, const char * data_end, std::size_t field_count, uint32_t double_mask)
+{
+    uint64_t value = 0;
+
+    if (!get_varint(data, data_end, value))
+    {
+        return (false);
+    }
+    codec_state.last_delta += zigzag_decode(value);
+    codec_state.last_time += static_cast<uint64_t>(codec_state.last_delta);
+
+    if (!get_varint(data, data_end, value))
+    {
+        return (false);
+    }
+    codec_state.last_sequence += static_cast<uint64_t>(zigzag_decode(value));
+
+    for (std::size_t field_index = 0; field_index < field_count; ++field_index)
+    {
+        if (!get_varint(data, data_end, value))
+        {
+            return (false);
+        }
+        if (0 != (double_mask & (1u << field_index)))
+        {
+            codec_state.last_fields[field_index] ^= value;
+        }
+        else
+        {
+            codec_state.last_fields[field_index] += static_cast<uint64_t>(zigzag_decode(value));
+        }
+    }
+
+    return (true);
+}
+
+static uint64_t steady_clock_milliseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+}
+
+static uint64_t system_clock_milliseconds()
+{
+    return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+}
+
+RecorderCodecState::RecorderCodecState()
+    : last_time(0)
+    , last_delta(0)
+    , last_sequence(0)
+    , last_fields()
+{
+    memset(last_fields, 0x0, sizeof(last_fields));
+}
+
+RecorderSeries::RecorderSeries()
+    : block_index(0)
+    , block_buffer()
+    , codec_state()
+    , written_size(0)
+{
+
+}
+
+RecordFrame::RecordFrame()
+    : sample_time(0)
+    , sample_sequence(0)
+    , system_resource()
+    , process_resources()
+{
+    memset(&system_resource, 0x0, sizeof(system_resource));
+}
+
+ResourceRecorder::ResourceRecorder()
+    : m_file(nullptr)
+    , m_block_count(0)
+    , m_steady_base(0)
+    , m_system_base(0)
+    , m_series_map()
+    , m_writer_thread()
+    , m_running(false)
+    , m_dropping(false)
+    , m_frames()
+    , m_frame_head(0)
+    , m_frame_count(0)
+    , m_frame_mutex()
+    , m_frame_condition()
+{
+
+}
+
+ResourceRecorder::~ResourceRecorder()
+{
+    stop();
+}
+
+bool ResourceRecorder::start(const std::string & file_path)
+{
+    stop();
+
+    do
+    {
+        m_file = fopen(file_path.c_str(), "wb");
+        if (nullptr == m_file)
+        {
+            RUN_LOG_ERR("recorder start failure while open file (%s) failed", file_path.c_str());
+            break;
+        }
+
+        RecorderFileHeader file_header;
+        memset(&file_header, 0x0, sizeof(file_header));
+        file_header.file_magic = RECORDER_FILE_MAGIC;
+        file_header.file_version = RECORDER_FILE_VERSION;
+        file_header.header_size = static_cast<uint32_t>(sizeof(file_header));
+        file_header.block_size = RECORDER_BLOCK_SIZE;
+        if (1 != fwrite(&file_header, sizeof(file_header), 1, m_file))
+        {
+            RUN_LOG_ERR("recorder start failure while write file (%s) header failed", file_path.c_str());
+            break;
+        }
+
+        m_block_count = 0;
+        m_steady_base = steady_clock_milliseconds();
+        m_system_base = system_clock_milliseconds();
+        m_series_map.clear();
+        m_dropping = false;
+        m_frames.resize(RECORDER_QUEUE_LIMIT);
+        m_frame_head = 0;
+        m_frame_count = 0;
+        m_running = true;
+
+        m_writer_thread = std::thread(&ResourceRecorder::writer_thread, this);
+        if (!m_writer_thread.joinable())
+        {
+            RUN_LOG_ERR("recorder start failure while writer thread create failed");
+            break;
+        }
+
+        RUN_LOG_DBG("recorder start to file (%s) success", file_path.c_str());
+
+        return (true);
+    } while (false);
+
+    stop();
+
+    return (false);
+}
+
+void ResourceRecorder::stop()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_frame_mutex);
+        m_running = false;
+    }
+    m_frame_condition.notify_all();
+
+    /* the writer drains the queue and writes every open block before it ends */
+    if (m_writer_thread.joinable())
+    {
+        m_writer_thread.join();
+    }
+
+    if (nullptr != m_file)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    m_series_map.clear();
+    m_frames.clear();
+    m_frame_head = 0;
+    m_frame_count = 0;
+}
+
+RecordFrame * ResourceRecorder::begin_append()
+{
+    std::lock_guard<std::mutex> locker(m_frame_mutex);
+
+    if (!m_running)
+    {
+        return (nullptr);
+    }
+
+    if (m_frame_count == m_frames.size())
+    {
+        if (!m_dropping)
+        {
+            RUN_LOG_WAR("recorder drops snapshots while the writer falls behind");
+            m_dropping = true;
+        }
+        return (nullptr);
+    }
+    m_dropping = false;
+
+    /* the slot behind the queue tail, the writer never touches it until end_append */
+    return (&m_frames[(m_frame_head + m_frame_count) % m_frames.size()]);
+}
+
+void ResourceRecorder::end_append(RecordFrame * record_frame)
+{
+    if (nullptr == record_frame)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_frame_mutex);
+        ++m_frame_count;
+    }
+    m_frame_condition.notify_one();
+}
+
+void ResourceRecorder::writer_thread()
+{
+    uint64_t flush_time = steady_clock_milliseconds();
+
+    std::unique_lock<std::mutex> locker(m_frame_mutex);
+
+    while (m_running || 0 != m_frame_count)
+    {
+        if (0 == m_frame_count)
+        {
+            m_frame_condition.wait_for(locker, std::chrono::milliseconds(RECORDER_FLUSH_INTERVAL_MS));
+        }
+
+        if (0 != m_frame_count)
+        {
+            const RecordFrame & record_frame = m_frames[m_frame_head];
+            locker.unlock();
+            write_frame(record_frame);
+            locker.lock();
+            m_frame_head = (m_frame_head + 1) % m_frames.size();
+            --m_frame_count;
+        }
+
+        if (steady_clock_milliseconds() >= flush_time + RECORDER_FLUSH_INTERVAL_MS)
+        {
+            locker.unlock();
+            flush_series();
+            locker.lock();
+            flush_time = steady_clock_milliseconds();
+        }
+    }
+
+    locker.unlock();
+
+    flush_series();
+}
+
+void ResourceRecorder::write_frame(const RecordFrame & record_frame)
+{
+    const uint64_t record_time = m_system_base + (record_frame.sample_time - m_steady_base);
+    uint64_t fields[RECORDER_FIELD_MAX] = { 0 };
+
+    get_system_fields(record_frame.system_resource, fields);
+    write_record(0, record_time, record_frame.sample_sequence, fields, SYSTEM_FIELD_COUNT, SYSTEM_DOUBLE_MASK);
+
+    for (std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter = record_frame.process_resources.begin(); record_frame.process_resources.end() != iter; ++iter)
+    {
+        get_process_fields(iter->second, fields);
+        write_record(iter->first, record_time, record_frame.sample_sequence, fields, PROCESS_FIELD_COUNT, PROCESS_DOUBLE_MASK);
+    }
+
+    retire_series(record_frame);
+}
+
+/*
+ * a process gone from the snapshot has its open block written out and its buffer freed, a pid that comes back starts a new block;
+ * both the frame and the series map ascend by process id
+ */
+void ResourceRecorder::retire_series(const RecordFrame & record_frame)
+{
+    const std::vector<std::pair<uint32_t, ProcessResource>> & process_resources = record_frame.process_resources;
+    std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter_process = process_resources.begin();
+    FlatMap<uint32_t, RecorderSeries>::iterator iter_series = m_series_map.begin();
+    while (m_series_map.end() != iter_series)
+    {
+        while (process_resources.end() != iter_process && iter_process->first < iter_series->first)
+        {
+            ++iter_process;
+        }
+        if (0 == iter_series->first || (process_resources.end() != iter_process && iter_process->first == iter_series->first))
+        {
+            ++iter_series;
+            continue;
+        }
+
+        write_block(iter_series->second);
+        iter_series = m_series_map.erase(iter_series);
+    }
+}
+
+void ResourceRecorder::write_record(uint32_t series_id, uint64_t record_time, uint64_t sample_sequence, const uint64_t * fields, std::size_t field_count, uint32_t double_mask)
+{
+    RecorderSeries & recorder_series = m_series_map[series_id];
+    RecorderBlockHeader * block_header = reinterpret_cast<RecorderBlockHeader *>(recorder_series.block_buffer.empty() ? nullptr : &recorder_series.block_buffer[0]);
+
+    /* a full block is written for good, the series goes on in a new slot with a fresh codec state */
+    if (nullptr != block_header && sizeof(RecorderBlockHeader) + block_header->data_size + RECORDER_RECORD_MAX > RECORDER_BLOCK_SIZE)
+    {
+        write_block(recorder_series);
+        block_header = nullptr;
+    }
+
+    if (nullptr == block_header)
+    {
+        recorder_series.block_index = m_block_count++;
+        recorder_series.block_buffer.assign(RECORDER_BLOCK_SIZE, 0);
+        recorder_series.codec_state = RecorderCodecState();
+        recorder_series.written_size = 0;
+        block_header = reinterpret_cast<RecorderBlockHeader *>(&recorder_series.block_buffer[0]);
+        block_header->block_magic = RECORDER_BLOCK_MAGIC;
+        block_header->series_id = series_id;
+        block_header->first_time = record_time;
+    }
+
+    char * record = &recorder_series.block_buffer[sizeof(RecorderBlockHeader) + block_header->data_size];
+    block_header->data_size += static_cast<uint32_t>(encode_record(recorder_series.codec_state, record_time, sample_sequence, fields, field_count, double_mask, record));
+    block_header->last_time = record_time;
+    ++block_header->record_count;
+}
+
+/*
+ * only the records appended since the last write go out, then the header that counts them
+ */
+bool ResourceRecorder::write_block(RecorderSeries & recorder_series)
+{
+    const RecorderBlockHeader * block_header = reinterpret_cast<const RecorderBlockHeader *>(&recorder_series.block_buffer[0]);
+    const uint64_t block_offset = sizeof(RecorderFileHeader) + recorder_series.block_index * RECORDER_BLOCK_SIZE;
+    const std::size_t data_offset = sizeof(RecorderBlockHeader) + recorder_series.written_size;
+    const std::size_t data_size = block_header->data_size - recorder_series.written_size;
+    if ((0 != data_size && (0 != recorder_fseek(m_file, block_offset + data_offset, SEEK_SET) || 1 != fwrite(&recorder_series.block_buffer[data_offset], data_size, 1, m_file))) ||
+        0 != recorder_fseek(m_file, block_offset, SEEK_SET) || 1 != fwrite(block_header, sizeof(RecorderBlockHeader), 1, m_file))
+    {
+        RUN_LOG_ERR("recorder write block (%llu) failure", static_cast<unsigned long long>(recorder_series.block_index));
+        return (false);
+    }
+    recorder_series.written_size = block_header->data_size;
+    return (true);
+}
+
+/*
+ * open blocks are brought up to date in place, so a reader sees recent records before the block fills
+ */
+void ResourceRecorder::flush_series()
+{
+    for (FlatMap<uint32_t, RecorderSeries>::iterator iter = m_series_map.begin(); m_series_map.end() != iter; ++iter)
+    {
+        RecorderSeries & recorder_series = iter->second;
+        const RecorderBlockHeader * block_header = reinterpret_cast<const RecorderBlockHeader *>(&recorder_series.block_buffer[0]);
+        if (block_header->data_size != recorder_series.written_size)
+        {
+            write_block(recorder_series);
+        }
+    }
+
+    /* retired series may have been written since the last flush too */
+    fflush(m_file);
+}
+
+ResourceRecordReaderImpl::ResourceRecordReaderImpl()
+#ifdef _MSC_VER
+    : m_file_handle(INVALID_HANDLE_VALUE)
+    , m_mapping_handle(nullptr)
+#else
+    : m_file_fd(-1)
+#endif // _MSC_VER
+    , m_file_data(nullptr)
+    , m_file_size(0)
+    , m_header_size(0)
+    , m_block_size(0)
+    , m_block_count(0)
+{
+
+}
+
+ResourceRecordReaderImpl::~ResourceRecordReaderImpl()
+{
+    close();
+}
+
+bool ResourceRecordReaderImpl::open(const std::string & file_path)
+{
+    close();
+
+    do
+    {
+#ifdef _MSC_VER
+        m_file_handle = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (INVALID_HANDLE_VALUE == m_file_handle)
+        {
+            RUN_LOG_ERR("record reader open failure while open file (%s) failed", file_path.c_str());
+            break;
+        }
+
+        LARGE_INTEGER file_size = { 0 };
+        if (!GetFileSizeEx(m_file_handle, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(RecorderFileHeader)))
+        {
+            RUN_LOG_ERR("record reader open failure while file (%s) is too small", file_path.c_str());
+            break;
+        }
+        m_file_size = static_cast<std::size_t>(file_size.QuadPart);
+
+        m_mapping_handle = CreateFileMappingA(m_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (nullptr == m_mapping_handle)
+        {
+            RUN_LOG_ERR("record reader open failure while map file (%s) failed", file_path.c_str());
+            break;
+        }
+
+        m_file_data = reinterpret_cast<const char *>(MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (nullptr == m_file_data)
+        {
+            RUN_LOG_ERR("record reader open failure while map file (%s) failed", file_path.c_str());
+            break;
+        }
+#else
+        m_file_fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_file_fd < 0)
+        {
+            RUN_LOG_ERR("record reader open failure while open file (%s) failed", file_path.c_str());
+            break;
+        }
+
+        struct stat file_stat;
+        if (0 != fstat(m_file_fd, &file_stat) || file_stat.st_size < static_cast<off_t>(sizeof(RecorderFileHeader)))
+        {
+            RUN_LOG_ERR("record reader open failure while file (%s) is too small", file_path.c_str());
+            break;
+        }
+        m_file_size = static_cast<std::size_t>(file_stat.st_size);
+
+        void * file_data = mmap(nullptr, m_file_size, PROT_READ, MAP_SHARED, m_file_fd, 0);
+        if (MAP_FAILED == file_data)
+        {
+            RUN_LOG_ERR("record reader open failure while map file (%s) failed", file_path.c_str());
+            break;
+        }
+        m_file_data = reinterpret_cast<const char *>(file_data);
+#endif // _MSC_VER
+
+        const RecorderFileHeader * file_header = reinterpret_cast<const RecorderFileHeader *>(m_file_data);
+        if (RECORDER_FILE_MAGIC != file_header->file_magic || RECORDER_FILE_VERSION != file_header->file_version || file_header->header_size < sizeof(RecorderFileHeader) || file_header->block_size <= sizeof(RecorderBlockHeader) || file_header->header_size > m_file_size)
+        {
+            RUN_LOG_ERR("record reader open failure while file (%s) is not a record file", file_path.c_str());
+            break;
+        }
+
+        m_header_size = file_header->header_size;
+        m_block_size = file_header->block_size;
+        m_block_count = (m_file_size - m_header_size + m_block_size - 1) / m_block_size; /* the last slot may still be short */
+
+        return (true);
+    } while (false);
+
+    close();
+
+    return (false);
+}
+
+void ResourceRecordReaderImpl::close()
+{
+#ifdef _MSC_VER
+    if (nullptr != m_file_data)
+    {
+        UnmapViewOfFile(m_file_data);
+        m_file_data = nullptr;
+    }
+
+    if (nullptr != m_mapping_handle)
+    {
+        CloseHandle(m_mapping_handle);
+        m_mapping_handle = nullptr;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_file_handle)
+    {
+        CloseHandle(m_file_handle);
+        m_file_handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (nullptr != m_file_data)
+    {
+        munmap(const_cast<char *>(m_file_data), m_file_size);
+        m_file_data = nullptr;
+    }
+
+    if (m_file_fd >= 0)
+    {
+        ::close(m_file_fd);
+        m_file_fd = -1;
+    }
+#endif // _MSC_VER
+
+    m_file_size = 0;
+    m_header_size = 0;
+    m_block_size = 0;
+    m_block_count = 0;
+}
+
+/*
+ * return: nullptr for a slot never written (or torn, or cut short by the end of the file), its records are skipped
+ */
+const RecorderBlockHeader * ResourceRecordReaderImpl::block_header(uint64_t block_index) const
+{
+    const std::size_t block_offset = static_cast<std::size_t>(m_header_size + block_index * m_block_size);
+    if (block_offset + sizeof(RecorderBlockHeader) > m_file_size)
+    {
+        return (nullptr);
+    }
+
+    const RecorderBlockHeader * block_header = reinterpret_cast<const RecorderBlockHeader *>(m_file_data + block_offset);
+    if (RECORDER_BLOCK_MAGIC != block_header->block_magic || block_header->data_size > m_block_size - sizeof(RecorderBlockHeader) || block_offset + sizeof(RecorderBlockHeader) + block_header->data_size > m_file_size)
+    {
+        return (nullptr);
+    }
+    return (block_header);
+}
+
+bool ResourceRecordReaderImpl::get_recorded_processes(std::vector<uint32_t> & process_ids) const
+{
+    process_ids.clear();
+
+    if (nullptr == m_file_data)
+    {
+        return (false);
+    }
+
+    for (uint64_t block_index = 0; block_index < m_block_count; ++block_index)
+    {
+        const RecorderBlockHeader * header = block_header(block_index);
+        if (nullptr != header && 0 != header->series_id)
+        {
+            process_ids.push_back(header->series_id);
+        }
+    }
+
+    std::sort(process_ids.begin(), process_ids.end());
+    process_ids.erase(std::unique(process_ids.begin(), process_ids.end()), process_ids.end());
+
+    return (true);
+}
+
+bool ResourceRecordReaderImpl::read_system_resources(uint64_t begin_time, uint64_t end_time, std::vector<SystemResource> & system_resources) const
+{
+    system_resources.clear();
+
+    if (nullptr == m_file_data)
+    {
+        return (false);
+    }
+
+    for (uint64_t block_index = 0; block_index < m_block_count; ++block_index)
+    {
+        const RecorderBlockHeader * header = block_header(block_index);
+        if (nullptr == header || 0 != header->series_id || header->last_time < begin_time || header->first_time >= end_time)
+        {
+            continue;
+        }
+
+        RecorderCodecState codec_state;
+        const char * data = reinterpret_cast<const char *>(header + 1);
+        const char * data_end = data + header->data_size;
+        for (uint32_t record_index = 0; record_index < header->record_count && decode_record(codec_state, data, data_end, SYSTEM_FIELD_COUNT, SYSTEM_DOUBLE_MASK); ++record_index)
+        {
+            if (codec_state.last_time >= begin_time && codec_state.last_time < end_time)
+            {
+                system_resources.push_back(SystemResource());
+                SystemResource & system_resource = system_resources.back();
+                set_system_fields(codec_state.last_fields, system_resource);
+                system_resource.sample_time = codec_state.last_time;
+                system_resource.sample_sequence = codec_state.last_sequence;
+            }
+        }
+    }
+
+    return (true);
+}
+
+bool ResourceRecordReaderImpl::read_process_resources(uint32_t process_id, uint64_t begin_time, uint64_t end_time, std::vector<ProcessResource> & process_resources) const
+{
+    process_resources.clear();
+
+    if (nullptr == m_file_data || 0 == process_id)
+    {
+        return (false);
+    }
+
+    for (uint64_t block_index = 0; block_index < m_block_count; ++block_index)
+    {
+        const RecorderBlockHeader * header = block_header(block_index);
+        if (nullptr == header || process_id != header->series_id || header->last_time < begin_time || header->first_time >= end_time)
+        {
+            continue;
+        }
+
+        RecorderCodecState codec_state;
+        const char * data = reinterpret_cast<const char *>(header + 1);
+        const char * data_end = data + header->data_size;
+        for (uint32_t record_index = 0; record_index < header->record_count && decode_record(codec_state, data, data_end, PROCESS_FIELD_COUNT, PROCESS_DOUBLE_MASK); ++record_index)
+        {
+            if (codec_state.last_time >= begin_time && codec_state.last_time < end_time)
+            {
+                process_resources.push_back(ProcessResource());
+                ProcessResource & process_resource = process_resources.back();
+                set_process_fields(codec_state.last_fields, process_resource);
+                process_resource.sample_time = codec_state.last_time;
+                process_resource.sample_sequence = codec_state.last_sequence;
+            }
+        }
+    }
+
+    return (true);
+}
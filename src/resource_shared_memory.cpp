@@ -0,0 +1,555 @@
+/********************************************************
+ * Description : shared memory export of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifdef _MSC_VER
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif // _MSC_VER
+#include <new>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include "resource_shared_memory.h"
+#include "log/log.h"
+
+#define SHARED_READ_SPIN_COUNT          1024    /* spins before a reader sleeps on a writer it caught inside */
+#define SHARED_READ_SLEEP_MS            1       /* a yield may keep the cpu from a preempted writer, a sleep gives it away */
+#define SHARED_READ_WAIT_MS             200     /* a writer inside longer than this died while publishing */
+
+#ifndef _MSC_VER
+static std::string get_segment_path(const std::string & segment_name)
+{
+    return ('/' == segment_name[0] ? segment_name : "/" + segment_name);
+}
+#endif // _MSC_VER
+
+SharedSnapshotWriter::SharedSnapshotWriter()
+    : m_segment_name()
+#ifdef _MSC_VER
+    , m_mapping_handle(nullptr)
+#else
+    , m_segment_device(0)
+    , m_segment_inode(0)
+#endif // _MSC_VER
+    , m_header(nullptr)
+    , m_process_entries(nullptr)
+    , m_segment_size(0)
+    , m_process_count(0)
+    , m_overflowed(false)
+{
+
+}
+
+SharedSnapshotWriter::~SharedSnapshotWriter()
+{
+    stop();
+}
+
+bool SharedSnapshotWriter::start(const std::string & segment_name, uint32_t process_capacity)
+{
+    stop();
+
+    if (segment_name.empty() || 0 == process_capacity)
+    {
+        return (false);
+    }
+
+    m_segment_name = segment_name;
+    m_segment_size = sizeof(SharedSnapshotHeader) + static_cast<std::size_t>(process_capacity) * sizeof(SharedProcessEntry);
+
+    do
+    {
+        void * segment_data = nullptr;
+
+#ifdef _MSC_VER
+        m_mapping_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(m_segment_size) >> 32), static_cast<DWORD>(m_segment_size), segment_name.c_str());
+        if (nullptr == m_mapping_handle)
+        {
+            RUN_LOG_ERR("shared export start failure while create mapping (%s) failed", segment_name.c_str());
+            break;
+        }
+
+        /* the mapping lives while a handle is open, an existing one belongs to another writer or its readers */
+        if (ERROR_ALREADY_EXISTS == GetLastError())
+        {
+            RUN_LOG_ERR("shared export start failure while mapping (%s) is still in use", segment_name.c_str());
+            break;
+        }
+
+        segment_data = MapViewOfFile(m_mapping_handle, FILE_MAP_WRITE, 0, 0, m_segment_size);
+        if (nullptr == segment_data)
+        {
+            RUN_LOG_ERR("shared export start failure while map (%s) failed", segment_name.c_str());
+            break;
+        }
+#else
+        const std::string segment_path = get_segment_path(segment_name);
+
+        /*
+         * a fresh object instead of resizing the old one, readers still mapping a stale (or live) segment
+         * keep it intact and see its writer_alive, the next open finds this one
+         */
+        shm_unlink(segment_path.c_str());
+        int segment_fd = shm_open(segment_path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+        if (segment_fd < 0)
+        {
+            RUN_LOG_ERR("shared export start failure while shm_open (%s) failed", segment_path.c_str());
+            break;
+        }
+
+        struct stat segment_stat;
+        if (0 != fstat(segment_fd, &segment_stat) || 0 != ftruncate(segment_fd, static_cast<off_t>(m_segment_size)))
+        {
+            RUN_LOG_ERR("shared export start failure while resize (%s) failed", segment_path.c_str());
+            ::close(segment_fd);
+            shm_unlink(segment_path.c_str());
+            break;
+        }
+
+        segment_data = mmap(nullptr, m_segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+        ::close(segment_fd);
+        if (MAP_FAILED == segment_data)
+        {
+            RUN_LOG_ERR("shared export start failure while mmap (%s) failed", segment_path.c_str());
+            shm_unlink(segment_path.c_str());
+            segment_data = nullptr;
+            break;
+        }
+        m_segment_device = static_cast<uint64_t>(segment_stat.st_dev);
+        m_segment_inode = static_cast<uint64_t>(segment_stat.st_ino);
+#endif // _MSC_VER
+
+        m_header = new (segment_data) SharedSnapshotHeader;
+        m_process_entries = reinterpret_cast<SharedProcessEntry *>(reinterpret_cast<char *>(segment_data) + sizeof(SharedSnapshotHeader));
+        m_header->write_sequence.store(1, std::memory_order_relaxed);
+        m_header->magic = SHARED_SNAPSHOT_MAGIC;
+        m_header->version = SHARED_SNAPSHOT_VERSION;
+        m_header->header_size = static_cast<uint32_t>(sizeof(SharedSnapshotHeader));
+        m_header->process_capacity = process_capacity;
+        m_header->writer_alive = 1;
+        m_header->process_count = 0;
+        m_header->card_count = 0;
+        m_header->sample_time = 0;
+        m_header->sample_sequence = 0;
+        memset(&m_header->system_resource, 0x0, sizeof(m_header->system_resource));
+        m_header->write_sequence.store(2, std::memory_order_release);
+
+        RUN_LOG_DBG("shared export start to (%s) capacity (%u) success", segment_name.c_str(), process_capacity);
+
+        return (true);
+    } while (false);
+
+    stop();
+
+    return (false);
+}
+
+void SharedSnapshotWriter::stop()
+{
+    if (nullptr != m_header)
+    {
+        uint64_t write_sequence = m_header->write_sequence.load(std::memory_order_relaxed);
+        m_header->write_sequence.store(write_sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->writer_alive = 0;
+        m_header->write_sequence.store(write_sequence + 2, std::memory_order_release);
+    }
+
+#ifdef _MSC_VER
+    if (nullptr != m_header)
+    {
+        UnmapViewOfFile(m_header);
+    }
+
+    if (nullptr != m_mapping_handle)
+    {
+        CloseHandle(m_mapping_handle);
+        m_mapping_handle = nullptr;
+    }
+#else
+    if (nullptr != m_header)
+    {
+        munmap(m_header, m_segment_size);
+
+        /* a later writer may have taken the name over, only our own object is unlinked */
+        const std::string segment_path = get_segment_path(m_segment_name);
+        int segment_fd = shm_open(segment_path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (segment_fd >= 0)
+        {
+            struct stat segment_stat;
+            if (0 == fstat(segment_fd, &segment_stat) && m_segment_device == static_cast<uint64_t>(segment_stat.st_dev) && m_segment_inode == static_cast<uint64_t>(segment_stat.st_ino))
+            {
+                shm_unlink(segment_path.c_str());
+            }
+            ::close(segment_fd);
+        }
+    }
+    m_segment_device = 0;
+    m_segment_inode = 0;
+#endif // _MSC_VER
+
+    m_header = nullptr;
+    m_process_entries = nullptr;
+    m_segment_size = 0;
+    m_segment_name.clear();
+}
+
+bool SharedSnapshotWriter::started() const
+{
+    return (nullptr != m_header);
+}
+
+void SharedSnapshotWriter::begin_write(uint64_t sample_time, uint64_t sample_sequence, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources)
+{
+    uint64_t write_sequence = m_header->write_sequence.load(std::memory_order_relaxed);
+    m_header->write_sequence.store(write_sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_header->sample_time = sample_time;
+    m_header->sample_sequence = sample_sequence;
+    memcpy(&m_header->system_resource, &system_resource, sizeof(m_header->system_resource));
+    m_header->card_count = static_cast<uint32_t>(std::min<std::size_t>(graphics_card_resources.size(), SHARED_SNAPSHOT_CARD_MAX));
+    if (0 != m_header->card_count)
+    {
+        memcpy(m_header->card_resources, &graphics_card_resources[0], sizeof(GraphicsCardResource) * m_header->card_count);
+    }
+
+    m_process_count = 0;
+}
+
+void SharedSnapshotWriter::write_process(uint32_t process_id, const ProcessResource & process_resource)
+{
+    if (m_process_count >= m_header->process_capacity)
+    {
+        if (!m_overflowed)
+        {
+            RUN_LOG_WAR("shared export leaves out processes while more than (%u) are monitoring", m_header->process_capacity);
+            m_overflowed = true;
+        }
+        return;
+    }
+
+    SharedProcessEntry & process_entry = m_process_entries[m_process_count++];
+    process_entry.process_id = process_id;
+    process_entry.reserved = 0;
+    memcpy(&process_entry.process_resource, &process_resource, sizeof(process_entry.process_resource));
+    process_entry.process_resource.sample_time = m_header->sample_time;
+    process_entry.process_resource.sample_sequence = m_header->sample_sequence;
+}
+
+void SharedSnapshotWriter::end_write()
+{
+    if (m_process_count < m_header->process_capacity)
+    {
+        m_overflowed = false;
+    }
+    m_header->process_count = m_process_count;
+
+    m_header->write_sequence.store(m_header->write_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+SharedSnapshotReaderImpl::SharedSnapshotReaderImpl()
+#ifdef _MSC_VER
+    : m_mapping_handle(nullptr)
+    , m_header(nullptr)
+#else
+    : m_header(nullptr)
+#endif // _MSC_VER
+    , m_process_entries(nullptr)
+    , m_segment_size(0)
+{
+
+}
+
+SharedSnapshotReaderImpl::~SharedSnapshotReaderImpl()
+{
+    close();
+}
+
+bool SharedSnapshotReaderImpl::open(const std::string & segment_name)
+{
+    close();
+
+    if (segment_name.empty())
+    {
+        return (false);
+    }
+
+    do
+    {
+        const void * segment_data = nullptr;
+
+#ifdef _MSC_VER
+        m_mapping_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, segment_name.c_str());
+        if (nullptr == m_mapping_handle)
+        {
+            RUN_LOG_ERR("shared reader open failure while open mapping (%s) failed", segment_name.c_str());
+            break;
+        }
+
+        segment_data = MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (nullptr == segment_data)
+        {
+            RUN_LOG_ERR("shared reader open failure while map (%s) failed", segment_name.c_str());
+            break;
+        }
+
+        MEMORY_BASIC_INFORMATION memory_information;
+        if (0 == VirtualQuery(segment_data, &memory_information, sizeof(memory_information)))
+        {
+            UnmapViewOfFile(segment_data);
+            break;
+        }
+        m_header = reinterpret_cast<const SharedSnapshotHeader *>(segment_data);
+        m_segment_size = memory_information.RegionSize;
+#else
+        const std::string segment_path = get_segment_path(segment_name);
+        int segment_fd = shm_open(segment_path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (segment_fd < 0)
+        {
+            RUN_LOG_ERR("shared reader open failure while shm_open (%s) failed", segment_path.c_str());
+            break;
+        }
+
+        struct stat segment_stat;
+        if (0 != fstat(segment_fd, &segment_stat) || segment_stat.st_size < static_cast<off_t>(sizeof(SharedSnapshotHeader)))
+        {
+            RUN_LOG_ERR("shared reader open failure while (%s) is too small", segment_path.c_str());
+            ::close(segment_fd);
+            break;
+        }
+
+        segment_data = mmap(nullptr, static_cast<std::size_t>(segment_stat.st_size), PROT_READ, MAP_SHARED, segment_fd, 0);
+        ::close(segment_fd);
+        if (MAP_FAILED == segment_data)
+        {
+            RUN_LOG_ERR("shared reader open failure while mmap (%s) failed", segment_path.c_str());
+            break;
+        }
+        m_header = reinterpret_cast<const SharedSnapshotHeader *>(segment_data);
+        m_segment_size = static_cast<std::size_t>(segment_stat.st_size);
+#endif // _MSC_VER
+
+        if (SHARED_SNAPSHOT_MAGIC != m_header->magic || SHARED_SNAPSHOT_VERSION != m_header->version || sizeof(SharedSnapshotHeader) != m_header->header_size || m_segment_size < sizeof(SharedSnapshotHeader) + static_cast<std::size_t>(m_header->process_capacity) * sizeof(SharedProcessEntry))
+        {
+            RUN_LOG_ERR("shared reader open failure while (%s) has another layout", segment_name.c_str());
+            break;
+        }
+
+        m_process_entries = reinterpret_cast<const SharedProcessEntry *>(reinterpret_cast<const char *>(m_header) + sizeof(SharedSnapshotHeader));
+
+        return (true);
+    } while (false);
+
+    close();
+
+    return (false);
+}
+
+void SharedSnapshotReaderImpl::close()
+{
+#ifdef _MSC_VER
+    if (nullptr != m_header)
+    {
+        UnmapViewOfFile(m_header);
+    }
+
+    if (nullptr != m_mapping_handle)
+    {
+        CloseHandle(m_mapping_handle);
+        m_mapping_handle = nullptr;
+    }
+#else
+    if (nullptr != m_header)
+    {
+        munmap(const_cast<SharedSnapshotHeader *>(m_header), m_segment_size);
+    }
+#endif // _MSC_VER
+
+    m_header = nullptr;
+    m_process_entries = nullptr;
+    m_segment_size = 0;
+}
+
+/*
+ * return: false when the writer stays inside, it died while publishing
+ * write_sequence: an even write sequence, the writer was outside when it was read
+ */
+bool SharedSnapshotReaderImpl::begin_read(uint64_t & write_sequence) const
+{
+    std::chrono::steady_clock::time_point wait_deadline;
+    for (uint32_t spin_count = 0; true; ++spin_count)
+    {
+        write_sequence = m_header->write_sequence.load(std::memory_order_acquire);
+        if (0 == (write_sequence & 1))
+        {
+            return (true);
+        }
+        if (spin_count == SHARED_READ_SPIN_COUNT)
+        {
+            wait_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_READ_WAIT_MS);
+        }
+        else if (spin_count > SHARED_READ_SPIN_COUNT)
+        {
+            if (std::chrono::steady_clock::now() >= wait_deadline)
+            {
+                return (false);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(SHARED_READ_SLEEP_MS));
+        }
+    }
+}
+
+/*
+ * return: nothing was written since begin_read, the copy is whole
+ */
+bool SharedSnapshotReaderImpl::end_read(uint64_t write_sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (m_header->write_sequence.load(std::memory_order_relaxed) == write_sequence);
+}
+
+bool SharedSnapshotReaderImpl::get_system_resource(SystemResource & system_resource) const
+{
+    if (nullptr == m_header)
+    {
+        return (false);
+    }
+
+    while (true)
+    {
+        uint64_t write_sequence = 0;
+        if (!begin_read(write_sequence))
+        {
+            return (false);
+        }
+        uint32_t writer_alive = m_header->writer_alive;
+        memcpy(&system_resource, &m_header->system_resource, sizeof(system_resource));
+        if (end_read(write_sequence))
+        {
+            return (0 != writer_alive);
+        }
+    }
+}
+
+bool SharedSnapshotReaderImpl::get_process_resource(uint32_t process_id, ProcessResource & process_resource) const
+{
+    if (nullptr == m_header)
+    {
+        return (false);
+    }
+
+    while (true)
+    {
+        uint64_t write_sequence = 0;
+        if (!begin_read(write_sequence))
+        {
+            return (false);
+        }
+        uint32_t writer_alive = m_header->writer_alive;
+        uint32_t process_count = std::min(m_header->process_count, m_header->process_capacity);
+
+        /* entries are sorted by process id, a torn count or order only costs a retry */
+        uint32_t lower_index = 0;
+        uint32_t upper_index = process_count;
+        while (lower_index < upper_index)
+        {
+            uint32_t middle_index = lower_index + (upper_index - lower_index) / 2;
+            if (m_process_entries[middle_index].process_id < process_id)
+            {
+                lower_index = middle_index + 1;
+            }
+            else
+            {
+                upper_index = middle_index;
+            }
+        }
+        bool process_found = (lower_index < process_count && process_id == m_process_entries[lower_index].process_id);
+        if (process_found)
+        {
+            memcpy(&process_resource, &m_process_entries[lower_index].process_resource, sizeof(process_resource));
+        }
+
+        if (end_read(write_sequence))
+        {
+            return (0 != writer_alive && process_found);
+        }
+    }
+}
+
+bool SharedSnapshotReaderImpl::get_all_process_resources(std::map<uint32_t, ProcessResource> & process_resources) const
+{
+    process_resources.clear();
+
+    if (nullptr == m_header)
+    {
+        return (false);
+    }
+
+    std::vector<SharedProcessEntry> process_entries(m_header->process_capacity);
+
+    while (true)
+    {
+        uint64_t write_sequence = 0;
+        if (!begin_read(write_sequence))
+        {
+            return (false);
+        }
+        uint32_t writer_alive = m_header->writer_alive;
+        uint32_t process_count = std::min(m_header->process_count, m_header->process_capacity);
+        if (0 != process_count)
+        {
+            memcpy(&process_entries[0], m_process_entries, sizeof(SharedProcessEntry) * process_count);
+        }
+
+        if (end_read(write_sequence))
+        {
+            for (uint32_t process_index = 0; process_index < process_count; ++process_index)
+            {
+                process_resources.insert(process_resources.end(), std::make_pair(process_entries[process_index].process_id, process_entries[process_index].process_resource));
+            }
+            return (0 != writer_alive);
+        }
+    }
+}
+
+bool SharedSnapshotReaderImpl::get_graphics_card_resources(std::vector<GraphicsCardResource> & graphics_card_resources) const
+{
+    graphics_card_resources.clear();
+
+    if (nullptr == m_header)
+    {
+        return (false);
+    }
+
+    GraphicsCardResource card_resources[SHARED_SNAPSHOT_CARD_MAX];
+
+    while (true)
+    {
+        uint64_t write_sequence = 0;
+        if (!begin_read(write_sequence))
+        {
+            return (false);
+        }
+        uint32_t writer_alive = m_header->writer_alive;
+        uint32_t card_count = std::min<uint32_t>(m_header->card_count, SHARED_SNAPSHOT_CARD_MAX);
+        memcpy(card_resources, m_header->card_resources, sizeof(GraphicsCardResource) * card_count);
+
+        if (end_read(write_sequence))
+        {
+            graphics_card_resources.assign(card_resources, card_resources + card_count);
+            return (0 != writer_alive);
+        }
+    }
+}
@@ -0,0 +1,392 @@
+/********************************************************
+ * Description : delta encoded diffs between published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstring>
+#include "resource_snapshot_diff.h"
+#include "resource_codec.h"
+
+DiffSnapshot::DiffSnapshot()
+    : sample_sequence(0)
+    , system_resource()
+    , process_resources()
+{
+    memset(&system_resource, 0x0, sizeof(system_resource));
+}
+
+SnapshotRetention::SnapshotRetention()
+    : m_snapshots()
+    , m_snapshot_head(0)
+    , m_snapshot_count(0)
+{
+
+}
+
+void SnapshotRetention::reset(uint32_t snapshot_count)
+{
+    m_snapshots.clear();
+    m_snapshots.resize(snapshot_count);
+    m_snapshots.shrink_to_fit();
+    m_snapshot_head = 0;
+    m_snapshot_count = 0;
+}
+
+bool SnapshotRetention::enabled() const
+{
+    return (!m_snapshots.empty());
+}
+
+DiffSnapshot & SnapshotRetention::append()
+{
+    DiffSnapshot & diff_snapshot = m_snapshots[m_snapshot_head];
+    m_snapshot_head = (m_snapshot_head + 1) % m_snapshots.size();
+    if (m_snapshot_count < m_snapshots.size())
+    {
+        ++m_snapshot_count;
+    }
+    return (diff_snapshot);
+}
+
+const DiffSnapshot * SnapshotRetention::find(uint64_t sample_sequence) const
+{
+    if (0 == m_snapshot_count)
+    {
+        return (nullptr);
+    }
+
+    const std::size_t latest_index = (m_snapshot_head + m_snapshots.size() - 1) % m_snapshots.size();
+    const DiffSnapshot & latest_snapshot = m_snapshots[latest_index];
+    if (0 == sample_sequence)
+    {
+        return (&latest_snapshot);
+    }
+
+    /* every publish is kept, so the sequences of the slots are consecutive */
+    if (sample_sequence > latest_snapshot.sample_sequence || latest_snapshot.sample_sequence - sample_sequence >= m_snapshot_count)
+    {
+        return (nullptr);
+    }
+
+    const std::size_t snapshot_index = (latest_index + m_snapshots.size() - static_cast<std::size_t>(latest_snapshot.sample_sequence - sample_sequence)) % m_snapshots.size();
+    const DiffSnapshot & diff_snapshot = m_snapshots[snapshot_index];
+
+    return (diff_snapshot.sample_sequence == sample_sequence ? &diff_snapshot : nullptr);
+}
+
+static void put_diff_varint(uint64_t value, std::string & snapshot_diff)
+{
+    char buffer[VARINT_SIZE_MAX];
+    snapshot_diff.append(buffer, put_varint(value, buffer));
+}
+
+/*
+ * return: mask of the fields that differ, their coded values go into field_values in field order
+ */
+static uint32_t diff_fields(const uint64_t * base_fields, const uint64_t * target_fields, std::size_t field_count, uint32_t double_mask, uint64_t * field_values, std::size_t & value_count)
+{
+    uint32_t field_mask = 0;
+    value_count = 0;
+    for (std::size_t field_index = 0; field_index < field_count; ++field_index)
+    {
+        if (base_fields[field_index] == target_fields[field_index])
+        {
+            continue;
+        }
+        field_mask |= (1u << field_index);
+        if (0 != (double_mask & (1u << field_index)))
+        {
+            field_values[value_count++] = base_fields[field_index] ^ target_fields[field_index];
+        }
+        else
+        {
+            field_values[value_count++] = zigzag_encode(static_cast<int64_t>(target_fields[field_index] - base_fields[field_index]));
+        }
+    }
+    return (field_mask);
+}
+
+static void put_diff_fields(const uint64_t * base_fields, const uint64_t * target_fields, std::size_t field_count, uint32_t double_mask, std::string & snapshot_diff)
+{
+    uint64_t field_values[SYSTEM_FIELD_COUNT];
+    std::size_t value_count = 0;
+    put_diff_varint(diff_fields(base_fields, target_fields, field_count, double_mask, field_values, value_count), snapshot_diff);
+    for (std::size_t value_index = 0; value_index < value_count; ++value_index)
+    {
+        put_diff_varint(field_values[value_index], snapshot_diff);
+    }
+}
+
+static bool accept_process(const FlatSet<uint32_t> * process_filter, uint32_t process_id)
+{
+    return (nullptr == process_filter || process_filter->end() != process_filter->find(process_id));
+}
+
+void encode_snapshot_diff(const DiffSnapshot & base_snapshot, const DiffSnapshot & target_snapshot, const FlatSet<uint32_t> * process_filter, std::string & snapshot_diff)
+{
+    snapshot_diff.clear();
+
+    put_diff_varint(SNAPSHOT_DIFF_VERSION, snapshot_diff);
+    put_diff_varint(base_snapshot.sample_sequence, snapshot_diff);
+    put_diff_varint(target_snapshot.sample_sequence - base_snapshot.sample_sequence, snapshot_diff);
+    put_diff_varint(zigzag_encode(static_cast<int64_t>(target_snapshot.system_resource.sample_time - base_snapshot.system_resource.sample_time)), snapshot_diff);
+
+    uint64_t base_fields[SYSTEM_FIELD_COUNT];
+    uint64_t target_fields[SYSTEM_FIELD_COUNT];
+    get_system_fields(base_snapshot.system_resource, base_fields);
+    get_system_fields(target_snapshot.system_resource, target_fields);
+    put_diff_fields(base_fields, target_fields, SYSTEM_FIELD_COUNT, SYSTEM_DOUBLE_MASK, snapshot_diff);
+
+    const std::vector<std::pair<uint32_t, ProcessResource>> & base_processes = base_snapshot.process_resources;
+    const std::vector<std::pair<uint32_t, ProcessResource>> & target_processes = target_snapshot.process_resources;
+
+    /* both lists ascend, one merge walk finds the removed ones and another the new or changed ones */
+    uint32_t removed_count = 0;
+    std::string removed_data;
+    uint32_t changed_count = 0;
+    std::string changed_data;
+    uint32_t removed_previous = 0;
+    uint32_t changed_previous = 0;
+
+    ProcessResource zero_resource;
+    memset(&zero_resource, 0x0, sizeof(zero_resource));
+
+    std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter_base = base_processes.begin();
+    std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter_target = target_processes.begin();
+    while (base_processes.end() != iter_base || target_processes.end() != iter_target)
+    {
+        if (target_processes.end() == iter_target || (base_processes.end() != iter_base && iter_base->first < iter_target->first))
+        {
+            if (accept_process(process_filter, iter_base->first))
+            {
+                put_diff_varint(iter_base->first - removed_previous, removed_data);
+                removed_previous = iter_base->first;
+                ++removed_count;
+            }
+            ++iter_base;
+            continue;
+        }
+
+        const bool process_known = (base_processes.end() != iter_base && iter_base->first == iter_target->first);
+        if (accept_process(process_filter, iter_target->first))
+        {
+            get_process_fields(process_known ? iter_base->second : zero_resource, base_fields);
+            get_process_fields(iter_target->second, target_fields);
+            uint64_t field_values[PROCESS_FIELD_COUNT];
+            std::size_t value_count = 0;
+            uint32_t field_mask = diff_fields(base_fields, target_fields, PROCESS_FIELD_COUNT, PROCESS_DOUBLE_MASK, field_values, value_count);
+            if (!process_known || 0 != field_mask)
+            {
+                put_diff_varint(iter_target->first - changed_previous, changed_data);
+                put_diff_varint(field_mask, changed_data);
+                for (std::size_t value_index = 0; value_index < value_count; ++value_index)
+                {
+                    put_diff_varint(field_values[value_index], changed_data);
+                }
+                changed_previous = iter_target->first;
+                ++changed_count;
+            }
+        }
+        if (process_known)
+        {
+            ++iter_base;
+        }
+        ++iter_target;
+    }
+
+    put_diff_varint(removed_count, snapshot_diff);
+    snapshot_diff.append(removed_data);
+    put_diff_varint(changed_count, snapshot_diff);
+    snapshot_diff.append(changed_data);
+}
+
+static bool get_diff_fields(const char *& data, const char * data_end, std::size_t field_count, uint32_t double_mask, uint64_t * fields)
+{
+    uint64_t field_mask = 0;
+    if (!get_varint(data, data_end, field_mask) || 0 != (field_mask >> field_count))
+    {
+        return (false);
+    }
+
+    for (std::size_t field_index = 0; field_index < field_count; ++field_index)
+    {
+        if (0 == (field_mask & (1u << field_index)))
+        {
+            continue;
+        }
+        uint64_t value = 0;
+        if (!get_varint(data, data_end, value))
+        {
+            return (false);
+        }
+        if (0 != (double_mask & (1u << field_index)))
+        {
+            fields[field_index] ^= value;
+        }
+        else
+        {
+            fields[field_index] += static_cast<uint64_t>(zigzag_decode(value));
+        }
+    }
+
+    return (true);
+}
+
+/*
+ * apply_changes false only reads and checks the diff against resource_snapshot
+ */
+static bool read_snapshot_diff(const std::string & snapshot_diff, ResourceSnapshot & resource_snapshot, bool apply_changes)
+{
+    const char * data = snapshot_diff.data();
+    const char * data_end = data + snapshot_diff.size();
+
+    uint64_t version = 0;
+    uint64_t base_sequence = 0;
+    uint64_t sequence_delta = 0;
+    uint64_t time_delta = 0;
+    if (!get_varint(data, data_end, version) || SNAPSHOT_DIFF_VERSION != version || !get_varint(data, data_end, base_sequence) || !get_varint(data, data_end, sequence_delta) || !get_varint(data, data_end, time_delta))
+    {
+        return (false);
+    }
+
+    /* a diff from the empty base replaces whatever the snapshot holds */
+    if (0 != base_sequence && resource_snapshot.sample_sequence != base_sequence)
+    {
+        return (false);
+    }
+    if (0 == base_sequence && apply_changes)
+    {
+        resource_snapshot.sample_sequence = 0;
+        memset(&resource_snapshot.system_resource, 0x0, sizeof(resource_snapshot.system_resource));
+        resource_snapshot.process_resources.clear();
+    }
+
+    const uint64_t sample_sequence = base_sequence + sequence_delta;
+    const uint64_t sample_time = (0 == base_sequence ? 0 : resource_snapshot.system_resource.sample_time) + static_cast<uint64_t>(zigzag_decode(time_delta));
+
+    uint64_t fields[SYSTEM_FIELD_COUNT];
+    if (0 == base_sequence)
+    {
+        memset(fields, 0x0, sizeof(fields));
+    }
+    else
+    {
+        get_system_fields(resource_snapshot.system_resource, fields);
+    }
+    if (!get_diff_fields(data, data_end, SYSTEM_FIELD_COUNT, SYSTEM_DOUBLE_MASK, fields))
+    {
+        return (false);
+    }
+    if (apply_changes)
+    {
+        set_system_fields(fields, resource_snapshot.system_resource);
+        resource_snapshot.system_resource.sample_time = sample_time;
+        resource_snapshot.system_resource.sample_sequence = sample_sequence;
+    }
+
+    std::map<uint32_t, ProcessResource> & process_resources = resource_snapshot.process_resources;
+
+    uint64_t removed_count = 0;
+    if (!get_varint(data, data_end, removed_count))
+    {
+        return (false);
+    }
+    uint64_t process_id = 0;
+    for (uint64_t removed_index = 0; removed_index < removed_count; ++removed_index)
+    {
+        uint64_t process_delta = 0;
+        if (!get_varint(data, data_end, process_delta))
+        {
+            return (false);
+        }
+        /* ascending without repeats, the check pass never erases so it could not tell a repeated pid from one still there */
+        if (0 != removed_index && 0 == process_delta)
+        {
+            return (false);
+        }
+        process_id += process_delta;
+        std::map<uint32_t, ProcessResource>::iterator iter = process_resources.find(static_cast<uint32_t>(process_id));
+        if (0 == base_sequence || process_id > UINT32_MAX || process_resources.end() == iter)
+        {
+            return (false);
+        }
+        if (apply_changes)
+        {
+            process_resources.erase(iter);
+        }
+    }
+
+    uint64_t changed_count = 0;
+    if (!get_varint(data, data_end, changed_count))
+    {
+        return (false);
+    }
+    process_id = 0;
+    for (uint64_t changed_index = 0; changed_index < changed_count; ++changed_index)
+    {
+        uint64_t process_delta = 0;
+        if (!get_varint(data, data_end, process_delta))
+        {
+            return (false);
+        }
+        if (0 != changed_index && 0 == process_delta)
+        {
+            return (false);
+        }
+        process_id += process_delta;
+        if (process_id > UINT32_MAX)
+        {
+            return (false);
+        }
+
+        uint64_t process_fields[PROCESS_FIELD_COUNT];
+        memset(process_fields, 0x0, sizeof(process_fields));
+        std::map<uint32_t, ProcessResource>::iterator iter = process_resources.end();
+        if (0 != base_sequence || apply_changes)
+        {
+            iter = process_resources.find(static_cast<uint32_t>(process_id));
+            if (process_resources.end() != iter)
+            {
+                get_process_fields(iter->second, process_fields);
+            }
+        }
+        if (!get_diff_fields(data, data_end, PROCESS_FIELD_COUNT, PROCESS_DOUBLE_MASK, process_fields))
+        {
+            return (false);
+        }
+        if (apply_changes)
+        {
+            if (process_resources.end() == iter)
+            {
+                iter = process_resources.insert(std::make_pair(static_cast<uint32_t>(process_id), ProcessResource())).first;
+            }
+            set_process_fields(process_fields, iter->second);
+        }
+    }
+
+    if (data != data_end)
+    {
+        return (false);
+    }
+
+    if (apply_changes)
+    {
+        resource_snapshot.sample_sequence = sample_sequence;
+        for (std::map<uint32_t, ProcessResource>::iterator iter = process_resources.begin(); process_resources.end() != iter; ++iter)
+        {
+            iter->second.sample_time = sample_time;
+            iter->second.sample_sequence = sample_sequence;
+        }
+    }
+
+    return (true);
+}
+
+bool decode_snapshot_diff(const std::string & snapshot_diff, ResourceSnapshot & resource_snapshot)
+{
+    return (read_snapshot_diff(snapshot_diff, resource_snapshot, false) && read_snapshot_diff(snapshot_diff, resource_snapshot, true));
+}
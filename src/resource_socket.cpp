@@ -0,0 +1,234 @@
+/********************************************************
+ * Description : local listening sockets of the exporters
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "resource_socket.h"
+#ifdef _MSC_VER
+    #include <ws2tcpip.h>
+#else
+    #include <fcntl.h>
+    #include <errno.h>
+    #include <unistd.h>
+    #include <sys/un.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+#endif // _MSC_VER
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "log/log.h"
+
+#define LISTEN_DEFAULT_HOST             "127.0.0.1"
+#define LISTEN_UNIX_PREFIX              "unix:"
+#define LISTEN_BACKLOG                  64
+
+static bool is_unix_address(const std::string & listen_address)
+{
+    return (0 == listen_address.compare(0, sizeof(LISTEN_UNIX_PREFIX) - 1, LISTEN_UNIX_PREFIX));
+}
+
+static bool set_socket_nonblock(socket_t sock)
+{
+#ifdef _MSC_VER
+    u_long non_block = 1;
+    return (0 == ioctlsocket(sock, FIONBIO, &non_block));
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return (flags >= 0 && 0 == fcntl(sock, F_SETFL, flags | O_NONBLOCK));
+#endif // _MSC_VER
+}
+
+static socket_t open_unix_socket(const std::string & socket_path)
+{
+#ifdef _MSC_VER
+    RUN_LOG_ERR("listen on (%s) failure while unix sockets are not supported", socket_path.c_str());
+    return (BAD_SOCKET);
+#else
+    struct sockaddr_un socket_address;
+    memset(&socket_address, 0x0, sizeof(socket_address));
+    if (socket_path.empty() || socket_path.size() >= sizeof(socket_address.sun_path))
+    {
+        RUN_LOG_ERR("listen on (%s) failure while the path is empty or too long", socket_path.c_str());
+        return (BAD_SOCKET);
+    }
+    socket_address.sun_family = AF_UNIX;
+    memcpy(socket_address.sun_path, socket_path.c_str(), socket_path.size());
+
+    socket_t sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (BAD_SOCKET == sock)
+    {
+        RUN_LOG_ERR("listen on (%s) failure while create socket failed (%d)", socket_path.c_str(), errno);
+        return (BAD_SOCKET);
+    }
+
+    /* a socket file left by a process that did not stop cleanly would fail the bind */
+    unlink(socket_path.c_str());
+
+    if (0 != bind(sock, reinterpret_cast<struct sockaddr *>(&socket_address), sizeof(socket_address)) || 0 != listen(sock, LISTEN_BACKLOG) || !set_socket_nonblock(sock))
+    {
+        RUN_LOG_ERR("listen on (%s) failure while bind or listen failed (%d)", socket_path.c_str(), errno);
+        close_socket(sock);
+        return (BAD_SOCKET);
+    }
+
+    return (sock);
+#endif // _MSC_VER
+}
+
+static socket_t open_tcp_socket(const std::string & listen_address)
+{
+    std::string host;
+    std::string port;
+    std::string::size_type colon_pos = listen_address.rfind(':');
+    if (std::string::npos == colon_pos)
+    {
+        port = listen_address;
+    }
+    else
+    {
+        host = listen_address.substr(0, colon_pos);
+        port = listen_address.substr(colon_pos + 1);
+    }
+    if (host.empty())
+    {
+        host = LISTEN_DEFAULT_HOST;
+    }
+
+    int port_number = atoi(port.c_str());
+    if (port_number <= 0 || port_number > 65535)
+    {
+        RUN_LOG_ERR("listen on (%s) failure while the port is invalid", listen_address.c_str());
+        return (BAD_SOCKET);
+    }
+
+    struct sockaddr_in socket_address;
+    memset(&socket_address, 0x0, sizeof(socket_address));
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(static_cast<uint16_t>(port_number));
+    if (1 != inet_pton(AF_INET, host.c_str(), &socket_address.sin_addr))
+    {
+        RUN_LOG_ERR("listen on (%s) failure while the host is not an ipv4 address", listen_address.c_str());
+        return (BAD_SOCKET);
+    }
+
+#ifdef _MSC_VER
+    socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#else
+    socket_t sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+#endif // _MSC_VER
+    if (BAD_SOCKET == sock)
+    {
+        RUN_LOG_ERR("listen on (%s) failure while create socket failed", listen_address.c_str());
+        return (BAD_SOCKET);
+    }
+
+    int reuse_address = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse_address), sizeof(reuse_address));
+
+    if (0 != bind(sock, reinterpret_cast<struct sockaddr *>(&socket_address), sizeof(socket_address)) || 0 != listen(sock, LISTEN_BACKLOG) || !set_socket_nonblock(sock))
+    {
+        RUN_LOG_ERR("listen on (%s) failure while bind or listen failed", listen_address.c_str());
+        close_socket(sock);
+        return (BAD_SOCKET);
+    }
+
+    return (sock);
+}
+
+socket_t open_listen_socket(const std::string & listen_address)
+{
+#ifdef _MSC_VER
+    WSADATA wsa_data;
+    if (0 != WSAStartup(MAKEWORD(2, 2), &wsa_data))
+    {
+        RUN_LOG_ERR("listen on (%s) failure while WSAStartup failed", listen_address.c_str());
+        return (BAD_SOCKET);
+    }
+#endif // _MSC_VER
+
+    socket_t listen_socket = (is_unix_address(listen_address) ? open_unix_socket(listen_address.substr(sizeof(LISTEN_UNIX_PREFIX) - 1)) : open_tcp_socket(listen_address));
+
+#ifdef _MSC_VER
+    if (BAD_SOCKET == listen_socket)
+    {
+        WSACleanup();
+    }
+#endif // _MSC_VER
+
+    return (listen_socket);
+}
+
+void close_listen_socket(socket_t listen_socket, const std::string & listen_address)
+{
+    if (BAD_SOCKET == listen_socket)
+    {
+        return;
+    }
+
+    close_socket(listen_socket);
+
+#ifdef _MSC_VER
+    WSACleanup();
+#else
+    if (is_unix_address(listen_address))
+    {
+        unlink(listen_address.substr(sizeof(LISTEN_UNIX_PREFIX) - 1).c_str());
+    }
+#endif // _MSC_VER
+}
+
+socket_t accept_client_socket(socket_t listen_socket)
+{
+#ifdef _MSC_VER
+    socket_t sock = accept(listen_socket, nullptr, nullptr);
+#else
+    socket_t sock = accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+#endif // _MSC_VER
+    if (BAD_SOCKET == sock)
+    {
+        return (BAD_SOCKET);
+    }
+
+#ifdef _MSC_VER
+    if (!set_socket_nonblock(sock))
+    {
+        close_socket(sock);
+        return (BAD_SOCKET);
+    }
+#endif // _MSC_VER
+
+    return (sock);
+}
+
+void close_socket(socket_t sock)
+{
+#ifdef _MSC_VER
+    closesocket(sock);
+#else
+    ::close(sock);
+#endif // _MSC_VER
+}
+
+bool socket_would_block()
+{
+#ifdef _MSC_VER
+    return (WSAEWOULDBLOCK == WSAGetLastError());
+#else
+    return (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno);
+#endif // _MSC_VER
+}
+
+int poll_sockets(struct pollfd * poll_fds, std::size_t poll_count, int timeout_ms)
+{
+#ifdef _MSC_VER
+    return (WSAPoll(poll_fds, static_cast<ULONG>(poll_count), timeout_ms));
+#else
+    return (poll(poll_fds, static_cast<nfds_t>(poll_count), timeout_ms));
+#endif // _MSC_VER
+}
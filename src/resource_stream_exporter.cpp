@@ -0,0 +1,498 @@
+/********************************************************
+ * Description : line protocol stream of published snapshots
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "resource_socket.h"
+#ifndef _MSC_VER
+    #include <errno.h>
+    #include <unistd.h>
+    #include <sys/uio.h>
+    #include <sys/socket.h>
+    #include <sys/eventfd.h>
+#endif // _MSC_VER
+#include <list>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "resource_stream_exporter.h"
+#include "log/log.h"
+
+#define STREAM_CLIENT_MAX               64
+#define STREAM_CLIENT_BACKLOG           64      /* frames, when start() gets 0 */
+#define STREAM_WRITE_VECTOR_MAX         64      /* frames gathered by one sendmsg */
+#define STREAM_POLL_INTERVAL_MS         1000
+
+struct StreamClient
+{
+    socket_t                                client_socket;
+    std::deque<std::shared_ptr<const std::string>> frame_queue;  /* guarded by the client mutex */
+    std::size_t                             frame_offset;         /* bytes of the front frame already sent, guarded by the client mutex */
+    bool                                    dropped;              /* guarded by the client mutex */
+
+    StreamClient();
+};
+
+struct StreamServer
+{
+    std::string                             listen_address;
+    socket_t                                listen_socket;
+#ifndef _MSC_VER
+    int                                     wake_fd;              /* eventfd, written by append_frame and stop */
+    std::vector<struct iovec>               send_vectors;
+#endif // _MSC_VER
+    std::list<StreamClient>                 client_list;          /* changed by the writer thread under the client mutex */
+    std::vector<struct pollfd>              poll_fds;
+    std::vector<std::shared_ptr<const std::string>> send_frames;
+
+    StreamServer();
+};
+
+StreamClient::StreamClient()
+    : client_socket(BAD_SOCKET)
+    , frame_queue()
+    , frame_offset(0)
+    , dropped(false)
+{
+
+}
+
+StreamServer::StreamServer()
+    : listen_address()
+    , listen_socket(BAD_SOCKET)
+#ifndef _MSC_VER
+    , wake_fd(-1)
+    , send_vectors()
+#endif // _MSC_VER
+    , client_list()
+    , poll_fds()
+    , send_frames()
+{
+
+}
+
+/*
+ * tag values escape comma, equal sign, space and backslash
+ */
+static void append_tag_value(std::string & stream_frame, const char * tag_value)
+{
+    for (const char * character = tag_value; 0x0 != *character; ++character)
+    {
+        if (',' == *character || '=' == *character || ' ' == *character || '\\' == *character)
+        {
+            stream_frame += '\\';
+        }
+        stream_frame += ('\n' == *character ? ' ' : *character);
+    }
+}
+
+static void append_double_field(std::string & stream_frame, const char * field_name, double field_value)
+{
+    char field_text[96] = { 0x0 };
+    snprintf(field_text, sizeof(field_text), ",%s=%.10g", field_name, field_value);
+    stream_frame += field_text;
+}
+
+static void append_uint_field(std::string & stream_frame, const char * field_name, uint64_t field_value)
+{
+    char field_text[96] = { 0x0 };
+    snprintf(field_text, sizeof(field_text), ",%s=%lluu", field_name, static_cast<unsigned long long>(field_value));
+    stream_frame += field_text;
+}
+
+static void append_timestamp(std::string & stream_frame, const char * frame_time)
+{
+    stream_frame += ' ';
+    stream_frame += frame_time;
+    stream_frame += '\n';
+}
+
+void format_stream_frame(uint64_t sample_sequence, uint64_t frame_time_ns, const SystemResource & system_resource, const std::vector<GraphicsCardResource> & graphics_card_resources, const std::vector<std::pair<uint32_t, ProcessResource>> & process_resources, std::string & stream_frame)
+{
+    stream_frame.clear();
+
+    char frame_time[32] = { 0x0 };
+    snprintf(frame_time, sizeof(frame_time), "%llu", static_cast<unsigned long long>(frame_time_ns));
+
+    char sequence_field[64] = { 0x0 };
+    snprintf(sequence_field, sizeof(sequence_field), "resource_monitor_system sample_sequence=%lluu", static_cast<unsigned long long>(sample_sequence));
+    stream_frame += sequence_field;
+    append_uint_field(stream_frame, "cpu_count", system_resource.cpu_count);
+    append_double_field(stream_frame, "cpu_usage", system_resource.cpu_usage);
+    append_uint_field(stream_frame, "ram_usage", system_resource.ram_usage);
+    append_uint_field(stream_frame, "ram_total", system_resource.ram_total);
+    append_uint_field(stream_frame, "disk_usage", system_resource.disk_usage);
+    append_uint_field(stream_frame, "disk_total", system_resource.disk_total);
+    append_uint_field(stream_frame, "gpu_count", system_resource.gpu_count);
+    append_double_field(stream_frame, "gpu_3d_usage", system_resource.gpu_3d_usage);
+    append_double_field(stream_frame, "gpu_vr_usage", system_resource.gpu_vr_usage);
+    append_double_field(stream_frame, "gpu_enc_usage", system_resource.gpu_enc_usage);
+    append_double_field(stream_frame, "gpu_dec_usage", system_resource.gpu_dec_usage);
+    append_uint_field(stream_frame, "gpu_mem_usage", system_resource.gpu_mem_usage);
+    append_uint_field(stream_frame, "gpu_mem_total", system_resource.gpu_mem_total);
+    append_uint_field(stream_frame, "gpu_temperature", system_resource.gpu_temperature);
+    append_uint_field(stream_frame, "gpu_sm_clock", system_resource.gpu_sm_clock);
+    append_uint_field(stream_frame, "gpu_mem_clock", system_resource.gpu_mem_clock);
+    append_uint_field(stream_frame, "net_send_bytes", system_resource.net_send_bytes);
+    append_uint_field(stream_frame, "net_recv_bytes", system_resource.net_recv_bytes);
+    append_timestamp(stream_frame, frame_time);
+
+    for (std::size_t card_index = 0; card_index < graphics_card_resources.size(); ++card_index)
+    {
+        const GraphicsCardResource & graphics_card_resource = graphics_card_resources[card_index];
+        char card_tag[64] = { 0x0 };
+        snprintf(card_tag, sizeof(card_tag), "resource_monitor_gpu,gpu=%u", static_cast<uint32_t>(card_index));
+        stream_frame += card_tag;
+        if (0x0 != graphics_card_resource.gpu_name[0])
+        {
+            stream_frame += ",name=";
+            append_tag_value(stream_frame, graphics_card_resource.gpu_name);
+        }
+        /* the first field has no leading comma */
+        char usage_field[64] = { 0x0 };
+        snprintf(usage_field, sizeof(usage_field), " gpu_3d_usage=%.10g", graphics_card_resource.gpu_3d_usage);
+        stream_frame += usage_field;
+        append_double_field(stream_frame, "gpu_enc_usage", graphics_card_resource.gpu_enc_usage);
+        append_double_field(stream_frame, "gpu_dec_usage", graphics_card_resource.gpu_dec_usage);
+        append_uint_field(stream_frame, "gpu_mem_usage", graphics_card_resource.gpu_mem_usage);
+        append_uint_field(stream_frame, "gpu_mem_total", graphics_card_resource.gpu_mem_total);
+        append_uint_field(stream_frame, "gpu_temperature", graphics_card_resource.gpu_temperature);
+        append_uint_field(stream_frame, "gpu_sm_clock", graphics_card_resource.gpu_sm_clock);
+        append_uint_field(stream_frame, "gpu_mem_clock", graphics_card_resource.gpu_mem_clock);
+        append_timestamp(stream_frame, frame_time);
+    }
+
+    for (std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter = process_resources.begin(); process_resources.end() != iter; ++iter)
+    {
+        const ProcessResource & process_resource = iter->second;
+        char process_field[96] = { 0x0 };
+        snprintf(process_field, sizeof(process_field), "resource_monitor_process,pid=%u cpu_usage=%.10g", iter->first, process_resource.cpu_usage);
+        stream_frame += process_field;
+        append_uint_field(stream_frame, "ram_usage", process_resource.ram_usage);
+        append_double_field(stream_frame, "gpu_3d_usage", process_resource.gpu_3d_usage);
+        append_double_field(stream_frame, "gpu_vr_usage", process_resource.gpu_vr_usage);
+        append_double_field(stream_frame, "gpu_enc_usage", process_resource.gpu_enc_usage);
+        append_double_field(stream_frame, "gpu_dec_usage", process_resource.gpu_dec_usage);
+        append_uint_field(stream_frame, "gpu_mem_usage", process_resource.gpu_mem_usage);
+        append_uint_field(stream_frame, "minor_faults", process_resource.minor_faults);
+        append_uint_field(stream_frame, "major_faults", process_resource.major_faults);
+        append_timestamp(stream_frame, frame_time);
+    }
+}
+
+ResourceStreamExporter::ResourceStreamExporter()
+    : m_stream_server(nullptr)
+    , m_running(false)
+    , m_writer_thread()
+    , m_client_count(0)
+    , m_client_backlog(STREAM_CLIENT_BACKLOG)
+    , m_client_mutex()
+{
+
+}
+
+ResourceStreamExporter::~ResourceStreamExporter()
+{
+    stop();
+}
+
+bool ResourceStreamExporter::start(const std::string & listen_address, uint32_t client_backlog)
+{
+    stop();
+
+#ifdef _MSC_VER
+    RUN_LOG_ERR("stream exporter start on (%s) failure while it needs sendmsg and eventfd", listen_address.c_str());
+    return (false);
+#else
+    if (listen_address.empty())
+    {
+        return (false);
+    }
+
+    do
+    {
+        m_stream_server = new StreamServer;
+        if (nullptr == m_stream_server)
+        {
+            break;
+        }
+
+        m_stream_server->listen_address = listen_address;
+        m_stream_server->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (m_stream_server->wake_fd < 0)
+        {
+            break;
+        }
+
+        m_stream_server->listen_socket = open_listen_socket(listen_address);
+        if (BAD_SOCKET == m_stream_server->listen_socket)
+        {
+            break;
+        }
+
+        m_client_backlog = (0 != client_backlog ? client_backlog : STREAM_CLIENT_BACKLOG);
+        m_client_count = 0;
+
+        m_running = true;
+        m_writer_thread = std::thread(&ResourceStreamExporter::writer_thread, this);
+
+        RUN_LOG_DBG("stream exporter start on (%s) backlog (%u) success", listen_address.c_str(), m_client_backlog);
+
+        return (true);
+    } while (false);
+
+    RUN_LOG_ERR("stream exporter start on (%s) failure", listen_address.c_str());
+
+    stop();
+
+    return (false);
+#endif // _MSC_VER
+}
+
+void ResourceStreamExporter::stop()
+{
+    m_running = false;
+    if (m_writer_thread.joinable())
+    {
+        wake_writer();
+        m_writer_thread.join();
+    }
+
+    if (nullptr != m_stream_server)
+    {
+        for (std::list<StreamClient>::iterator iter = m_stream_server->client_list.begin(); m_stream_server->client_list.end() != iter; ++iter)
+        {
+            close_socket(iter->client_socket);
+        }
+        close_listen_socket(m_stream_server->listen_socket, m_stream_server->listen_address);
+#ifndef _MSC_VER
+        if (m_stream_server->wake_fd >= 0)
+        {
+            ::close(m_stream_server->wake_fd);
+        }
+#endif // _MSC_VER
+        delete m_stream_server;
+        m_stream_server = nullptr;
+    }
+
+    m_client_count = 0;
+}
+
+bool ResourceStreamExporter::started() const
+{
+    return (nullptr != m_stream_server);
+}
+
+bool ResourceStreamExporter::has_clients() const
+{
+    return (nullptr != m_stream_server && 0 != m_client_count.load(std::memory_order_relaxed));
+}
+
+void ResourceStreamExporter::wake_writer()
+{
+#ifndef _MSC_VER
+    if (nullptr != m_stream_server && m_stream_server->wake_fd >= 0)
+    {
+        uint64_t wake_count = 1;
+        if (sizeof(wake_count) != write(m_stream_server->wake_fd, &wake_count, sizeof(wake_count)))
+        {
+            /* the counter is already far from zero, the writer wakes anyway */
+        }
+    }
+#endif // _MSC_VER
+}
+
+void ResourceStreamExporter::append_frame(const std::shared_ptr<const std::string> & stream_frame)
+{
+    if (nullptr == m_stream_server || !stream_frame || stream_frame->empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_client_mutex);
+        for (std::list<StreamClient>::iterator iter = m_stream_server->client_list.begin(); m_stream_server->client_list.end() != iter; ++iter)
+        {
+            StreamClient & stream_client = *iter;
+            if (stream_client.dropped)
+            {
+                continue;
+            }
+            if (stream_client.frame_queue.size() >= m_client_backlog)
+            {
+                /* the writer closes it, a partial frame may be the last thing it reads */
+                stream_client.dropped = true;
+                stream_client.frame_queue.clear();
+                continue;
+            }
+            stream_client.frame_queue.push_back(stream_frame);
+        }
+    }
+
+    wake_writer();
+}
+
+void ResourceStreamExporter::writer_thread()
+{
+#ifndef _MSC_VER
+    StreamServer & stream_server = *m_stream_server;
+    std::list<StreamClient> & client_list = stream_server.client_list;
+    std::vector<struct pollfd> & poll_fds = stream_server.poll_fds;
+    std::vector<std::shared_ptr<const std::string>> & send_frames = stream_server.send_frames;
+    std::vector<struct iovec> & send_vectors = stream_server.send_vectors;
+
+    while (m_running)
+    {
+        poll_fds.resize(2 + client_list.size());
+        poll_fds[0].fd = stream_server.listen_socket;
+        poll_fds[0].events = POLLIN;
+        poll_fds[0].revents = 0;
+        poll_fds[1].fd = stream_server.wake_fd;
+        poll_fds[1].events = POLLIN;
+        poll_fds[1].revents = 0;
+        {
+            std::lock_guard<std::mutex> locker(m_client_mutex);
+            std::size_t poll_index = 2;
+            for (std::list<StreamClient>::iterator iter = client_list.begin(); client_list.end() != iter; ++iter, ++poll_index)
+            {
+                poll_fds[poll_index].fd = iter->client_socket;
+                poll_fds[poll_index].events = static_cast<short>(iter->frame_queue.empty() ? POLLIN : (POLLIN | POLLOUT));
+                poll_fds[poll_index].revents = 0;
+            }
+        }
+
+        if (poll_sockets(&poll_fds[0], poll_fds.size(), STREAM_POLL_INTERVAL_MS) < 0)
+        {
+            continue;
+        }
+
+        if (0 != (poll_fds[1].revents & POLLIN))
+        {
+            uint64_t wake_count = 0;
+            if (sizeof(wake_count) != read(stream_server.wake_fd, &wake_count, sizeof(wake_count)))
+            {
+                /* nothing to drain */
+            }
+        }
+
+        /* the poll results follow the list order, only this thread changes the list */
+        std::size_t poll_index = 2;
+        std::list<StreamClient>::iterator iter = client_list.begin();
+        while (client_list.end() != iter)
+        {
+            StreamClient & stream_client = *iter;
+            const short revents = poll_fds[poll_index++].revents;
+            bool client_done = (0 != (revents & (POLLERR | POLLHUP | POLLNVAL)));
+
+            /* a client only listens, what it sends is discarded; end of stream means it left */
+            if (!client_done && 0 != (revents & POLLIN))
+            {
+                char discard_buffer[512];
+                ssize_t read_size = recv(stream_client.client_socket, discard_buffer, sizeof(discard_buffer), 0);
+                client_done = (0 == read_size || (read_size < 0 && !socket_would_block()));
+            }
+
+            /* frames queued after the poll are sent as well, sendmsg simply stops where the socket is full */
+            if (!client_done)
+            {
+                std::size_t frame_offset = 0;
+                {
+                    std::lock_guard<std::mutex> locker(m_client_mutex);
+                    client_done = stream_client.dropped;
+                    frame_offset = stream_client.frame_offset;
+                    const std::size_t frame_count = std::min<std::size_t>(stream_client.frame_queue.size(), STREAM_WRITE_VECTOR_MAX);
+                    send_frames.assign(stream_client.frame_queue.begin(), stream_client.frame_queue.begin() + frame_count);
+                }
+
+                if (client_done)
+                {
+                    RUN_LOG_WAR("stream exporter drops a client more than (%u) frames behind", m_client_backlog);
+                }
+                else if (!send_frames.empty())
+                {
+                    send_vectors.resize(send_frames.size());
+                    for (std::size_t frame_index = 0; frame_index < send_frames.size(); ++frame_index)
+                    {
+                        const std::size_t skip_size = (0 == frame_index ? frame_offset : 0);
+                        send_vectors[frame_index].iov_base = const_cast<char *>(send_frames[frame_index]->data() + skip_size);
+                        send_vectors[frame_index].iov_len = send_frames[frame_index]->size() - skip_size;
+                    }
+
+                    /* sendmsg rather than writev, a peer gone meanwhile fails it with EPIPE instead of raising SIGPIPE */
+                    struct msghdr send_message;
+                    memset(&send_message, 0x0, sizeof(send_message));
+                    send_message.msg_iov = &send_vectors[0];
+                    send_message.msg_iovlen = send_vectors.size();
+
+                    ssize_t send_size = sendmsg(stream_client.client_socket, &send_message, SOCKET_SEND_FLAGS);
+                    if (send_size < 0)
+                    {
+                        client_done = !socket_would_block();
+                    }
+                    else
+                    {
+                        std::size_t sent_size = static_cast<std::size_t>(send_size);
+                        std::lock_guard<std::mutex> locker(m_client_mutex);
+                        while (!stream_client.frame_queue.empty() && sent_size > 0)
+                        {
+                            const std::size_t left_size = stream_client.frame_queue.front()->size() - stream_client.frame_offset;
+                            if (sent_size < left_size)
+                            {
+                                stream_client.frame_offset += sent_size;
+                                break;
+                            }
+                            sent_size -= left_size;
+                            stream_client.frame_offset = 0;
+                            stream_client.frame_queue.pop_front();
+                        }
+                    }
+                    send_frames.clear();
+                }
+            }
+
+            if (client_done)
+            {
+                close_socket(stream_client.client_socket);
+                {
+                    std::lock_guard<std::mutex> locker(m_client_mutex);
+                    client_list.erase(iter++);
+                }
+                m_client_count = static_cast<uint32_t>(client_list.size());
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        if (0 != (poll_fds[0].revents & POLLIN))
+        {
+            while (true)
+            {
+                socket_t client_socket = accept_client_socket(stream_server.listen_socket);
+                if (BAD_SOCKET == client_socket)
+                {
+                    break;
+                }
+                if (client_list.size() >= STREAM_CLIENT_MAX)
+                {
+                    RUN_LOG_WAR("stream exporter refuses a client while (%u) are connected", static_cast<uint32_t>(client_list.size()));
+                    close_socket(client_socket);
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> locker(m_client_mutex);
+                    client_list.push_back(StreamClient());
+                    client_list.back().client_socket = client_socket;
+                }
+                m_client_count = static_cast<uint32_t>(client_list.size());
+            }
+        }
+    }
+#endif // _MSC_VER
+}
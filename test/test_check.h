@@ -0,0 +1,31 @@
+/********************************************************
+ * Description : check macro of the tests, a test returns the failure count from main
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_TEST_CHECK_H
+#define RESOURCE_TEST_CHECK_H
+
+
+#include <cstdio>
+
+static int s_test_failure_count = 0;
+
+#define TEST_CHECK(condition)                                                           \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(condition))                                                               \
+        {                                                                               \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);        \
+            ++s_test_failure_count;                                                     \
+        }                                                                               \
+    } while (false)
+
+#define TEST_RESULT()                   (0 == s_test_failure_count ? 0 : 1)
+
+
+#endif // RESOURCE_TEST_CHECK_H
@@ -0,0 +1,140 @@
+/********************************************************
+ * Description : batched inserts and erases of the flat containers
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <set>
+#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "flat_container.h"
+#include "test_check.h"
+
+#define TEST_ROUND_COUNT                2000
+#define TEST_KEY_RANGE                  300
+
+static bool same_items(const FlatMap<uint32_t, uint32_t> & flat_map, const std::map<uint32_t, uint32_t> & std_map)
+{
+    if (flat_map.size() != std_map.size())
+    {
+        return (false);
+    }
+    std::map<uint32_t, uint32_t>::const_iterator iter_std = std_map.begin();
+    for (FlatMap<uint32_t, uint32_t>::const_iterator iter = flat_map.begin(); flat_map.end() != iter; ++iter, ++iter_std)
+    {
+        if (iter->first != iter_std->first || iter->second != iter_std->second)
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+static bool same_items(const FlatSet<uint32_t> & flat_set, const std::set<uint32_t> & std_set)
+{
+    return (flat_set.size() == std_set.size() && std::equal(flat_set.begin(), flat_set.end(), std_set.begin()));
+}
+
+static void test_edges()
+{
+    FlatMap<uint32_t, uint32_t> flat_map;
+    flat_map.merge_pending();
+    TEST_CHECK(flat_map.empty());
+
+    /* a pending key is not found until the merge */
+    flat_map.insert_pending(std::make_pair(5u, 50u)).second = 55;
+    TEST_CHECK(flat_map.end() == flat_map.find(5));
+    flat_map.merge_pending();
+    TEST_CHECK(flat_map.end() != flat_map.find(5) && 55 == flat_map.find(5)->second);
+
+    /* keys before, between and after the present ones */
+    flat_map.insert_pending(std::make_pair(9u, 90u));
+    flat_map.insert_pending(std::make_pair(1u, 10u));
+    flat_map.insert_pending(std::make_pair(7u, 70u));
+    flat_map.merge_pending();
+    TEST_CHECK(4 == flat_map.size() && 1 == flat_map.begin()->first && 9 == (flat_map.end() - 1)->first);
+
+    const uint32_t no_keys[1] = { 0 };
+    TEST_CHECK(0 == flat_map.erase_keys(no_keys, no_keys));
+    const uint32_t drop_keys[4] = { 0, 5, 6, 9 };
+    TEST_CHECK(2 == flat_map.erase_keys(drop_keys, drop_keys + 4));
+    TEST_CHECK(2 == flat_map.size() && 1 == flat_map.begin()->first && 7 == (flat_map.begin() + 1)->first);
+
+    /* clear drops the pending keys too */
+    flat_map.insert_pending(std::make_pair(3u, 30u));
+    flat_map.clear();
+    flat_map.merge_pending();
+    TEST_CHECK(flat_map.empty());
+}
+
+/*
+ * random rounds of pending inserts and sorted erases against std::map / std::set
+ */
+static void test_random_rounds()
+{
+    FlatMap<uint32_t, uint32_t> flat_map;
+    FlatSet<uint32_t> flat_set;
+    std::map<uint32_t, uint32_t> std_map;
+    std::set<uint32_t> std_set;
+    std::vector<uint32_t> drop_keys;
+    int mismatch_count = 0;
+
+    srand(1);
+    for (uint32_t round_index = 0; round_index < TEST_ROUND_COUNT; ++round_index)
+    {
+        const uint32_t insert_count = rand() % 20;
+        for (uint32_t insert_index = 0; insert_index < insert_count; ++insert_index)
+        {
+            const uint32_t key = rand() % TEST_KEY_RANGE;
+            if (std_map.insert(std::make_pair(key, round_index)).second)
+            {
+                flat_map.insert_pending(std::make_pair(key, round_index));
+            }
+            if (std_set.insert(key).second)
+            {
+                flat_set.insert_pending(key);
+            }
+        }
+        flat_map.merge_pending();
+        flat_set.merge_pending();
+
+        drop_keys.clear();
+        const uint32_t drop_count = rand() % 20;
+        for (uint32_t drop_index = 0; drop_index < drop_count; ++drop_index)
+        {
+            drop_keys.push_back(rand() % TEST_KEY_RANGE);
+        }
+        std::sort(drop_keys.begin(), drop_keys.end());
+
+        std::size_t std_erase_count = 0;
+        std::size_t std_set_erase_count = 0;
+        for (std::vector<uint32_t>::const_iterator iter = drop_keys.begin(); drop_keys.end() != iter; ++iter)
+        {
+            std_erase_count += std_map.erase(*iter);
+            std_set_erase_count += std_set.erase(*iter);
+        }
+        if (std_erase_count != flat_map.erase_keys(drop_keys.begin(), drop_keys.end())
+            || std_set_erase_count != flat_set.erase_keys(drop_keys.begin(), drop_keys.end())
+            || !same_items(flat_map, std_map) || !same_items(flat_set, std_set))
+        {
+            ++mismatch_count;
+        }
+    }
+
+    TEST_CHECK(0 == mismatch_count);
+}
+
+int main()
+{
+    test_edges();
+    test_random_rounds();
+
+    return (TEST_RESULT());
+}
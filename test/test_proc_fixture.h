@@ -0,0 +1,116 @@
+/********************************************************
+ * Description : a small proc and sys tree on disk for init(proc_root, sys_root)
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#ifndef RESOURCE_TEST_PROC_FIXTURE_H
+#define RESOURCE_TEST_PROC_FIXTURE_H
+
+
+#ifndef _MSC_VER
+
+#include <ftw.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FIXTURE_CPU_COUNT               2
+#define FIXTURE_MEM_TOTAL_KB            8000000
+#define FIXTURE_MEM_AVAILABLE_KB        6000000
+#define FIXTURE_GPU_NAME                "Fixture GPU"
+#define FIXTURE_GPU_MEM_TOTAL           4294967296ULL
+#define FIXTURE_GPU_BUSY_PERCENT        25
+
+static bool write_fixture_file(const std::string & file_path, const std::string & content)
+{
+    FILE * file = fopen(file_path.c_str(), "wb");
+    if (nullptr == file)
+    {
+        return (false);
+    }
+    bool ret = (content.size() == fwrite(content.data(), 1, content.size(), file));
+    fclose(file);
+    return (ret);
+}
+
+/*
+ * writes <proc_root>/<pid>/stat, the fields after comm as parse_process_stat counts them;
+ * the file is rewritten in place, so a stat fd the monitor keeps open reads the new values
+ */
+static bool write_fixture_process(const std::string & proc_root, uint32_t process_id, uint32_t parent_process_id, uint64_t start_time, uint64_t resident_pages, uint64_t minor_faults, uint64_t major_faults)
+{
+    char process_path[64] = { 0x0 };
+    snprintf(process_path, sizeof(process_path), "/%u", process_id);
+    mkdir((proc_root + process_path).c_str(), 0755);
+
+    char stat_line[256] = { 0x0 };
+    snprintf(stat_line, sizeof(stat_line), "%u (fixture %u) S %u %u %u 0 -1 4194304 %llu 0 %llu 0 10 5 0 0 20 0 1 0 %llu 1000000 %llu 0 0 0\n",
+        process_id, process_id, parent_process_id, process_id, process_id, static_cast<unsigned long long>(minor_faults), static_cast<unsigned long long>(major_faults),
+        static_cast<unsigned long long>(start_time), static_cast<unsigned long long>(resident_pages));
+    return (write_fixture_file(proc_root + process_path + "/stat", stat_line));
+}
+
+/*
+ * root/proc: stat with FIXTURE_CPU_COUNT cpus, meminfo, net/dev; root/sys: one drm card with sysfs memory and busy counters;
+ * return: false if any file could not be made
+ */
+static bool make_proc_fixture(const std::string & root)
+{
+    const std::string proc_root(root + "/proc");
+    const std::string device_path(root + "/sys/class/drm/card0/device");
+
+    bool ret = true;
+    ret = (0 == mkdir(proc_root.c_str(), 0755)) && ret;
+    ret = (0 == mkdir((proc_root + "/net").c_str(), 0755)) && ret;
+    ret = (0 == mkdir((root + "/sys").c_str(), 0755)) && ret;
+    ret = (0 == mkdir((root + "/sys/class").c_str(), 0755)) && ret;
+    ret = (0 == mkdir((root + "/sys/class/drm").c_str(), 0755)) && ret;
+    ret = (0 == mkdir((root + "/sys/class/drm/card0").c_str(), 0755)) && ret;
+    ret = (0 == mkdir(device_path.c_str(), 0755)) && ret;
+
+    ret = write_fixture_file(proc_root + "/stat", "cpu  100 0 100 800 0 0 0 0 0 0\ncpu0 50 0 50 400 0 0 0 0 0 0\ncpu1 50 0 50 400 0 0 0 0 0 0\nintr 0\n") && ret;
+    ret = write_fixture_file(proc_root + "/meminfo", "MemTotal:        8000000 kB\nMemFree:         1000000 kB\nMemAvailable:    6000000 kB\nBuffers:          100000 kB\nCached:          2000000 kB\n") && ret;
+    ret = write_fixture_file(proc_root + "/net/dev",
+        "Inter-|   Receive                                                |  Transmit\n"
+        " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n"
+        "    lo: 1000 10 0 0 0 0 0 0 1000 10 0 0 0 0 0 0\n"
+        "  eth0: 5000 50 0 0 0 0 0 0 3000 30 0 0 0 0 0 0\n") && ret;
+
+    ret = write_fixture_file(device_path + "/product_name", FIXTURE_GPU_NAME "\n") && ret;
+    ret = write_fixture_file(device_path + "/mem_info_vram_total", "4294967296\n") && ret;
+    ret = write_fixture_file(device_path + "/mem_info_vram_used", "1073741824\n") && ret;
+    ret = write_fixture_file(device_path + "/gpu_busy_percent", "25\n") && ret;
+
+    return (ret);
+}
+
+static int remove_fixture_entry(const char * path, const struct stat *, int, struct FTW *)
+{
+    return (::remove(path));
+}
+
+static void remove_proc_fixture(const std::string & root)
+{
+    nftw(root.c_str(), &remove_fixture_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/*
+ * return: a new empty directory under the temp directory, empty on failure
+ */
+static std::string make_fixture_root()
+{
+    char root[] = "/tmp/resource_monitor_fixture_XXXXXX";
+    return (nullptr != mkdtemp(root) ? std::string(root) : std::string());
+}
+
+#endif // _MSC_VER
+
+
+#endif // RESOURCE_TEST_PROC_FIXTURE_H
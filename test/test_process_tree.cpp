@@ -0,0 +1,440 @@
+/********************************************************
+ * Description : tree attribution of update_process_tree against a reference on random fixture trees
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <iterator>
+#include "../src/resource_monitor_impl.cpp"
+#include "test_proc_fixture.h"
+#include "test_check.h"
+
+/*
+ * every round spawns TEST_SPAWN_COUNT processes under random live parents, in a pid space of TEST_PID_MAX so pids wrap around and are reused;
+ * an exited parent leaves its children to pid 1 half of the time, otherwise they keep its pid as their parent (as windows does,
+ * or a stat read racing the reparent), which a later process may then hold: a reused parent
+ */
+#define TEST_ROUND_COUNT                30
+#define TEST_SPAWN_COUNT                500
+#define TEST_PID_MAX                    400
+#define TEST_LIVE_MAX                   (TEST_PID_MAX / 2)
+#define TEST_TREE_ROOT_MAX              6
+#define TEST_REPARENT_PER_MILLE         100
+
+struct FixtureProcess
+{
+    uint32_t                                parent_process_id;
+    uint64_t                                start_time;
+};
+
+typedef std::map<uint32_t, FixtureProcess> fixture_table_t;
+typedef std::map<uint32_t, std::set<uint32_t>> fixture_set_map_t;
+
+static uint32_t random_process_id(const fixture_table_t & process_table)
+{
+    fixture_table_t::const_iterator iter = process_table.begin();
+    std::advance(iter, rand() % process_table.size());
+    return (iter->first);
+}
+
+static void make_process_table(fixture_table_t & process_table)
+{
+    process_table.clear();
+    process_table[1].parent_process_id = 0;
+    process_table[1].start_time = 0;
+
+    uint32_t next_process_id = 1;
+    uint32_t last_process_id = 1;
+    uint64_t start_time = 0;
+    for (uint32_t spawn_index = 0; spawn_index < TEST_SPAWN_COUNT; ++spawn_index)
+    {
+        if (process_table.size() > 2 && (process_table.size() >= TEST_LIVE_MAX || 0 == rand() % 3))
+        {
+            uint32_t process_id = 1;
+            while (1 == process_id)
+            {
+                process_id = random_process_id(process_table);
+            }
+            process_table.erase(process_id);
+            if (0 == rand() % 2)
+            {
+                for (fixture_table_t::iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+                {
+                    if (process_id == iter->second.parent_process_id)
+                    {
+                        iter->second.parent_process_id = 1;
+                    }
+                }
+            }
+        }
+
+        /* processes started in the same clock tick tie */
+        start_time += rand() % 3;
+        do
+        {
+            next_process_id = next_process_id % TEST_PID_MAX + 1 + rand() % 4;
+        } while (next_process_id > TEST_PID_MAX || process_table.end() != process_table.find(next_process_id));
+
+        /* half of the processes start under the one before them, so chains get deep and parents tie with their children */
+        FixtureProcess fixture_process;
+        fixture_process.parent_process_id = (process_table.end() != process_table.find(last_process_id) && 0 == rand() % 2 ? last_process_id : random_process_id(process_table));
+        fixture_process.start_time = start_time;
+        process_table[next_process_id] = fixture_process;
+        last_process_id = next_process_id;
+    }
+}
+
+static bool write_process_table(const std::string & proc_root, const fixture_table_t & process_table)
+{
+    bool ret = true;
+    for (fixture_table_t::const_iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+    {
+        ret = write_fixture_process(proc_root, iter->first, iter->second.parent_process_id, iter->second.start_time, 1, 0, 0) && ret;
+    }
+    return (ret);
+}
+
+/*
+ * the reference walks up instead of down: a process belongs to the first tree root on its parent chain,
+ * every step below that root needs a parent that started no later than the child
+ */
+static bool find_reference_owner(const fixture_table_t & process_table, const std::set<uint32_t> & tree_root_set, uint32_t process_id, uint32_t & process_owner)
+{
+    uint32_t child_process_id = process_id;
+    for (std::size_t step_index = 0; step_index <= process_table.size(); ++step_index)
+    {
+        const FixtureProcess & child_process = process_table.find(child_process_id)->second;
+        const uint32_t parent_process_id = child_process.parent_process_id;
+        fixture_table_t::const_iterator iter_parent = process_table.find(parent_process_id);
+        if (parent_process_id == child_process_id || process_table.end() == iter_parent)
+        {
+            return (false);
+        }
+        if (tree_root_set.end() != tree_root_set.find(parent_process_id))
+        {
+            process_owner = parent_process_id;
+            return (true);
+        }
+        if (child_process.start_time < iter_parent->second.start_time)
+        {
+            return (false);
+        }
+        child_process_id = parent_process_id;
+    }
+    return (false);
+}
+
+static void make_reference_owners(const fixture_table_t & process_table, const std::set<uint32_t> & tree_root_set, std::map<uint32_t, uint32_t> & process_owner_map)
+{
+    process_owner_map.clear();
+    for (fixture_table_t::const_iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+    {
+        uint32_t process_owner = 0;
+        if (tree_root_set.end() == tree_root_set.find(iter->first) && find_reference_owner(process_table, tree_root_set, iter->first, process_owner))
+        {
+            process_owner_map[iter->first] = process_owner;
+        }
+    }
+}
+
+/*
+ * a nested tree root is a leaf of its parent when the parent is walked and the step to the root passes the start time check,
+ * then every leaf set takes the leaf sets of its members
+ */
+static void make_reference_leaves(const fixture_table_t & process_table, const std::set<uint32_t> & tree_root_set, const std::map<uint32_t, uint32_t> & process_owner_map, fixture_set_map_t & process_leaf_map)
+{
+    process_leaf_map.clear();
+    for (std::set<uint32_t>::const_iterator iter_root = tree_root_set.begin(); tree_root_set.end() != iter_root; ++iter_root)
+    {
+        const FixtureProcess & root_process = process_table.find(*iter_root)->second;
+        const uint32_t parent_process_id = root_process.parent_process_id;
+        fixture_table_t::const_iterator iter_parent = process_table.find(parent_process_id);
+        if (parent_process_id == *iter_root || process_table.end() == iter_parent)
+        {
+            continue;
+        }
+        const bool parent_is_root = (tree_root_set.end() != tree_root_set.find(parent_process_id));
+        if (!parent_is_root && (process_owner_map.end() == process_owner_map.find(parent_process_id) || root_process.start_time < iter_parent->second.start_time))
+        {
+            continue;
+        }
+        process_leaf_map[parent_process_id].insert(*iter_root);
+    }
+
+    fixture_set_map_t direct_leaf_map(process_leaf_map);
+    for (fixture_set_map_t::iterator iter_leaf = process_leaf_map.begin(); process_leaf_map.end() != iter_leaf; ++iter_leaf)
+    {
+        std::vector<uint32_t> process_list(iter_leaf->second.begin(), iter_leaf->second.end());
+        for (std::size_t process_index = 0; process_index < process_list.size(); ++process_index)
+        {
+            fixture_set_map_t::const_iterator iter_sub_leaf = direct_leaf_map.find(process_list[process_index]);
+            if (direct_leaf_map.end() == iter_sub_leaf)
+            {
+                continue;
+            }
+            for (std::set<uint32_t>::const_iterator iter = iter_sub_leaf->second.begin(); iter_sub_leaf->second.end() != iter; ++iter)
+            {
+                if (iter_leaf->second.insert(*iter).second)
+                {
+                    process_list.push_back(*iter);
+                }
+            }
+        }
+    }
+}
+
+template <typename flat_set_t>
+static bool same_process_set(const flat_set_t & process_set, const std::set<uint32_t> & reference_set)
+{
+    if (process_set.size() != reference_set.size())
+    {
+        return (false);
+    }
+    typename flat_set_t::const_iterator iter = process_set.begin();
+    for (std::set<uint32_t>::const_iterator iter_reference = reference_set.begin(); reference_set.end() != iter_reference; ++iter_reference, ++iter)
+    {
+        if (*iter != *iter_reference)
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+/*
+ * return: count of tables of system_snapshot that differ from the reference descendant sets and leaf sets
+ */
+static int compare_attribution(const SystemSnapshot & system_snapshot, const fixture_set_map_t & descendant_set_map, const fixture_set_map_t & process_leaf_map)
+{
+    int mismatch_count = 0;
+
+    std::set<uint32_t> helper_set;
+    for (fixture_set_map_t::const_iterator iter = descendant_set_map.begin(); descendant_set_map.end() != iter; ++iter)
+    {
+        FlatMap<uint32_t, ProcessTree>::const_iterator iter_tree = system_snapshot.process_tree_map.find(iter->first);
+        if (system_snapshot.process_tree_map.end() == iter_tree || !same_process_set(iter_tree->second.process_descendant_set, iter->second))
+        {
+            ++mismatch_count;
+        }
+        helper_set.insert(iter->second.begin(), iter->second.end());
+    }
+
+    std::set<uint32_t> helper_key_set;
+    for (FlatMap<uint32_t, ProcessHelper>::const_iterator iter = system_snapshot.process_helper_map.begin(); system_snapshot.process_helper_map.end() != iter; ++iter)
+    {
+        helper_key_set.insert(iter->first);
+    }
+    if (helper_set != helper_key_set)
+    {
+        ++mismatch_count;
+    }
+
+    if (system_snapshot.process_leaf_map.size() != process_leaf_map.size())
+    {
+        ++mismatch_count;
+    }
+    for (fixture_set_map_t::const_iterator iter = process_leaf_map.begin(); process_leaf_map.end() != iter; ++iter)
+    {
+        FlatMap<uint32_t, ProcessLeaf>::const_iterator iter_leaf = system_snapshot.process_leaf_map.find(iter->first);
+        if (system_snapshot.process_leaf_map.end() == iter_leaf || !same_process_set(iter_leaf->second.process_descendant_set, iter->second))
+        {
+            ++mismatch_count;
+        }
+    }
+
+    return (mismatch_count);
+}
+
+/*
+ * descendant sets of the reference: the root itself, what it owns now, and what it owned before and nobody owns now,
+ * since a process only leaves its tree when it exits or another tree claims it
+ */
+static void make_reference_descendants(const std::set<uint32_t> & tree_root_set, const std::map<uint32_t, uint32_t> & process_owner_map, const std::map<uint32_t, uint32_t> & last_owner_map, fixture_set_map_t & descendant_set_map)
+{
+    descendant_set_map.clear();
+    for (std::set<uint32_t>::const_iterator iter = tree_root_set.begin(); tree_root_set.end() != iter; ++iter)
+    {
+        descendant_set_map[*iter].insert(*iter);
+    }
+    for (std::map<uint32_t, uint32_t>::const_iterator iter = process_owner_map.begin(); process_owner_map.end() != iter; ++iter)
+    {
+        descendant_set_map[iter->second].insert(iter->first);
+    }
+    for (std::map<uint32_t, uint32_t>::const_iterator iter = last_owner_map.begin(); last_owner_map.end() != iter; ++iter)
+    {
+        if (process_owner_map.end() == process_owner_map.find(iter->first))
+        {
+            descendant_set_map[iter->second].insert(iter->first);
+        }
+    }
+}
+
+struct AttributionCoverage
+{
+    uint32_t                                wrapped_count;        /* attributed processes with a lower pid than their parent */
+    uint32_t                                reused_count;         /* processes cut off by a parent that started after them */
+    uint32_t                                nested_count;         /* tree roots that are leaves of another process */
+    uint32_t                                tied_count;           /* attributed processes that started in the same tick as their parent */
+};
+
+static void count_coverage(const fixture_table_t & process_table, const std::set<uint32_t> & tree_root_set, const std::map<uint32_t, uint32_t> & process_owner_map, const fixture_set_map_t & process_leaf_map, AttributionCoverage & attribution_coverage)
+{
+    for (std::map<uint32_t, uint32_t>::const_iterator iter = process_owner_map.begin(); process_owner_map.end() != iter; ++iter)
+    {
+        if (iter->first < process_table.find(iter->first)->second.parent_process_id)
+        {
+            ++attribution_coverage.wrapped_count;
+        }
+    }
+    for (fixture_table_t::const_iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+    {
+        const uint32_t parent_process_id = iter->second.parent_process_id;
+        fixture_table_t::const_iterator iter_parent = process_table.find(parent_process_id);
+        if (process_table.end() != iter_parent && tree_root_set.end() == tree_root_set.find(parent_process_id)
+            && process_owner_map.end() != process_owner_map.find(parent_process_id) && iter->second.start_time < iter_parent->second.start_time)
+        {
+            ++attribution_coverage.reused_count;
+        }
+    }
+    for (fixture_set_map_t::const_iterator iter = process_leaf_map.begin(); process_leaf_map.end() != iter; ++iter)
+    {
+        attribution_coverage.nested_count += static_cast<uint32_t>(iter->second.size());
+    }
+    for (std::map<uint32_t, uint32_t>::const_iterator iter = process_owner_map.begin(); process_owner_map.end() != iter; ++iter)
+    {
+        const FixtureProcess & fixture_process = process_table.find(iter->first)->second;
+        fixture_table_t::const_iterator iter_parent = process_table.find(fixture_process.parent_process_id);
+        if (iter->second != fixture_process.parent_process_id && fixture_process.start_time == iter_parent->second.start_time)
+        {
+            ++attribution_coverage.tied_count;
+        }
+    }
+}
+
+static void close_process_helpers(SystemSnapshot & system_snapshot)
+{
+    FlatMap<uint32_t, ProcessHelper> & process_helper_map = system_snapshot.process_helper_map;
+    for (FlatMap<uint32_t, ProcessHelper>::iterator iter = process_helper_map.begin(); process_helper_map.end() != iter; ++iter)
+    {
+        close_process_helper(iter->first, iter->second);
+    }
+    close(system_snapshot.system_helper.proc_root_fd);
+    system_snapshot.system_helper.proc_root_fd = -1;
+}
+
+/*
+ * a pass on a new table, the same pass again (nothing may move), then a pass after some processes got new parents
+ */
+static void test_attribution_round(const std::string & root, AttributionCoverage & attribution_coverage)
+{
+    const std::string proc_root(root + "/proc");
+    TEST_CHECK(make_proc_fixture(root));
+
+    fixture_table_t process_table;
+    make_process_table(process_table);
+    TEST_CHECK(write_process_table(proc_root, process_table));
+
+    /* most later tree roots are children of the root before them, so trees nest several levels deep */
+    std::set<uint32_t> tree_root_set;
+    const std::size_t tree_root_count = 1 + rand() % TEST_TREE_ROOT_MAX;
+    uint32_t last_root_id = 0;
+    while (tree_root_set.size() < tree_root_count)
+    {
+        uint32_t process_id = random_process_id(process_table);
+        if (0 != last_root_id && 0 != rand() % 4)
+        {
+            std::vector<uint32_t> child_process_list;
+            for (fixture_table_t::const_iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+            {
+                if (last_root_id == iter->second.parent_process_id)
+                {
+                    child_process_list.push_back(iter->first);
+                }
+            }
+            if (!child_process_list.empty())
+            {
+                process_id = child_process_list[rand() % child_process_list.size()];
+            }
+        }
+        if (1 != process_id && tree_root_set.insert(process_id).second)
+        {
+            last_root_id = process_id;
+        }
+    }
+
+    SystemSnapshot system_snapshot;
+    system_snapshot.system_helper.proc_root = proc_root;
+    system_snapshot.system_helper.proc_root_fd = open(proc_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    TEST_CHECK(system_snapshot.system_helper.proc_root_fd >= 0);
+    for (std::set<uint32_t>::const_iterator iter = tree_root_set.begin(); tree_root_set.end() != iter; ++iter)
+    {
+        TEST_CHECK(append_process_to_monitor(system_snapshot, *iter, true));
+    }
+
+    std::map<uint32_t, uint32_t> process_owner_map;
+    fixture_set_map_t process_leaf_map;
+    fixture_set_map_t descendant_set_map;
+    make_reference_owners(process_table, tree_root_set, process_owner_map);
+    make_reference_leaves(process_table, tree_root_set, process_owner_map, process_leaf_map);
+    make_reference_descendants(tree_root_set, process_owner_map, std::map<uint32_t, uint32_t>(), descendant_set_map);
+    count_coverage(process_table, tree_root_set, process_owner_map, process_leaf_map, attribution_coverage);
+
+    TEST_CHECK(update_process_tree(system_snapshot));
+    TEST_CHECK(0 == compare_attribution(system_snapshot, descendant_set_map, process_leaf_map));
+    TEST_CHECK(update_process_tree(system_snapshot));
+    TEST_CHECK(0 == compare_attribution(system_snapshot, descendant_set_map, process_leaf_map));
+
+    /* start times stay, so the stat fds of the helpers read the new parents and nothing looks reused */
+    for (fixture_table_t::iterator iter = process_table.begin(); process_table.end() != iter; ++iter)
+    {
+        if (1 != iter->first && tree_root_set.end() == tree_root_set.find(iter->first) && rand() % 1000 < TEST_REPARENT_PER_MILLE)
+        {
+            iter->second.parent_process_id = random_process_id(process_table);
+        }
+    }
+    TEST_CHECK(write_process_table(proc_root, process_table));
+
+    const std::map<uint32_t, uint32_t> last_owner_map(process_owner_map);
+    make_reference_owners(process_table, tree_root_set, process_owner_map);
+    make_reference_leaves(process_table, tree_root_set, process_owner_map, process_leaf_map);
+    make_reference_descendants(tree_root_set, process_owner_map, last_owner_map, descendant_set_map);
+    count_coverage(process_table, tree_root_set, process_owner_map, process_leaf_map, attribution_coverage);
+
+    TEST_CHECK(update_process_tree(system_snapshot));
+    TEST_CHECK(0 == compare_attribution(system_snapshot, descendant_set_map, process_leaf_map));
+
+    close_process_helpers(system_snapshot);
+}
+
+int main()
+{
+    srand(1);
+
+    AttributionCoverage attribution_coverage = { 0, 0, 0, 0 };
+    for (uint32_t round_index = 0; round_index < TEST_ROUND_COUNT; ++round_index)
+    {
+        const std::string root(make_fixture_root());
+        TEST_CHECK(!root.empty());
+        if (root.empty())
+        {
+            break;
+        }
+        test_attribution_round(root, attribution_coverage);
+        remove_proc_fixture(root);
+    }
+
+    /* the rounds must have hit what the start time check and the downward walk are for */
+    TEST_CHECK(0 != attribution_coverage.wrapped_count);
+    TEST_CHECK(0 != attribution_coverage.reused_count);
+    TEST_CHECK(0 != attribution_coverage.nested_count);
+    TEST_CHECK(0 != attribution_coverage.tied_count);
+
+    return (TEST_RESULT());
+}
@@ -0,0 +1,137 @@
+/********************************************************
+ * Description : windowed statistics of the sample history
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "resource_history.h"
+#include "test_check.h"
+
+#define TEST_SAMPLE_CAPACITY            200
+#define TEST_SAMPLE_COUNT               20000
+
+static void append_cpu_usage(ResourceHistory & resource_history, uint64_t sample_time, double cpu_usage)
+{
+    double metric_values[RESOURCE_METRIC_COUNT] = { cpu_usage, 0.0, 0.0, 0.0 };
+    resource_history.append(sample_time, metric_values);
+}
+
+static void test_init_and_empty()
+{
+    ResourceHistory resource_history;
+    const uint32_t window_ms[RESOURCE_HISTORY_WINDOW_MAX + 1] = { 100, 200, 300, 400, 500 };
+    const uint32_t zero_window_ms[1] = { 0 };
+
+    TEST_CHECK(!resource_history.init(0, window_ms, 1));
+    TEST_CHECK(!resource_history.init(10, nullptr, 1));
+    TEST_CHECK(!resource_history.init(10, window_ms, 0));
+    TEST_CHECK(!resource_history.init(10, window_ms, RESOURCE_HISTORY_WINDOW_MAX + 1));
+    TEST_CHECK(!resource_history.init(10, zero_window_ms, 1));
+    TEST_CHECK(resource_history.init(10, window_ms, 2));
+
+    ResourceStatistics resource_statistics;
+    TEST_CHECK(!resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, 0, resource_statistics));
+
+    append_cpu_usage(resource_history, 1000, 5.0);
+    TEST_CHECK(resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, 0, resource_statistics));
+    TEST_CHECK(!resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, 2, resource_statistics));
+    TEST_CHECK(!resource_history.get_statistics(RESOURCE_METRIC_COUNT, 0, resource_statistics));
+
+    resource_history.clear();
+    TEST_CHECK(!resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, 0, resource_statistics));
+}
+
+static void test_fixed_window()
+{
+    ResourceHistory resource_history;
+    const uint32_t window_ms[1] = { 300 };
+    TEST_CHECK(resource_history.init(10, window_ms, 1));
+
+    /* 1000 .. 1500 every 100 ms: the window at 1500 keeps 1300, 1400 and 1500 */
+    const double cpu_usages[6] = { 9.0, 1.0, 7.0, 4.0, 2.0, 6.0 };
+    for (std::size_t sample_index = 0; sample_index < 6; ++sample_index)
+    {
+        append_cpu_usage(resource_history, 1000 + sample_index * 100, cpu_usages[sample_index]);
+    }
+
+    ResourceStatistics resource_statistics;
+    TEST_CHECK(resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, 0, resource_statistics));
+    TEST_CHECK(3 == resource_statistics.sample_count);
+    TEST_CHECK(2.0 == resource_statistics.min_value);
+    TEST_CHECK(6.0 == resource_statistics.max_value);
+    TEST_CHECK(std::fabs(resource_statistics.mean_value - 4.0) < 1e-9);
+    TEST_CHECK(resource_statistics.p99_value >= 6.0 * 0.875 && resource_statistics.p99_value <= 6.0);
+}
+
+/*
+ * random times and values against a plain scan of the last samples, for windows shorter and longer than the capacity
+ */
+static void test_random_windows()
+{
+    ResourceHistory resource_history;
+    const uint32_t window_ms[3] = { 50, 300, 100000 };
+    TEST_CHECK(resource_history.init(TEST_SAMPLE_CAPACITY, window_ms, 3));
+
+    std::vector<std::pair<uint64_t, double>> samples;
+    uint64_t sample_time = 1000;
+    int mismatch_count = 0;
+
+    srand(1);
+    for (uint32_t sample_index = 0; sample_index < TEST_SAMPLE_COUNT; ++sample_index)
+    {
+        sample_time += 1 + rand() % 5;
+        const double cpu_usage = (rand() % 10000) / 10.0;
+        append_cpu_usage(resource_history, sample_time, cpu_usage);
+        samples.push_back(std::make_pair(sample_time, cpu_usage));
+
+        const std::size_t first_index = (samples.size() > TEST_SAMPLE_CAPACITY ? samples.size() - TEST_SAMPLE_CAPACITY : 0);
+        for (std::size_t window_index = 0; window_index < 3; ++window_index)
+        {
+            uint64_t sample_count = 0;
+            double min_value = 0.0;
+            double max_value = 0.0;
+            double value_sum = 0.0;
+            for (std::size_t index = first_index; index < samples.size(); ++index)
+            {
+                if (samples[index].first + window_ms[window_index] <= sample_time)
+                {
+                    continue;
+                }
+                const double value = samples[index].second;
+                min_value = (0 == sample_count ? value : std::min(min_value, value));
+                max_value = (0 == sample_count ? value : std::max(max_value, value));
+                value_sum += value;
+                ++sample_count;
+            }
+
+            ResourceStatistics resource_statistics;
+            if (!resource_history.get_statistics(RESOURCE_METRIC_CPU_USAGE, window_index, resource_statistics)
+                || sample_count != resource_statistics.sample_count
+                || min_value != resource_statistics.min_value
+                || max_value != resource_statistics.max_value
+                || std::fabs(value_sum / sample_count - resource_statistics.mean_value) > 1e-6)
+            {
+                ++mismatch_count;
+            }
+        }
+    }
+
+    TEST_CHECK(0 == mismatch_count);
+}
+
+int main()
+{
+    test_init_and_empty();
+    test_fixed_window();
+    test_random_windows();
+
+    return (TEST_RESULT());
+}
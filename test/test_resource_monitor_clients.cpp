@@ -0,0 +1,326 @@
+/********************************************************
+ * Description : several monitors on one shared collector engine
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "resource_monitor.h"
+#include "test_proc_fixture.h"
+#include "test_check.h"
+
+#define TEST_COLLECTOR_INTERVAL_MS      100
+#define TEST_DEFAULT_INTERVAL_MS        5000    /* COLLECTOR_DEFAULT_INTERVAL_MS of a new engine */
+#define TEST_WAIT_MS                    5000
+#define TEST_SNAPSHOT_RETENTION         8
+
+/*
+ * return: true once process_id holds ram_usage in a published snapshot, false after TEST_WAIT_MS
+ */
+static bool wait_for_process_ram(ResourceMonitor & resource_monitor, uint32_t process_id, uint64_t ram_usage)
+{
+    uint64_t sample_sequence = 0;
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_WAIT_MS);
+    while (std::chrono::steady_clock::now() < end_time)
+    {
+        ProcessResource process_resource;
+        if (resource_monitor.get_process_resource(process_id, process_resource) && ram_usage == process_resource.ram_usage)
+        {
+            return (true);
+        }
+        resource_monitor.wait_for_sample(sample_sequence, TEST_COLLECTOR_INTERVAL_MS * 2, sample_sequence);
+    }
+    return (false);
+}
+
+static bool wait_for_flag(const std::atomic<bool> & flag)
+{
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_WAIT_MS);
+    while (std::chrono::steady_clock::now() < end_time && !flag.load())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return (flag.load());
+}
+
+/*
+ * return: true if the engine of resource_monitor publishes a snapshot after the latest one
+ */
+static bool engine_running(ResourceMonitor & resource_monitor)
+{
+    uint64_t last_sequence = 0;
+    uint64_t sample_sequence = 0;
+    return (resource_monitor.wait_for_sample(0, TEST_WAIT_MS, last_sequence) && resource_monitor.wait_for_sample(last_sequence, TEST_WAIT_MS, sample_sequence) && sample_sequence > last_sequence);
+}
+
+static bool same_process_ids(const std::map<uint32_t, ProcessResource> & process_resources, uint32_t process_id, uint32_t other_process_id)
+{
+    return (2 == process_resources.size() && process_resources.end() != process_resources.find(process_id) && process_resources.end() != process_resources.find(other_process_id));
+}
+
+static void exit_on_threshold(ResourceMonitor * resource_monitor, std::atomic<bool> * exited, uint32_t subscription_id, const ResourceThreshold & threshold, bool raised, double value)
+{
+    resource_monitor->exit();
+    exited->store(true);
+}
+
+static void exit_on_process_exit(ResourceMonitor * resource_monitor, std::atomic<bool> * exited, uint32_t process_id)
+{
+    resource_monitor->exit();
+    exited->store(true);
+}
+
+/*
+ * a monitor sees only what it appended, in single reads, batch reads, full reads and snapshot diffs
+ */
+static void test_client_masking(ResourceMonitor & monitor_a, ResourceMonitor & monitor_b)
+{
+    ProcessResource process_resource;
+    TEST_CHECK(!monitor_b.get_process_resource(200, process_resource));
+    TEST_CHECK(!monitor_a.get_process_resource(300, process_resource));
+
+    const uint32_t process_ids[3] = { 100, 200, 300 };
+    ProcessResource process_resources[3];
+    bool process_statuses[3] = { false, false, false };
+    TEST_CHECK(monitor_b.get_process_resources(process_ids, 3, process_resources, process_statuses));
+    TEST_CHECK(process_statuses[0] && !process_statuses[1] && process_statuses[2]);
+    TEST_CHECK(0 == process_resources[1].ram_usage && 0 != process_resources[2].ram_usage);
+
+    std::map<uint32_t, ProcessResource> all_process_resources;
+    TEST_CHECK(monitor_a.get_all_process_resources(all_process_resources));
+    TEST_CHECK(same_process_ids(all_process_resources, 100, 200));
+    TEST_CHECK(monitor_b.get_all_process_resources(all_process_resources));
+    TEST_CHECK(same_process_ids(all_process_resources, 100, 300));
+
+    uint64_t sample_sequence = 0;
+    TEST_CHECK(monitor_a.set_snapshot_retention(TEST_SNAPSHOT_RETENTION));
+    TEST_CHECK(monitor_a.wait_for_sample(0, TEST_WAIT_MS, sample_sequence));
+    TEST_CHECK(monitor_a.wait_for_sample(sample_sequence, TEST_WAIT_MS, sample_sequence));
+
+    std::string snapshot_diff;
+    ResourceSnapshot snapshot_a;
+    TEST_CHECK(monitor_a.get_snapshot_diff(0, 0, snapshot_diff));
+    TEST_CHECK(apply_snapshot_diff(snapshot_diff, snapshot_a));
+    TEST_CHECK(same_process_ids(snapshot_a.process_resources, 100, 200));
+
+    ResourceSnapshot snapshot_b;
+    TEST_CHECK(monitor_b.get_snapshot_diff(0, 0, snapshot_diff));
+    TEST_CHECK(apply_snapshot_diff(snapshot_diff, snapshot_b));
+    TEST_CHECK(same_process_ids(snapshot_b.process_resources, 100, 300));
+}
+
+/*
+ * 100 is appended by both monitors: it stays in the engine until the last of them removes it,
+ * only then may it come back with another tree flag
+ */
+static void test_process_refcount(ResourceMonitor & monitor_a, ResourceMonitor & monitor_b, uint64_t page_size)
+{
+    ProcessResource process_resource;
+
+    TEST_CHECK(monitor_a.remove_process(100));
+    TEST_CHECK(!monitor_a.remove_process(100));
+    TEST_CHECK(!monitor_a.get_process_resource(100, process_resource));
+    TEST_CHECK(!monitor_a.append_process(100, false));
+
+    uint64_t last_sequence = 0;
+    uint64_t sample_sequence = 0;
+    TEST_CHECK(monitor_b.wait_for_sample(0, TEST_WAIT_MS, last_sequence));
+    TEST_CHECK(monitor_b.wait_for_sample(last_sequence, TEST_WAIT_MS, sample_sequence));
+    TEST_CHECK(monitor_b.get_process_resource(100, process_resource));
+    TEST_CHECK((10 + 20) * page_size == process_resource.ram_usage);
+
+    TEST_CHECK(monitor_b.remove_process(100));
+    TEST_CHECK(monitor_a.append_process(100, false));
+    TEST_CHECK(wait_for_process_ram(monitor_a, 100, 10 * page_size));
+    TEST_CHECK(!monitor_b.get_process_resource(100, process_resource));
+}
+
+/*
+ * monitor_b leaves from its own threshold callback while monitor_a stays, its processes and subscriptions go with it
+ */
+static void test_exit_from_threshold_callback(ResourceMonitor & monitor_a, ResourceMonitor & monitor_b)
+{
+    std::atomic<bool> exited(false);
+
+    ResourceThreshold threshold;
+    memset(&threshold, 0x0, sizeof(threshold));
+    threshold.process_id = 300;
+    threshold.metric_type = RESOURCE_METRIC_RAM_USAGE;
+    threshold.raise_value = 1.0;
+    threshold.clear_value = 0.0;
+    threshold.min_duration_ms = 0;
+
+    uint32_t subscription_id = 0;
+    TEST_CHECK(!monitor_a.subscribe_threshold(threshold, std::bind(&exit_on_threshold, &monitor_b, &exited, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4), subscription_id));
+    TEST_CHECK(monitor_b.subscribe_threshold(threshold, std::bind(&exit_on_threshold, &monitor_b, &exited, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4), subscription_id));
+    TEST_CHECK(wait_for_flag(exited));
+
+    ProcessResource process_resource;
+    TEST_CHECK(!monitor_b.get_process_resource(300, process_resource));
+    TEST_CHECK(engine_running(monitor_a));
+
+    /* 300 left the engine with monitor_b, any tree flag is free again */
+    TEST_CHECK(monitor_a.append_process(300, true));
+    TEST_CHECK(monitor_a.remove_process(300));
+}
+
+/*
+ * the engine outlives every exit but the last: a monitor that inits while another is still there shares its intervals,
+ * one that inits after the last exit starts a new engine with the default intervals
+ */
+static void test_last_exit(ResourceMonitor & monitor_a, const std::string & proc_root, const std::string & sys_root)
+{
+    uint32_t interval_ms = 0;
+
+    ResourceMonitor monitor_c;
+    TEST_CHECK(monitor_c.init(proc_root, sys_root));
+    TEST_CHECK(monitor_c.get_collector_interval(RESOURCE_COLLECTOR_PROCESS, interval_ms));
+    TEST_CHECK(TEST_COLLECTOR_INTERVAL_MS == interval_ms);
+
+    monitor_a.exit();
+    TEST_CHECK(!monitor_a.get_collector_interval(RESOURCE_COLLECTOR_PROCESS, interval_ms));
+    TEST_CHECK(engine_running(monitor_c));
+    monitor_c.exit();
+
+    ResourceMonitor monitor_d;
+    TEST_CHECK(monitor_d.init(proc_root, sys_root));
+    TEST_CHECK(monitor_d.get_collector_interval(RESOURCE_COLLECTOR_PROCESS, interval_ms));
+    TEST_CHECK(TEST_DEFAULT_INTERVAL_MS == interval_ms);
+    monitor_d.exit();
+}
+
+static void test_fixture_clients(const std::string & root)
+{
+    const std::string proc_root(root + "/proc");
+    const std::string sys_root(root + "/sys");
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    TEST_CHECK(make_proc_fixture(root));
+    TEST_CHECK(write_fixture_process(proc_root, 100, 1, 1000, 10, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 101, 100, 1100, 20, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 200, 1, 1000, 40, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 300, 1, 1000, 60, 0, 0));
+
+    ResourceMonitor monitor_a;
+    ResourceMonitor monitor_b;
+    const bool monitor_started = monitor_a.init(proc_root, sys_root) && monitor_b.init(proc_root, sys_root);
+    TEST_CHECK(monitor_started);
+    if (!monitor_started)
+    {
+        return;
+    }
+
+    /* intervals belong to the shared engine */
+    for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+    {
+        TEST_CHECK(monitor_a.set_collector_interval(static_cast<ResourceCollectorType>(collector_type), TEST_COLLECTOR_INTERVAL_MS));
+    }
+    uint32_t interval_ms = 0;
+    TEST_CHECK(monitor_b.get_collector_interval(RESOURCE_COLLECTOR_PROCESS_TREE, interval_ms));
+    TEST_CHECK(TEST_COLLECTOR_INTERVAL_MS == interval_ms);
+
+    /* the engine watches a pid with one tree flag, whoever appended it first */
+    TEST_CHECK(monitor_a.append_process(100, true));
+    TEST_CHECK(!monitor_b.append_process(100, false));
+    TEST_CHECK(monitor_b.append_process(100, true));
+    TEST_CHECK(monitor_b.append_process(100, true));
+    TEST_CHECK(monitor_a.append_process(200, false));
+    TEST_CHECK(monitor_b.append_process(300, false));
+
+    TEST_CHECK(wait_for_process_ram(monitor_a, 100, (10 + 20) * page_size));
+    TEST_CHECK(wait_for_process_ram(monitor_a, 200, 40 * page_size));
+    TEST_CHECK(wait_for_process_ram(monitor_b, 300, 60 * page_size));
+
+    test_client_masking(monitor_a, monitor_b);
+    test_process_refcount(monitor_a, monitor_b, page_size);
+    test_exit_from_threshold_callback(monitor_a, monitor_b);
+    test_last_exit(monitor_a, proc_root, sys_root);
+}
+
+/*
+ * a fixture tree has no exit watcher, so a real child on /proc is killed: both monitors leave from their exit callbacks,
+ * the second one is the last client and its engine stops on another thread
+ */
+static void test_exit_from_process_exit_callback()
+{
+    const pid_t child_id = fork();
+    TEST_CHECK(child_id >= 0);
+    if (0 == child_id)
+    {
+        while (true)
+        {
+            pause();
+        }
+    }
+    if (child_id < 0)
+    {
+        return;
+    }
+
+    std::atomic<bool> exited_e(false);
+    std::atomic<bool> exited_f(false);
+
+    ResourceMonitor monitor_e;
+    ResourceMonitor monitor_f;
+    const bool monitor_started = monitor_e.init() && monitor_f.init();
+    TEST_CHECK(monitor_started);
+    if (monitor_started)
+    {
+        TEST_CHECK(monitor_e.append_process(static_cast<uint32_t>(child_id), false));
+        TEST_CHECK(monitor_f.append_process(static_cast<uint32_t>(child_id), false));
+        TEST_CHECK(monitor_e.set_process_exit_callback(std::bind(&exit_on_process_exit, &monitor_e, &exited_e, std::placeholders::_1)));
+        TEST_CHECK(monitor_f.set_process_exit_callback(std::bind(&exit_on_process_exit, &monitor_f, &exited_f, std::placeholders::_1)));
+    }
+
+    kill(child_id, SIGKILL);
+    waitpid(child_id, nullptr, 0);
+
+    if (monitor_started)
+    {
+        TEST_CHECK(wait_for_flag(exited_e));
+        TEST_CHECK(wait_for_flag(exited_f));
+
+        /* a new engine starts while the old one may still be stopping */
+        ResourceMonitor monitor_g;
+        TEST_CHECK(monitor_g.init());
+        uint32_t interval_ms = 0;
+        TEST_CHECK(monitor_g.get_collector_interval(RESOURCE_COLLECTOR_PROCESS, interval_ms));
+        TEST_CHECK(TEST_DEFAULT_INTERVAL_MS == interval_ms);
+        monitor_g.exit();
+
+        /* the detached stop of the old engine has to end before the process does */
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+    monitor_e.exit();
+    monitor_f.exit();
+}
+
+int main()
+{
+    const std::string root(make_fixture_root());
+    TEST_CHECK(!root.empty());
+    if (root.empty())
+    {
+        return (TEST_RESULT());
+    }
+
+    test_fixture_clients(root);
+    remove_proc_fixture(root);
+
+    test_exit_from_process_exit_callback();
+
+    return (TEST_RESULT());
+}
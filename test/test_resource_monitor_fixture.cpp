@@ -0,0 +1,163 @@
+/********************************************************
+ * Description : a monitor started on a fixture proc and sys tree
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <list>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include "resource_monitor.h"
+#include "test_proc_fixture.h"
+#include "test_check.h"
+
+#define TEST_COLLECTOR_INTERVAL_MS      100
+#define TEST_WAIT_MS                    5000
+
+/*
+ * return: true once process_id holds ram_usage in a published snapshot, false after TEST_WAIT_MS
+ */
+static bool wait_for_process_ram(ResourceMonitor & resource_monitor, uint32_t process_id, uint64_t ram_usage)
+{
+    uint64_t sample_sequence = 0;
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_WAIT_MS);
+    while (std::chrono::steady_clock::now() < end_time)
+    {
+        ProcessResource process_resource;
+        if (resource_monitor.get_process_resource(process_id, process_resource) && ram_usage == process_resource.ram_usage)
+        {
+            return (true);
+        }
+        resource_monitor.wait_for_sample(sample_sequence, TEST_COLLECTOR_INTERVAL_MS * 2, sample_sequence);
+    }
+    return (false);
+}
+
+/*
+ * 200 takes minflt from 1000 to 1000000 and keeps majflt at 7: a minor fault rate shows up in the next samples, then drops back to 0
+ */
+static void test_fault_rates(ResourceMonitor & resource_monitor, const std::string & proc_root)
+{
+    TEST_CHECK(write_fixture_process(proc_root, 200, 1, 1000, 40, 1000000, 7));
+
+    bool rate_seen = false;
+    bool rate_dropped = false;
+    uint64_t sample_sequence = 0;
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_WAIT_MS);
+    while (std::chrono::steady_clock::now() < end_time && !rate_dropped)
+    {
+        ProcessResource process_resource;
+        if (resource_monitor.get_process_resource(200, process_resource))
+        {
+            TEST_CHECK(0 == process_resource.major_faults);
+            rate_seen = rate_seen || 0 != process_resource.minor_faults;
+            rate_dropped = rate_seen && 0 == process_resource.minor_faults;
+        }
+        resource_monitor.wait_for_sample(sample_sequence, TEST_COLLECTOR_INTERVAL_MS * 2, sample_sequence);
+    }
+    TEST_CHECK(rate_seen);
+    TEST_CHECK(rate_dropped);
+}
+
+static void test_system_resource(ResourceMonitor & resource_monitor)
+{
+    SystemResource system_resource;
+    TEST_CHECK(resource_monitor.get_system_resource(system_resource));
+    TEST_CHECK(FIXTURE_CPU_COUNT == system_resource.cpu_count);
+    TEST_CHECK(static_cast<uint64_t>(FIXTURE_MEM_TOTAL_KB) * 1024 == system_resource.ram_total);
+    TEST_CHECK(static_cast<uint64_t>(FIXTURE_MEM_TOTAL_KB - FIXTURE_MEM_AVAILABLE_KB) * 1024 == system_resource.ram_usage);
+    TEST_CHECK(1 == system_resource.gpu_count);
+    TEST_CHECK(FIXTURE_GPU_MEM_TOTAL == system_resource.gpu_mem_total);
+
+    std::list<std::string> graphics_card_names;
+    TEST_CHECK(resource_monitor.get_graphics_cards(graphics_card_names));
+    TEST_CHECK(1 == graphics_card_names.size() && FIXTURE_GPU_NAME == graphics_card_names.front());
+
+    /* the gpu collector reads gpu_busy_percent once it is due */
+    uint64_t sample_sequence = 0;
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_WAIT_MS);
+    while (std::chrono::steady_clock::now() < end_time && FIXTURE_GPU_BUSY_PERCENT != system_resource.gpu_3d_usage)
+    {
+        resource_monitor.wait_for_sample(sample_sequence, TEST_COLLECTOR_INTERVAL_MS * 2, sample_sequence);
+        resource_monitor.get_system_resource(system_resource);
+    }
+    TEST_CHECK(FIXTURE_GPU_BUSY_PERCENT == system_resource.gpu_3d_usage);
+}
+
+/*
+ * tree 100: 101 under it and 102 under 101; 200 is monitored without its tree, so 201 is not summed into it;
+ * 103 starts under 102 later and is found by the next tree pass
+ */
+static void test_process_trees(ResourceMonitor & resource_monitor, const std::string & proc_root)
+{
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    TEST_CHECK(resource_monitor.append_process(100, true));
+    TEST_CHECK(resource_monitor.append_process(200, false));
+    TEST_CHECK(!resource_monitor.append_process(999, true));
+
+    TEST_CHECK(wait_for_process_ram(resource_monitor, 100, (10 + 20 + 30) * page_size));
+    TEST_CHECK(wait_for_process_ram(resource_monitor, 200, 40 * page_size));
+    test_fault_rates(resource_monitor, proc_root);
+
+    ProcessResource process_resource;
+    TEST_CHECK(!resource_monitor.get_process_resource(101, process_resource));
+
+    TEST_CHECK(write_fixture_process(proc_root, 103, 102, 1300, 50, 0, 0));
+    TEST_CHECK(wait_for_process_ram(resource_monitor, 100, (10 + 20 + 30 + 50) * page_size));
+
+    /* below the root, a process that started before its parent has a reused parent pid and is not in the tree */
+    TEST_CHECK(write_fixture_process(proc_root, 104, 101, 500, 70, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 105, 101, 1400, 80, 0, 0));
+    TEST_CHECK(wait_for_process_ram(resource_monitor, 100, (10 + 20 + 30 + 50 + 80) * page_size));
+
+    TEST_CHECK(resource_monitor.remove_process(100));
+    TEST_CHECK(!resource_monitor.get_process_resource(100, process_resource));
+    TEST_CHECK(resource_monitor.get_process_resource(200, process_resource));
+}
+
+int main()
+{
+    const std::string root(make_fixture_root());
+    TEST_CHECK(!root.empty());
+    if (root.empty())
+    {
+        return (TEST_RESULT());
+    }
+
+    const std::string proc_root(root + "/proc");
+    TEST_CHECK(make_proc_fixture(root));
+    TEST_CHECK(write_fixture_process(proc_root, 100, 1, 1000, 10, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 101, 100, 1100, 20, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 102, 101, 1200, 30, 0, 0));
+    TEST_CHECK(write_fixture_process(proc_root, 200, 1, 1000, 40, 1000, 7));
+    TEST_CHECK(write_fixture_process(proc_root, 201, 200, 1100, 60, 0, 0));
+
+    {
+        ResourceMonitor resource_monitor;
+        TEST_CHECK(!resource_monitor.init(root + "/missing", root + "/sys"));
+    }
+
+    ResourceMonitor resource_monitor;
+    const bool monitor_started = resource_monitor.init(proc_root, root + "/sys");
+    TEST_CHECK(monitor_started);
+    if (monitor_started)
+    {
+        for (uint32_t collector_type = 0; collector_type < RESOURCE_COLLECTOR_COUNT; ++collector_type)
+        {
+            TEST_CHECK(resource_monitor.set_collector_interval(static_cast<ResourceCollectorType>(collector_type), TEST_COLLECTOR_INTERVAL_MS));
+        }
+
+        test_system_resource(resource_monitor);
+        test_process_trees(resource_monitor, proc_root);
+    }
+    resource_monitor.exit();
+
+    remove_proc_fixture(root);
+
+    return (TEST_RESULT());
+}
@@ -0,0 +1,251 @@
+/********************************************************
+ * Description : varint and xor coding, recorder blocks written and read back
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <utility>
+#include "resource_codec.h"
+#include "resource_recorder.h"
+#include "test_check.h"
+
+#define TEST_RECORD_FILE                "test_resource_recorder.bin"
+#define TEST_FRAME_COUNT                3000
+#define TEST_PROCESS_COUNT              30
+
+static void test_zigzag()
+{
+    TEST_CHECK(0 == zigzag_encode(0));
+    TEST_CHECK(1 == zigzag_encode(-1));
+    TEST_CHECK(2 == zigzag_encode(1));
+    TEST_CHECK(std::numeric_limits<uint64_t>::max() == zigzag_encode(std::numeric_limits<int64_t>::min()));
+
+    const int64_t values[6] = { 0, 1, -1, 1234567, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min() };
+    for (std::size_t value_index = 0; value_index < 6; ++value_index)
+    {
+        TEST_CHECK(values[value_index] == zigzag_decode(zigzag_encode(values[value_index])));
+    }
+}
+
+static void test_varint()
+{
+    char buffer[VARINT_SIZE_MAX] = { 0x0 };
+
+    TEST_CHECK(1 == put_varint(0, buffer));
+    TEST_CHECK(1 == put_varint(127, buffer));
+    TEST_CHECK(2 == put_varint(128, buffer));
+    TEST_CHECK(VARINT_SIZE_MAX == put_varint(std::numeric_limits<uint64_t>::max(), buffer));
+
+    for (uint32_t shift = 0; shift < 64; ++shift)
+    {
+        const uint64_t values[3] = { (static_cast<uint64_t>(1) << shift) - 1, static_cast<uint64_t>(1) << shift, (static_cast<uint64_t>(1) << shift) + 1 };
+        for (std::size_t value_index = 0; value_index < 3; ++value_index)
+        {
+            const std::size_t size = put_varint(values[value_index], buffer);
+            const char * data = buffer;
+            uint64_t value = 0;
+            TEST_CHECK(get_varint(data, buffer + size, value));
+            TEST_CHECK(values[value_index] == value);
+            TEST_CHECK(buffer + size == data);
+
+            /* one byte short is never a value */
+            data = buffer;
+            TEST_CHECK(!get_varint(data, buffer + size - 1, value));
+        }
+    }
+
+    /* more continuation bytes than 64 bits take */
+    char overlong[VARINT_SIZE_MAX + 1];
+    memset(overlong, 0x80, sizeof(overlong));
+    const char * data = overlong;
+    uint64_t value = 0;
+    TEST_CHECK(!get_varint(data, overlong + sizeof(overlong), value));
+}
+
+static void test_double_bits()
+{
+    const double values[5] = { 0.0, -0.0, 1.5, -123.456, std::numeric_limits<double>::max() };
+    for (std::size_t value_index = 0; value_index < 5; ++value_index)
+    {
+        TEST_CHECK(double_bits(values[value_index]) == double_bits(bits_double(double_bits(values[value_index]))));
+    }
+    TEST_CHECK(double_bits(0.0) != double_bits(-0.0));
+}
+
+static double random_double()
+{
+    return ((rand() % 1000000) / 100.0);
+}
+
+static uint64_t random_field()
+{
+    return ((static_cast<uint64_t>(rand()) << 20) ^ static_cast<uint64_t>(rand()));
+}
+
+static void make_system_resource(SystemResource & system_resource)
+{
+    uint64_t fields[SYSTEM_FIELD_COUNT] = { 0 };
+    for (std::size_t field_index = 0; field_index < SYSTEM_FIELD_COUNT; ++field_index)
+    {
+        fields[field_index] = (0 != (SYSTEM_DOUBLE_MASK & (1u << field_index)) ? double_bits(random_double()) : random_field());
+    }
+    memset(&system_resource, 0x0, sizeof(system_resource));
+    set_system_fields(fields, system_resource);
+}
+
+static void make_process_resource(ProcessResource & process_resource)
+{
+    uint64_t fields[PROCESS_FIELD_COUNT] = { 0 };
+    for (std::size_t field_index = 0; field_index < PROCESS_FIELD_COUNT; ++field_index)
+    {
+        fields[field_index] = (0 != (PROCESS_DOUBLE_MASK & (1u << field_index)) ? double_bits(random_double()) : random_field());
+    }
+    memset(&process_resource, 0x0, sizeof(process_resource));
+    set_process_fields(fields, process_resource);
+}
+
+static bool same_system_fields(const SystemResource & system_resource, const SystemResource & other_resource)
+{
+    uint64_t fields[SYSTEM_FIELD_COUNT] = { 0 };
+    uint64_t other_fields[SYSTEM_FIELD_COUNT] = { 0 };
+    get_system_fields(system_resource, fields);
+    get_system_fields(other_resource, other_fields);
+    return (0 == memcmp(fields, other_fields, sizeof(fields)));
+}
+
+static bool same_process_fields(const ProcessResource & process_resource, const ProcessResource & other_resource)
+{
+    uint64_t fields[PROCESS_FIELD_COUNT] = { 0 };
+    uint64_t other_fields[PROCESS_FIELD_COUNT] = { 0 };
+    get_process_fields(process_resource, fields);
+    get_process_fields(other_resource, other_fields);
+    return (0 == memcmp(fields, other_fields, sizeof(fields)));
+}
+
+/*
+ * process n is in the frames unless (frame / 100 + n) % 3 is 0, so series leave and come back across several blocks
+ */
+static bool process_in_frame(uint32_t frame_index, uint32_t process_index)
+{
+    return (0 != (frame_index / 100 + process_index) % 3);
+}
+
+static void test_recorder_round_trip()
+{
+    std::vector<RecordFrame> sent_frames(TEST_FRAME_COUNT);
+    uint64_t sample_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    for (uint32_t frame_index = 0; frame_index < TEST_FRAME_COUNT; ++frame_index)
+    {
+        RecordFrame & record_frame = sent_frames[frame_index];
+        sample_time += 90 + rand() % 20;
+        record_frame.sample_time = sample_time;
+        record_frame.sample_sequence = frame_index + 1;
+        make_system_resource(record_frame.system_resource);
+        for (uint32_t process_index = 0; process_index < TEST_PROCESS_COUNT; ++process_index)
+        {
+            if (process_in_frame(frame_index, process_index))
+            {
+                ProcessResource process_resource;
+                make_process_resource(process_resource);
+                record_frame.process_resources.push_back(std::make_pair(1000 + process_index * 4, process_resource));
+            }
+        }
+    }
+
+    ResourceRecorder resource_recorder;
+    TEST_CHECK(resource_recorder.start(TEST_RECORD_FILE));
+    for (uint32_t frame_index = 0; frame_index < TEST_FRAME_COUNT; ++frame_index)
+    {
+        RecordFrame * record_frame = nullptr;
+        while (nullptr == (record_frame = resource_recorder.begin_append()))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        *record_frame = sent_frames[frame_index];
+        resource_recorder.end_append(record_frame);
+    }
+    resource_recorder.stop();
+
+    ResourceRecordReaderImpl record_reader;
+    TEST_CHECK(record_reader.open(TEST_RECORD_FILE));
+
+    std::vector<uint32_t> process_ids;
+    TEST_CHECK(record_reader.get_recorded_processes(process_ids));
+    TEST_CHECK(TEST_PROCESS_COUNT == process_ids.size());
+
+    std::vector<SystemResource> system_resources;
+    TEST_CHECK(record_reader.read_system_resources(0, std::numeric_limits<uint64_t>::max(), system_resources));
+    TEST_CHECK(TEST_FRAME_COUNT == system_resources.size());
+    if (TEST_FRAME_COUNT == system_resources.size())
+    {
+        int mismatch_count = 0;
+        for (uint32_t frame_index = 0; frame_index < TEST_FRAME_COUNT; ++frame_index)
+        {
+            const SystemResource & system_resource = system_resources[frame_index];
+            if (!same_system_fields(sent_frames[frame_index].system_resource, system_resource)
+                || sent_frames[frame_index].sample_sequence != system_resource.sample_sequence
+                || sent_frames[frame_index].sample_time - sent_frames[0].sample_time != system_resource.sample_time - system_resources[0].sample_time)
+            {
+                ++mismatch_count;
+            }
+        }
+        TEST_CHECK(0 == mismatch_count);
+    }
+
+    for (uint32_t process_index = 0; process_index < TEST_PROCESS_COUNT; ++process_index)
+    {
+        const uint32_t process_id = 1000 + process_index * 4;
+        std::vector<ProcessResource> process_resources;
+        TEST_CHECK(record_reader.read_process_resources(process_id, 0, std::numeric_limits<uint64_t>::max(), process_resources));
+
+        std::size_t record_index = 0;
+        int mismatch_count = 0;
+        for (uint32_t frame_index = 0; frame_index < TEST_FRAME_COUNT; ++frame_index)
+        {
+            if (!process_in_frame(frame_index, process_index))
+            {
+                continue;
+            }
+            const std::vector<std::pair<uint32_t, ProcessResource>> & sent_processes = sent_frames[frame_index].process_resources;
+            std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter = sent_processes.begin();
+            while (sent_processes.end() != iter && iter->first != process_id)
+            {
+                ++iter;
+            }
+            if (record_index >= process_resources.size() || sent_processes.end() == iter
+                || !same_process_fields(iter->second, process_resources[record_index])
+                || sent_frames[frame_index].sample_sequence != process_resources[record_index].sample_sequence)
+            {
+                ++mismatch_count;
+            }
+            ++record_index;
+        }
+        TEST_CHECK(0 == mismatch_count);
+        TEST_CHECK(record_index == process_resources.size());
+    }
+
+    record_reader.close();
+    remove(TEST_RECORD_FILE);
+}
+
+int main()
+{
+    srand(1);
+
+    test_zigzag();
+    test_varint();
+    test_double_bits();
+    test_recorder_round_trip();
+
+    return (TEST_RESULT());
+}
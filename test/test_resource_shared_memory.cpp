@@ -0,0 +1,196 @@
+/********************************************************
+ * Description : seqlock reads of the shared memory export
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "resource_shared_memory.h"
+#include "test_check.h"
+
+#define TEST_SEGMENT_NAME               "resource_monitor_test_segment"
+#define TEST_PROCESS_CAPACITY           256
+#define TEST_RACE_MS                    500
+#define TEST_PUBLISH_PAUSE_US           100     /* a writer publishing back to back starves any seqlock reader */
+#define TEST_READ_WAIT_MS               200     /* SHARED_READ_WAIT_MS of the reader */
+
+/*
+ * every value of snapshot n is n and it holds 1 + n % TEST_PROCESS_CAPACITY processes, so a copy mixing two snapshots shows
+ */
+static uint32_t get_process_count(uint64_t sample_sequence)
+{
+    return (static_cast<uint32_t>(1 + sample_sequence % TEST_PROCESS_CAPACITY));
+}
+
+static void publish_snapshot(SharedSnapshotWriter & snapshot_writer, uint64_t sample_sequence)
+{
+    SystemResource system_resource;
+    memset(&system_resource, 0x0, sizeof(system_resource));
+    system_resource.cpu_count = sample_sequence;
+    system_resource.ram_usage = sample_sequence;
+    system_resource.net_recv_bytes = sample_sequence;
+    system_resource.sample_sequence = sample_sequence;
+
+    ProcessResource process_resource;
+    memset(&process_resource, 0x0, sizeof(process_resource));
+    process_resource.ram_usage = sample_sequence;
+    process_resource.gpu_mem_usage = sample_sequence;
+
+    snapshot_writer.begin_write(sample_sequence * 100, sample_sequence, system_resource, std::vector<GraphicsCardResource>());
+    for (uint32_t process_index = 0; process_index < get_process_count(sample_sequence); ++process_index)
+    {
+        snapshot_writer.write_process(1000 + process_index * 4, process_resource);
+    }
+    snapshot_writer.end_write();
+}
+
+static void writer_thread(SharedSnapshotWriter & snapshot_writer, const std::atomic<bool> & running, uint64_t & sample_sequence)
+{
+    while (running.load())
+    {
+        publish_snapshot(snapshot_writer, ++sample_sequence);
+        std::this_thread::sleep_for(std::chrono::microseconds(TEST_PUBLISH_PAUSE_US));
+    }
+}
+
+static void test_single_reads(SharedSnapshotReaderImpl & snapshot_reader)
+{
+    SystemResource system_resource;
+    TEST_CHECK(snapshot_reader.get_system_resource(system_resource));
+    TEST_CHECK(1 == system_resource.sample_sequence && 1 == system_resource.ram_usage);
+
+    ProcessResource process_resource;
+    TEST_CHECK(snapshot_reader.get_process_resource(1004, process_resource));
+    TEST_CHECK(1 == process_resource.ram_usage && 1 == process_resource.sample_sequence && 100 == process_resource.sample_time);
+    TEST_CHECK(!snapshot_reader.get_process_resource(1002, process_resource));
+    TEST_CHECK(!snapshot_reader.get_process_resource(1008, process_resource));
+
+    std::map<uint32_t, ProcessResource> process_resources;
+    TEST_CHECK(snapshot_reader.get_all_process_resources(process_resources));
+    TEST_CHECK(2 == process_resources.size());
+}
+
+/*
+ * a reader racing the writer retries until its copy is whole, it never sees two snapshots at once;
+ * the writer wakes up every TEST_PUBLISH_PAUSE_US, so even on one cpu it often preempts the reader in the middle of a copy
+ */
+static uint64_t test_racing_reads(SharedSnapshotWriter & snapshot_writer, SharedSnapshotReaderImpl & snapshot_reader)
+{
+    uint64_t sample_sequence = 1;
+    std::atomic<bool> running(true);
+    std::thread publish_thread(std::bind(&writer_thread, std::ref(snapshot_writer), std::cref(running), std::ref(sample_sequence)));
+
+    uint64_t read_count = 0;
+    uint64_t torn_count = 0;
+    uint64_t last_sequence = 0;
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_RACE_MS);
+    while (std::chrono::steady_clock::now() < end_time)
+    {
+        SystemResource system_resource;
+        std::map<uint32_t, ProcessResource> process_resources;
+        if (!snapshot_reader.get_system_resource(system_resource) || !snapshot_reader.get_all_process_resources(process_resources))
+        {
+            ++torn_count;
+            continue;
+        }
+        ++read_count;
+
+        const uint64_t sample_sequence = system_resource.sample_sequence;
+        if (system_resource.cpu_count != sample_sequence || system_resource.ram_usage != sample_sequence || system_resource.net_recv_bytes != sample_sequence || sample_sequence < last_sequence)
+        {
+            ++torn_count;
+        }
+        last_sequence = sample_sequence;
+
+        if (process_resources.empty())
+        {
+            ++torn_count;
+            continue;
+        }
+        const uint64_t process_sequence = process_resources.begin()->second.sample_sequence;
+        if (get_process_count(process_sequence) != process_resources.size())
+        {
+            ++torn_count;
+        }
+        for (std::map<uint32_t, ProcessResource>::const_iterator iter = process_resources.begin(); process_resources.end() != iter; ++iter)
+        {
+            if (iter->second.sample_sequence != process_sequence || iter->second.ram_usage != process_sequence || iter->second.gpu_mem_usage != process_sequence)
+            {
+                ++torn_count;
+                break;
+            }
+        }
+    }
+
+    running = false;
+    publish_thread.join();
+
+    TEST_CHECK(0 != read_count);
+    TEST_CHECK(0 == torn_count);
+
+    return (sample_sequence);
+}
+
+/*
+ * a writer that never leaves (it died while publishing) turns reads false after the wait, a finished write lets them through again
+ */
+static void test_stuck_writer(SharedSnapshotWriter & snapshot_writer, SharedSnapshotReaderImpl & snapshot_reader, uint64_t sample_sequence)
+{
+    SystemResource system_resource;
+    memset(&system_resource, 0x0, sizeof(system_resource));
+    snapshot_writer.begin_write(0, 0, system_resource, std::vector<GraphicsCardResource>());
+
+    std::chrono::steady_clock::time_point begin_time = std::chrono::steady_clock::now();
+    TEST_CHECK(!snapshot_reader.get_system_resource(system_resource));
+    const int64_t wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin_time).count();
+    TEST_CHECK(wait_ms >= TEST_READ_WAIT_MS && wait_ms < TEST_READ_WAIT_MS * 10);
+
+    ProcessResource process_resource;
+    std::map<uint32_t, ProcessResource> process_resources;
+    TEST_CHECK(!snapshot_reader.get_process_resource(1000, process_resource));
+    TEST_CHECK(!snapshot_reader.get_all_process_resources(process_resources));
+
+    snapshot_writer.end_write();
+    publish_snapshot(snapshot_writer, sample_sequence + 1);
+    TEST_CHECK(snapshot_reader.get_system_resource(system_resource));
+    TEST_CHECK(sample_sequence + 1 == system_resource.sample_sequence);
+}
+
+int main()
+{
+    SharedSnapshotWriter snapshot_writer;
+    TEST_CHECK(snapshot_writer.start(TEST_SEGMENT_NAME, TEST_PROCESS_CAPACITY));
+    if (!snapshot_writer.started())
+    {
+        return (TEST_RESULT());
+    }
+    publish_snapshot(snapshot_writer, 1);
+
+    SharedSnapshotReaderImpl snapshot_reader;
+    const bool reader_opened = snapshot_reader.open(TEST_SEGMENT_NAME);
+    TEST_CHECK(reader_opened);
+    if (reader_opened)
+    {
+        test_single_reads(snapshot_reader);
+        const uint64_t sample_sequence = test_racing_reads(snapshot_writer, snapshot_reader);
+        test_stuck_writer(snapshot_writer, snapshot_reader, sample_sequence);
+
+        /* the segment of a stopped writer is stale */
+        snapshot_writer.stop();
+        SystemResource system_resource;
+        TEST_CHECK(!snapshot_reader.get_system_resource(system_resource));
+    }
+
+    snapshot_reader.close();
+    snapshot_writer.stop();
+
+    return (TEST_RESULT());
+}
@@ -0,0 +1,335 @@
+/********************************************************
+ * Description : snapshot diffs encoded and applied back
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <iterator>
+#include <string>
+#include "resource_snapshot_diff.h"
+#include "resource_codec.h"
+#include "test_check.h"
+
+#define TEST_SNAPSHOT_COUNT             5000
+#define TEST_RETENTION_COUNT            8
+#define TEST_PROCESS_COUNT              40
+#define TEST_RANDOM_DIFF_COUNT          20000
+
+static double random_usage()
+{
+    return ((rand() % 10000) / 100.0);
+}
+
+static ProcessResource random_process_resource()
+{
+    ProcessResource process_resource;
+    memset(&process_resource, 0x0, sizeof(process_resource));
+    process_resource.cpu_usage = random_usage();
+    process_resource.ram_usage = rand();
+    process_resource.gpu_mem_usage = (0 == rand() % 3 ? rand() : 0);
+    return (process_resource);
+}
+
+/*
+ * the next published snapshot: some values move, a process may leave or start
+ */
+static void next_snapshot(DiffSnapshot & diff_snapshot, uint64_t sample_sequence)
+{
+    diff_snapshot.sample_sequence = sample_sequence;
+
+    SystemResource & system_resource = diff_snapshot.system_resource;
+    system_resource.sample_time += 100 + rand() % 5;
+    system_resource.cpu_count = 8;
+    system_resource.ram_total = static_cast<uint64_t>(1) << 34;
+    if (0 == rand() % 2)
+    {
+        system_resource.cpu_usage = random_usage();
+    }
+    if (0 == rand() % 3)
+    {
+        system_resource.ram_usage += rand() % 100000 - 50000;
+    }
+    if (0 == rand() % 4)
+    {
+        system_resource.net_recv_bytes = rand();
+    }
+
+    std::map<uint32_t, ProcessResource> process_resources(diff_snapshot.process_resources.begin(), diff_snapshot.process_resources.end());
+    for (std::map<uint32_t, ProcessResource>::iterator iter = process_resources.begin(); process_resources.end() != iter; ++iter)
+    {
+        if (0 == rand() % 3)
+        {
+            iter->second.cpu_usage = random_usage();
+        }
+        if (0 == rand() % 4)
+        {
+            iter->second.ram_usage = rand();
+        }
+    }
+
+    const int change_type = rand() % 10;
+    if (change_type < 2 && !process_resources.empty())
+    {
+        std::map<uint32_t, ProcessResource>::iterator iter = process_resources.begin();
+        std::advance(iter, rand() % process_resources.size());
+        process_resources.erase(iter);
+    }
+    else if (change_type > 6)
+    {
+        process_resources[1 + rand() % 100000] = random_process_resource();
+    }
+
+    diff_snapshot.process_resources.assign(process_resources.begin(), process_resources.end());
+}
+
+/*
+ * what a receiver holds once it applied every diff up to diff_snapshot
+ */
+static ResourceSnapshot expected_snapshot(const DiffSnapshot & diff_snapshot, const FlatSet<uint32_t> * process_filter)
+{
+    ResourceSnapshot resource_snapshot;
+    resource_snapshot.sample_sequence = diff_snapshot.sample_sequence;
+    resource_snapshot.system_resource = diff_snapshot.system_resource;
+    resource_snapshot.system_resource.sample_sequence = diff_snapshot.sample_sequence;
+    for (std::vector<std::pair<uint32_t, ProcessResource>>::const_iterator iter = diff_snapshot.process_resources.begin(); diff_snapshot.process_resources.end() != iter; ++iter)
+    {
+        if (nullptr != process_filter && process_filter->end() == process_filter->find(iter->first))
+        {
+            continue;
+        }
+        ProcessResource process_resource = iter->second;
+        process_resource.sample_time = diff_snapshot.system_resource.sample_time;
+        process_resource.sample_sequence = diff_snapshot.sample_sequence;
+        resource_snapshot.process_resources[iter->first] = process_resource;
+    }
+    return (resource_snapshot);
+}
+
+static bool same_snapshot(const ResourceSnapshot & resource_snapshot, const ResourceSnapshot & other_snapshot)
+{
+    if (resource_snapshot.sample_sequence != other_snapshot.sample_sequence || 0 != memcmp(&resource_snapshot.system_resource, &other_snapshot.system_resource, sizeof(SystemResource)) || resource_snapshot.process_resources.size() != other_snapshot.process_resources.size())
+    {
+        return (false);
+    }
+    for (std::map<uint32_t, ProcessResource>::const_iterator iter = resource_snapshot.process_resources.begin(); resource_snapshot.process_resources.end() != iter; ++iter)
+    {
+        std::map<uint32_t, ProcessResource>::const_iterator iter_other = other_snapshot.process_resources.find(iter->first);
+        if (other_snapshot.process_resources.end() == iter_other || 0 != memcmp(&iter->second, &iter_other->second, sizeof(ProcessResource)))
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+static void test_retention()
+{
+    SnapshotRetention snapshot_retention;
+    TEST_CHECK(!snapshot_retention.enabled());
+    TEST_CHECK(nullptr == snapshot_retention.find(0));
+
+    snapshot_retention.reset(3);
+    TEST_CHECK(snapshot_retention.enabled());
+    for (uint64_t sample_sequence = 1; sample_sequence <= 5; ++sample_sequence)
+    {
+        snapshot_retention.append().sample_sequence = sample_sequence;
+    }
+    TEST_CHECK(nullptr == snapshot_retention.find(2));
+    TEST_CHECK(nullptr != snapshot_retention.find(3) && 3 == snapshot_retention.find(3)->sample_sequence);
+    TEST_CHECK(nullptr != snapshot_retention.find(0) && 5 == snapshot_retention.find(0)->sample_sequence);
+    TEST_CHECK(nullptr == snapshot_retention.find(6));
+
+    snapshot_retention.reset(0);
+    TEST_CHECK(!snapshot_retention.enabled());
+}
+
+/*
+ * two receivers follow the publisher, one with every process from diffs against its last snapshot,
+ * one with a filter on every third snapshot; each must hold exactly what was published
+ */
+static void test_round_trip()
+{
+    SnapshotRetention snapshot_retention;
+    snapshot_retention.reset(TEST_RETENTION_COUNT);
+
+    DiffSnapshot published_snapshot;
+    published_snapshot.system_resource.sample_time = 123456789;
+    FlatSet<uint32_t> process_filter;
+    for (uint32_t process_index = 0; process_index < TEST_PROCESS_COUNT; ++process_index)
+    {
+        published_snapshot.process_resources.push_back(std::make_pair(1000 + process_index * 7, random_process_resource()));
+        if (0 == process_index % 3)
+        {
+            process_filter.insert(1000 + process_index * 7);
+        }
+    }
+
+    const DiffSnapshot empty_snapshot;
+    ResourceSnapshot full_receiver;
+    ResourceSnapshot filter_receiver;
+    std::string snapshot_diff;
+    int mismatch_count = 0;
+
+    for (uint64_t sample_sequence = 1; sample_sequence <= TEST_SNAPSHOT_COUNT; ++sample_sequence)
+    {
+        next_snapshot(published_snapshot, sample_sequence);
+        snapshot_retention.append() = published_snapshot;
+
+        const DiffSnapshot * base_snapshot = (0 == full_receiver.sample_sequence ? &empty_snapshot : snapshot_retention.find(full_receiver.sample_sequence));
+        encode_snapshot_diff(*base_snapshot, published_snapshot, nullptr, snapshot_diff);
+        if (!decode_snapshot_diff(snapshot_diff, full_receiver) || !same_snapshot(full_receiver, expected_snapshot(published_snapshot, nullptr)))
+        {
+            ++mismatch_count;
+        }
+
+        if (0 == sample_sequence % 3)
+        {
+            base_snapshot = (0 == filter_receiver.sample_sequence ? &empty_snapshot : snapshot_retention.find(filter_receiver.sample_sequence));
+            encode_snapshot_diff(*base_snapshot, published_snapshot, &process_filter, snapshot_diff);
+            if (!decode_snapshot_diff(snapshot_diff, filter_receiver) || !same_snapshot(filter_receiver, expected_snapshot(published_snapshot, &process_filter)))
+            {
+                ++mismatch_count;
+            }
+        }
+    }
+
+    TEST_CHECK(0 == mismatch_count);
+}
+
+/*
+ * a diff against another base, a cut or padded diff, or random bytes never change the receiver
+ */
+static void test_rejected_diffs()
+{
+    SnapshotRetention snapshot_retention;
+    snapshot_retention.reset(TEST_RETENTION_COUNT);
+
+    DiffSnapshot published_snapshot;
+    for (uint64_t sample_sequence = 1; sample_sequence <= TEST_RETENTION_COUNT; ++sample_sequence)
+    {
+        next_snapshot(published_snapshot, sample_sequence);
+        snapshot_retention.append() = published_snapshot;
+    }
+
+    const ResourceSnapshot base_receiver = expected_snapshot(*snapshot_retention.find(TEST_RETENTION_COUNT - 1), nullptr);
+    std::string snapshot_diff;
+
+    ResourceSnapshot resource_snapshot = base_receiver;
+    encode_snapshot_diff(*snapshot_retention.find(TEST_RETENTION_COUNT - 2), published_snapshot, nullptr, snapshot_diff);
+    TEST_CHECK(!decode_snapshot_diff(snapshot_diff, resource_snapshot));
+    TEST_CHECK(same_snapshot(resource_snapshot, base_receiver));
+
+    encode_snapshot_diff(*snapshot_retention.find(TEST_RETENTION_COUNT - 1), published_snapshot, nullptr, snapshot_diff);
+    int cut_accepted_count = 0;
+    for (std::size_t diff_size = 0; diff_size < snapshot_diff.size(); ++diff_size)
+    {
+        resource_snapshot = base_receiver;
+        if (decode_snapshot_diff(snapshot_diff.substr(0, diff_size), resource_snapshot) || !same_snapshot(resource_snapshot, base_receiver))
+        {
+            ++cut_accepted_count;
+        }
+    }
+    TEST_CHECK(0 == cut_accepted_count);
+
+    resource_snapshot = base_receiver;
+    TEST_CHECK(!decode_snapshot_diff(snapshot_diff + "x", resource_snapshot));
+    TEST_CHECK(same_snapshot(resource_snapshot, base_receiver));
+
+    int changed_count = 0;
+    for (uint32_t diff_index = 0; diff_index < TEST_RANDOM_DIFF_COUNT; ++diff_index)
+    {
+        std::string random_diff(1 + rand() % 40, '\0');
+        for (std::size_t byte_index = 0; byte_index < random_diff.size(); ++byte_index)
+        {
+            random_diff[byte_index] = static_cast<char>(rand());
+        }
+        random_diff[0] = SNAPSHOT_DIFF_VERSION;
+
+        resource_snapshot = base_receiver;
+        if (!decode_snapshot_diff(random_diff, resource_snapshot) && !same_snapshot(resource_snapshot, base_receiver))
+        {
+            ++changed_count;
+        }
+    }
+    TEST_CHECK(0 == changed_count);
+
+    resource_snapshot = base_receiver;
+    TEST_CHECK(decode_snapshot_diff(snapshot_diff, resource_snapshot));
+    TEST_CHECK(same_snapshot(resource_snapshot, expected_snapshot(published_snapshot, nullptr)));
+}
+
+static void append_varint(uint64_t value, std::string & snapshot_diff)
+{
+    char buffer[VARINT_SIZE_MAX];
+    snapshot_diff.append(buffer, put_varint(value, buffer));
+}
+
+/*
+ * a hand made diff on base 7 that sets cpu_count from 4 to 8, then lists pid 5 twice (delta 0) as removed or as changed:
+ * it must be refused before anything is applied
+ */
+static std::string repeated_pid_diff(bool removed_list)
+{
+    std::string snapshot_diff;
+    append_varint(SNAPSHOT_DIFF_VERSION, snapshot_diff);
+    append_varint(7, snapshot_diff);                      /* base sequence */
+    append_varint(1, snapshot_diff);                      /* sequence delta */
+    append_varint(zigzag_encode(100), snapshot_diff);     /* time delta */
+    append_varint(1, snapshot_diff);                      /* system field mask: cpu_count */
+    append_varint(zigzag_encode(4), snapshot_diff);
+    if (removed_list)
+    {
+        append_varint(2, snapshot_diff);
+        append_varint(5, snapshot_diff);
+        append_varint(0, snapshot_diff);
+        append_varint(0, snapshot_diff);                  /* changed count */
+    }
+    else
+    {
+        append_varint(0, snapshot_diff);                  /* removed count */
+        append_varint(2, snapshot_diff);
+        append_varint(5, snapshot_diff);
+        append_varint(1, snapshot_diff);                  /* process field mask: cpu_usage */
+        append_varint(1, snapshot_diff);
+        append_varint(0, snapshot_diff);
+        append_varint(1, snapshot_diff);
+        append_varint(1, snapshot_diff);
+    }
+    return (snapshot_diff);
+}
+
+static void test_repeated_pids()
+{
+    ResourceSnapshot base_receiver;
+    base_receiver.sample_sequence = 7;
+    base_receiver.system_resource.cpu_count = 4;
+    base_receiver.system_resource.sample_sequence = 7;
+    base_receiver.process_resources[5] = random_process_resource();
+    base_receiver.process_resources[9] = random_process_resource();
+
+    ResourceSnapshot resource_snapshot = base_receiver;
+    TEST_CHECK(!decode_snapshot_diff(repeated_pid_diff(true), resource_snapshot));
+    TEST_CHECK(same_snapshot(resource_snapshot, base_receiver));
+
+    resource_snapshot = base_receiver;
+    TEST_CHECK(!decode_snapshot_diff(repeated_pid_diff(false), resource_snapshot));
+    TEST_CHECK(same_snapshot(resource_snapshot, base_receiver));
+}
+
+int main()
+{
+    srand(7);
+
+    test_retention();
+    test_round_trip();
+    test_rejected_diffs();
+    test_repeated_pids();
+
+    return (TEST_RESULT());
+}
@@ -0,0 +1,136 @@
+/********************************************************
+ * Description : raise and clear edges of a threshold rule
+ * Author      : ryan
+ * Email       : ryan@rayvision.com
+ * Version     : 2.0
+ * History     :
+ * Copyright(C): 2021-2022
+ ********************************************************/
+
+#include "../src/resource_monitor_impl.cpp"
+#include "test_check.h"
+
+#define TEST_RAISE_VALUE                40.0
+#define TEST_CLEAR_VALUE                20.0
+#define TEST_MIN_DURATION_MS            1000
+
+static void make_rule(uint32_t min_duration_ms, bool raised, ThresholdRule & threshold_rule)
+{
+    threshold_rule.threshold.process_id = 100;
+    threshold_rule.threshold.metric_type = RESOURCE_METRIC_CPU_USAGE;
+    threshold_rule.threshold.raise_value = TEST_RAISE_VALUE;
+    threshold_rule.threshold.clear_value = TEST_CLEAR_VALUE;
+    threshold_rule.threshold.min_duration_ms = min_duration_ms;
+    threshold_rule.raised = raised;
+    threshold_rule.pending_time = 0;
+}
+
+/*
+ * the raise edge is inclusive and must hold for min_duration_ms, a value between the edges neither raises nor clears
+ */
+static void test_raise_and_clear()
+{
+    ThresholdRule threshold_rule;
+    make_rule(TEST_MIN_DURATION_MS, false, threshold_rule);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 30.0, 1000));
+    TEST_CHECK(0 == threshold_rule.pending_time);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, TEST_RAISE_VALUE, 2000));
+    TEST_CHECK(2000 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 2999));
+    TEST_CHECK(!threshold_rule.raised);
+    TEST_CHECK(update_threshold_rule(threshold_rule, true, 50.0, 3000));
+    TEST_CHECK(threshold_rule.raised && 0 == threshold_rule.pending_time);
+
+    /* raised: above clear_value holds the state, even below raise_value */
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 30.0, 4000));
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 5000));
+    TEST_CHECK(threshold_rule.raised && 0 == threshold_rule.pending_time);
+
+    /* the clear edge is inclusive too */
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, TEST_CLEAR_VALUE, 6000));
+    TEST_CHECK(6000 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 10.0, 6999));
+    TEST_CHECK(update_threshold_rule(threshold_rule, true, 10.0, 7000));
+    TEST_CHECK(!threshold_rule.raised && 0 == threshold_rule.pending_time);
+}
+
+/*
+ * a value back on the near side of the edge, or a snapshot without the value, restarts the wait
+ */
+static void test_pending_reset()
+{
+    ThresholdRule threshold_rule;
+    make_rule(TEST_MIN_DURATION_MS, false, threshold_rule);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 1000));
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 39.0, 1500));
+    TEST_CHECK(0 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 1800));
+    TEST_CHECK(1800 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 2000));
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 2799));
+    TEST_CHECK(!threshold_rule.raised);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, false, 0.0, 2900));
+    TEST_CHECK(!threshold_rule.raised && 0 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 3000));
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 50.0, 3999));
+    TEST_CHECK(update_threshold_rule(threshold_rule, true, 50.0, 4000));
+    TEST_CHECK(threshold_rule.raised);
+
+    /* the same on the clear side */
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 10.0, 5000));
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 21.0, 5500));
+    TEST_CHECK(threshold_rule.raised && 0 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 10.0, 6000));
+    TEST_CHECK(6000 == threshold_rule.pending_time);
+}
+
+/*
+ * min_duration_ms 0 flips on the first snapshot past the edge
+ */
+static void test_zero_duration()
+{
+    ThresholdRule threshold_rule;
+    make_rule(0, false, threshold_rule);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 39.9, 1000));
+    TEST_CHECK(update_threshold_rule(threshold_rule, true, TEST_RAISE_VALUE, 1100));
+    TEST_CHECK(threshold_rule.raised && 0 == threshold_rule.pending_time);
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 100.0, 1200));
+    TEST_CHECK(update_threshold_rule(threshold_rule, true, TEST_CLEAR_VALUE, 1300));
+    TEST_CHECK(!threshold_rule.raised && 0 == threshold_rule.pending_time);
+}
+
+/*
+ * a raised rule whose process left the snapshot clears at once, whatever min_duration_ms is; a cleared one stays quiet
+ */
+static void test_process_lost()
+{
+    ThresholdRule threshold_rule;
+    make_rule(TEST_MIN_DURATION_MS, true, threshold_rule);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, true, 10.0, 1000));
+    TEST_CHECK(1000 == threshold_rule.pending_time);
+    TEST_CHECK(update_threshold_rule(threshold_rule, false, 0.0, 1100));
+    TEST_CHECK(!threshold_rule.raised && 0 == threshold_rule.pending_time);
+
+    TEST_CHECK(!update_threshold_rule(threshold_rule, false, 0.0, 1200));
+    TEST_CHECK(!threshold_rule.raised && 0 == threshold_rule.pending_time);
+
+    make_rule(0, true, threshold_rule);
+    TEST_CHECK(update_threshold_rule(threshold_rule, false, 0.0, 1300));
+    TEST_CHECK(!threshold_rule.raised);
+}
+
+int main()
+{
+    test_raise_and_clear();
+    test_pending_reset();
+    test_zero_duration();
+    test_process_lost();
+
+    return (TEST_RESULT());
+}